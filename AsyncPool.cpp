@@ -0,0 +1,170 @@
+#include "AsyncPool.h"
+#include "Metrics.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+void AsyncJob::run(Compressor &compressor) {
+	HttpRequest request = m_parser.request(m_request.data());
+	request.params() = m_params;
+
+	const std::uint64_t start = CycleClock::now();
+	m_handler(m_response, request);
+	m_handlerTicks = CycleClock::now() - start;
+
+	if (m_encoding != CONTENT_ENCODING::IDENTITY) {
+		compressor.compressResponse(m_response, 0, m_encoding, *m_compression);
+	}
+}
+
+AsyncCompletions::~AsyncCompletions() {
+	drain([](AsyncJob *job) {
+		delete job;
+	});
+
+	if (m_eventfd != -1) {
+		close(m_eventfd);
+	}
+}
+
+bool AsyncCompletions::init() {
+	m_eventfd = eventfd(0, EFD_CLOEXEC);
+	if (m_eventfd == -1) {
+		perror("eventfd");
+		return false;
+	}
+
+	return true;
+}
+
+int AsyncCompletions::fd() const {
+	return m_eventfd;
+}
+
+void AsyncCompletions::push(AsyncJob *job) {
+	AsyncJob *head = m_head.load(std::memory_order_relaxed);
+
+	do {
+		job->m_next = head;
+	} while (!m_head.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+
+	if (!m_signalled.exchange(true, std::memory_order_acq_rel)) {
+		const std::uint64_t one = 1;
+		if (write(m_eventfd, &one, sizeof(one)) == -1) {
+			perror("write(eventfd)");
+		}
+	}
+}
+
+AsyncPool::AsyncPool(std::size_t threads) {
+	threads = std::max<std::size_t>(threads, 1);
+
+	for (std::size_t i = 0; i < threads; ++i) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+
+	for (std::size_t i = 0; i < threads; ++i) {
+		m_threads.emplace_back([this, i]() {
+			run(i);
+		});
+	}
+}
+
+AsyncPool::~AsyncPool() {
+	{
+		std::lock_guard<std::mutex> lock{ m_sleepMutex };
+		m_stop.store(true);
+	}
+
+	m_wakeup.notify_all();
+
+	for (auto &thread : m_threads) {
+		thread.join();
+	}
+
+	// The jobs that never ran, their connections are gone with the workers
+	for (auto &queue : m_queues) {
+		for (AsyncJob *job : queue->m_jobs) {
+			delete job;
+		}
+	}
+}
+
+void AsyncPool::submit(std::unique_ptr<AsyncJob> job) {
+	Queue &queue = *m_queues[m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size()];
+
+	{
+		std::lock_guard<std::mutex> lock{ queue.m_mutex };
+		queue.m_jobs.push_back(job.release());
+	}
+
+	// Pairs with the sleeping thread, which counts itself before it checks m_queued: one of the two
+	// sees the other's store, so a job is never left behind a sleeping pool
+	m_queued.fetch_add(1);
+
+	if (m_sleeping.load() != 0) {
+		{
+			std::lock_guard<std::mutex> lock{ m_sleepMutex };
+		}
+
+		m_wakeup.notify_one();
+	}
+}
+
+void AsyncPool::run(std::size_t idx) {
+	Compressor compressor;
+
+	while (true) {
+		if (AsyncJob *job = take(idx)) {
+			job->run(compressor);
+			job->m_completions->push(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock{ m_sleepMutex };
+
+		m_sleeping.fetch_add(1);
+		m_wakeup.wait(lock, [this]() {
+			return m_queued.load() != 0 || m_stop.load();
+		});
+		m_sleeping.fetch_sub(1);
+
+		if (m_stop.load()) {
+			return;
+		}
+	}
+}
+
+AsyncJob *AsyncPool::take(std::size_t idx) {
+	const std::size_t queues = m_queues.size();
+
+	// The own queue from the front, the oldest job first, then the others from the back
+	for (std::size_t i = 0; i < queues; ++i) {
+		Queue &queue = *m_queues[(idx + i) % queues];
+
+		std::lock_guard<std::mutex> lock{ queue.m_mutex };
+
+		if (queue.m_jobs.empty()) {
+			continue;
+		}
+
+		AsyncJob *job = nullptr;
+
+		if (i == 0) {
+			job = queue.m_jobs.front();
+			queue.m_jobs.pop_front();
+		}
+		else {
+			job = queue.m_jobs.back();
+			queue.m_jobs.pop_back();
+		}
+
+		m_queued.fetch_sub(1);
+		return job;
+	}
+
+	return nullptr;
+}
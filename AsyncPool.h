@@ -0,0 +1,140 @@
+#ifndef _ASYNC_POOL_H_
+#define _ASYNC_POOL_H_
+
+#include "HttpMessage.h"
+#include "HttpParser.h"
+#include "Compression.h"
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+
+class AsyncCompletions;
+
+// A call of an async handler. The request is copied, so the connection can go on while the handler
+// runs on the pool, and the job is posted back to the worker that owns the connection when it's done.
+struct AsyncJob {
+	using Handler_t = void(*)(std::string&, const HttpRequest&);
+
+	// Pool thread, the compressor belongs to it
+	void run(Compressor &compressor);
+
+	Handler_t m_handler{ nullptr };
+
+	std::string m_request;		// The bytes of the request, the parser's offsets point into them
+	HttpParser m_parser;
+	RouteParams m_params;		// The values point into m_request
+
+	std::string m_response;
+	std::uint64_t m_handlerTicks{ 0 };
+
+	// The response is compressed on the pool thread too, identity leaves it as it is
+	CONTENT_ENCODING m_encoding{ CONTENT_ENCODING::IDENTITY };
+	const CompressionOptions *m_compression{ nullptr };
+
+	// The connection, the response is dropped if its slot has been released since
+	AsyncCompletions *m_completions{ nullptr };
+	std::uint32_t m_slot{ 0 };
+	std::uint32_t m_generation{ 0 };
+
+	HTTP_METHOD m_method{ HTTP_METHOD::INVALID_METHOD };
+	bool m_close{ false };
+
+	AsyncJob *m_next{ nullptr };
+};
+
+// The finished jobs of one worker: an intrusive lock-free stack that the pool threads push to and the
+// worker takes whole. Like ClientHandoff, the eventfd is written only by the push that finds the
+// worker not signalled yet, so a burst of completions costs one wakeup.
+class AsyncCompletions {
+public:
+	AsyncCompletions() = default;
+	~AsyncCompletions();
+
+	AsyncCompletions(const AsyncCompletions &) = delete;
+	AsyncCompletions &operator=(const AsyncCompletions &) = delete;
+
+	bool init();
+	int fd() const;
+
+	// Any thread. Takes the ownership of the job.
+	void push(AsyncJob *job);
+
+	// Worker thread, after the eventfd has been read. Calls onJob(AsyncJob *) in completion order.
+	template <typename OnJob>
+	void drain(OnJob &&onJob);
+
+private:
+	int m_eventfd{ -1 };
+
+	alignas(64) std::atomic<AsyncJob *> m_head{ nullptr };
+	alignas(64) std::atomic<bool> m_signalled{ false };
+};
+
+// The executor of the async handlers, shared by all workers. Every pool thread has its own queue and
+// takes jobs from the back of the others when it runs out, so a burst of slow requests is spread
+// over the whole pool. A worker never waits for the pool, submit() only pushes.
+class AsyncPool {
+public:
+	explicit AsyncPool(std::size_t threads);
+	~AsyncPool();
+
+	AsyncPool(const AsyncPool &) = delete;
+	AsyncPool &operator=(const AsyncPool &) = delete;
+
+	// Any thread. Takes the ownership of the job.
+	void submit(std::unique_ptr<AsyncJob> job);
+
+private:
+	struct alignas(64) Queue {
+		std::mutex m_mutex;
+		std::deque<AsyncJob *> m_jobs;
+	};
+
+	void run(std::size_t idx);
+	AsyncJob *take(std::size_t idx);
+
+private:
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread> m_threads;
+
+	alignas(64) std::atomic<std::size_t> m_nextQueue{ 0 };
+	alignas(64) std::atomic<std::size_t> m_queued{ 0 };
+	std::atomic<std::size_t> m_sleeping{ 0 };
+	std::atomic<bool> m_stop{ false };
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wakeup;
+};
+
+template <typename OnJob>
+void AsyncCompletions::drain(OnJob &&onJob) {
+	// Cleared first, a push that the exchange below misses signals the eventfd again
+	m_signalled.exchange(false, std::memory_order_acq_rel);
+
+	AsyncJob *head = m_head.exchange(nullptr, std::memory_order_acquire);
+
+	// The stack is in the reverse order
+	AsyncJob *ordered = nullptr;
+	while (head) {
+		AsyncJob *next = head->m_next;
+		head->m_next = ordered;
+		ordered = head;
+		head = next;
+	}
+
+	while (ordered) {
+		AsyncJob *next = ordered->m_next;
+		onJob(ordered);
+		ordered = next;
+	}
+}
+
+#endif // !_ASYNC_POOL_H_
@@ -0,0 +1,23 @@
+#ifndef _BODY_SINK_H_
+#define _BODY_SINK_H_
+
+#include <string>
+#include <string_view>
+
+// The receiver of a request body that is too large to collect in memory. It's created by the upload
+// handler as soon as the headers are complete and gets the decoded body as it arrives, one read at a
+// time, so only the bytes of the current read are in memory. The sink is owned by the connection
+// until the body ends or the connection is closed, so it must copy whatever it needs from the request.
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+
+    // Called with the pieces of the body in order. Returning false stops the upload, the client gets
+    // a 500 and the connection is closed.
+    virtual bool write(std::string_view piece) = 0;
+
+    // Called after the last piece. Appends the whole response, like the handlers without a body.
+    virtual void finish(std::string &response) = 0;
+};
+
+#endif // !_BODY_SINK_H_
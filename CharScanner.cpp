@@ -0,0 +1,435 @@
+#include "CharScanner.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHAR_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr std::size_t MAX_DELIMITERS = 16;
+
+struct Implementation {
+    std::size_t (*m_findFirstOf)(const char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum);
+
+    // findFirstOf() that also lower-cases the bytes before the delimiter
+    std::size_t (*m_toLowerUntil)(char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum);
+
+    // Flips the case of the bytes in [first, last]
+    void (*m_flipCase)(char *data, std::size_t len, char first, char last);
+};
+
+bool isDelimiter(char c, const char *delimiters, std::size_t delimitersNum) {
+    for (std::size_t j = 0; j < delimitersNum; ++j) {
+        if (c == delimiters[j]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+char flipCase(char c, char first, char last) {
+    return c >= first && c <= last ? static_cast<char>(c ^ 0x20) : c;
+}
+
+// Any number of delimiters. The vector code finishes the last few bytes with these, memchr() there
+// slows down the AVX2 path.
+std::size_t findFirstOfBytes(const char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    for (std::size_t i = 0; i < len; ++i) {
+        if (isDelimiter(data[i], delimiters, delimitersNum)) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+std::size_t toLowerUntilBytes(char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    for (std::size_t i = 0; i < len; ++i) {
+        if (isDelimiter(data[i], delimiters, delimitersNum)) {
+            return i;
+        }
+
+        data[i] = flipCase(data[i], 'A', 'Z');
+    }
+
+    return len;
+}
+
+// The scalar implementation. The parser looks for one or two delimiters, those get loops with the delimiters
+// in registers, at least as fast as the byte loops the scanner replaced, and a single one is left to memchr().
+std::size_t findFirstOfScalar(const char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    if (delimitersNum == 1) {
+        const void *found = std::memchr(data, delimiters[0], len);
+        return found ? static_cast<const char *>(found) - data : len;
+    }
+
+    if (delimitersNum == 2) {
+        const char first = delimiters[0];
+        const char second = delimiters[1];
+
+        for (std::size_t i = 0; i < len; ++i) {
+            if (data[i] == first || data[i] == second) {
+                return i;
+            }
+        }
+
+        return len;
+    }
+
+    return findFirstOfBytes(data, len, delimiters, delimitersNum);
+}
+
+std::size_t toLowerUntilScalar(char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    if (delimitersNum == 1 || delimitersNum == 2) {
+        const char first = delimiters[0];
+        const char second = delimiters[delimitersNum - 1];
+
+        for (std::size_t i = 0; i < len; ++i) {
+            const char c = data[i];
+
+            if (c == first || c == second) {
+                return i;
+            }
+
+            data[i] = flipCase(c, 'A', 'Z');
+        }
+
+        return len;
+    }
+
+    return toLowerUntilBytes(data, len, delimiters, delimitersNum);
+}
+
+void flipCaseScalar(char *data, std::size_t len, char first, char last) {
+    for (std::size_t i = 0; i < len; ++i) {
+        data[i] = flipCase(data[i], first, last);
+    }
+}
+
+#ifdef CHAR_SCANNER_X86
+
+// The vector loops never read or write past the end of the data and leave the last few bytes to the
+// scalar code. Copying them into a padded buffer instead stalls on the store forwarding and is slower.
+
+// [first, last] is moved to the bottom of the signed range, so a single signed comparison checks both ends
+struct CaseRange {
+    char m_shift;
+    char m_bound;
+
+    CaseRange(char first, char last)
+        : m_shift{ static_cast<char>(-128 - first) }
+        , m_bound{ static_cast<char>(-128 + (last - first) + 1) } {
+    }
+};
+
+__attribute__((target("sse4.2")))
+inline __m128i flipCase128(__m128i chunk, const CaseRange &range) {
+    const __m128i inRange = _mm_cmplt_epi8(_mm_add_epi8(chunk, _mm_set1_epi8(range.m_shift)), _mm_set1_epi8(range.m_bound));
+
+    return _mm_xor_si128(chunk, _mm_and_si128(inRange, _mm_set1_epi8(0x20)));
+}
+
+// Takes the bytes before idx from changed and the rest from chunk
+__attribute__((target("sse4.2")))
+inline __m128i blendPrefix128(__m128i chunk, __m128i changed, int idx) {
+    const __m128i positions = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    return _mm_blendv_epi8(chunk, changed, _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(idx)), positions));
+}
+
+__attribute__((target("sse4.2")))
+inline __m128i loadDelimiters128(const char *delimiters, std::size_t delimitersNum) {
+    alignas(16) char set[16]{};
+    std::memcpy(set, delimiters, delimitersNum);
+
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(set));
+}
+
+constexpr int CMPESTRI_MODE = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+
+__attribute__((target("sse4.2")))
+std::size_t findFirstOfSSE42(const char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    const __m128i needles = loadDelimiters128(delimiters, delimitersNum);
+    const int needlesNum = static_cast<int>(delimitersNum);
+
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+
+        const int idx = _mm_cmpestri(needles, needlesNum, chunk, 16, CMPESTRI_MODE);
+        if (idx < 16) {
+            return i + idx;
+        }
+    }
+
+    return i + findFirstOfBytes(data + i, len - i, delimiters, delimitersNum);
+}
+
+__attribute__((target("sse4.2")))
+std::size_t toLowerUntilSSE42(char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    const __m128i needles = loadDelimiters128(delimiters, delimitersNum);
+    const int needlesNum = static_cast<int>(delimitersNum);
+    const CaseRange upper{ 'A', 'Z' };
+
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i *ptr = reinterpret_cast<__m128i *>(data + i);
+        const __m128i chunk = _mm_loadu_si128(ptr);
+        const __m128i lower = flipCase128(chunk, upper);
+
+        const int idx = _mm_cmpestri(needles, needlesNum, chunk, 16, CMPESTRI_MODE);
+        if (idx < 16) {
+            _mm_storeu_si128(ptr, blendPrefix128(chunk, lower, idx));
+            return i + idx;
+        }
+
+        _mm_storeu_si128(ptr, lower);
+    }
+
+    return i + toLowerUntilBytes(data + i, len - i, delimiters, delimitersNum);
+}
+
+__attribute__((target("sse4.2")))
+void flipCaseSSE42(char *data, std::size_t len, char first, char last) {
+    const CaseRange range{ first, last };
+
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i *ptr = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(ptr, flipCase128(_mm_loadu_si128(ptr), range));
+    }
+
+    flipCaseScalar(data + i, len - i, first, last);
+}
+
+__attribute__((target("avx2")))
+inline __m256i flipCase256(__m256i chunk, const CaseRange &range) {
+    const __m256i inRange = _mm256_cmpgt_epi8(_mm256_set1_epi8(range.m_bound), _mm256_add_epi8(chunk, _mm256_set1_epi8(range.m_shift)));
+
+    return _mm256_xor_si256(chunk, _mm256_and_si256(inRange, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i blendPrefix256(__m256i chunk, __m256i changed, int idx) {
+    const __m256i positions = _mm256_setr_epi8(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+        , 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31
+    );
+
+    return _mm256_blendv_epi8(chunk, changed, _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(idx)), positions));
+}
+
+// Broadcasts of the delimiters, compared one by one. There are one or two in practice.
+struct Needles {
+    __m256i m_vectors[MAX_DELIMITERS];
+    std::size_t m_size;
+
+    __attribute__((target("avx2")))
+    Needles(const char *delimiters, std::size_t delimitersNum)
+        : m_size{ delimitersNum } {
+        for (std::size_t j = 0; j < delimitersNum; ++j) {
+            m_vectors[j] = _mm256_set1_epi8(delimiters[j]);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    std::uint32_t match(__m256i chunk) const {
+        __m256i matches = _mm256_setzero_si256();
+
+        for (std::size_t j = 0; j < m_size; ++j) {
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chunk, m_vectors[j]));
+        }
+
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+    }
+
+    __attribute__((target("avx2")))
+    std::uint32_t match(__m128i chunk) const {
+        __m128i matches = _mm_setzero_si128();
+
+        for (std::size_t j = 0; j < m_size; ++j) {
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, _mm256_castsi256_si128(m_vectors[j])));
+        }
+
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+    }
+};
+
+__attribute__((target("avx2")))
+std::size_t findFirstOfAVX2(const char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    const Needles needles{ delimiters, delimitersNum };
+
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        if (const std::uint32_t mask = needles.match(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)))) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    if (i + 16 <= len) {
+        if (const std::uint32_t mask = needles.match(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)))) {
+            return i + __builtin_ctz(mask);
+        }
+
+        i += 16;
+    }
+
+    return i + findFirstOfBytes(data + i, len - i, delimiters, delimitersNum);
+}
+
+__attribute__((target("avx2")))
+std::size_t toLowerUntilAVX2(char *data, std::size_t len, const char *delimiters, std::size_t delimitersNum) {
+    const Needles needles{ delimiters, delimitersNum };
+    const CaseRange upper{ 'A', 'Z' };
+
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i *ptr = reinterpret_cast<__m256i *>(data + i);
+        const __m256i chunk = _mm256_loadu_si256(ptr);
+        const __m256i lower = flipCase256(chunk, upper);
+
+        if (const std::uint32_t mask = needles.match(chunk)) {
+            const int idx = __builtin_ctz(mask);
+            _mm256_storeu_si256(ptr, blendPrefix256(chunk, lower, idx));
+            return i + idx;
+        }
+
+        _mm256_storeu_si256(ptr, lower);
+    }
+
+    if (i + 16 <= len) {
+        __m128i *ptr = reinterpret_cast<__m128i *>(data + i);
+        const __m128i chunk = _mm_loadu_si128(ptr);
+        const __m128i lower = flipCase128(chunk, upper);
+
+        if (const std::uint32_t mask = needles.match(chunk)) {
+            const int idx = __builtin_ctz(mask);
+            _mm_storeu_si128(ptr, blendPrefix128(chunk, lower, idx));
+            return i + idx;
+        }
+
+        _mm_storeu_si128(ptr, lower);
+        i += 16;
+    }
+
+    return i + toLowerUntilBytes(data + i, len - i, delimiters, delimitersNum);
+}
+
+__attribute__((target("avx2")))
+void flipCaseAVX2(char *data, std::size_t len, char first, char last) {
+    const CaseRange range{ first, last };
+
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i *ptr = reinterpret_cast<__m256i *>(data + i);
+        _mm256_storeu_si256(ptr, flipCase256(_mm256_loadu_si256(ptr), range));
+    }
+
+    if (i + 16 <= len) {
+        __m128i *ptr = reinterpret_cast<__m128i *>(data + i);
+        _mm_storeu_si128(ptr, flipCase128(_mm_loadu_si128(ptr), range));
+        i += 16;
+    }
+
+    flipCaseScalar(data + i, len - i, first, last);
+}
+
+#endif // CHAR_SCANNER_X86
+
+constexpr Implementation IMPLEMENTATIONS[] = {
+    { findFirstOfScalar, toLowerUntilScalar, flipCaseScalar },
+#ifdef CHAR_SCANNER_X86
+    { findFirstOfSSE42, toLowerUntilSSE42, flipCaseSSE42 },
+    { findFirstOfAVX2, toLowerUntilAVX2, flipCaseAVX2 },
+#endif
+};
+
+CharScanner::ISA detectIsa() {
+#ifdef CHAR_SCANNER_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return CharScanner::ISA::AVX2;
+    }
+
+    if (__builtin_cpu_supports("sse4.2")) {
+        return CharScanner::ISA::SSE42;
+    }
+#endif
+
+    return CharScanner::ISA::SCALAR;
+}
+
+CharScanner::ISA g_isa = detectIsa();
+const Implementation *g_implementation = &IMPLEMENTATIONS[static_cast<std::size_t>(g_isa)];
+
+}
+
+std::size_t CharScanner::findFirstOf(const char *data, std::size_t len, std::string_view delimiters) {
+    if (delimiters.size() > MAX_DELIMITERS) {
+        return findFirstOfScalar(data, len, delimiters.data(), delimiters.size());
+    }
+
+    return g_implementation->m_findFirstOf(data, len, delimiters.data(), delimiters.size());
+}
+
+std::size_t CharScanner::toLowerUntil(char *data, std::size_t len, std::string_view delimiters) {
+    if (delimiters.size() > MAX_DELIMITERS) {
+        return toLowerUntilScalar(data, len, delimiters.data(), delimiters.size());
+    }
+
+    return g_implementation->m_toLowerUntil(data, len, delimiters.data(), delimiters.size());
+}
+
+void CharScanner::toLower(char *data, std::size_t len) {
+    g_implementation->m_flipCase(data, len, 'A', 'Z');
+}
+
+void CharScanner::toUpper(char *data, std::size_t len) {
+    g_implementation->m_flipCase(data, len, 'a', 'z');
+}
+
+CharScanner::ISA CharScanner::isa() {
+    return g_isa;
+}
+
+bool CharScanner::supported(ISA isa) {
+#ifdef CHAR_SCANNER_X86
+    switch (isa) {
+    case ISA::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ISA::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    default:
+        return true;
+    }
+#else
+    return isa == ISA::SCALAR;
+#endif
+}
+
+std::string_view CharScanner::isaName(ISA isa) {
+    switch (isa) {
+    case ISA::AVX2:
+        return "avx2";
+    case ISA::SSE42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+bool CharScanner::setIsa(ISA isa) {
+    if (!supported(isa)) {
+        return false;
+    }
+
+    g_isa = isa;
+    g_implementation = &IMPLEMENTATIONS[static_cast<std::size_t>(isa)];
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef _CHAR_SCANNER_H_
+#define _CHAR_SCANNER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+// Byte scanning primitives used by the request parser. There are AVX2, SSE4.2 and scalar
+// implementations, the best one supported by the CPU is picked at startup and all of them
+// produce identical results. Only ASCII letters are changed by the case conversions.
+class CharScanner {
+public:
+    enum class ISA : std::uint8_t {
+        SCALAR,
+        SSE42,
+        AVX2
+    };
+
+    // The index of the first byte equal to one of the delimiters (at most 16), or len if there is none
+    static std::size_t findFirstOf(const char *data, std::size_t len, std::string_view delimiters);
+
+    // findFirstOf() that also lower-cases the bytes before the delimiter in the same pass
+    static std::size_t toLowerUntil(char *data, std::size_t len, std::string_view delimiters);
+
+    static void toLower(char *data, std::size_t len);
+    static void toUpper(char *data, std::size_t len);
+
+    static ISA isa();
+    static bool supported(ISA isa);
+    static std::string_view isaName(ISA isa);
+
+    // Not thread-safe, meant for the benchmarks. Returns false if the CPU doesn't support the ISA.
+    static bool setIsa(ISA isa);
+};
+
+#endif // !_CHAR_SCANNER_H_
@@ -0,0 +1,323 @@
+#include "Compression.h"
+#include "ServerResponses.h"
+
+#include <cctype>
+#include <limits>
+#include <algorithm>
+
+namespace {
+
+std::string_view trimSpaces(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+
+    return str;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+bool startsWithIgnoreCase(std::string_view str, std::string_view prefix) {
+    return str.size() >= prefix.size() && equalsIgnoreCase(str.substr(0, prefix.size()), prefix);
+}
+
+bool endsWithIgnoreCase(std::string_view str, std::string_view suffix) {
+    return str.size() >= suffix.size() && equalsIgnoreCase(str.substr(str.size() - suffix.size()), suffix);
+}
+
+// "q=0.5" in thousandths, 1000 without a q parameter and -1 if it's invalid
+int parseQuality(std::string_view params) {
+    while (!params.empty()) {
+        const auto semicolon = params.find(';');
+        const std::string_view param = trimSpaces(params.substr(0, semicolon));
+
+        if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+            const std::string_view value = param.substr(2);
+
+            if (value.empty() || (value[0] != '0' && value[0] != '1')) {
+                return -1;
+            }
+
+            int quality = (value[0] - '0') * 1000;
+
+            if (value.size() > 1) {
+                if (value[1] != '.' || value.size() > 5) {
+                    return -1;
+                }
+
+                int scale = 100;
+                for (const char c : value.substr(2)) {
+                    if (c < '0' || c > '9') {
+                        return -1;
+                    }
+
+                    quality += (c - '0') * scale;
+                    scale /= 10;
+                }
+            }
+
+            return std::min(quality, 1000);
+        }
+
+        if (semicolon == std::string_view::npos) {
+            break;
+        }
+
+        params.remove_prefix(semicolon + 1);
+    }
+
+    return 1000;
+}
+
+}
+
+CONTENT_ENCODING negotiateEncoding(std::string_view acceptEncoding) {
+    // -1 until the coding is listed
+    int gzip = -1;
+    int deflate = -1;
+    int any = -1;
+
+    while (!acceptEncoding.empty()) {
+        const auto comma = acceptEncoding.find(',');
+        const std::string_view item = acceptEncoding.substr(0, comma);
+
+        const auto semicolon = item.find(';');
+        const std::string_view coding = trimSpaces(item.substr(0, semicolon));
+        const int quality = semicolon == std::string_view::npos ? 1000 : parseQuality(item.substr(semicolon + 1));
+
+        if (quality >= 0) {
+            if (equalsIgnoreCase(coding, "gzip") || equalsIgnoreCase(coding, "x-gzip")) {
+                gzip = quality;
+            }
+            else if (equalsIgnoreCase(coding, "deflate")) {
+                deflate = quality;
+            }
+            else if (coding == "*") {
+                any = quality;
+            }
+        }
+
+        if (comma == std::string_view::npos) {
+            break;
+        }
+
+        acceptEncoding.remove_prefix(comma + 1);
+    }
+
+    // "*" covers the codings that aren't listed
+    if (gzip == -1) {
+        gzip = any;
+    }
+
+    if (deflate == -1) {
+        deflate = any;
+    }
+
+    if (gzip > 0 && gzip >= deflate) {
+        return CONTENT_ENCODING::GZIP;
+    }
+
+    if (deflate > 0) {
+        return CONTENT_ENCODING::DEFLATE;
+    }
+
+    return CONTENT_ENCODING::IDENTITY;
+}
+
+bool isCompressible(std::string_view contentType) {
+    const std::string_view type = trimSpaces(contentType.substr(0, contentType.find(';')));
+
+    static constexpr std::string_view TYPES[] = {
+        "application/json",
+        "application/javascript",
+        "application/xml",
+        "application/wasm",
+        "image/svg+xml"
+    };
+
+    if (startsWithIgnoreCase(type, "text/") || endsWithIgnoreCase(type, "+json") || endsWithIgnoreCase(type, "+xml")) {
+        return true;
+    }
+
+    return std::any_of(std::begin(TYPES), std::end(TYPES), [type](std::string_view known) {
+        return equalsIgnoreCase(type, known);
+    });
+}
+
+std::string_view encodingToString(CONTENT_ENCODING encoding) {
+    switch (encoding) {
+    case CONTENT_ENCODING::GZIP:
+        return "gzip";
+    case CONTENT_ENCODING::DEFLATE:
+        return "deflate";
+    default:
+        return "identity";
+    }
+}
+
+Compressor::~Compressor() {
+    for (std::size_t i = 0; i < STREAMS_NUM; ++i) {
+        if (m_levels[i] != 0) {
+            deflateEnd(&m_streams[i]);
+        }
+    }
+}
+
+z_stream *Compressor::prepare(CONTENT_ENCODING encoding, int level) {
+    const std::size_t idx = static_cast<std::size_t>(encoding);
+    z_stream &stream = m_streams[idx];
+
+    if (m_levels[idx] == 0) {
+        // 15 bits of window, +16 for the gzip wrapper, deflate is the zlib format (RFC 9110, 8.4.1)
+        const int windowBits = encoding == CONTENT_ENCODING::GZIP ? 15 + 16 : 15;
+
+        if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return nullptr;
+        }
+
+        m_levels[idx] = level;
+        return &stream;
+    }
+
+    if (deflateReset(&stream) != Z_OK) {
+        return nullptr;
+    }
+
+    // Nothing has been compressed since the reset, so changing the level doesn't flush anything
+    if (m_levels[idx] != level) {
+        if (deflateParams(&stream, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return nullptr;
+        }
+
+        m_levels[idx] = level;
+    }
+
+    return &stream;
+}
+
+bool Compressor::compress(std::string_view data, CONTENT_ENCODING encoding, int level, std::string &out) {
+    if (encoding == CONTENT_ENCODING::IDENTITY || data.size() > std::numeric_limits<uInt>::max()) {
+        return false;
+    }
+
+    z_stream *stream = prepare(encoding, level);
+    if (!stream) {
+        return false;
+    }
+
+    const std::size_t start = out.size();
+    const std::size_t bound = deflateBound(stream, static_cast<uLong>(data.size()));
+
+    out.resize(start + bound);
+
+    stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream->avail_in = static_cast<uInt>(data.size());
+    stream->next_out = reinterpret_cast<Bytef *>(out.data() + start);
+    stream->avail_out = static_cast<uInt>(bound);
+
+    // The output has room for the bound, a single call finishes the stream
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        out.resize(start);
+        return false;
+    }
+
+    out.resize(start + (bound - stream->avail_out));
+    return true;
+}
+
+bool Compressor::compressResponse(std::string &response, std::size_t start, CONTENT_ENCODING encoding, const CompressionOptions &options) {
+    using namespace std::string_view_literals;
+
+    const std::size_t headersEnd = response.find("\r\n\r\n"sv, start);
+    if (headersEnd == std::string::npos) {
+        return false;
+    }
+
+    const std::size_t bodyStart = headersEnd + 4;
+    const std::size_t bodySize = response.size() - bodyStart;
+
+    if (bodySize < options.m_minSize) {
+        return false;
+    }
+
+    // "HTTP/1.1 200 OK"
+    const std::string_view head{ response.data() + start, headersEnd - start };
+    if (head.size() < 12 || head.substr(9, 3) != "200"sv) {
+        return false;
+    }
+
+    bool compressible = false;
+    bool lengthMatches = false;
+    std::size_t lengthBegin = 0;
+    std::size_t lengthEnd = 0;
+
+    // Every header line starts after a CRLF, the status line is skipped
+    for (std::size_t lineBegin = head.find("\r\n"sv); lineBegin != std::string_view::npos;) {
+        lineBegin += 2;
+
+        const std::size_t lineEnd = std::min(head.find("\r\n"sv, lineBegin), head.size());
+        const std::string_view line = head.substr(lineBegin, lineEnd - lineBegin);
+
+        const auto colon = line.find(':');
+        const std::string_view name = line.substr(0, colon);
+        const std::string_view value = colon == std::string_view::npos ? std::string_view{} : trimSpaces(line.substr(colon + 1));
+
+        if (equalsIgnoreCase(name, "Content-Encoding"sv) || equalsIgnoreCase(name, "Transfer-Encoding"sv)) {
+            return false;
+        }
+
+        if (equalsIgnoreCase(name, "Content-Type"sv)) {
+            compressible = isCompressible(value);
+        }
+        else if (equalsIgnoreCase(name, "Content-Length"sv)) {
+            lengthMatches = value == std::to_string(bodySize);
+            lengthBegin = lineBegin - 2;
+            lengthEnd = lineEnd;
+        }
+
+        lineBegin = lineEnd < head.size() ? lineEnd : std::string_view::npos;
+    }
+
+    if (!compressible || !lengthMatches) {
+        return false;
+    }
+
+    m_body.clear();
+
+    const std::string_view body{ response.data() + bodyStart, bodySize };
+    if (!compress(body, encoding, static_cast<int>(options.m_level), m_body) || m_body.size() >= bodySize) {
+        return false;
+    }
+
+    // The headers without the old Content-Length
+    m_head.assign(head.substr(0, lengthBegin));
+    m_head += head.substr(lengthEnd);
+
+    m_head += ResponseBody::CRLF;
+    m_head += "Content-Encoding: "sv;
+    m_head += encodingToString(encoding);
+    m_head += ResponseBody::CRLF;
+
+    m_head += "Vary: Accept-Encoding"sv;
+    m_head += ResponseBody::CRLF;
+
+    m_head += "Content-Length: "sv;
+    m_head += std::to_string(m_body.size());
+    m_head += ResponseBody::CRLF;
+
+    m_head += ResponseBody::CRLF;
+
+    response.resize(start);
+    response += m_head;
+    response += m_body;
+
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef _COMPRESSION_H_
+#define _COMPRESSION_H_
+
+#include <array>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+#include <zlib.h>
+
+enum class CONTENT_ENCODING : std::uint8_t {
+    IDENTITY,
+    GZIP,
+    DEFLATE,
+    COUNT
+};
+
+struct CompressionOptions {
+    bool m_enabled{ true };
+    std::uint32_t m_minSize{ 1024 };    // Smaller handler responses are sent as they are
+    std::uint32_t m_level{ 6 };         // Of the handler responses, the constant bodies are compressed once with the best level
+};
+
+// Picks the encoding from an Accept-Encoding value: the highest q wins, gzip on a tie, and q=0
+// excludes a coding. Identity when neither gzip nor deflate is acceptable.
+CONTENT_ENCODING negotiateEncoding(std::string_view acceptEncoding);
+
+// Text, JSON, XML, JavaScript, SVG and WebAssembly, the formats that aren't compressed already
+bool isCompressible(std::string_view contentType);
+
+// "gzip" or "deflate"
+std::string_view encodingToString(CONTENT_ENCODING encoding);
+
+// Reusable zlib streams, one per encoding. A stream is allocated on the first use and only reset
+// between the calls, so a compression doesn't allocate the ~256 KB of the deflate state.
+// Owned by a single thread: the workers have one in their ThreadContext and so do the async pool threads.
+class Compressor {
+public:
+    Compressor() = default;
+    ~Compressor();
+
+    Compressor(const Compressor &) = delete;
+    Compressor &operator=(const Compressor &) = delete;
+
+    // Appends the compressed data to out. Returns false if zlib fails.
+    bool compress(std::string_view data, CONTENT_ENCODING encoding, int level, std::string &out);
+
+    // Compresses the body of the complete response that starts at start, in place: a 200 with a
+    // compressible Content-Type, a Content-Length of at least options.m_minSize and no Content-Encoding.
+    // Returns false if the response has been left as it was, e.g. when compression doesn't make it smaller.
+    bool compressResponse(std::string &response, std::size_t start, CONTENT_ENCODING encoding, const CompressionOptions &options);
+
+private:
+    z_stream *prepare(CONTENT_ENCODING encoding, int level);
+
+private:
+    static constexpr std::size_t STREAMS_NUM = static_cast<std::size_t>(CONTENT_ENCODING::COUNT);
+
+    std::array<z_stream, STREAMS_NUM> m_streams{};
+    std::array<int, STREAMS_NUM> m_levels{};    // 0 means not initialized
+    std::string m_body;
+    std::string m_head;
+};
+
+#endif // !_COMPRESSION_H_
@@ -0,0 +1,668 @@
+#include "EpollReactor.h"
+#include "ServerThread.h"
+
+#include <cassert>
+
+#include <cstdio>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+EpollReactor::EpollReactor(ServerThread &thread, int listenerfd)
+	: m_thread{ thread }
+	, m_data{ thread.data() }
+	, m_context{ thread.context() }
+	, m_stats{ thread.stats() }
+	, m_metrics{ thread.metrics() }
+	, m_epollfd{ -1 }
+	, m_edgeTriggered{ thread.server().config().m_epollEdgeTriggered }
+	, m_zerocopyThreshold{ thread.server().config().m_zerocopyThreshold }
+	, m_tls{ thread.server().tls() }
+	, m_events(thread.server().config().m_epollEvents) {
+	m_listener.m_data.fd = listenerfd;
+
+	if (m_tls && !m_context.m_tlsRecord) {
+		m_context.m_tlsRecord = std::make_unique<char[]>(TlsSession::MAX_RECORD_SIZE);
+	}
+}
+
+EpollReactor::~EpollReactor() {
+	if (m_epollfd != -1) {
+		close(m_epollfd);
+	}
+}
+
+bool EpollReactor::init() {
+	m_epollfd = epoll_create1(0);
+	if (m_epollfd == -1) {
+		perror("epoll_create1");
+		return false;
+	}
+
+	// Either the listener or the eventfd of the dispatcher
+	ThreadData::Event *source = &m_listener;
+
+	if (m_listener.m_data.fd == -1) {
+		if (!m_handoff.init()) {
+			return false;
+		}
+
+		m_wakeup.m_data.fd = m_handoff.fd();
+		source = &m_wakeup;
+	}
+
+	epoll_event sourceEvent;
+	sourceEvent.events = EPOLLIN;
+	sourceEvent.data.ptr = source;
+
+	if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, source->m_data.fd, &sourceEvent) == -1) {
+		perror("epoll_ctl");
+		return false;
+	}
+
+	m_asyncWakeup.m_data.fd = m_thread.completions().fd();
+
+	if (m_asyncWakeup.m_data.fd != -1) {
+		epoll_event asyncEvent;
+		asyncEvent.events = EPOLLIN;
+		asyncEvent.data.ptr = &m_asyncWakeup;
+
+		if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_asyncWakeup.m_data.fd, &asyncEvent) == -1) {
+			perror("epoll_ctl");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool EpollReactor::addClient(int fd) {
+	return m_handoff.push(fd);
+}
+
+std::size_t EpollReactor::pendingClients() const {
+	return m_handoff.size();
+}
+
+bool EpollReactor::add(ThreadData::Event &event) {
+	if (m_tls) {
+		event.m_data.tls = m_tls->accept(event.m_data.fd, m_context.m_tlsRecord.get());
+		if (!event.m_data.tls) {
+			return false;
+		}
+
+		// OpenSSL writes every record by itself, e.g. the session ticket after the handshake,
+		// and Nagle would hold the next one until the peer's delayed ACK
+		const int enable = 1;
+		setsockopt(event.m_data.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		m_stats.addSyscalls(1);
+	}
+
+	epoll_event newEvent;
+	newEvent.events = m_edgeTriggered ? EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET : EPOLLIN | EPOLLHUP | EPOLLRDHUP;
+	newEvent.data.ptr = &event;
+
+	m_stats.addSyscalls(1);
+
+	if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, event.m_data.fd, &newEvent) == -1) {
+		return false;
+	}
+
+	if (m_zerocopyThreshold != 0) {
+		const int enable = 1;
+
+		// Without the kernel's support the connection copies everything
+		if (setsockopt(event.m_data.fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0) {
+			event.m_data.output.enableZerocopy(m_zerocopyThreshold);
+
+			// Nagle would hold the last partial segment of a zero-copy send until the peer's delayed ACK.
+			// The headers before the body are still held back by MSG_MORE.
+			setsockopt(event.m_data.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+			m_stats.addSyscalls(1);
+		}
+
+		m_stats.addSyscalls(1);
+	}
+
+	m_thread.armTimeout(event, ServerThread::TIMEOUT::HEADER);
+	return true;
+}
+
+void EpollReactor::addHandedOff() {
+	std::uint64_t count;
+	if (read(m_handoff.fd(), &count, sizeof(count)) == -1) {
+		perror("read(eventfd)");
+	}
+
+	m_stats.addSyscalls(1);
+
+	m_handoff.drain([this](int clientSocket) {
+		addAccepted(clientSocket);
+	});
+}
+
+void EpollReactor::addAccepted(int clientSocket) {
+	ThreadData::Event *event = m_data.acquire(clientSocket);
+
+	if (!event || !add(*event)) {
+		if (event) {
+			m_data.release(*event);
+		}
+
+		close(clientSocket);
+		m_stats.addSyscalls(1);
+		m_metrics.addRejected();
+		return;
+	}
+
+	m_metrics.addAccepted();
+}
+
+void EpollReactor::closeConnection(ThreadData::Event &event, epoll_event *epollEvent) {
+	const int fd = event.m_data.fd;
+
+	m_thread.cancelTimeout(event);
+
+	// The pages of the unfinished zero-copy sends may be read after close(), their owners are kept
+	auto &output = event.m_data.output;
+	if (output.zerocopyPending()) {
+		output.reapZerocopy(fd, m_stats);
+	}
+
+	if (output.zerocopyEnabled()) {
+		output.resetZerocopy(m_context.m_zerocopyRetired);
+	}
+
+	if (event.m_data.tls) {
+		event.m_data.tls->close();
+		m_stats.addSyscalls(1);
+	}
+
+	shutdown(fd, SHUT_RDWR);
+
+	if (epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, epollEvent) == -1) {
+		assert(false && "Error. Can't release the epoll event.");
+	}
+
+	m_data.release(event);
+
+	close(fd);
+
+	m_stats.addSyscalls(3);
+	m_metrics.addClosed();
+}
+
+bool EpollReactor::handleError(ThreadData::Event &event) {
+	auto &data = event.m_data;
+
+	if (!data.output.zerocopyEnabled() || !data.output.reapZerocopy(data.fd, m_stats)) {
+		return false;
+	}
+
+	// The completions raise EPOLLERR too, the socket may have no error at all
+	int error = 0;
+	socklen_t errorSize = sizeof(error);
+
+	m_stats.addSyscalls(1);
+
+	return getsockopt(data.fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) == 0 && error == 0;
+}
+
+bool EpollReactor::handshake(ThreadData::Event &event, epoll_event *epollEvent) {
+	auto &data = event.m_data;
+
+	const TlsSession::RESULT result = data.tls->handshake();
+	m_stats.addSyscalls(1);
+
+	if (result == TlsSession::RESULT::ERROR) {
+		m_metrics.addTlsFailure();
+		return false;
+	}
+
+	if (result == TlsSession::RESULT::DONE) {
+		m_metrics.addTlsHandshake(data.tls->resumed(), data.tls->kernelSend());
+	}
+
+	// Edge-triggered, both directions are registered
+	if (!epollEvent) {
+		return true;
+	}
+
+	const bool wantWrite = result == TlsSession::RESULT::WANT_WRITE;
+	if (wantWrite == ((epollEvent->events & EPOLLOUT) != 0)) {
+		return true;
+	}
+
+	epollEvent->events = wantWrite ? EPOLLOUT | EPOLLHUP | EPOLLRDHUP : EPOLLIN | EPOLLHUP | EPOLLRDHUP;
+
+	m_stats.addSyscalls(1);
+
+	return epoll_ctl(m_epollfd, EPOLL_CTL_MOD, data.fd, epollEvent) != -1;
+}
+
+int EpollReactor::receive(ThreadData::Event::Data &data) {
+	m_stats.addSyscalls(1);
+
+	if (data.tls) {
+		return static_cast<int>(data.tls->read(data.input.writePtr(), data.input.writable()));
+	}
+
+	return recv(data.fd, data.input.writePtr(), data.input.writable(), 0);
+}
+
+void EpollReactor::completeAsync() {
+	std::uint64_t count;
+	if (read(m_asyncWakeup.m_data.fd, &count, sizeof(count)) == -1) {
+		perror("read(eventfd)");
+	}
+
+	m_stats.addSyscalls(1);
+
+	m_thread.completions().drain([this](AsyncJob *job) {
+		ThreadData::Event *event = m_thread.completeAsync(job);
+		if (!event) {
+			return;
+		}
+
+		if (!resumeAsync(*event)) {
+			closeConnection(*event, nullptr);
+			return;
+		}
+
+		m_thread.updateTimeout(*event);
+	});
+}
+
+bool EpollReactor::resumeAsync(ThreadData::Event &event) {
+	auto &data = event.m_data;
+
+	if (m_edgeTriggered) {
+		if (!processInput(event)) {
+			return false;
+		}
+
+		// Reading stopped while the handler ran
+		if (data.output.empty() && data.readPaused && !data.asyncPending) {
+			data.readPaused = 0;
+			return drainInput(event);
+		}
+
+		return true;
+	}
+
+	// sendData() appends the response and the responses of the requests that waited for it
+	epoll_event epollEvent;
+	epollEvent.events = EPOLLOUT | EPOLLHUP | EPOLLRDHUP;
+	epollEvent.data.ptr = &event;
+
+	m_stats.addSyscalls(1);
+
+	return epoll_ctl(m_epollfd, EPOLL_CTL_MOD, data.fd, &epollEvent) != -1;
+}
+
+void EpollReactor::run() {
+	while (true) {
+		bool asyncCompleted = false;
+
+		// Wake up for the next deadline and periodically for the housekeeping, even if there are no events
+		const int timeout = static_cast<int>(m_thread.waitTimeout().count());
+
+		const int eventsNum = epoll_wait(m_epollfd, m_events.data(), static_cast<int>(m_events.size()), timeout);
+		m_stats.addSyscalls(1);
+
+		const auto wakeup = std::chrono::steady_clock::now();
+		m_context.m_fileCache.onTimer(wakeup);
+		m_context.m_date.onTimer(wakeup);
+		m_context.m_zerocopyRetired.onTimer(wakeup);
+		m_thread.onWakeup();
+
+		if (eventsNum == -1) {
+			if (errno != EINTR) {
+				perror("epoll_wait");
+			}
+
+			continue;
+		}
+
+		for (int i = 0; i < eventsNum; ++i) {
+			auto &event = m_events[i];
+
+			assert(event.data.ptr && "The pointer must point to pre-allocated and valid data");
+
+			ThreadData::Event &eventData = *static_cast<ThreadData::Event *>(event.data.ptr);
+
+			if (&eventData == &m_listener) {
+				acceptClients();
+				continue;
+			}
+
+			if (&eventData == &m_wakeup) {
+				addHandedOff();
+				continue;
+			}
+
+			if (&eventData == &m_asyncWakeup) {
+				asyncCompleted = true;
+				continue;
+			}
+
+			if (m_edgeTriggered) {
+				if (!handleEdgeEvent(eventData, event.events)) {
+					closeConnection(eventData, &event);
+				}
+
+				continue;
+			}
+
+			if (event.events & EPOLLRDHUP || event.events & EPOLLHUP || (event.events & EPOLLERR && !handleError(eventData))) {
+				closeConnection(eventData, &event);
+				continue;
+			}
+
+			if (event.events & EPOLLIN) {
+
+				if (!readData(eventData, event)) {
+					closeConnection(eventData, &event);
+					continue;
+				}
+			}
+			else if (event.events & EPOLLOUT) {
+
+				if (!sendData(eventData, event)) {
+					closeConnection(eventData, &event);
+					continue;
+				}
+			}
+
+			m_thread.updateTimeout(eventData);
+		}
+
+		// After the batch, a connection closed here can't have another event in it
+		if (asyncCompleted) {
+			completeAsync();
+		}
+
+		m_thread.expireTimeouts([this](ThreadData::Event &eventData) {
+			closeConnection(eventData, nullptr);
+		});
+
+		// For the dispatcher's placement policy
+		m_stats.addLoopTime(std::chrono::steady_clock::now() - wakeup);
+	}
+}
+
+void EpollReactor::acceptClients() {
+	const int listener = m_listener.m_data.fd;
+
+	// The listener is level-triggered, so it's fine to stop on the first error and wait for the next epoll_wait()
+	while (true) {
+		const int clientSocket = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+		m_stats.addSyscalls(1);
+
+		if (clientSocket == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+
+			return;
+		}
+
+		addAccepted(clientSocket);
+	}
+}
+
+bool EpollReactor::readData(ThreadData::Event &event, epoll_event &epollEvent) {
+	auto &data = event.m_data;
+	const int fd = data.fd;
+
+	if (data.tls && !data.tls->established()) {
+		// The request comes after the handshake, with a new EPOLLIN
+		return handshake(event, &epollEvent);
+	}
+
+	// A whole TLS record, so nothing is left in OpenSSL without an EPOLLIN for it
+	data.input.prepareRead(data.tls ? TlsSession::MAX_RECORD_SIZE : InputBuffer::MIN_READ_SIZE);
+
+	const int nr = receive(data);
+
+	switch (nr) {
+	case -1:
+		// Do nothing, just loop and wait for the next epoll_wait()
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return true;
+		}
+
+		return false; // error
+	case 0:
+		// The connection must be closed
+		return false;
+	default:
+		m_stats.addBytesIn(static_cast<std::size_t>(nr));
+		data.input.commit(static_cast<std::size_t>(nr));
+
+		data.input.consume(m_thread.processRequests(event, data.input.data(), data.input.size()));
+
+		if (data.output.empty()) {
+			if (!data.asyncPending) {
+				return true; // Wait for the rest of the request
+			}
+
+			// Don't read until the async handler returns
+			epollEvent.events = EPOLLHUP | EPOLLRDHUP;
+		}
+		else {
+			epollEvent.events = EPOLLOUT | EPOLLHUP | EPOLLRDHUP;
+		}
+
+		m_stats.addSyscalls(1);
+
+		if (epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &epollEvent) == -1) {
+			assert(false && "This should not happen.");
+			return false;
+		}
+
+		return true;
+	}
+}
+
+bool EpollReactor::handleEdgeEvent(ThreadData::Event &event, std::uint32_t events) {
+	auto &data = event.m_data;
+
+	if (events & EPOLLHUP || (events & EPOLLERR && !handleError(event))) {
+		return false;
+	}
+
+	if (data.tls && !data.tls->established()) {
+		if (!handshake(event, nullptr)) {
+			return false;
+		}
+
+		if (!data.tls->established()) {
+			return true;
+		}
+
+		// The request may have arrived with the last flight of the handshake, without a new edge
+		events |= EPOLLIN;
+	}
+
+	bool handled = false;
+
+	if (events & EPOLLOUT && !data.output.empty()) {
+		if (!writeOutput(event)) {
+			return false;
+		}
+
+		handled = true;
+
+		// There may be no new EPOLLIN edge for the bytes that were left in the socket or
+		// for the requests that were held back during a streamed response
+		if (data.output.empty() && (data.readPaused || !data.input.empty())) {
+			data.readPaused = 0;
+
+			if (!drainInput(event)) {
+				return false;
+			}
+
+			events &= ~(EPOLLIN | EPOLLRDHUP);
+		}
+	}
+
+	// The data and the FIN may come together, so EPOLLRDHUP is handled by reading until recv() returns 0
+	if (events & (EPOLLIN | EPOLLRDHUP) && !data.readPaused) {
+		if (!drainInput(event)) {
+			return false;
+		}
+
+		handled = true;
+	}
+
+	// A bare EPOLLOUT edge, e.g. right after the registration, doesn't change the deadline
+	if (handled) {
+		m_thread.updateTimeout(event);
+	}
+
+	return true;
+}
+
+bool EpollReactor::drainInput(ThreadData::Event &event) {
+	auto &data = event.m_data;
+
+	// The requests that arrived during a streamed response
+	if (!data.input.empty() && data.output.empty() && !processInput(event)) {
+		return false;
+	}
+
+	while (true) {
+		if (!data.output.empty() || data.asyncPending) {
+			// The socket buffer is full, continue when it's writable again or when the async handler returns
+			data.readPaused = 1;
+			return true;
+		}
+
+		data.input.prepareRead(data.tls ? TlsSession::MAX_RECORD_SIZE : InputBuffer::MIN_READ_SIZE);
+
+		const std::size_t requested = data.input.writable();
+		const int nr = receive(data);
+
+		if (nr == -1) {
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+
+		if (nr == 0) {
+			return false;
+		}
+
+		m_stats.addBytesIn(static_cast<std::size_t>(nr));
+		data.input.commit(static_cast<std::size_t>(nr));
+
+		if (!processInput(event)) {
+			return false;
+		}
+
+		// A short read means that the socket has been drained. The bytes that arrive later
+		// raise a new edge, so the recv() that would fail with EAGAIN is skipped. A TLS read
+		// returns a single record, more of them may be waiting.
+		if (!data.tls && static_cast<std::size_t>(nr) < requested) {
+			return true;
+		}
+	}
+}
+
+bool EpollReactor::processInput(ThreadData::Event &event) {
+	auto &data = event.m_data;
+
+	do {
+		data.input.consume(m_thread.processRequests(event, data.input.data(), data.input.size()));
+
+		if (data.output.empty()) {
+			return true;
+		}
+
+		if (!writeOutput(event)) {
+			return false;
+		}
+
+		// A streamed response that has been sent at once, the requests after it are still in the input
+	} while (data.output.empty() && !data.input.empty());
+
+	return true;
+}
+
+bool EpollReactor::writeOutput(ThreadData::Event &event) {
+	auto &data = event.m_data;
+
+	m_thread.onSend(data);
+
+	switch (data.output.flush(data.fd, m_stats, data.tls.get())) {
+	case OutputQueue::RESULT::WOULD_BLOCK:
+		return true; // Wait for the EPOLLOUT edge
+	case OutputQueue::RESULT::ERROR:
+		return false;
+	default:
+		if (data.clientClosed) {
+			shutdown(data.fd, SHUT_WR); // Won't write anymore
+			m_stats.addSyscalls(1);
+			return false;
+		}
+
+		return true;
+	}
+}
+
+bool EpollReactor::sendData(ThreadData::Event &event, epoll_event &epollEvent) {
+	auto &data = event.m_data;
+	const int fd = data.fd;
+
+	if (data.tls && !data.tls->established()) {
+		return handshake(event, &epollEvent);
+	}
+
+	while (true) {
+		m_thread.onSend(data);
+
+		switch (data.output.flush(fd, m_stats, data.tls.get())) {
+		case OutputQueue::RESULT::WOULD_BLOCK:
+			return true;
+		case OutputQueue::RESULT::ERROR:
+			return false;
+		default:
+			break;
+		}
+
+		// Everything has been sent
+		if (data.clientClosed) {
+			shutdown(fd, SHUT_WR); // Won't write anymore
+			m_stats.addSyscalls(1);
+			return false;
+		}
+
+		if (data.input.empty() && !data.asyncJob) {
+			break;
+		}
+
+		// The finished async request and the requests that arrived during a streamed response
+		data.input.consume(m_thread.processRequests(event, data.input.data(), data.input.size()));
+
+		if (data.output.empty()) {
+			break;
+		}
+	}
+
+	{
+		// Don't read until the async handler returns
+		epollEvent.events = data.asyncPending ? EPOLLHUP | EPOLLRDHUP : EPOLLIN | EPOLLHUP | EPOLLRDHUP;
+
+		m_stats.addSyscalls(1);
+
+		if (epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &epollEvent) == -1) {
+			assert(false && "This should not happen.");
+			return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef _EPOLL_REACTOR_H_
+#define _EPOLL_REACTOR_H_
+
+#include "Reactor.h"
+#include "ThreadData.h"
+
+#include <vector>
+
+#include <sys/epoll.h>
+
+struct ThreadContext;
+class IoStats;
+class Metrics;
+class TlsContext;
+
+// epoll loop with two modes. Level-triggered: a connection waits for EPOLLIN until a response is
+// produced, then for EPOLLOUT until the response is sent. Edge-triggered: both are registered once,
+// the responses are written as soon as they are produced and EPOLLOUT matters only when the socket
+// buffer is full. Reading stops while the output is blocked, which keeps a client that doesn't
+// read its responses from filling the worker's memory, and while an async handler runs. The async
+// completions and the deadlines of the connections are handled after every batch of events.
+// A TLS connection completes its handshake first, waiting for the readiness that OpenSSL asks for.
+class EpollReactor : public Reactor {
+public:
+	EpollReactor(ServerThread &thread, int listenerfd);
+	~EpollReactor() override;
+
+	bool init();
+
+	void run() override;
+	bool addClient(int fd) override;
+	std::size_t pendingClients() const override;
+
+private:
+	bool add(ThreadData::Event &event);
+	void acceptClients();
+	void addHandedOff();
+	void addAccepted(int clientSocket);
+	void closeConnection(ThreadData::Event &event, epoll_event *epollEvent);
+
+	// EPOLLERR: the zero-copy completions on the error queue or a socket error. Returns false for the latter.
+	bool handleError(ThreadData::Event &event);
+
+	// Hands the finished async requests back to their connections
+	void completeAsync();
+	bool resumeAsync(ThreadData::Event &event);
+
+	// Continues the TLS handshake. Returns false if it failed. Level-triggered, epollEvent switches
+	// the connection to EPOLLOUT while the handshake can't write and back to EPOLLIN.
+	bool handshake(ThreadData::Event &event, epoll_event *epollEvent);
+
+	// recv() or the decrypted input of a TLS connection, into the free space of the input buffer
+	int receive(ThreadData::Event::Data &data);
+
+	bool readData(ThreadData::Event &event, epoll_event &epollEvent);
+	bool sendData(ThreadData::Event &event, epoll_event &epollEvent);
+
+	// Edge-triggered mode. Return false if the connection must be closed.
+	bool handleEdgeEvent(ThreadData::Event &event, std::uint32_t events);
+	bool drainInput(ThreadData::Event &event);
+	bool processInput(ThreadData::Event &event);
+	bool writeOutput(ThreadData::Event &event);
+
+private:
+	ServerThread &m_thread;
+	ThreadData &m_data;
+	ThreadContext &m_context;
+	IoStats &m_stats;
+	Metrics &m_metrics;
+
+	int m_epollfd;
+	const bool m_edgeTriggered;
+	const std::uint32_t m_zerocopyThreshold;
+	const TlsContext *m_tls; // nullptr without TLS
+	std::vector<epoll_event> m_events;
+	ThreadData::Event m_listener;
+
+	// Dispatcher mode
+	ClientHandoff m_handoff;
+	ThreadData::Event m_wakeup;
+
+	// The eventfd of the async completions
+	ThreadData::Event m_asyncWakeup;
+};
+
+#endif // !_EPOLL_REACTOR_H_
@@ -0,0 +1,160 @@
+#include "FileCache.h"
+#include "HttpDate.h"
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+bool sameFile(const struct stat &lhs, const struct stat &rhs) {
+    return lhs.st_dev == rhs.st_dev
+        && lhs.st_ino == rhs.st_ino
+        && lhs.st_size == rhs.st_size
+        && lhs.st_mtim.tv_sec == rhs.st_mtim.tv_sec
+        && lhs.st_mtim.tv_nsec == rhs.st_mtim.tv_nsec;
+}
+
+}
+
+CachedFile::CachedFile(int fd, const struct stat &fileStat)
+    : m_fd{ fd }
+    , m_stat(fileStat) {
+
+    char buff[64];
+
+    const int len = std::snprintf(
+        buff
+        , sizeof(buff)
+        , "\"%llx-%llx\""
+        , static_cast<unsigned long long>(fileStat.st_mtim.tv_sec) * 1000000000ull + fileStat.st_mtim.tv_nsec
+        , static_cast<unsigned long long>(fileStat.st_size)
+    );
+    m_etag.assign(buff, len);
+
+    m_lastModified.assign(buff, HttpDate::format(fileStat.st_mtim.tv_sec, buff));
+}
+
+CachedFile::~CachedFile() {
+    close(m_fd);
+}
+
+std::shared_ptr<const CachedFile::Compressed> CachedFile::compressed(CONTENT_ENCODING encoding, Compressor &compressor) const {
+    auto &cached = m_compressed[static_cast<std::size_t>(encoding)];
+    if (cached) {
+        return cached;
+    }
+
+    const std::size_t size = static_cast<std::size_t>(m_stat.st_size);
+    if (size > MAX_COMPRESSED_SIZE) {
+        return nullptr;
+    }
+
+    std::string content(size, '\0');
+
+    for (std::size_t offset = 0; offset < size;) {
+        const ssize_t nr = pread(m_fd, content.data() + offset, size - offset, static_cast<off_t>(offset));
+        if (nr <= 0) {
+            return nullptr;
+        }
+
+        offset += static_cast<std::size_t>(nr);
+    }
+
+    auto result = std::make_shared<Compressed>();
+
+    if (compressor.compress(content, encoding, Z_BEST_COMPRESSION, result->m_body) && result->m_body.size() < size) {
+        // "<mtime>-<size>-gzip"
+        result->m_etag.assign(m_etag, 0, m_etag.size() - 1);
+        result->m_etag += '-';
+        result->m_etag += encodingToString(encoding);
+        result->m_etag += '"';
+    }
+    else {
+        result->m_body.clear();
+    }
+
+    cached = std::move(result);
+    return cached;
+}
+
+FileCache::FileCache(std::size_t capacity, std::chrono::milliseconds revalidateInterval)
+    : m_capacity{ capacity }
+    , m_revalidateInterval{ revalidateInterval }
+    , m_lastRevalidation{ std::chrono::steady_clock::now() } {
+
+}
+
+FileCache::FilePtr FileCache::open(std::string_view root, std::string_view relativePath) {
+    m_pathBuffer.assign(root);
+    m_pathBuffer.append(relativePath);
+
+    if (auto it = m_entries.find(m_pathBuffer); it != m_entries.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.m_lruIt);
+        return it->second.m_file;
+    }
+
+    const int fd = ::open(m_pathBuffer.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    auto file = std::make_shared<const CachedFile>(fd, fileStat);
+
+    if (m_capacity == 0) {
+        return file;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+        evict();
+    }
+
+    m_lru.push_front(m_pathBuffer);
+    m_entries.emplace(m_pathBuffer, Entry{ file, m_lru.begin() });
+
+    return file;
+}
+
+void FileCache::onTimer(std::chrono::steady_clock::time_point now) {
+    if (now - m_lastRevalidation < m_revalidateInterval) {
+        return;
+    }
+
+    m_lastRevalidation = now;
+
+    revalidate();
+}
+
+void FileCache::revalidate() {
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        struct stat fileStat;
+
+        if (stat(it->first.c_str(), &fileStat) == 0 && sameFile(fileStat, it->second.m_file->m_stat)) {
+            ++it;
+            continue;
+        }
+
+        m_lru.erase(it->second.m_lruIt);
+        it = m_entries.erase(it);
+    }
+}
+
+std::chrono::milliseconds FileCache::revalidateInterval() const {
+    return m_revalidateInterval;
+}
+
+bool FileCache::enabled() const {
+    return m_capacity != 0;
+}
+
+void FileCache::evict() {
+    m_entries.erase(m_lru.back());
+    m_lru.pop_back();
+}
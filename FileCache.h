@@ -0,0 +1,86 @@
+#ifndef _FILE_CACHE_H_
+#define _FILE_CACHE_H_
+
+#include "Compression.h"
+
+#include <list>
+#include <array>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+struct CachedFile {
+    struct Compressed {
+        std::string m_body;     // Empty if the file doesn't get smaller
+        std::string m_etag;     // The representation differs, so does its entity tag
+    };
+
+    static constexpr std::size_t MAX_COMPRESSED_SIZE = 1024 * 1024;
+
+    CachedFile(int fd, const struct stat &fileStat);
+    CachedFile(const CachedFile &) = delete;
+    CachedFile &operator=(const CachedFile &) = delete;
+    ~CachedFile();
+
+    int m_fd;
+    struct stat m_stat;
+
+    // Preformatted validators
+    std::string m_etag;
+    std::string m_lastModified;
+
+    // The whole file compressed with the best level on the first request that accepts the encoding.
+    // Only the worker that owns the cache calls it. Returns nullptr if the file is larger than
+    // MAX_COMPRESSED_SIZE or can't be read.
+    std::shared_ptr<const Compressed> compressed(CONTENT_ENCODING encoding, Compressor &compressor) const;
+
+private:
+    mutable std::array<std::shared_ptr<const Compressed>, static_cast<std::size_t>(CONTENT_ENCODING::COUNT)> m_compressed;
+};
+
+// Per-worker cache of open file descriptors and their stat() results. The entries are shared
+// with the output queues, so an evicted file stays open until its last response is sent.
+// revalidate() re-stats the cached paths and drops the files that changed on disk.
+class FileCache {
+public:
+    using FilePtr = std::shared_ptr<const CachedFile>;
+
+    explicit FileCache(std::size_t capacity = 1024, std::chrono::milliseconds revalidateInterval = std::chrono::seconds(1));
+
+    // Returns nullptr if the path isn't a regular file that can be opened
+    FilePtr open(std::string_view root, std::string_view relativePath);
+
+    // Revalidates the entries if the interval has elapsed
+    void onTimer(std::chrono::steady_clock::time_point now);
+    void revalidate();
+
+    std::chrono::milliseconds revalidateInterval() const;
+
+    // With a capacity of 0 every request opens the file again
+    bool enabled() const;
+
+private:
+    struct Entry {
+        FilePtr m_file;
+        std::list<std::string>::iterator m_lruIt;
+    };
+
+    void evict();
+
+private:
+    std::size_t m_capacity;
+    std::chrono::milliseconds m_revalidateInterval;
+    std::chrono::steady_clock::time_point m_lastRevalidation;
+
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // Most recently used first
+
+    std::string m_pathBuffer;
+};
+
+#endif // !_FILE_CACHE_H_
@@ -0,0 +1,70 @@
+#include "HttpDate.h"
+
+#include <cstring>
+
+namespace {
+
+void writeTwoDigits(char *out, int value) {
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+}
+
+}
+
+HttpDate::HttpDate() {
+    std::memcpy(m_line.data(), PREFIX.data(), PREFIX.size());
+    m_line[m_line.size() - 2] = '\r';
+    m_line[m_line.size() - 1] = '\n';
+
+    update(std::chrono::steady_clock::now());
+}
+
+void HttpDate::onTimer(std::chrono::steady_clock::time_point now) {
+    if (now >= m_next) {
+        update(now);
+    }
+}
+
+std::string_view HttpDate::headerLine() const {
+    return { m_line.data(), m_line.size() };
+}
+
+std::size_t HttpDate::format(time_t time, char *out) {
+    static constexpr char DAYS[] = "SunMonTueWedThuFriSat";
+    static constexpr char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    struct tm date;
+    gmtime_r(&time, &date);
+
+    std::memcpy(out, DAYS + date.tm_wday * 3, 3);
+    out[3] = ',';
+    out[4] = ' ';
+    writeTwoDigits(out + 5, date.tm_mday);
+    out[7] = ' ';
+    std::memcpy(out + 8, MONTHS + date.tm_mon * 3, 3);
+    out[11] = ' ';
+
+    const int year = date.tm_year + 1900;
+    writeTwoDigits(out + 12, year / 100 % 100);
+    writeTwoDigits(out + 14, year % 100);
+    out[16] = ' ';
+
+    writeTwoDigits(out + 17, date.tm_hour);
+    out[19] = ':';
+    writeTwoDigits(out + 20, date.tm_min);
+    out[22] = ':';
+    writeTwoDigits(out + 23, date.tm_sec);
+    std::memcpy(out + 25, " GMT", 4);
+
+    return DATE_SIZE;
+}
+
+void HttpDate::update(std::chrono::steady_clock::time_point now) {
+    const auto wallClock = std::chrono::system_clock::now().time_since_epoch();
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(wallClock);
+
+    format(static_cast<time_t>(seconds.count()), m_line.data() + PREFIX.size());
+
+    // The steady clock doesn't jump, the next second starts when the rest of this one has elapsed
+    m_next = now + (std::chrono::seconds(1) - (wallClock - seconds));
+}
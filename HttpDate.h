@@ -0,0 +1,40 @@
+#ifndef _HTTP_DATE_H_
+#define _HTTP_DATE_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+
+#include <ctime>
+
+// The Date header of a worker's responses (RFC 9110, 6.6.1). It's formatted again only when the
+// wall-clock second changes, so a response copies the preformatted line instead of calling gmtime.
+class HttpDate {
+public:
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    static constexpr std::size_t DATE_SIZE = 29;
+    static constexpr std::size_t LINE_SIZE = sizeof("Date: ") - 1 + DATE_SIZE + 2;
+
+    HttpDate();
+
+    // Called on every loop iteration of the worker, reads the wall clock at most once per second
+    void onTimer(std::chrono::steady_clock::time_point now);
+
+    // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+    std::string_view headerLine() const;
+
+    // Writes the IMF-fixdate of time, DATE_SIZE bytes. Returns DATE_SIZE.
+    static std::size_t format(time_t time, char *out);
+
+private:
+    void update(std::chrono::steady_clock::time_point now);
+
+private:
+    static constexpr std::string_view PREFIX = "Date: ";
+
+    std::chrono::steady_clock::time_point m_next;
+    std::array<char, LINE_SIZE> m_line;
+};
+
+#endif // !_HTTP_DATE_H_
@@ -1,27 +1,296 @@
 #include "HttpMessage.h"
 
-bool HttpHeader::hasFieldValue(std::size_t key, std::string_view value) const {
-    auto it = m_fields.find(key);
+#include <algorithm>
 
-    if (it != m_fields.end()) {
-        return it->second == value;
+namespace {
+
+constexpr std::uint32_t FNV_OFFSET_BASIS = 2166136261u;
+constexpr std::uint32_t FNV_PRIME = 16777619u;
+
+constexpr char toLowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+}
+
+constexpr std::uint32_t hashName(std::string_view name) {
+    std::uint32_t hash = FNV_OFFSET_BASIS;
+
+    for (const char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(toLowerAscii(c))) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        if (toLowerAscii(lhs[i]) != toLowerAscii(rhs[i])) {
+            return false;
+        }
     }
 
-    return false;
+    return true;
+}
+
+struct KnownHeader {
+    std::string_view m_name;
+    std::uint32_t m_hash;
+
+    constexpr KnownHeader(std::string_view name)
+        : m_name{ name }
+        , m_hash{ hashName(name) } {
+    }
+};
+
+// In the order of HTTP_HEADER
+constexpr std::array<KnownHeader, static_cast<std::size_t>(HTTP_HEADER::UNKNOWN)> KNOWN_HEADERS = {
+    KnownHeader{ "accept" },
+    KnownHeader{ "accept-encoding" },
+    KnownHeader{ "connection" },
+    KnownHeader{ "content-length" },
+    KnownHeader{ "content-type" },
+    KnownHeader{ "cookie" },
+    KnownHeader{ "expect" },
+    KnownHeader{ "host" },
+    KnownHeader{ "if-modified-since" },
+    KnownHeader{ "if-none-match" },
+    KnownHeader{ "if-range" },
+    KnownHeader{ "range" },
+    KnownHeader{ "transfer-encoding" },
+    KnownHeader{ "user-agent" }
+};
+
+}
+
+std::string_view HttpHeader::Field::name() const {
+    return { m_name, m_nameLen };
+}
+
+std::string_view HttpHeader::Field::value() const {
+    return { m_value, m_valueLen };
+}
+
+HttpHeader::HttpHeader(std::pmr::memory_resource *resource)
+    : m_spilled{ resource } {
+    m_known.fill(NO_FIELD);
+}
+
+std::optional<std::string_view> HttpHeader::getFieldValue(HTTP_HEADER header) const {
+    if (header == HTTP_HEADER::UNKNOWN) {
+        return std::nullopt;
+    }
+
+    const auto idx = m_known[static_cast<std::size_t>(header)];
+    if (idx == NO_FIELD) {
+        return std::nullopt;
+    }
+
+    return (*this)[idx].value();
+}
+
+std::optional<std::string_view> HttpHeader::getFieldValue(std::string_view field) const {
+    const auto idx = find(field);
+    if (idx == NPOS) {
+        return std::nullopt;
+    }
+
+    return (*this)[idx].value();
+}
+
+bool HttpHeader::hasFieldValue(HTTP_HEADER header, std::string_view value) const {
+    const auto fieldValue = getFieldValue(header);
+    return fieldValue && *fieldValue == value;
 }
 
 bool HttpHeader::hasFieldValue(std::string_view field, std::string_view value) const {
-    const auto key = calcKey(field);
-    return hasFieldValue(key, value);
+    const auto fieldValue = getFieldValue(field);
+    return fieldValue && *fieldValue == value;
+}
+
+std::size_t HttpHeader::find(std::string_view field, std::size_t from) const {
+    const auto hash = calcKey(field);
+
+    for (std::size_t idx = from; idx < m_size; ++idx) {
+        const Field &entry = (*this)[idx];
+
+        if (entry.m_hash == hash && equalsIgnoreCase(entry.name(), field)) {
+            return idx;
+        }
+    }
+
+    return NPOS;
+}
+
+std::size_t HttpHeader::size() const {
+    return m_size;
+}
+
+const HttpHeader::Field &HttpHeader::operator[](std::size_t idx) const {
+    return idx < INLINE_FIELDS ? m_inline[idx] : m_spilled[idx - INLINE_FIELDS];
 }
 
 void HttpHeader::insert(std::string_view field, std::string_view value) {
-    const auto key = calcKey(field);
-    m_fields[key] = value;
+    if (m_size == NO_FIELD) {
+        return;
+    }
+
+    const auto hash = calcKey(field);
+    const auto known = findKnownHeader(field, hash);
+
+    const Field entry{
+        field.data()
+        , value.data()
+        , static_cast<std::uint32_t>(field.size())
+        , static_cast<std::uint32_t>(value.size())
+        , hash
+        , known
+    };
+
+    if (m_size < INLINE_FIELDS) {
+        m_inline[m_size] = entry;
+    }
+    else {
+        m_spilled.push_back(entry);
+    }
+
+    if (known != HTTP_HEADER::UNKNOWN && m_known[static_cast<std::size_t>(known)] == NO_FIELD) {
+        m_known[static_cast<std::size_t>(known)] = m_size;
+    }
+
+    ++m_size;
+}
+
+std::uint32_t HttpHeader::calcKey(std::string_view field) {
+    return hashName(field);
+}
+
+HTTP_HEADER HttpHeader::findKnownHeader(std::string_view field, std::uint32_t hash) {
+    for (std::size_t idx = 0; idx < KNOWN_HEADERS.size(); ++idx) {
+        if (KNOWN_HEADERS[idx].m_hash == hash && equalsIgnoreCase(KNOWN_HEADERS[idx].m_name, field)) {
+            return static_cast<HTTP_HEADER>(idx);
+        }
+    }
+
+    return HTTP_HEADER::UNKNOWN;
+}
+
+QueryParams::QueryParams(std::string_view query, std::pmr::memory_resource *resource)
+    : m_params{ resource } {
+    while (!query.empty()) {
+        const auto end = std::min(query.find('&'), query.size());
+        const std::string_view pair = query.substr(0, end);
+
+        query.remove_prefix(std::min(end + 1, query.size()));
+
+        if (pair.empty()) {
+            continue;
+        }
+
+        const auto equals = pair.find('=');
+
+        Param param{ std::pmr::string{ resource }, std::pmr::string{ resource } };
+        decode(pair.substr(0, equals), param.m_name);
+
+        if (equals != std::string_view::npos) {
+            decode(pair.substr(equals + 1), param.m_value);
+        }
+
+        m_params.push_back(std::move(param));
+    }
+}
+
+std::optional<std::string_view> QueryParams::get(std::string_view name) const {
+    for (const auto &param : m_params) {
+        if (param.m_name == name) {
+            return param.m_value;
+        }
+    }
+
+    return std::nullopt;
 }
 
-std::size_t HttpHeader::calcKey(std::string_view field) {
-    return std::hash<std::string_view>{}(field);
+std::size_t QueryParams::size() const {
+    return m_params.size();
+}
+
+const QueryParams::Param &QueryParams::operator[](std::size_t idx) const {
+    return m_params[idx];
+}
+
+void QueryParams::decode(std::string_view str, std::pmr::string &decoded) {
+    decoded.reserve(str.size());
+
+    for (std::size_t i = 0; i < str.size(); ++i) {
+        const char c = str[i];
+
+        if (c == '+') {
+            decoded += ' ';
+            continue;
+        }
+
+        // Malformed escapes are kept as they are
+        if (c == '%' && i + 2 < str.size() && hexValue(str[i + 1]) != -1 && hexValue(str[i + 2]) != -1) {
+            decoded += static_cast<char>(hexValue(str[i + 1]) * 16 + hexValue(str[i + 2]));
+            i += 2;
+            continue;
+        }
+
+        decoded += c;
+    }
+}
+
+std::optional<std::string_view> RouteParams::get(std::string_view name) const {
+    for (std::size_t i = 0; i < m_size; ++i) {
+        if (m_params[i].m_name == name) {
+            return m_params[i].m_value;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::size_t RouteParams::size() const {
+    return m_size;
+}
+
+const RouteParams::Param &RouteParams::operator[](std::size_t idx) const {
+    return m_params[idx];
+}
+
+bool RouteParams::push(std::string_view name, std::string_view value) {
+    if (m_size == MAX_PARAMS) {
+        return false;
+    }
+
+    m_params[m_size++] = { name, value };
+    return true;
+}
+
+void RouteParams::truncate(std::size_t size) {
+    m_size = static_cast<std::uint8_t>(size);
+}
+
+void RouteParams::clear() {
+    m_size = 0;
 }
 
 HttpMessageBuilderBase::HttpMessageBuilderBase(HttpRequest &message)
@@ -55,7 +324,10 @@ HttpRequestLineBuilder& HttpRequestLineBuilder::setMethod(HTTP_METHOD method) {
 }
 
 HttpRequestLineBuilder& HttpRequestLineBuilder::setPath(std::string_view path) {
-    getMessage().m_line.m_path = path;
+    const auto queryPos = path.find('?');
+
+    getMessage().m_line.m_path = path.substr(0, queryPos);
+    getMessage().m_line.m_query = queryPos == std::string_view::npos ? std::string_view{} : path.substr(queryPos + 1);
     return *this;
 }
 
@@ -78,8 +350,14 @@ HttpBodyBuilder& HttpBodyBuilder::set(std::string_view value) {
     return *this;
 }
 
-HttpRequest::Builder HttpRequest::create() {
-    return {};
+HttpRequest::HttpRequest(std::pmr::memory_resource *resource)
+    : m_resource{ resource }
+    , m_header{ resource } {
+
+}
+
+HttpRequest::Builder HttpRequest::create(std::pmr::memory_resource *resource) {
+    return Builder{ resource };
 }
 
 const HttpRequestLine& HttpRequest::line() const {
@@ -93,3 +371,19 @@ const HttpHeader& HttpRequest::headers() const {
 const HttpBody& HttpRequest::body() const {
     return m_body;
 }
+
+const RouteParams& HttpRequest::params() const {
+    return m_params;
+}
+
+RouteParams& HttpRequest::params() {
+    return m_params;
+}
+
+QueryParams HttpRequest::queryParams() const {
+    return { m_line.m_query, m_resource };
+}
+
+std::pmr::memory_resource *HttpRequest::resource() const {
+    return m_resource;
+}
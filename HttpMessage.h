@@ -1,15 +1,63 @@
 #ifndef _HTTP_MESSAGE_H_
 #define _HTTP_MESSAGE_H_
 
+#include <array>
+#include <string>
 #include <vector>
+#include <cstdint>
+#include <optional>
 #include <string_view>
-#include <unordered_map>
+#include <memory_resource>
 
+// The status codes of RFC 9110, the last value is the number of codes
 enum class HTTP_RESPONSE_CODE {
+    _100,
+    _101,
     _200,
+    _201,
+    _202,
+    _203,
+    _204,
+    _205,
+    _206,
+    _300,
+    _301,
+    _302,
+    _303,
+    _304,
+    _307,
+    _308,
     _400,
+    _401,
+    _402,
+    _403,
     _404,
-    _500
+    _405,
+    _406,
+    _407,
+    _408,
+    _409,
+    _410,
+    _411,
+    _412,
+    _413,
+    _414,
+    _415,
+    _416,
+    _417,
+    _421,
+    _422,
+    _426,
+    _428,
+    _429,
+    _431,
+    _500,
+    _501,
+    _502,
+    _503,
+    _504,
+    _505,
+    COUNT
 };
 
 enum class HTTP_METHOD {
@@ -31,29 +79,137 @@ enum class HTTP_VERSION {
     INVALID_VERSION
 };
 
+// Header fields the server looks at. They are recognized once when the request is built,
+// so looking them up doesn't compare or hash names.
+enum class HTTP_HEADER : std::uint8_t {
+    ACCEPT,
+    ACCEPT_ENCODING,
+    CONNECTION,
+    CONTENT_LENGTH,
+    CONTENT_TYPE,
+    COOKIE,
+    EXPECT,
+    HOST,
+    IF_MODIFIED_SINCE,
+    IF_NONE_MATCH,
+    IF_RANGE,
+    RANGE,
+    TRANSFER_ENCODING,
+    USER_AGENT,
+    UNKNOWN
+};
+
 struct HttpRequestLine {
-    HTTP_METHOD m_method;
-    HTTP_VERSION m_httpVersion;
-    std::string_view m_path;
+    HTTP_METHOD m_method{ HTTP_METHOD::INVALID_METHOD };
+    HTTP_VERSION m_httpVersion{ HTTP_VERSION::INVALID_VERSION };
+    std::string_view m_path;  // Without the query
+    std::string_view m_query; // After the '?'
 };
 
-struct HttpHeader {
-    using HeaderFields_t = std::unordered_map<std::size_t, std::string_view>; // (field hash -> value)
+// The fields in the order they were received, repeated ones included. The first INLINE_FIELDS are
+// stored in the object itself and only unusually large requests spill into a vector, which is
+// allocated from the request's memory resource.
+// Names are case-insensitive. Their hashes are computed once on insertion.
+class HttpHeader {
+public:
+    static constexpr std::size_t INLINE_FIELDS = 24;
+    static constexpr std::size_t NPOS = SIZE_MAX;
+
+    struct Field {
+        const char *m_name;
+        const char *m_value;
+        std::uint32_t m_nameLen;
+        std::uint32_t m_valueLen;
+        std::uint32_t m_hash; // calcKey(name)
+        HTTP_HEADER m_known;
+
+        std::string_view name() const;
+        std::string_view value() const;
+    };
 
-    bool hasFieldValue(std::size_t key, std::string_view value) const;
+    explicit HttpHeader(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    // The value of the first field with the name
+    std::optional<std::string_view> getFieldValue(HTTP_HEADER header) const;
+    std::optional<std::string_view> getFieldValue(std::string_view field) const;
+    bool hasFieldValue(HTTP_HEADER header, std::string_view value) const;
     bool hasFieldValue(std::string_view field, std::string_view value) const;
+
+    // The index of the first field with the name at or after from, or NPOS. Walks the repeated fields.
+    std::size_t find(std::string_view field, std::size_t from = 0) const;
+
+    std::size_t size() const;
+    const Field &operator[](std::size_t idx) const;
+
     void insert(std::string_view field, std::string_view value);
 
-    static std::size_t calcKey(std::string_view field);
+    // Case-insensitive FNV-1a
+    static std::uint32_t calcKey(std::string_view field);
 
 private:
-    HeaderFields_t m_fields;
+    static constexpr std::uint16_t NO_FIELD = UINT16_MAX;
+    static constexpr std::size_t KNOWN_HEADERS_NUM = static_cast<std::size_t>(HTTP_HEADER::UNKNOWN);
+
+    static HTTP_HEADER findKnownHeader(std::string_view field, std::uint32_t hash);
+
+private:
+    std::array<Field, INLINE_FIELDS> m_inline;
+    std::pmr::vector<Field> m_spilled;
+    std::array<std::uint16_t, KNOWN_HEADERS_NUM> m_known; // The index of the first occurrence
+    std::uint16_t m_size{ 0 };
 };
 
 struct HttpBody {
     std::string_view m_data;
 };
 
+// The parameters captured by the router. Names point into the route table and values into the request.
+class RouteParams {
+public:
+    static constexpr std::size_t MAX_PARAMS = 8;
+
+    struct Param {
+        std::string_view m_name;
+        std::string_view m_value;
+    };
+
+    std::optional<std::string_view> get(std::string_view name) const;
+
+    std::size_t size() const;
+    const Param &operator[](std::size_t idx) const;
+
+    bool push(std::string_view name, std::string_view value);
+    void truncate(std::size_t size);
+    void clear();
+
+private:
+    std::array<Param, MAX_PARAMS> m_params;
+    std::uint8_t m_size{ 0 };
+};
+
+// The percent-decoded name=value pairs of a query string, allocated from the given memory resource
+class QueryParams {
+public:
+    struct Param {
+        std::pmr::string m_name;
+        std::pmr::string m_value;
+    };
+
+    QueryParams(std::string_view query, std::pmr::memory_resource *resource);
+
+    // The value of the first parameter with the name
+    std::optional<std::string_view> get(std::string_view name) const;
+
+    std::size_t size() const;
+    const Param &operator[](std::size_t idx) const;
+
+private:
+    static void decode(std::string_view str, std::pmr::string &decoded);
+
+private:
+    std::pmr::vector<Param> m_params;
+};
+
 class HttpRequest;
 class HttpRequestLineBuilder;
 class HttpHeaderBuilder;
@@ -99,7 +255,9 @@ public:
 template <typename Message>
 class HttpMessageBuilder : public HttpMessageBuilderBase {
 public:
-    HttpMessageBuilder() : HttpMessageBuilderBase{ m_message } {}
+    explicit HttpMessageBuilder(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : HttpMessageBuilderBase{ m_message }
+        , m_message{ resource } {}
     HttpMessageBuilder(const HttpMessageBuilder&) = delete;
     HttpMessageBuilder& operator=(const HttpMessageBuilder&) = delete;
 
@@ -117,21 +275,33 @@ public:
     using Builder = HttpMessageBuilder<HttpRequest>;
 
     HttpRequest() = default;
+    explicit HttpRequest(std::pmr::memory_resource *resource);
     HttpRequest(const HttpRequest &) = delete;
     HttpRequest& operator=(const HttpRequest&) = delete;
     HttpRequest(HttpRequest&&) = default;
     HttpRequest& operator=(HttpRequest&&) = default;
 
-    static Builder create();
+    // The request's dynamic storage (spilled header fields, query parameters) comes from the resource
+    static Builder create(std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
     const HttpRequestLine &line() const;
     const HttpHeader &headers() const;
     const HttpBody &body() const;
 
+    const RouteParams &params() const;
+    RouteParams &params();
+
+    // Parses the query string on every call
+    QueryParams queryParams() const;
+
+    std::pmr::memory_resource *resource() const;
+
 private:
+    std::pmr::memory_resource *m_resource{ std::pmr::get_default_resource() };
     HttpRequestLine m_line;
     HttpHeader m_header;
     HttpBody m_body;
+    RouteParams m_params;
 };
 
 #endif // !_HTTP_MESSAGE_H_
@@ -0,0 +1,630 @@
+#include "HttpParser.h"
+#include "CharScanner.h"
+
+#include <array>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+// The header values aren't normalized
+bool equalsIgnoreCase(std::string_view value, std::string_view lowercase) {
+    if (value.size() != lowercase.size()) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < value.size(); ++i) {
+        const char c = value[i] >= 'A' && value[i] <= 'Z' ? value[i] - 'A' + 'a' : value[i];
+
+        if (c != lowercase[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+}
+
+HttpParser::RESULT HttpParser::parse(char *data, std::size_t len, const ParserLimits &limits) {
+    while (m_state == STATE::REQUEST_LINE || m_state == STATE::HEADERS) {
+        const bool requestLine = m_state == STATE::REQUEST_LINE;
+        const std::size_t lineLimit = requestLine ? limits.m_maxRequestLine : limits.m_maxHeaderLine;
+
+        const char *newLine = static_cast<const char *>(std::memchr(data + m_scanned, '\n', len - m_scanned));
+
+        if (!newLine) {
+            m_scanned = static_cast<std::uint32_t>(len);
+
+            if (len - m_lineBegin > lineLimit) {
+                return fail(requestLine ? RESULT::REQUEST_LINE_TOO_LONG : RESULT::HEADERS_TOO_LARGE);
+            }
+
+            // The empty lines before the request line count too
+            if (len > limits.m_maxHeaderBytes) {
+                return fail(RESULT::HEADERS_TOO_LARGE);
+            }
+
+            return RESULT::INCOMPLETE;
+        }
+
+        const std::size_t lineEnd = newLine - data;
+        std::size_t contentEnd = lineEnd;
+
+        if (contentEnd > m_lineBegin && data[contentEnd - 1] == '\r') {
+            --contentEnd;
+        }
+
+        m_scanned = static_cast<std::uint32_t>(lineEnd + 1);
+
+        if (contentEnd - m_lineBegin > lineLimit) {
+            return fail(requestLine ? RESULT::REQUEST_LINE_TOO_LONG : RESULT::HEADERS_TOO_LARGE);
+        }
+
+        if (m_scanned > limits.m_maxHeaderBytes) {
+            return fail(RESULT::HEADERS_TOO_LARGE);
+        }
+
+        if (requestLine) {
+            // Empty lines before the request line are ignored (RFC 9112, 2.2)
+            if (contentEnd != m_lineBegin) {
+                if (const RESULT result = parseRequestLine(data, m_lineBegin, contentEnd); result != RESULT::COMPLETE) {
+                    return fail(result);
+                }
+
+                m_state = STATE::HEADERS;
+            }
+        }
+        else {
+            if (contentEnd == m_lineBegin) {
+                m_headersEnd = m_scanned;
+                m_lineBegin = m_scanned;
+
+                if (const RESULT result = finishHeaders(data); result != RESULT::COMPLETE) {
+                    return fail(result);
+                }
+
+                if (!m_hasBody) {
+                    m_state = STATE::COMPLETE;
+                    return RESULT::COMPLETE;
+                }
+
+                m_state = m_chunked ? STATE::CHUNK_SIZE : STATE::BODY;
+                return RESULT::BODY_FOLLOWS;
+            }
+            else if (const RESULT result = parseHeaderLine(data, m_lineBegin, contentEnd, limits); result != RESULT::COMPLETE) {
+                return fail(result);
+            }
+        }
+
+        m_lineBegin = m_scanned;
+    }
+
+    switch (m_state) {
+    case STATE::COMPLETE:
+        return RESULT::COMPLETE;
+    case STATE::ERROR:
+        return m_error;
+    default:
+        break;
+    }
+
+    // The body is collected right after the headers, a chunked one without its framing
+    while (true) {
+        std::size_t pieceBegin = 0;
+        std::size_t pieceLen = 0;
+
+        const RESULT result = decodeBody(data, len, limits, pieceBegin, pieceLen);
+
+        if (pieceLen != 0) {
+            const std::size_t bodyEnd = static_cast<std::size_t>(m_headersEnd) + m_bodyLength;
+
+            if (pieceBegin != bodyEnd) {
+                std::memmove(data + bodyEnd, data + pieceBegin, pieceLen);
+            }
+
+            m_bodyLength += static_cast<std::uint32_t>(pieceLen);
+        }
+
+        if (result == RESULT::COMPLETE) {
+            return result;
+        }
+
+        if (result != RESULT::INCOMPLETE) {
+            return fail(result);
+        }
+
+        if (pieceLen == 0) {
+            return RESULT::INCOMPLETE;
+        }
+    }
+}
+
+void HttpParser::streamBody() {
+    m_streamed = true;
+    m_scanned = 0;
+}
+
+HttpParser::RESULT HttpParser::parseBody(char *data, std::size_t len, const ParserLimits &limits, std::string_view &piece, std::size_t &used) {
+    piece = {};
+    used = 0;
+
+    switch (m_state) {
+    case STATE::COMPLETE:
+        return RESULT::COMPLETE;
+    case STATE::ERROR:
+        return m_error;
+    default:
+        break;
+    }
+
+    // The caller drops the bytes that have been decoded
+    m_scanned = 0;
+
+    std::size_t pieceBegin = 0;
+    std::size_t pieceLen = 0;
+
+    const RESULT result = decodeBody(data, len, limits, pieceBegin, pieceLen);
+
+    piece = { data + pieceBegin, pieceLen };
+    used = m_scanned;
+
+    if (result != RESULT::INCOMPLETE && result != RESULT::COMPLETE) {
+        return fail(result);
+    }
+
+    return result;
+}
+
+HttpRequest HttpParser::request(const char *data, std::pmr::memory_resource *resource) const {
+    auto builder = HttpRequest::create(resource);
+
+    // The request line and the headers are complete
+    if (m_state == STATE::REQUEST_LINE || m_state == STATE::HEADERS || m_state == STATE::ERROR) {
+        return builder;
+    }
+
+    builder.line()
+        .setMethod(m_method)
+        .setPath({ data + m_pathBegin, m_pathLen })
+        .setHttpVersion(m_version);
+
+    auto headers = builder.header();
+
+    for (const auto &header : m_headers) {
+        headers.add({ data + header.m_nameBegin, header.m_nameLen }, { data + header.m_valueBegin, header.m_valueLen });
+    }
+
+    if (m_state == STATE::COMPLETE && m_bodyLength) {
+        builder.body().set({ data + m_headersEnd, m_bodyLength });
+    }
+
+    return builder;
+}
+
+std::size_t HttpParser::requestSize() const {
+    return m_scanned;
+}
+
+bool HttpParser::expectsContinue() const {
+    return m_expectContinue;
+}
+
+void HttpParser::reset() {
+    m_state = STATE::REQUEST_LINE;
+    m_error = RESULT::INVALID;
+    m_method = HTTP_METHOD::INVALID_METHOD;
+    m_version = HTTP_VERSION::INVALID_VERSION;
+    m_lineBegin = 0;
+    m_scanned = 0;
+    m_pathBegin = 0;
+    m_pathLen = 0;
+    m_headersEnd = 0;
+    m_bodyLength = 0;
+    m_trailerBytes = 0;
+    m_remaining = 0;
+    m_received = 0;
+    m_hasBody = false;
+    m_chunked = false;
+    m_streamed = false;
+    m_expectContinue = false;
+    m_headers.clear();
+}
+
+HTTP_RESPONSE_CODE HttpParser::errorCode(RESULT result) {
+    switch (result) {
+    case RESULT::REQUEST_LINE_TOO_LONG:
+        return HTTP_RESPONSE_CODE::_414;
+    case RESULT::HEADERS_TOO_LARGE:
+        return HTTP_RESPONSE_CODE::_431;
+    case RESULT::BODY_TOO_LARGE:
+        return HTTP_RESPONSE_CODE::_413;
+    default:
+        return HTTP_RESPONSE_CODE::_400;
+    }
+}
+
+HttpParser::RESULT HttpParser::parseRequestLine(char *data, std::size_t begin, std::size_t end) {
+    std::size_t read = begin;
+
+    skipSpaces(read, data, end);
+
+    const auto methodBegin = read;
+
+    read += CharScanner::findFirstOf(data + read, end - read, " ");
+    CharScanner::toUpper(data + methodBegin, read - methodBegin);
+
+    m_method = findHttpMethod({ data + methodBegin, read - methodBegin });
+
+    skipSpaces(read, data, end);
+
+    const auto pathBegin = read;
+
+    read += CharScanner::findFirstOf(data + read, end - read, " ");
+
+    m_pathBegin = static_cast<std::uint32_t>(pathBegin);
+    m_pathLen = static_cast<std::uint32_t>(read - pathBegin);
+
+    skipSpaces(read, data, end);
+
+    const auto versionBegin = read;
+
+    read += CharScanner::findFirstOf(data + read, end - read, " ");
+
+    m_version = findHttpVersion({ data + versionBegin, read - versionBegin });
+
+    return RESULT::COMPLETE;
+}
+
+HttpParser::RESULT HttpParser::parseHeaderLine(char *data, std::size_t begin, std::size_t end, const ParserLimits &limits) {
+    if (m_headers.size() >= limits.m_maxHeaders) {
+        return RESULT::HEADERS_TOO_LARGE;
+    }
+
+    // An obs-fold continuation line would be a separate field here and the value of the previous one
+    // to a proxy that unfolds it (RFC 9112, 5.2)
+    if (data[begin] == ' ' || data[begin] == '\t') {
+        return RESULT::INVALID;
+    }
+
+    std::size_t read = begin;
+
+    const auto fieldBegin = read;
+
+    read += CharScanner::toLowerUntil(data + read, end - read, ": ");
+
+    if (read == fieldBegin || read >= end || data[read] != ':') {
+        return RESULT::INVALID;
+    }
+
+    const auto fieldEnd = read;
+
+    ++read;
+    while (read < end && (data[read] == ' ' || data[read] == '\t')) {
+        ++read;
+    }
+
+    std::size_t valueEnd = end;
+    while (valueEnd > read && (data[valueEnd - 1] == ' ' || data[valueEnd - 1] == '\t')) {
+        --valueEnd;
+    }
+
+    m_headers.push_back({
+        static_cast<std::uint32_t>(fieldBegin)
+        , static_cast<std::uint32_t>(fieldEnd - fieldBegin)
+        , static_cast<std::uint32_t>(read)
+        , static_cast<std::uint32_t>(valueEnd - read)
+    });
+
+    return RESULT::COMPLETE;
+}
+
+HttpParser::RESULT HttpParser::finishHeaders(const char *data) {
+    using namespace std::string_view_literals;
+
+    bool hasLength = false;
+    bool hasTransferEncoding = false;
+    std::uint64_t bodyLength = 0;
+
+    for (const auto &header : m_headers) {
+        const std::string_view field{ data + header.m_nameBegin, header.m_nameLen };
+        const std::string_view value{ data + header.m_valueBegin, header.m_valueLen };
+
+        if (field == "transfer-encoding"sv) {
+            // Only "chunked" alone is supported, any other coding can't be framed
+            if (hasTransferEncoding || m_version != HTTP_VERSION::HTTP_11 || !equalsIgnoreCase(value, "chunked"sv)) {
+                return RESULT::INVALID;
+            }
+
+            hasTransferEncoding = true;
+            continue;
+        }
+
+        if (field == "expect"sv) {
+            m_expectContinue = m_version == HTTP_VERSION::HTTP_11 && equalsIgnoreCase(value, "100-continue"sv);
+            continue;
+        }
+
+        if (field != "content-length"sv) {
+            continue;
+        }
+
+        // More digits could overflow, the limits are much lower anyway
+        constexpr std::size_t MAX_LENGTH_DIGITS = 18;
+
+        if (value.empty()) {
+            return RESULT::INVALID;
+        }
+
+        if (value.size() > MAX_LENGTH_DIGITS) {
+            return RESULT::BODY_TOO_LARGE;
+        }
+
+        std::uint64_t length = 0;
+        for (const char c : value) {
+            if (c < '0' || c > '9') {
+                return RESULT::INVALID;
+            }
+
+            length = length * 10 + (c - '0');
+        }
+
+        if (hasLength && length != bodyLength) {
+            return RESULT::INVALID;
+        }
+
+        hasLength = true;
+        bodyLength = length;
+    }
+
+    // Both would let a proxy and the server disagree on where the request ends
+    if (hasLength && hasTransferEncoding) {
+        return RESULT::INVALID;
+    }
+
+    m_chunked = hasTransferEncoding;
+    m_hasBody = m_chunked || bodyLength != 0;
+    m_remaining = bodyLength;
+
+    return RESULT::COMPLETE;
+}
+
+HttpParser::RESULT HttpParser::decodeBody(const char *data, std::size_t len, const ParserLimits &limits, std::size_t &pieceBegin, std::size_t &pieceLen) {
+    pieceBegin = m_scanned;
+    pieceLen = 0;
+
+    while (true) {
+        switch (m_state) {
+        case STATE::BODY:
+        case STATE::CHUNK_DATA: {
+            if (m_state == STATE::BODY && m_received + m_remaining > bodyLimit(limits)) {
+                return RESULT::BODY_TOO_LARGE;
+            }
+
+            const std::size_t available = len - m_scanned;
+            if (available == 0) {
+                return RESULT::INCOMPLETE;
+            }
+
+            const std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(available, m_remaining));
+
+            pieceBegin = m_scanned;
+            pieceLen = take;
+
+            m_scanned += static_cast<std::uint32_t>(take);
+            m_remaining -= take;
+            m_received += take;
+
+            if (m_remaining != 0) {
+                return RESULT::INCOMPLETE;
+            }
+
+            if (m_state == STATE::BODY) {
+                m_state = STATE::COMPLETE;
+                return RESULT::COMPLETE;
+            }
+
+            m_state = STATE::CHUNK_END;
+            return RESULT::INCOMPLETE;
+        }
+        case STATE::CHUNK_SIZE: {
+            // A collected body can't grow by more than the header limit because of its framing
+            if (!m_streamed && m_scanned - m_headersEnd - m_received > limits.m_maxHeaderBytes) {
+                return RESULT::BODY_TOO_LARGE;
+            }
+
+            const char *newLine = static_cast<const char *>(std::memchr(data + m_scanned, '\n', len - m_scanned));
+
+            if (!newLine) {
+                return len - m_scanned > limits.m_maxHeaderLine ? RESULT::INVALID : RESULT::INCOMPLETE;
+            }
+
+            const std::size_t lineEnd = newLine - data;
+            std::size_t contentEnd = lineEnd;
+
+            if (contentEnd > m_scanned && data[contentEnd - 1] == '\r') {
+                --contentEnd;
+            }
+
+            if (const RESULT result = parseChunkSize(data, m_scanned, contentEnd, limits); result != RESULT::COMPLETE) {
+                return result;
+            }
+
+            m_scanned = static_cast<std::uint32_t>(lineEnd + 1);
+            break;
+        }
+        case STATE::CHUNK_END: {
+            const std::size_t available = len - m_scanned;
+            if (available == 0) {
+                return RESULT::INCOMPLETE;
+            }
+
+            if (data[m_scanned] == '\r') {
+                if (available < 2) {
+                    return RESULT::INCOMPLETE;
+                }
+
+                if (data[m_scanned + 1] != '\n') {
+                    return RESULT::INVALID;
+                }
+
+                m_scanned += 2;
+            }
+            else if (data[m_scanned] == '\n') {
+                ++m_scanned;
+            }
+            else {
+                return RESULT::INVALID;
+            }
+
+            m_state = STATE::CHUNK_SIZE;
+            break;
+        }
+        case STATE::TRAILERS: {
+            // The trailer fields are ignored
+            const char *newLine = static_cast<const char *>(std::memchr(data + m_scanned, '\n', len - m_scanned));
+
+            if (!newLine) {
+                return len - m_scanned > limits.m_maxHeaderLine ? RESULT::HEADERS_TOO_LARGE : RESULT::INCOMPLETE;
+            }
+
+            const std::size_t lineEnd = newLine - data;
+            const bool empty = lineEnd == m_scanned || (lineEnd == m_scanned + 1 && data[m_scanned] == '\r');
+
+            m_trailerBytes += static_cast<std::uint32_t>(lineEnd + 1 - m_scanned);
+            m_scanned = static_cast<std::uint32_t>(lineEnd + 1);
+
+            if (m_trailerBytes > limits.m_maxHeaderBytes) {
+                return RESULT::HEADERS_TOO_LARGE;
+            }
+
+            if (empty) {
+                m_state = STATE::COMPLETE;
+                return RESULT::COMPLETE;
+            }
+
+            break;
+        }
+        case STATE::COMPLETE:
+            return RESULT::COMPLETE;
+        default:
+            return RESULT::INVALID;
+        }
+    }
+}
+
+HttpParser::RESULT HttpParser::parseChunkSize(const char *data, std::size_t begin, std::size_t end, const ParserLimits &limits) {
+    // 15 hex digits can't overflow the sum with the received bytes
+    constexpr std::size_t MAX_SIZE_DIGITS = 15;
+
+    std::size_t idx = begin;
+    std::uint64_t size = 0;
+
+    for (; idx < end; ++idx) {
+        const int digit = hexDigit(data[idx]);
+        if (digit < 0) {
+            break;
+        }
+
+        if (idx - begin == MAX_SIZE_DIGITS) {
+            return RESULT::BODY_TOO_LARGE;
+        }
+
+        size = size * 16 + static_cast<std::uint64_t>(digit);
+    }
+
+    if (idx == begin) {
+        return RESULT::INVALID;
+    }
+
+    while (idx < end && (data[idx] == ' ' || data[idx] == '\t')) {
+        ++idx;
+    }
+
+    // The chunk extensions are ignored
+    if (idx < end && data[idx] != ';') {
+        return RESULT::INVALID;
+    }
+
+    if (m_received + size > bodyLimit(limits)) {
+        return RESULT::BODY_TOO_LARGE;
+    }
+
+    m_remaining = size;
+    m_state = size != 0 ? STATE::CHUNK_DATA : STATE::TRAILERS;
+
+    return RESULT::COMPLETE;
+}
+
+std::uint64_t HttpParser::bodyLimit(const ParserLimits &limits) const {
+    return m_streamed ? static_cast<std::uint64_t>(limits.m_maxUploadMb) << 20 : limits.m_maxBodySize;
+}
+
+HttpParser::RESULT HttpParser::fail(RESULT result) {
+    m_state = STATE::ERROR;
+    m_error = result;
+
+    return result;
+}
+
+void HttpParser::skipSpaces(std::size_t &idx, const char *str, const std::size_t len) {
+    while (idx < len && str[idx] == ' ') {
+        ++idx;
+    }
+}
+
+HTTP_METHOD HttpParser::findHttpMethod(std::string_view method) {
+    using namespace std::string_view_literals;
+
+    static constexpr std::array methodMap = {
+        std::make_pair("GET"sv, HTTP_METHOD::GET),
+        std::make_pair("HEAD"sv, HTTP_METHOD::HEAD),
+        std::make_pair("POST"sv, HTTP_METHOD::POST),
+        std::make_pair("PUT"sv, HTTP_METHOD::PUT),
+        std::make_pair("DELETE"sv, HTTP_METHOD::DELETE),
+        std::make_pair("CONNECT"sv, HTTP_METHOD::CONNECT),
+        std::make_pair("OPTIONS"sv, HTTP_METHOD::OPTIONS),
+        std::make_pair("TRACE"sv, HTTP_METHOD::TRACE),
+        std::make_pair("PATCH"sv, HTTP_METHOD::PATCH)
+    };
+
+    auto it = std::find_if(methodMap.begin(), methodMap.end(), [method](const auto &pair) { return method == pair.first; });
+    if (it == methodMap.end()) {
+        return HTTP_METHOD::INVALID_METHOD;
+    }
+
+    return it->second;
+}
+
+HTTP_VERSION HttpParser::findHttpVersion(std::string_view version) {
+    using namespace std::string_view_literals;
+
+    static constexpr std::array versionMap = {
+        std::make_pair("HTTP/1.0"sv, HTTP_VERSION::HTTP_10),
+        std::make_pair("HTTP/1.1"sv, HTTP_VERSION::HTTP_11)
+    };
+
+    auto it = std::find_if(versionMap.begin(), versionMap.end(), [version](const auto &pair) { return version == pair.first; });
+
+    if (it == versionMap.end()) {
+        return HTTP_VERSION::INVALID_VERSION;
+    }
+
+    return it->second;
+}
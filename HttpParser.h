@@ -0,0 +1,130 @@
+#ifndef _HTTP_PARSER_H_
+#define _HTTP_PARSER_H_
+
+#include "HttpMessage.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+struct ParserLimits {
+    std::uint32_t m_maxRequestLine{ 8 * 1024 };
+    std::uint32_t m_maxHeaderLine{ 8 * 1024 };
+    std::uint32_t m_maxHeaders{ 100 };
+    std::uint32_t m_maxHeaderBytes{ 64 * 1024 }; // request line + headers
+    std::uint32_t m_maxBodySize{ 1024 * 1024 };     // A body collected in the buffer
+    std::uint32_t m_maxUploadMb{ 1024 };            // A body streamed to an upload handler
+};
+
+// Resumable request parser. The caller keeps the bytes of the current request in one contiguous
+// buffer (which may be reallocated between the calls) and calls parse() every time new bytes arrive.
+// Only offsets are kept between the calls, so the parser doesn't care if the buffer has moved.
+//
+// The body is framed by Content-Length or by the chunked transfer coding. When the headers of a
+// request with a body are complete, parse() stops once with BODY_FOLLOWS and the caller picks how the
+// body is received: the next parse() calls collect it in the buffer (a chunked body is decoded in
+// place), or after streamBody() parseBody() hands it out piece by piece and nothing is kept.
+class HttpParser {
+public:
+    enum class RESULT {
+        INCOMPLETE,
+        COMPLETE,
+        BODY_FOLLOWS,
+        INVALID,
+        REQUEST_LINE_TOO_LONG,
+        HEADERS_TOO_LARGE,
+        BODY_TOO_LARGE
+    };
+
+    // data points to the beginning of the request and len is the number of bytes received so far.
+    // Header names and the method are normalized in place.
+    RESULT parse(char *data, std::size_t len, const ParserLimits &limits);
+
+    // After BODY_FOLLOWS the caller has dropped the request line and the headers, and the body is
+    // decoded from the beginning of the bytes passed to parseBody().
+    void streamBody();
+
+    // Decodes the next piece of a streamed body from [data, data + len). piece is empty when more
+    // bytes are needed, used is the number of bytes that can be dropped. Returns INCOMPLETE until
+    // the last piece, COMPLETE after it, or the error.
+    RESULT parseBody(char *data, std::size_t len, const ParserLimits &limits, std::string_view &piece, std::size_t &used);
+
+    // Builds the parsed request, without the body until it's complete. The views point into data,
+    // which must be the buffer passed to parse().
+    HttpRequest request(const char *data, std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+    // The size of the complete request (including the body), or of the request line and the headers
+    // after BODY_FOLLOWS
+    std::size_t requestSize() const;
+
+    // "Expect: 100-continue" in an HTTP/1.1 request
+    bool expectsContinue() const;
+
+    void reset();
+
+    static HTTP_RESPONSE_CODE errorCode(RESULT result);
+
+private:
+    enum class STATE : std::uint8_t {
+        REQUEST_LINE,
+        HEADERS,
+        BODY,           // Content-Length
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,      // The CRLF after the data
+        TRAILERS,
+        COMPLETE,
+        ERROR
+    };
+
+    struct HeaderSpan {
+        std::uint32_t m_nameBegin;
+        std::uint32_t m_nameLen;
+        std::uint32_t m_valueBegin;
+        std::uint32_t m_valueLen;
+    };
+
+    RESULT parseRequestLine(char *data, std::size_t begin, std::size_t end);
+    RESULT parseHeaderLine(char *data, std::size_t begin, std::size_t end, const ParserLimits &limits);
+    RESULT finishHeaders(const char *data);
+
+    // Walks the framing from m_scanned up to the next bytes of the body, [pieceBegin, pieceBegin + pieceLen).
+    // Returns INCOMPLETE with an empty piece when more bytes are needed.
+    RESULT decodeBody(const char *data, std::size_t len, const ParserLimits &limits, std::size_t &pieceBegin, std::size_t &pieceLen);
+    RESULT parseChunkSize(const char *data, std::size_t begin, std::size_t end, const ParserLimits &limits);
+    std::uint64_t bodyLimit(const ParserLimits &limits) const;
+    RESULT fail(RESULT result);
+
+    static void skipSpaces(std::size_t &idx, const char *str, const std::size_t len);
+
+    static HTTP_METHOD findHttpMethod(std::string_view method);
+    static HTTP_VERSION findHttpVersion(std::string_view version);
+
+private:
+    STATE m_state{ STATE::REQUEST_LINE };
+    RESULT m_error{ RESULT::INVALID };
+
+    HTTP_METHOD m_method{ HTTP_METHOD::INVALID_METHOD };
+    HTTP_VERSION m_version{ HTTP_VERSION::INVALID_VERSION };
+
+    std::uint32_t m_lineBegin{ 0 };
+    std::uint32_t m_scanned{ 0 };
+    std::uint32_t m_pathBegin{ 0 };
+    std::uint32_t m_pathLen{ 0 };
+    std::uint32_t m_headersEnd{ 0 };
+    std::uint32_t m_bodyLength{ 0 };    // The bytes of a collected body, after the headers
+    std::uint32_t m_trailerBytes{ 0 };
+
+    std::uint64_t m_remaining{ 0 };     // Of the Content-Length or the current chunk
+    std::uint64_t m_received{ 0 };      // The decoded body
+
+    bool m_hasBody{ false };
+    bool m_chunked{ false };
+    bool m_streamed{ false };
+    bool m_expectContinue{ false };
+
+    std::vector<HeaderSpan> m_headers;
+};
+
+#endif // !_HTTP_PARSER_H_
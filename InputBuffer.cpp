@@ -0,0 +1,87 @@
+#include "InputBuffer.h"
+
+#include <cassert>
+#include <cstring>
+
+char *InputBuffer::data() {
+    return m_data.get();
+}
+
+const char *InputBuffer::data() const {
+    return m_data.get();
+}
+
+std::size_t InputBuffer::size() const {
+    return m_size;
+}
+
+std::size_t InputBuffer::capacity() const {
+    return m_capacity;
+}
+
+bool InputBuffer::empty() const {
+    return m_size == 0;
+}
+
+char *InputBuffer::writePtr() {
+    return m_data.get() + m_size;
+}
+
+std::size_t InputBuffer::writable() const {
+    return m_capacity - m_size;
+}
+
+void InputBuffer::prepareRead(std::size_t minimum) {
+    reserve(minimum);
+}
+
+void InputBuffer::commit(std::size_t bytes) {
+    assert(bytes <= writable());
+    m_size += bytes;
+}
+
+void InputBuffer::append(const char *bytes, std::size_t len) {
+    reserve(len);
+
+    std::memcpy(writePtr(), bytes, len);
+    commit(len);
+}
+
+void InputBuffer::reserve(std::size_t writableBytes) {
+    if (writable() >= writableBytes) {
+        return;
+    }
+
+    std::size_t newCapacity = m_capacity ? m_capacity * 2 : INITIAL_CAPACITY;
+    while (newCapacity - m_size < writableBytes) {
+        newCapacity *= 2;
+    }
+
+    std::unique_ptr<char[]> newData{ new char[newCapacity] };
+    if (m_size) {
+        std::memcpy(newData.get(), m_data.get(), m_size);
+    }
+
+    m_data = std::move(newData);
+    m_capacity = newCapacity;
+}
+
+void InputBuffer::consume(std::size_t bytes) {
+    assert(bytes <= m_size);
+
+    const std::size_t remaining = m_size - bytes;
+    if (remaining) {
+        std::memmove(m_data.get(), m_data.get() + bytes, remaining);
+    }
+
+    m_size = remaining;
+}
+
+void InputBuffer::clear() {
+    m_size = 0;
+
+    if (m_capacity > INITIAL_CAPACITY) {
+        m_data.reset();
+        m_capacity = 0;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef _INPUT_BUFFER_H_
+#define _INPUT_BUFFER_H_
+
+#include <memory>
+#include <cstddef>
+
+// Per-connection receive buffer. The memory is allocated on the first read and grows only
+// when a request doesn't fit, so the parser can hand out views that stay valid until consume().
+class InputBuffer {
+public:
+    static constexpr std::size_t INITIAL_CAPACITY = 4096;
+    static constexpr std::size_t MIN_READ_SIZE = 1024;
+
+    char *data();
+    const char *data() const;
+    std::size_t size() const;
+    std::size_t capacity() const;
+    bool empty() const;
+
+    char *writePtr();
+    std::size_t writable() const;
+
+    // Makes sure there are at least minimum free bytes after the data
+    void prepareRead(std::size_t minimum = MIN_READ_SIZE);
+    void commit(std::size_t bytes);
+
+    // Copies bytes that were received somewhere else
+    void append(const char *bytes, std::size_t len);
+
+    // Drops the first bytes and moves the rest to the front
+    void consume(std::size_t bytes);
+
+    // Keeps the memory for the next connection unless it grew above the initial capacity
+    void clear();
+
+private:
+    void reserve(std::size_t writableBytes);
+
+private:
+    std::unique_ptr<char[]> m_data;
+    std::size_t m_size{ 0 };
+    std::size_t m_capacity{ 0 };
+};
+
+#endif // !_INPUT_BUFFER_H_
@@ -0,0 +1,52 @@
+#ifndef _IO_STATS_H_
+#define _IO_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Per-worker counters. Only the worker updates them, so an update is a relaxed load and store
+// instead of a locked read-modify-write, and any thread may read them.
+class alignas(64) IoStats {
+public:
+    void addRequests(std::uint64_t count) { add(m_requests, count); }
+    void addSyscalls(std::uint64_t count) { add(m_syscalls, count); }
+    void addBytesIn(std::uint64_t bytes) { add(m_bytesIn, bytes); }
+    void addBytesOut(std::uint64_t bytes) { add(m_bytesOut, bytes); }
+
+    // MSG_ZEROCOPY sends, and the completions of the ones the kernel copied anyway (e.g. over loopback)
+    void addZerocopySends(std::uint64_t count) { add(m_zerocopySends, count); }
+    void addZerocopyCopied(std::uint64_t count) { add(m_zerocopyCopied, count); }
+
+    // The time one loop iteration spent on its events, averaged with a weight of 1/8 for the newest one
+    void addLoopTime(std::chrono::nanoseconds busy) {
+        const std::uint64_t sample = static_cast<std::uint64_t>(busy.count());
+        const std::uint64_t average = m_loopLatency.load(std::memory_order_relaxed);
+
+        m_loopLatency.store(average - average / 8 + sample / 8, std::memory_order_relaxed);
+    }
+
+    std::uint64_t requests() const { return m_requests.load(std::memory_order_relaxed); }
+    std::uint64_t syscalls() const { return m_syscalls.load(std::memory_order_relaxed); }
+    std::uint64_t bytesIn() const { return m_bytesIn.load(std::memory_order_relaxed); }
+    std::uint64_t bytesOut() const { return m_bytesOut.load(std::memory_order_relaxed); }
+    std::uint64_t zerocopySends() const { return m_zerocopySends.load(std::memory_order_relaxed); }
+    std::uint64_t zerocopyCopied() const { return m_zerocopyCopied.load(std::memory_order_relaxed); }
+    std::chrono::nanoseconds loopLatency() const { return std::chrono::nanoseconds{ m_loopLatency.load(std::memory_order_relaxed) }; }
+
+private:
+    static void add(std::atomic<std::uint64_t> &counter, std::uint64_t count) {
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_requests{ 0 };
+    std::atomic<std::uint64_t> m_syscalls{ 0 };
+    std::atomic<std::uint64_t> m_bytesIn{ 0 };
+    std::atomic<std::uint64_t> m_bytesOut{ 0 };
+    std::atomic<std::uint64_t> m_zerocopySends{ 0 };
+    std::atomic<std::uint64_t> m_zerocopyCopied{ 0 };
+    std::atomic<std::uint64_t> m_loopLatency{ 0 }; // ns
+};
+
+#endif // !_IO_STATS_H_
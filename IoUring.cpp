@@ -0,0 +1,242 @@
+#include "IoUring.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params &params) {
+	return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void *arg, unsigned argsNum) {
+	return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, argsNum));
+}
+
+}
+
+IoUring::~IoUring() {
+	if (m_bufferRing) {
+		io_uring_buf_reg reg;
+		std::memset(&reg, 0, sizeof(reg));
+		reg.bgid = BUFFER_GROUP;
+		ioUringRegister(m_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+
+		munmap(m_bufferRing, m_bufferRingSize);
+	}
+
+	if (m_sqes) {
+		munmap(m_sqes, m_sqesSize);
+	}
+
+	if (m_ringPtr) {
+		munmap(m_ringPtr, m_ringSize);
+	}
+
+	if (m_fd != -1) {
+		close(m_fd);
+	}
+}
+
+bool IoUring::init(unsigned entries) {
+	// From the cheapest to the most compatible setup: deferred task work is run only when we wait
+	// for completions, instead of interrupting the thread, but it requires a single submitting thread.
+	static constexpr unsigned FLAG_SETS[] = {
+		IORING_SETUP_R_DISABLED | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+		IORING_SETUP_COOP_TASKRUN,
+		0
+	};
+
+	io_uring_params params;
+
+	for (const unsigned flags : FLAG_SETS) {
+		std::memset(&params, 0, sizeof(params));
+		params.flags = flags | IORING_SETUP_CQSIZE;
+		params.cq_entries = entries * 4; // Multishot requests post many completions per submission
+
+		m_fd = ioUringSetup(entries, params);
+		if (m_fd != -1) {
+			m_setupFlags = params.flags;
+			break;
+		}
+
+		if (errno != EINVAL) {
+			break;
+		}
+	}
+
+	if (m_fd == -1) {
+		perror("io_uring_setup");
+		return false;
+	}
+
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)
+		|| !(params.features & IORING_FEAT_NODROP)) {
+		std::fprintf(stderr, "io_uring: the kernel is too old\n");
+		return false;
+	}
+
+	// With IORING_FEAT_SINGLE_MMAP both rings are in the same mapping
+	m_ringSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+		params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+
+	m_ringPtr = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (m_ringPtr == MAP_FAILED) {
+		m_ringPtr = nullptr;
+		perror("mmap");
+		return false;
+	}
+
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+
+	m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+	char *ring = static_cast<char *>(m_ringPtr);
+
+	m_sqHead = reinterpret_cast<unsigned *>(ring + params.sq_off.head);
+	m_sqTail = reinterpret_cast<unsigned *>(ring + params.sq_off.tail);
+	m_sqMask = *reinterpret_cast<unsigned *>(ring + params.sq_off.ring_mask);
+	m_sqEntries = params.sq_entries;
+	m_sqLocalTail = *m_sqTail;
+
+	// The entries are always used in order, so the index array never changes
+	unsigned *sqArray = reinterpret_cast<unsigned *>(ring + params.sq_off.array);
+	for (unsigned i = 0; i < m_sqEntries; ++i) {
+		sqArray[i] = i;
+	}
+
+	m_cqHead = reinterpret_cast<unsigned *>(ring + params.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned *>(ring + params.cq_off.tail);
+	m_cqMask = *reinterpret_cast<unsigned *>(ring + params.cq_off.ring_mask);
+	m_cqes = reinterpret_cast<io_uring_cqe *>(ring + params.cq_off.cqes);
+
+	return true;
+}
+
+bool IoUring::enable() {
+	if (!(m_setupFlags & IORING_SETUP_R_DISABLED)) {
+		return true;
+	}
+
+	if (ioUringRegister(m_fd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) == -1) {
+		perror("io_uring_register(IORING_REGISTER_ENABLE_RINGS)");
+		return false;
+	}
+
+	return true;
+}
+
+bool IoUring::setupBuffers(unsigned count, unsigned size) {
+	if (count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+		std::fprintf(stderr, "io_uring: the number of buffers must be a power of 2 up to 32768\n");
+		return false;
+	}
+
+	m_bufferRingSize = count * sizeof(io_uring_buf);
+
+	void *ringMemory = mmap(nullptr, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (ringMemory == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+
+	io_uring_buf_reg reg;
+	std::memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<std::uint64_t>(ringMemory);
+	reg.ring_entries = count;
+	reg.bgid = BUFFER_GROUP;
+
+	if (ioUringRegister(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+		perror("io_uring_register(IORING_REGISTER_PBUF_RING)");
+		munmap(ringMemory, m_bufferRingSize);
+		return false;
+	}
+
+	m_bufferRing = static_cast<io_uring_buf_ring *>(ringMemory);
+	m_buffers = std::make_unique<char[]>(static_cast<std::size_t>(count) * size);
+	m_bufferSize = size;
+	m_bufferMask = count - 1;
+	m_bufferTail = 0;
+
+	for (unsigned bufferId = 0; bufferId < count; ++bufferId) {
+		recycleBuffer(bufferId);
+	}
+
+	return true;
+}
+
+char *IoUring::buffer(unsigned bufferId) {
+	return m_buffers.get() + static_cast<std::size_t>(bufferId) * m_bufferSize;
+}
+
+void IoUring::recycleBuffer(unsigned bufferId) {
+	// Not m_bufferRing->bufs: in C++ the empty struct that __DECLARE_FLEX_ARRAY puts before it takes a byte
+	io_uring_buf &entry = reinterpret_cast<io_uring_buf *>(m_bufferRing)[m_bufferTail & m_bufferMask];
+	entry.addr = reinterpret_cast<std::uint64_t>(buffer(bufferId));
+	entry.len = m_bufferSize;
+	entry.bid = static_cast<std::uint16_t>(bufferId);
+
+	// The tail overlaps the reserved field of the first entry
+	__atomic_store_n(&m_bufferRing->tail, ++m_bufferTail, __ATOMIC_RELEASE);
+}
+
+io_uring_sqe *IoUring::getSqe() {
+	if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+		enter(flushSubmissions(), 0, 0, nullptr, 0);
+
+		if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+			return nullptr;
+		}
+	}
+
+	io_uring_sqe *sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+	std::memset(sqe, 0, sizeof(*sqe));
+	++m_sqLocalTail;
+
+	return sqe;
+}
+
+bool IoUring::submitAndWait(std::chrono::milliseconds timeout) {
+	__kernel_timespec ts;
+	ts.tv_sec = timeout.count() / 1000;
+	ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+	io_uring_getevents_arg arg;
+	std::memset(&arg, 0, sizeof(arg));
+	arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+
+	const int result = enter(flushSubmissions(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	if (result == -1 && errno != ETIME && errno != EINTR) {
+		perror("io_uring_enter");
+		return false;
+	}
+
+	return true;
+}
+
+std::uint64_t IoUring::enterCalls() const {
+	return m_enterCalls;
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, std::size_t argSize) {
+	++m_enterCalls;
+	return static_cast<int>(syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+unsigned IoUring::flushSubmissions() {
+	__atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+	// Also the entries that a previous io_uring_enter() didn't consume
+	return m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+}
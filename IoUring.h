@@ -0,0 +1,102 @@
+#ifndef _IO_URING_H_
+#define _IO_URING_H_
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+#include <linux/io_uring.h>
+
+// A minimal io_uring wrapper on top of the raw system calls: the submission and completion rings
+// and a single ring of provided receive buffers (buffer group 0).
+// All methods except init() must be called from the thread that called enable().
+class IoUring {
+public:
+	static constexpr std::uint16_t BUFFER_GROUP = 0;
+
+	IoUring() = default;
+	~IoUring();
+
+	IoUring(const IoUring &) = delete;
+	IoUring &operator=(const IoUring &) = delete;
+
+	// The rings are created disabled when the kernel supports it, so that the submitting thread can be
+	// a different one than the creating thread. Fails if the kernel doesn't have the features we need.
+	bool init(unsigned entries);
+	bool enable();
+
+	// count must be a power of 2
+	bool setupBuffers(unsigned count, unsigned size);
+	char *buffer(unsigned bufferId);
+	// Gives the buffer back to the kernel
+	void recycleBuffer(unsigned bufferId);
+
+	// Submits the queued entries first if the submission queue is full
+	io_uring_sqe *getSqe();
+
+	// Submits the queued entries and waits for at least one completion or the timeout.
+	// Returns false on errors other than the timeout and EINTR.
+	bool submitAndWait(std::chrono::milliseconds timeout);
+
+	// Calls handler(const io_uring_cqe &) for every available completion
+	template <typename Handler>
+	unsigned forEachCompletion(Handler &&handler);
+
+	// The number of io_uring_enter() calls so far
+	std::uint64_t enterCalls() const;
+
+private:
+	int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, std::size_t argSize);
+	unsigned flushSubmissions();
+
+private:
+	int m_fd{ -1 };
+	unsigned m_setupFlags{ 0 };
+	std::uint64_t m_enterCalls{ 0 };
+
+	void *m_ringPtr{ nullptr };
+	std::size_t m_ringSize{ 0 };
+	io_uring_sqe *m_sqes{ nullptr };
+	std::size_t m_sqesSize{ 0 };
+
+	// Submission queue
+	unsigned *m_sqHead{ nullptr };
+	unsigned *m_sqTail{ nullptr };
+	unsigned m_sqMask{ 0 };
+	unsigned m_sqEntries{ 0 };
+	unsigned m_sqLocalTail{ 0 };
+
+	// Completion queue
+	unsigned *m_cqHead{ nullptr };
+	unsigned *m_cqTail{ nullptr };
+	unsigned m_cqMask{ 0 };
+	io_uring_cqe *m_cqes{ nullptr };
+
+	// Provided buffers
+	io_uring_buf_ring *m_bufferRing{ nullptr };
+	std::size_t m_bufferRingSize{ 0 };
+	std::unique_ptr<char[]> m_buffers;
+	unsigned m_bufferSize{ 0 };
+	unsigned m_bufferMask{ 0 };
+	std::uint16_t m_bufferTail{ 0 };
+};
+
+template <typename Handler>
+unsigned IoUring::forEachCompletion(Handler &&handler) {
+	unsigned head = *m_cqHead;
+	const unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+	const unsigned count = tail - head;
+
+	for (; head != tail; ++head) {
+		handler(static_cast<const io_uring_cqe &>(m_cqes[head & m_cqMask]));
+	}
+
+	// The handler may have queued new entries, but the completions are consumed only now
+	__atomic_store_n(m_cqHead, tail, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+#endif // !_IO_URING_H_
@@ -0,0 +1,201 @@
+#include "Metrics.h"
+#include "ServerThread.h"
+
+#include <thread>
+#include <cstdio>
+#include <string_view>
+
+namespace {
+
+void appendNumber(std::string &body, std::uint64_t value) {
+    char text[24];
+    const int len = std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(value));
+    body.append(text, static_cast<std::size_t>(len));
+}
+
+void appendSeconds(std::string &body, double seconds) {
+    char text[32];
+    const int len = std::snprintf(text, sizeof(text), "%.9g", seconds);
+    body.append(text, static_cast<std::size_t>(len));
+}
+
+void appendHeader(std::string &body, std::string_view name, std::string_view type, std::string_view help) {
+    body += "# HELP ";
+    body += name;
+    body += ' ';
+    body += help;
+    body += "\n# TYPE ";
+    body += name;
+    body += ' ';
+    body += type;
+    body += '\n';
+}
+
+void appendMetric(std::string &body, std::string_view name, std::string_view type, std::string_view help, std::uint64_t value) {
+    appendHeader(body, name, type, help);
+
+    body += name;
+    body += ' ';
+    appendNumber(body, value);
+    body += '\n';
+}
+
+template <typename Getter>
+std::uint64_t sum(const ServerThread *threads, int threadsNum, Getter &&getter) {
+    std::uint64_t total = 0;
+    for (int i = 0; i < threadsNum; ++i) {
+        total += getter(threads[i]);
+    }
+
+    return total;
+}
+
+}
+
+double CycleClock::ticksPerSecond() {
+#ifdef METRICS_HAS_TSC
+    static const double TICKS_PER_SECOND = []() {
+        const auto start = std::chrono::steady_clock::now();
+        const std::uint64_t startTicks = now();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        const std::uint64_t ticks = now() - startTicks;
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return static_cast<double>(ticks) / elapsed.count();
+    }();
+
+    return TICKS_PER_SECOND;
+#else
+    return std::chrono::steady_clock::period::den / static_cast<double>(std::chrono::steady_clock::period::num);
+#endif
+}
+
+std::uint64_t LatencyHistogram::upperBound(int bucket) {
+    // Even buckets end at 1.5 * 2^msb and odd ones at 2^(msb + 1)
+    const int msb = bucket / 2 + MIN_BITS;
+    const std::uint64_t power = std::uint64_t{ 1 } << msb;
+
+    return bucket % 2 == 0 ? power + power / 2 : power * 2;
+}
+
+void Metrics::writePrometheus(std::string &body, const ServerThread *threads, int threadsNum) {
+    using namespace std::string_view_literals;
+
+    const auto total = [threads, threadsNum](std::atomic<std::uint64_t> Metrics::*counter) {
+        return sum(threads, threadsNum, [counter](const ServerThread &thread) {
+            return (thread.metrics().*counter).load(std::memory_order_relaxed);
+        });
+    };
+
+    appendMetric(body, "http_connections_accepted_total"sv, "counter"sv, "Accepted connections."sv, total(&Metrics::m_accepted));
+    appendMetric(body, "http_connections_closed_total"sv, "counter"sv, "Closed connections."sv, total(&Metrics::m_closed));
+    appendMetric(body, "http_connections_rejected_total"sv, "counter"sv, "Connections closed right away because the worker had no free slot."sv, total(&Metrics::m_rejected));
+    appendMetric(body, "http_connections_open"sv, "gauge"sv, "Open and queued connections."sv, sum(threads, threadsNum, [](const ServerThread &thread) {
+        return thread.connections();
+    }));
+
+    // The requests that the parser rejected are counted as "other"
+    appendHeader(body, "http_requests_total"sv, "counter"sv, "Requests by method."sv);
+    for (int method = 0; method <= static_cast<int>(HTTP_METHOD::INVALID_METHOD); ++method) {
+        const std::uint64_t count = sum(threads, threadsNum, [method](const ServerThread &thread) {
+            return thread.metrics().m_methods[method].load(std::memory_order_relaxed);
+        });
+
+        body += "http_requests_total{method=\""sv;
+        body += method == static_cast<int>(HTTP_METHOD::INVALID_METHOD) ? "other"sv : Server::methodToString(static_cast<HTTP_METHOD>(method));
+        body += "\"} "sv;
+        appendNumber(body, count);
+        body += '\n';
+    }
+
+    // Only the codes that have been sent, there are hundreds of possible ones
+    appendHeader(body, "http_responses_total"sv, "counter"sv, "Responses by status code."sv);
+    for (int status = 0; status < STATUS_CODES; ++status) {
+        const std::uint64_t count = sum(threads, threadsNum, [status](const ServerThread &thread) {
+            return thread.metrics().m_statuses[status].load(std::memory_order_relaxed);
+        });
+
+        if (count == 0) {
+            continue;
+        }
+
+        body += "http_responses_total{code=\""sv;
+        if (status == STATUS_CODES - 1) {
+            body += "other"sv;
+        }
+        else {
+            appendNumber(body, static_cast<std::uint64_t>(status + 100));
+        }
+        body += "\"} "sv;
+        appendNumber(body, count);
+        body += '\n';
+    }
+
+    appendMetric(body, "http_parse_errors_total"sv, "counter"sv, "Requests rejected by the parser."sv, total(&Metrics::m_parseErrors));
+
+    appendMetric(body, "http_tls_handshakes_total"sv, "counter"sv, "Completed TLS handshakes."sv, total(&Metrics::m_tlsHandshakes));
+    appendMetric(body, "http_tls_resumed_total"sv, "counter"sv, "TLS handshakes that resumed a session."sv, total(&Metrics::m_tlsResumed));
+    appendMetric(body, "http_tls_ktls_total"sv, "counter"sv, "TLS connections whose output the kernel encrypts."sv, total(&Metrics::m_tlsKernel));
+    appendMetric(body, "http_tls_handshake_failures_total"sv, "counter"sv, "TLS handshakes that failed."sv, total(&Metrics::m_tlsFailures));
+
+    appendMetric(body, "http_received_bytes_total"sv, "counter"sv, "Bytes received from the clients."sv, sum(threads, threadsNum, [](const ServerThread &thread) {
+        return thread.stats().bytesIn();
+    }));
+    appendMetric(body, "http_sent_bytes_total"sv, "counter"sv, "Bytes sent to the clients."sv, sum(threads, threadsNum, [](const ServerThread &thread) {
+        return thread.stats().bytesOut();
+    }));
+    appendMetric(body, "http_zerocopy_sends_total"sv, "counter"sv, "MSG_ZEROCOPY sends."sv, sum(threads, threadsNum, [](const ServerThread &thread) {
+        return thread.stats().zerocopySends();
+    }));
+    appendMetric(body, "http_zerocopy_copied_total"sv, "counter"sv, "MSG_ZEROCOPY sends that the kernel copied."sv, sum(threads, threadsNum, [](const ServerThread &thread) {
+        return thread.stats().zerocopyCopied();
+    }));
+    appendMetric(body, "http_syscalls_total"sv, "counter"sv, "System calls made by the workers."sv, sum(threads, threadsNum, [](const ServerThread &thread) {
+        return thread.stats().syscalls();
+    }));
+
+    const double secondsPerTick = 1.0 / CycleClock::ticksPerSecond();
+
+    const auto histogram = [&](std::string_view name, std::string_view help, LatencyHistogram Metrics::*member) {
+        appendHeader(body, name, "histogram"sv, help);
+
+        std::uint64_t count = 0;
+        for (int bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+            count += sum(threads, threadsNum, [bucket, member](const ServerThread &thread) {
+                return (thread.metrics().*member).count(bucket);
+            });
+
+            body += name;
+            body += "_bucket{le=\""sv;
+            if (bucket == LatencyHistogram::BUCKETS - 1) {
+                body += "+Inf"sv;
+            }
+            else {
+                appendSeconds(body, static_cast<double>(LatencyHistogram::upperBound(bucket)) * secondsPerTick);
+            }
+            body += "\"} "sv;
+            appendNumber(body, count);
+            body += '\n';
+        }
+
+        const std::uint64_t ticks = sum(threads, threadsNum, [member](const ServerThread &thread) {
+            return (thread.metrics().*member).sum();
+        });
+
+        body += name;
+        body += "_sum "sv;
+        appendSeconds(body, static_cast<double>(ticks) * secondsPerTick);
+        body += '\n';
+
+        body += name;
+        body += "_count "sv;
+        appendNumber(body, count);
+        body += '\n';
+    };
+
+    histogram("http_request_parse_seconds"sv, "Time to parse a complete request, from the read for the first one of a wakeup. Sampled."sv, &Metrics::m_parse);
+    histogram("http_request_handler_seconds"sv, "Time to route a request and create its response. Sampled."sv, &Metrics::m_handler);
+    histogram("http_time_to_first_byte_seconds"sv, "From the wakeup that read the end of a request until its response is complete, or until the wakeup that writes it. Sampled."sv, &Metrics::m_firstByte);
+}
@@ -0,0 +1,146 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include "HttpMessage.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define METRICS_HAS_TSC 1
+#endif
+
+class ServerThread;
+
+// A cheap timestamp for the latency histograms: the TSC on x86 (invariant on every CPU that the
+// server targets), otherwise steady_clock nanoseconds. The ticks are converted to seconds only
+// when the metrics are exported.
+class CycleClock {
+public:
+    static std::uint64_t now();
+
+    // Measured once against steady_clock, the first call takes about 20 ms
+    static double ticksPerSecond();
+};
+
+// Log-linear histogram of CycleClock ticks: every power of two is split into 2 buckets, from
+// 2^MIN_BITS ticks (tens of nanoseconds) to 2^MAX_BITS ticks (minutes). The smaller values land
+// in the first bucket and the larger ones in the last, which has no upper bound.
+class LatencyHistogram {
+public:
+    static constexpr int MIN_BITS = 6;
+    static constexpr int MAX_BITS = 38;
+    static constexpr int BUCKETS = (MAX_BITS - MIN_BITS) * 2 + 1;
+
+    // Only the owning worker records
+    void record(std::uint64_t ticks);
+
+    std::uint64_t count(int bucket) const { return m_counts[bucket].load(std::memory_order_relaxed); }
+    std::uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+
+    // Exclusive, in ticks. The last bucket has none.
+    static std::uint64_t upperBound(int bucket);
+
+    static int bucketOf(std::uint64_t ticks);
+
+private:
+    std::array<std::atomic<std::uint64_t>, BUCKETS> m_counts{};
+    std::atomic<std::uint64_t> m_sum{ 0 };
+};
+
+// The counters and histograms of one worker. Like IoStats, only the worker writes them, so an
+// update is a relaxed load and store on memory that no other thread writes. The exporter sums
+// all workers when /metrics is requested.
+class alignas(64) Metrics {
+public:
+    // The latencies are recorded on one of this many wakeups of a worker, the clock reads cost
+    // more than everything else the metrics do
+    static constexpr std::uint32_t TIMED_WAKEUPS = 32;
+
+    // Status codes 100-599 have their own counter, anything else is counted as "other"
+    static constexpr int STATUS_CODES = 501;
+
+    void addAccepted() { add(m_accepted, 1); }
+    void addRejected() { add(m_rejected, 1); }
+    void addClosed() { add(m_closed, 1); }
+    void addParseError() { add(m_parseErrors, 1); }
+
+    void addTlsHandshake(bool resumed, bool kernel) {
+        add(m_tlsHandshakes, 1);
+        add(m_tlsResumed, resumed ? 1 : 0);
+        add(m_tlsKernel, kernel ? 1 : 0);
+    }
+    void addTlsFailure() { add(m_tlsFailures, 1); }
+
+    void addRequest(HTTP_METHOD method, int status);
+
+    LatencyHistogram &parse() { return m_parse; }
+    LatencyHistogram &handler() { return m_handler; }
+    LatencyHistogram &firstByte() { return m_firstByte; }
+
+    // Appends the Prometheus text format of the sum of all workers
+    static void writePrometheus(std::string &body, const ServerThread *threads, int threadsNum);
+
+private:
+    static void add(std::atomic<std::uint64_t> &counter, std::uint64_t count) {
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_accepted{ 0 };
+    std::atomic<std::uint64_t> m_rejected{ 0 };    // The connection limit was reached or no slot could be allocated
+    std::atomic<std::uint64_t> m_closed{ 0 };
+    std::atomic<std::uint64_t> m_parseErrors{ 0 };
+    std::atomic<std::uint64_t> m_tlsHandshakes{ 0 };
+    std::atomic<std::uint64_t> m_tlsResumed{ 0 };
+    std::atomic<std::uint64_t> m_tlsKernel{ 0 };   // The handshakes after which the kernel encrypts the output
+    std::atomic<std::uint64_t> m_tlsFailures{ 0 };
+
+    std::array<std::atomic<std::uint64_t>, static_cast<int>(HTTP_METHOD::INVALID_METHOD) + 1> m_methods{};
+    std::array<std::atomic<std::uint64_t>, STATUS_CODES> m_statuses{};
+
+    LatencyHistogram m_parse;
+    LatencyHistogram m_handler;
+    LatencyHistogram m_firstByte;
+};
+
+inline std::uint64_t CycleClock::now() {
+#ifdef METRICS_HAS_TSC
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+inline void LatencyHistogram::record(std::uint64_t ticks) {
+    auto &counter = m_counts[bucketOf(ticks)];
+
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_sum.store(m_sum.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+}
+
+inline int LatencyHistogram::bucketOf(std::uint64_t ticks) {
+    const int msb = 63 - __builtin_clzll(ticks | 1);
+
+    if (msb < MIN_BITS) {
+        return 0;
+    }
+
+    if (msb >= MAX_BITS) {
+        return BUCKETS - 1;
+    }
+
+    // The bit below the most significant one picks the half of the power of two
+    return (msb - MIN_BITS) * 2 + static_cast<int>((ticks >> (msb - 1)) & 1);
+}
+
+inline void Metrics::addRequest(HTTP_METHOD method, int status) {
+    add(m_methods[static_cast<int>(method)], 1);
+    add(m_statuses[status >= 100 && status < 600 ? status - 100 : STATUS_CODES - 1], 1);
+}
+
+#endif // !_METRICS_H_
@@ -0,0 +1,521 @@
+#include "OutputQueue.h"
+#include "FileCache.h"
+#include "IoStats.h"
+#include "Tls.h"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+namespace {
+
+// sendfile() transfers at most 0x7ffff000 bytes per call
+constexpr std::size_t MAX_SENDFILE_SIZE = 0x7ffff000;
+
+// The size of a chunk is written in front of it when it's known, zero-padded to a fixed width
+constexpr std::size_t CHUNK_SIZE_DIGITS = 8;
+constexpr std::size_t CHUNK_HEADER_SIZE = CHUNK_SIZE_DIGITS + 2;
+
+constexpr std::size_t MAX_RETAINED_CAPACITY = 4 * ResponseStream::PIECE_SIZE;
+
+}
+
+OutputQueue::OutputQueue(std::size_t reserve) {
+    m_buffer.reserve(reserve);
+}
+
+std::string &OutputQueue::buffer() {
+    return m_buffer;
+}
+
+void OutputQueue::addStatic(std::string_view data) {
+    if (data.empty()) {
+        return;
+    }
+
+    m_segments.push_back({ m_buffer.size(), data.data(), nullptr, nullptr, 0, data.size() });
+}
+
+void OutputQueue::addShared(std::string_view data, std::shared_ptr<const void> owner) {
+    if (data.empty()) {
+        return;
+    }
+
+    m_segments.push_back({ m_buffer.size(), data.data(), std::move(owner), nullptr, 0, data.size() });
+}
+
+void OutputQueue::addFile(std::shared_ptr<const CachedFile> file, off_t offset, std::size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    m_segments.push_back({ m_buffer.size(), nullptr, nullptr, std::move(file), offset, length });
+}
+
+void OutputQueue::setStream(std::unique_ptr<ResponseStream> stream, bool chunked, std::size_t length) {
+    m_stream = std::move(stream);
+    m_chunked = chunked;
+    m_streamLength = length;
+    m_streamProduced = 0;
+}
+
+bool OutputQueue::streaming() const {
+    return m_stream != nullptr;
+}
+
+bool OutputQueue::closeDelimited() const {
+    return m_stream && !m_chunked && m_streamLength == UNKNOWN_LENGTH;
+}
+
+bool OutputQueue::refill() {
+    while (m_stream && m_buffer.size() - m_sent < ResponseStream::PIECE_SIZE) {
+        // The pieces that have been sent are dropped, so the buffer doesn't grow with the body
+        if (m_segmentIdx == m_segments.size()) {
+            m_buffer.erase(0, m_sent);
+            m_sent = 0;
+
+            m_segments.clear();
+            m_segmentIdx = 0;
+        }
+
+        const std::size_t start = m_buffer.size();
+        if (m_chunked) {
+            m_buffer.append(CHUNK_HEADER_SIZE, '0');
+        }
+
+        const bool more = m_stream->produce(m_buffer);
+
+        const std::size_t produced = m_buffer.size() - start - (m_chunked ? CHUNK_HEADER_SIZE : 0);
+        m_streamProduced += produced;
+
+        if (m_chunked) {
+            if (produced == 0) {
+                // An empty chunk would end the body
+                m_buffer.resize(start);
+            }
+            else {
+                static constexpr char HEX[] = "0123456789abcdef";
+
+                for (std::size_t i = 0, size = produced; i < CHUNK_SIZE_DIGITS; ++i, size >>= 4) {
+                    m_buffer[start + CHUNK_SIZE_DIGITS - 1 - i] = HEX[size & 0xf];
+                }
+
+                m_buffer[start + CHUNK_SIZE_DIGITS] = '\r';
+                m_buffer[start + CHUNK_SIZE_DIGITS + 1] = '\n';
+                m_buffer += "\r\n";
+            }
+        }
+
+        if (m_streamLength != UNKNOWN_LENGTH && m_streamProduced > m_streamLength) {
+            return false;
+        }
+
+        if (!more) {
+            if (m_chunked) {
+                m_buffer += "0\r\n\r\n";
+            }
+
+            m_stream.reset();
+
+            if (m_streamLength != UNKNOWN_LENGTH && m_streamProduced != m_streamLength) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool OutputQueue::empty() const {
+    return !m_stream && m_sent == m_buffer.size() && m_segmentIdx == m_segments.size();
+}
+
+OutputQueue::RESULT OutputQueue::flush(int fd, IoStats &stats, TlsSession *tls) {
+    while (true) {
+        if (!refill()) {
+            return RESULT::ERROR;
+        }
+
+        if (empty()) {
+            break;
+        }
+
+        std::size_t sent = 0;
+
+        RESULT result;
+
+        // With kTLS the kernel encrypts what's written to the socket
+        if (tls && !tls->kernelSend()) {
+            result = sendTls(*tls, sent);
+        }
+        else {
+            result = fileNext() ? sendFile(fd, m_segments[m_segmentIdx], sent) : sendMemory(fd, sent, stats);
+        }
+
+        stats.addSyscalls(1);
+        stats.addBytesOut(sent);
+
+        if (result != RESULT::DONE) {
+            return result;
+        }
+    }
+
+    clear();
+    return RESULT::DONE;
+}
+
+int OutputQueue::gatherMemory(iovec *iov, int maxIov, std::size_t &bytes, bool &moreFollows) const {
+    int iovCount = 0;
+    bytes = 0;
+    moreFollows = false;
+
+    // Gather the buffered bytes and the memory segments up to the next file or zero-copy segment
+    std::size_t position = m_sent;
+    std::size_t segmentIdx = m_segmentIdx;
+
+    while (iovCount < maxIov) {
+        const std::size_t bufferEnd = segmentIdx < m_segments.size() ? m_segments[segmentIdx].m_position : m_buffer.size();
+
+        if (position < bufferEnd) {
+            iov[iovCount++] = { const_cast<char *>(m_buffer.data()) + position, bufferEnd - position };
+            bytes += bufferEnd - position;
+            position = bufferEnd;
+            continue;
+        }
+
+        if (segmentIdx == m_segments.size()) {
+            break;
+        }
+
+        const auto &segment = m_segments[segmentIdx];
+        if (segment.m_file || sendsSeparately(segment)) {
+            moreFollows = true;
+            break;
+        }
+
+        iov[iovCount++] = { const_cast<char *>(segment.m_data), segment.m_length };
+        bytes += segment.m_length;
+        ++segmentIdx;
+    }
+
+    return iovCount;
+}
+
+void OutputQueue::commitSent(std::size_t bytes) {
+    advance(bytes);
+
+    if (empty()) {
+        clear();
+    }
+}
+
+bool OutputQueue::fileNext() const {
+    return m_segmentIdx < m_segments.size()
+        && m_segments[m_segmentIdx].m_file
+        && m_segments[m_segmentIdx].m_position == m_sent;
+}
+
+OutputQueue::RESULT OutputQueue::sendNextFile(int fd, IoStats &stats) {
+    std::size_t sent = 0;
+
+    const RESULT result = sendFile(fd, m_segments[m_segmentIdx], sent);
+    stats.addSyscalls(1);
+    stats.addBytesOut(sent);
+
+    if (empty()) {
+        clear();
+    }
+
+    return result;
+}
+
+OutputQueue::RESULT OutputQueue::sendMemory(int fd, std::size_t &sent, IoStats &stats) {
+    if (zerocopyNext()) {
+        return sendZerocopy(fd, sent, stats);
+    }
+
+    iovec iov[MAX_IOVEC];
+    std::size_t total = 0;
+    bool moreFollows = false;
+
+    const int iovCount = gatherMemory(iov, MAX_IOVEC, total, moreFollows);
+
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = iovCount;
+
+    // MSG_MORE lets the kernel put the headers and the beginning of the body in the same packet
+    const ssize_t nw = sendmsg(fd, &message, MSG_NOSIGNAL | (moreFollows ? MSG_MORE : 0));
+    if (nw == -1) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? RESULT::WOULD_BLOCK : RESULT::ERROR;
+    }
+
+    sent = static_cast<std::size_t>(nw);
+    advance(sent);
+
+    return static_cast<std::size_t>(nw) < total ? RESULT::WOULD_BLOCK : RESULT::DONE;
+}
+
+OutputQueue::RESULT OutputQueue::sendZerocopy(int fd, std::size_t &sent, IoStats &stats) {
+    const Segment &segment = m_segments[m_segmentIdx];
+    const std::size_t length = segment.m_length;
+
+    const bool last = m_segmentIdx + 1 == m_segments.size() && segment.m_position == m_buffer.size() && !m_stream;
+    const int flags = MSG_NOSIGNAL | (last ? 0 : MSG_MORE);
+
+    ssize_t nw = send(fd, segment.m_data, length, flags | MSG_ZEROCOPY);
+
+    if (nw == -1 && errno == ENOBUFS) {
+        // The socket has reached its limit of pinned pages, this part is copied
+        nw = send(fd, segment.m_data, length, flags);
+        stats.addSyscalls(1);
+    }
+    else if (nw != -1) {
+        // Every successful call gets the next id, a partial one too
+        if (segment.m_owner) {
+            m_zerocopyOwners.push_back({ m_zerocopyNextId, segment.m_owner });
+        }
+
+        ++m_zerocopyNextId;
+        ++m_zerocopyPending;
+        stats.addZerocopySends(1);
+    }
+
+    if (nw == -1) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? RESULT::WOULD_BLOCK : RESULT::ERROR;
+    }
+
+    sent = static_cast<std::size_t>(nw);
+    advance(sent);
+
+    return sent < length ? RESULT::WOULD_BLOCK : RESULT::DONE;
+}
+
+OutputQueue::RESULT OutputQueue::sendFile(int fd, Segment &segment, std::size_t &sent) {
+    const std::size_t len = std::min(segment.m_length, MAX_SENDFILE_SIZE);
+
+    const ssize_t nw = sendfile(fd, segment.m_file->m_fd, &segment.m_offset, len);
+    if (nw == -1) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? RESULT::WOULD_BLOCK : RESULT::ERROR;
+    }
+
+    // The file was truncated after it was opened
+    if (nw == 0) {
+        return RESULT::ERROR;
+    }
+
+    sent = static_cast<std::size_t>(nw);
+
+    segment.m_length -= static_cast<std::size_t>(nw);
+
+    if (segment.m_length == 0) {
+        segment.m_file.reset();
+        ++m_segmentIdx;
+    }
+    else if (static_cast<std::size_t>(nw) < len) {
+        return RESULT::WOULD_BLOCK;
+    }
+
+    return RESULT::DONE;
+}
+
+OutputQueue::RESULT OutputQueue::sendTls(TlsSession &tls, std::size_t &sent) {
+    const char *data = tls.record();
+    std::size_t length = 0;
+
+    const bool file = fileNext();
+
+    if (file) {
+        const Segment &segment = m_segments[m_segmentIdx];
+        const ssize_t nr = pread(segment.m_file->m_fd, tls.record(), std::min(segment.m_length, TlsSession::MAX_RECORD_SIZE), segment.m_offset);
+
+        // The file was truncated after it was opened
+        if (nr <= 0) {
+            return RESULT::ERROR;
+        }
+
+        length = static_cast<std::size_t>(nr);
+    }
+    else {
+        iovec iov[MAX_IOVEC];
+        std::size_t total = 0;
+        bool moreFollows = false;
+
+        const int iovCount = gatherMemory(iov, MAX_IOVEC, total, moreFollows);
+
+        if (iovCount == 1 || iov[0].iov_len >= TlsSession::MAX_RECORD_SIZE) {
+            // A whole record in one piece is encrypted from where it is
+            data = static_cast<const char *>(iov[0].iov_base);
+            length = std::min(iov[0].iov_len, TlsSession::MAX_RECORD_SIZE);
+        }
+        else {
+            // The small pieces share a record
+            for (int i = 0; i < iovCount && length < TlsSession::MAX_RECORD_SIZE; ++i) {
+                const std::size_t piece = std::min(iov[i].iov_len, TlsSession::MAX_RECORD_SIZE - length);
+                std::memcpy(tls.record() + length, iov[i].iov_base, piece);
+                length += piece;
+            }
+        }
+    }
+
+    switch (tls.write(data, length, sent)) {
+    case TlsSession::RESULT::DONE:
+        break;
+    case TlsSession::RESULT::ERROR:
+        return RESULT::ERROR;
+    default:
+        return RESULT::WOULD_BLOCK;
+    }
+
+    if (!file) {
+        advance(sent);
+        return RESULT::DONE;
+    }
+
+    Segment &segment = m_segments[m_segmentIdx];
+    segment.m_offset += static_cast<off_t>(sent);
+    segment.m_length -= sent;
+
+    if (segment.m_length == 0) {
+        segment.m_file.reset();
+        ++m_segmentIdx;
+    }
+
+    return RESULT::DONE;
+}
+
+void OutputQueue::advance(std::size_t bytes) {
+    while (bytes) {
+        const std::size_t bufferEnd = m_segmentIdx < m_segments.size() ? m_segments[m_segmentIdx].m_position : m_buffer.size();
+
+        if (m_sent < bufferEnd) {
+            const std::size_t sent = std::min(bytes, bufferEnd - m_sent);
+            m_sent += sent;
+            bytes -= sent;
+            continue;
+        }
+
+        auto &segment = m_segments[m_segmentIdx];
+
+        const std::size_t sent = std::min(bytes, segment.m_length);
+        segment.m_data += sent;
+        segment.m_length -= sent;
+        bytes -= sent;
+
+        if (segment.m_length == 0) {
+            ++m_segmentIdx;
+        }
+    }
+}
+
+void OutputQueue::clear() {
+    m_buffer.clear();
+    m_sent = 0;
+
+    m_segments.clear();
+    m_segmentIdx = 0;
+
+    m_stream.reset();
+
+    // The slots are reused by the next connections, don't keep the memory of a large response
+    if (m_buffer.capacity() > MAX_RETAINED_CAPACITY) {
+        std::string{}.swap(m_buffer);
+    }
+}
+
+void OutputQueue::enableZerocopy(std::size_t threshold) {
+    m_zerocopyThreshold = threshold;
+}
+
+bool OutputQueue::reapZerocopy(int fd, IoStats &stats) {
+    while (true) {
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        const ssize_t nr = recvmsg(fd, &message, MSG_ERRQUEUE);
+        stats.addSyscalls(1);
+
+        if (nr == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            const bool recvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+
+            if (!recvErr) {
+                continue;
+            }
+
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+
+            if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY || error.ee_errno != 0) {
+                return false;
+            }
+
+            // The sends [ee_info, ee_data] have completed, the ids wrap around
+            const std::uint32_t first = error.ee_info;
+            const std::uint32_t count = error.ee_data - first + 1;
+
+            m_zerocopyPending -= std::min(count, m_zerocopyPending);
+
+            if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                stats.addZerocopyCopied(count);
+            }
+
+            m_zerocopyOwners.erase(std::remove_if(m_zerocopyOwners.begin(), m_zerocopyOwners.end(), [first, count](const ZerocopySend &send) {
+                return send.m_id - first < count;
+            }), m_zerocopyOwners.end());
+        }
+    }
+}
+
+bool OutputQueue::zerocopyEnabled() const {
+    return m_zerocopyThreshold != 0;
+}
+
+bool OutputQueue::zerocopyPending() const {
+    return m_zerocopyPending != 0;
+}
+
+void OutputQueue::resetZerocopy(ZerocopyRetired &retired) {
+    for (ZerocopySend &send : m_zerocopyOwners) {
+        retired.retire(std::move(send.m_owner));
+    }
+
+    m_zerocopyOwners.clear();
+    m_zerocopyThreshold = 0;
+    m_zerocopyNextId = 0;
+    m_zerocopyPending = 0;
+}
+
+bool OutputQueue::zerocopyNext() const {
+    return m_segmentIdx < m_segments.size()
+        && m_segments[m_segmentIdx].m_position == m_sent
+        && sendsSeparately(m_segments[m_segmentIdx]);
+}
+
+bool OutputQueue::sendsSeparately(const Segment &segment) const {
+    return m_zerocopyThreshold != 0 && !segment.m_file && segment.m_length >= m_zerocopyThreshold;
+}
+
+void ZerocopyRetired::retire(std::shared_ptr<const void> owner) {
+    m_owners.emplace_back(std::chrono::steady_clock::now() + DELAY, std::move(owner));
+}
+
+void ZerocopyRetired::onTimer(std::chrono::steady_clock::time_point now) {
+    while (!m_owners.empty() && m_owners.front().first <= now) {
+        m_owners.pop_front();
+    }
+}
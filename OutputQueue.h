@@ -0,0 +1,164 @@
+#ifndef _OUTPUT_QUEUE_H_
+#define _OUTPUT_QUEUE_H_
+
+#include "ResponseStream.h"
+
+#include <deque>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <sys/types.h>
+
+struct iovec;
+struct CachedFile;
+class IoStats;
+class TlsSession;
+class ZerocopyRetired;
+
+// Per-connection outgoing data. Most of the bytes are appended to buffer(), while immutable
+// memory and file ranges are queued as segments that are never copied into the buffer. The memory
+// is gathered with the buffered bytes into a single sendmsg() and the files are sent with sendfile().
+// Every segment remembers the buffer position it was added at, so the order is preserved.
+// A ResponseStream may follow the queued data, its pieces are appended to the buffer as it drains.
+class OutputQueue {
+public:
+    enum class RESULT {
+        DONE,
+        WOULD_BLOCK,
+        ERROR
+    };
+
+    // The number of buffer pieces and memory segments gathered per sendmsg()
+    static constexpr int MAX_IOVEC = 64;
+
+    static constexpr std::size_t UNKNOWN_LENGTH = SIZE_MAX;
+
+    // Smaller data costs less to copy into the buffer than a separate iovec entry
+    static constexpr std::size_t MIN_SEGMENT_SIZE = 512;
+
+    explicit OutputQueue(std::size_t reserve = 0);
+
+    std::string &buffer();
+
+    // The bytes must outlive the queue
+    void addStatic(std::string_view data);
+    // The bytes are kept alive by the owner, which is released when the queue is cleared
+    void addShared(std::string_view data, std::shared_ptr<const void> owner);
+    void addFile(std::shared_ptr<const CachedFile> file, off_t offset, std::size_t length);
+
+    // The body that follows everything queued so far. Chunked wraps every piece in the chunked
+    // encoding, otherwise the stream must produce exactly length bytes unless it's UNKNOWN_LENGTH.
+    void setStream(std::unique_ptr<ResponseStream> stream, bool chunked, std::size_t length);
+
+    bool streaming() const;
+
+    // A body without a length and without the chunked encoding ends when the connection is closed
+    bool closeDelimited() const;
+
+    // Produces the next pieces of the stream while less than a piece waits to be sent. Returns false
+    // if the stream broke its length. flush() calls it, the asynchronous senders call it before gatherMemory().
+    bool refill();
+
+    // Nothing to send and no stream
+    bool empty() const;
+
+    // Sends as much as the socket accepts. A TLS session without kTLS encrypts the data record by record.
+    RESULT flush(int fd, IoStats &stats, TlsSession *tls = nullptr);
+
+    // For the asynchronous senders. Fills iov with the memory that precedes the next file segment and
+    // returns the number of entries, which is 0 if a file segment is next or there is nothing to send.
+    // moreFollows is set if the gathering stopped at a segment that is sent separately.
+    int gatherMemory(iovec *iov, int maxIov, std::size_t &bytes, bool &moreFollows) const;
+    void commitSent(std::size_t bytes);
+
+    bool fileNext() const;
+
+    // Sends the file segment that is next with sendfile()
+    RESULT sendNextFile(int fd, IoStats &stats);
+
+    void clear();
+
+    // The socket has SO_ZEROCOPY. flush() then sends every memory segment of at least threshold bytes
+    // by itself with MSG_ZEROCOPY, and the segment's owner is kept until the kernel reports on the error
+    // queue that it no longer reads the pages. The buffer is always copied, it's reused right away.
+    void enableZerocopy(std::size_t threshold);
+
+    // Reads the completions from the socket's error queue and releases the owners of the finished
+    // sends. Returns false if the queue holds another error.
+    bool reapZerocopy(int fd, IoStats &stats);
+
+    bool zerocopyEnabled() const;
+
+    // Sends whose completion hasn't been read yet
+    bool zerocopyPending() const;
+
+    // When the connection is closed: the owners of the unfinished sends go to retired, the kernel
+    // may still read their pages after close()
+    void resetZerocopy(ZerocopyRetired &retired);
+
+private:
+    struct Segment {
+        std::size_t m_position;
+        const char *m_data;                         // Memory segment
+        std::shared_ptr<const void> m_owner;        // Keeps the memory alive, nullptr for static memory
+        std::shared_ptr<const CachedFile> m_file;   // File segment
+        off_t m_offset;
+        std::size_t m_length;
+    };
+
+    struct ZerocopySend {
+        std::uint32_t m_id;                         // The kernel numbers the sends of a socket from 0
+        std::shared_ptr<const void> m_owner;
+    };
+
+    // sent is set to the number of bytes accepted by the socket
+    RESULT sendMemory(int fd, std::size_t &sent, IoStats &stats);
+    RESULT sendZerocopy(int fd, std::size_t &sent, IoStats &stats);
+    RESULT sendFile(int fd, Segment &segment, std::size_t &sent);
+    RESULT sendTls(TlsSession &tls, std::size_t &sent);
+
+    bool zerocopyNext() const;
+    bool sendsSeparately(const Segment &segment) const;
+
+    // Skips the bytes that have been sent
+    void advance(std::size_t bytes);
+
+    std::string m_buffer;
+    std::size_t m_sent{ 0 };
+
+    std::vector<Segment> m_segments;
+    std::size_t m_segmentIdx{ 0 };
+
+    std::size_t m_zerocopyThreshold{ 0 };           // 0 without SO_ZEROCOPY
+    std::uint32_t m_zerocopyNextId{ 0 };
+    std::uint32_t m_zerocopyPending{ 0 };
+    std::vector<ZerocopySend> m_zerocopyOwners;     // In the order of the ids
+
+    std::unique_ptr<ResponseStream> m_stream;
+    bool m_chunked{ false };
+    std::size_t m_streamLength{ UNKNOWN_LENGTH };
+    std::size_t m_streamProduced{ 0 };
+};
+
+// The owners of the zero-copy sends that were still in flight when their connection was closed. Their
+// completions can't be read after close(), so they are released after a delay that covers sending
+// what was left in the socket. One per worker.
+class ZerocopyRetired {
+public:
+    static constexpr std::chrono::seconds DELAY{ 60 };
+
+    void retire(std::shared_ptr<const void> owner);
+
+    // Releases the owners whose delay has elapsed
+    void onTimer(std::chrono::steady_clock::time_point now);
+
+private:
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<const void>>> m_owners;
+};
+
+#endif // !_OUTPUT_QUEUE_H_
@@ -0,0 +1,124 @@
+#include "Reactor.h"
+#include "EpollReactor.h"
+#include "UringReactor.h"
+
+#include <cstdio>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+std::unique_ptr<Reactor> Reactor::create(IO_BACKEND backend, ServerThread &thread, int listenerfd) {
+	switch (backend) {
+	case IO_BACKEND::IO_URING: {
+		auto reactor = std::make_unique<UringReactor>(thread, listenerfd);
+		if (!reactor->init()) {
+			return nullptr;
+		}
+
+		return reactor;
+	}
+	default: {
+		auto reactor = std::make_unique<EpollReactor>(thread, listenerfd);
+		if (!reactor->init()) {
+			return nullptr;
+		}
+
+		return reactor;
+	}
+	}
+}
+
+ClientHandoff::ClientHandoff()
+	: m_cells{ new Cell[CAPACITY] } {
+
+	for (std::size_t i = 0; i < CAPACITY; ++i) {
+		m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+		m_cells[i].m_fd = -1;
+	}
+}
+
+ClientHandoff::~ClientHandoff() {
+	// The sockets that the worker never took
+	int clientfd;
+	while (pop(clientfd)) {
+		close(clientfd);
+	}
+
+	if (m_eventfd != -1) {
+		close(m_eventfd);
+	}
+}
+
+bool ClientHandoff::init() {
+	m_eventfd = eventfd(0, EFD_CLOEXEC);
+	if (m_eventfd == -1) {
+		perror("eventfd");
+		return false;
+	}
+
+	return true;
+}
+
+int ClientHandoff::fd() const {
+	return m_eventfd;
+}
+
+bool ClientHandoff::push(int clientfd) {
+	// A cell is free for the position when its sequence equals the position (Vyukov's bounded queue)
+	std::size_t position = m_tail.load(std::memory_order_relaxed);
+	Cell *cell;
+
+	while (true) {
+		cell = &m_cells[position % CAPACITY];
+
+		const std::size_t sequence = cell->m_sequence.load(std::memory_order_acquire);
+		const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence - position);
+
+		if (diff == 0) {
+			if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			return false; // Full
+		}
+		else {
+			position = m_tail.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->m_fd = clientfd;
+	cell->m_sequence.store(position + 1, std::memory_order_release);
+
+	if (!m_signalled.exchange(true, std::memory_order_acq_rel)) {
+		const std::uint64_t one = 1;
+		if (write(m_eventfd, &one, sizeof(one)) == -1) {
+			perror("write(eventfd)");
+		}
+	}
+
+	return true;
+}
+
+bool ClientHandoff::pop(int &clientfd) {
+	const std::size_t head = m_head.load(std::memory_order_relaxed);
+	Cell &cell = m_cells[head % CAPACITY];
+
+	if (cell.m_sequence.load(std::memory_order_acquire) != head + 1) {
+		return false; // Empty, or the producer hasn't finished writing the cell
+	}
+
+	clientfd = cell.m_fd;
+	cell.m_sequence.store(head + CAPACITY, std::memory_order_release);
+	m_head.store(head + 1, std::memory_order_relaxed);
+
+	return true;
+}
+
+std::size_t ClientHandoff::size() const {
+	const std::size_t head = m_head.load(std::memory_order_relaxed);
+	const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+	return tail > head ? tail - head : 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+#include "ServerConfig.h"
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+class ServerThread;
+
+// The event loop of a worker thread. It owns the I/O of the worker's connections and hands the
+// received bytes to ServerThread::processRequests().
+class Reactor {
+public:
+	virtual ~Reactor() = default;
+
+	// Runs in the worker thread and never returns
+	virtual void run() = 0;
+
+	// Called by the dispatcher thread. Returns false if the worker can't take the connection.
+	virtual bool addClient(int fd) = 0;
+
+	// The connections handed over by the dispatcher that the worker hasn't taken yet. Any thread.
+	virtual std::size_t pendingClients() const = 0;
+
+	// When listenerfd is valid the reactor accepts its own connections from it (SO_REUSEPORT mode).
+	// Returns nullptr if the backend can't be set up.
+	static std::unique_ptr<Reactor> create(IO_BACKEND backend, ServerThread &thread, int listenerfd);
+};
+
+// The sockets that the dispatcher thread has accepted for a worker: a bounded lock-free queue with
+// any number of producers and the worker as the only consumer. The worker takes the connection
+// slots itself, so ThreadData is never touched by another thread. The eventfd is written only
+// by the push that finds the worker not signalled yet, a burst of connections costs one wakeup.
+class ClientHandoff {
+public:
+	static constexpr std::size_t CAPACITY = 4096;
+
+	ClientHandoff();
+	~ClientHandoff();
+
+	ClientHandoff(const ClientHandoff &) = delete;
+	ClientHandoff &operator=(const ClientHandoff &) = delete;
+
+	bool init();
+	int fd() const;
+
+	// Any thread. Returns false if the queue is full.
+	bool push(int clientfd);
+
+	// Any thread, approximate while the queue is being used
+	std::size_t size() const;
+
+	// Worker thread, after the eventfd has been read. Calls onClient(int fd) for every queued socket.
+	template <typename OnClient>
+	void drain(OnClient &&onClient);
+
+private:
+	bool pop(int &clientfd);
+
+private:
+	struct Cell {
+		std::atomic<std::size_t> m_sequence;
+		int m_fd;
+	};
+
+	int m_eventfd{ -1 };
+
+	std::unique_ptr<Cell[]> m_cells;
+
+	alignas(64) std::atomic<std::size_t> m_tail{ 0 };	// Producers
+	alignas(64) std::atomic<bool> m_signalled{ false };
+	alignas(64) std::atomic<std::size_t> m_head{ 0 };	// Written only by the consumer
+};
+
+template <typename OnClient>
+void ClientHandoff::drain(OnClient &&onClient) {
+	// Cleared first, a push that the loop below misses signals the eventfd again
+	m_signalled.exchange(false, std::memory_order_acq_rel);
+
+	int clientfd;
+	while (pop(clientfd)) {
+		onClient(clientfd);
+	}
+}
+
+#endif // !_REACTOR_H_
@@ -0,0 +1,16 @@
+#include "RequestArena.h"
+
+RequestArena::RequestArena()
+    : m_buffer{ std::make_unique<std::byte[]>(INITIAL_SIZE) }
+    , m_resource{ m_buffer.get(), INITIAL_SIZE, std::pmr::new_delete_resource() } {
+
+}
+
+std::pmr::memory_resource *RequestArena::resource() {
+    return &m_resource;
+}
+
+void RequestArena::reset() {
+    // Returns the overflow blocks to the heap and starts again from the beginning of m_buffer
+    m_resource.release();
+}
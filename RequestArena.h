@@ -0,0 +1,29 @@
+#ifndef _REQUEST_ARENA_H_
+#define _REQUEST_ARENA_H_
+
+#include <memory>
+#include <cstddef>
+#include <memory_resource>
+
+// Per-worker bump allocator for the memory that is needed only while one request is handled.
+// The first INITIAL_SIZE bytes are allocated once, so a typical request doesn't touch the heap.
+// Anything above that comes from the global heap and is released together with the rest by reset().
+class RequestArena {
+public:
+    static constexpr std::size_t INITIAL_SIZE = 16 * 1024;
+
+    RequestArena();
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    std::pmr::memory_resource *resource();
+
+    // Frees everything at once. Nothing allocated from the arena may be used afterwards.
+    void reset();
+
+private:
+    std::unique_ptr<std::byte[]> m_buffer;
+    std::pmr::monotonic_buffer_resource m_resource;
+};
+
+#endif // !_REQUEST_ARENA_H_
@@ -0,0 +1,36 @@
+#ifndef _RESPONSE_STREAM_H_
+#define _RESPONSE_STREAM_H_
+
+#include "HttpMessage.h"
+
+#include <string>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+// A response whose body is produced in pieces, for the bodies that are too large to build in memory.
+// The connection asks for the next piece only when less than PIECE_SIZE bytes wait to be sent, so
+// a slow client pauses the producer instead of growing the output queue. The stream is created by
+// the handler and owned by the connection until the last piece has been produced or the connection
+// is closed, so it must copy whatever it needs from the request.
+class ResponseStream {
+public:
+    static constexpr std::size_t PIECE_SIZE = 64 * 1024;
+
+    virtual ~ResponseStream() = default;
+
+    virtual HTTP_RESPONSE_CODE status() const { return HTTP_RESPONSE_CODE::_200; }
+
+    // The bytes must outlive the stream
+    virtual std::string_view contentType() const = 0;
+
+    // Without a length the body is sent with "Transfer-Encoding: chunked" (HTTP/1.0: until the
+    // connection is closed). A stream that produces a different number of bytes than it declared
+    // gets its connection closed.
+    virtual std::optional<std::size_t> contentLength() const { return std::nullopt; }
+
+    // Appends the next piece, about PIECE_SIZE bytes, to out. Returns false after the last piece.
+    virtual bool produce(std::string &out) = 0;
+};
+
+#endif // !_RESPONSE_STREAM_H_
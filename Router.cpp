@@ -0,0 +1,399 @@
+#include "Router.h"
+
+#include <cstring>
+#include <optional>
+#include <algorithm>
+
+struct Router::BuildNode {
+    BuildNode(NODE_TYPE type, std::string_view label)
+        : m_type{ type }
+        , m_label{ label } {
+        m_routes.fill(NONE);
+    }
+
+    NODE_TYPE m_type;
+    std::string m_label;
+    std::vector<std::unique_ptr<BuildNode>> m_children;
+    std::unique_ptr<BuildNode> m_param;
+    std::unique_ptr<BuildNode> m_wildcard;
+    MethodRoutes_t m_routes;
+    bool m_hasRoutes{ false };
+};
+
+namespace {
+
+bool isSegmentStart(std::string_view pattern, std::size_t idx) {
+    return idx > 0 && pattern[idx - 1] == '/';
+}
+
+}
+
+Router::Router()
+    : m_root{ std::make_unique<BuildNode>(NODE_TYPE::STATIC, std::string_view{}) } {
+}
+
+Router::~Router() = default;
+
+bool Router::add(HTTP_METHOD method, std::string_view pattern, std::uint32_t routeId) {
+    if (pattern.empty() || pattern.front() != '/' || method == HTTP_METHOD::INVALID_METHOD) {
+        return false;
+    }
+
+    BuildNode *node = m_root.get();
+    std::size_t idx = 0;
+
+    while (idx < pattern.size()) {
+        const char c = pattern[idx];
+
+        if (c == ':' && isSegmentStart(pattern, idx)) {
+            const auto end = std::min(pattern.find('/', idx), pattern.size());
+            const std::string_view name = pattern.substr(idx + 1, end - idx - 1);
+
+            if (name.empty()) {
+                return false;
+            }
+
+            if (!node->m_param) {
+                node->m_param = std::make_unique<BuildNode>(NODE_TYPE::PARAM, name);
+            }
+            else if (node->m_param->m_label != name) {
+                return false;
+            }
+
+            node = node->m_param.get();
+            idx = end;
+            continue;
+        }
+
+        if (c == '*' && isSegmentStart(pattern, idx)) {
+            const std::string_view name = pattern.substr(idx + 1);
+
+            if (name.empty() || name.find('/') != std::string_view::npos) {
+                return false;
+            }
+
+            if (!node->m_wildcard) {
+                node->m_wildcard = std::make_unique<BuildNode>(NODE_TYPE::WILDCARD, name);
+            }
+            else if (node->m_wildcard->m_label != name) {
+                return false;
+            }
+
+            node = node->m_wildcard.get();
+            idx = pattern.size();
+            continue;
+        }
+
+        // Static text up to the next parameter
+        std::size_t end = idx + 1;
+        while (end < pattern.size() && !((pattern[end] == ':' || pattern[end] == '*') && isSegmentStart(pattern, end))) {
+            ++end;
+        }
+
+        std::string_view text = pattern.substr(idx, end - idx);
+        idx = end;
+
+        while (!text.empty()) {
+            auto it = std::find_if(node->m_children.begin(), node->m_children.end(), [&text](const auto &child) { return child->m_label.front() == text.front(); });
+
+            if (it == node->m_children.end()) {
+                node = node->m_children.emplace_back(std::make_unique<BuildNode>(NODE_TYPE::STATIC, text)).get();
+                break;
+            }
+
+            BuildNode *child = it->get();
+
+            const std::size_t maxCommon = std::min(child->m_label.size(), text.size());
+            std::size_t common = 0;
+            while (common < maxCommon && child->m_label[common] == text[common]) {
+                ++common;
+            }
+
+            // Split the edge at the end of the common prefix
+            if (common < child->m_label.size()) {
+                auto split = std::make_unique<BuildNode>(NODE_TYPE::STATIC, std::string_view{ child->m_label }.substr(0, common));
+                child->m_label.erase(0, common);
+                split->m_children.push_back(std::move(*it));
+                *it = std::move(split);
+                child = it->get();
+            }
+
+            node = child;
+            text.remove_prefix(common);
+        }
+    }
+
+    auto &route = node->m_routes[static_cast<std::size_t>(method)];
+    if (route != NONE) {
+        return false;
+    }
+
+    route = routeId;
+    node->m_hasRoutes = true;
+
+    // Flattening on every insertion would make adding the routes quadratic
+    m_dirty.store(true, std::memory_order_relaxed);
+
+    return true;
+}
+
+void Router::finalize() const {
+    if (!m_dirty.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    // The workers may start their lookups at the same time
+    std::lock_guard lock{ m_buildMutex };
+
+    if (m_dirty.load(std::memory_order_relaxed)) {
+        build();
+        m_dirty.store(false, std::memory_order_release);
+    }
+}
+
+Router::RESULT Router::findInTree(HTTP_METHOD method, std::string_view path, std::uint32_t &routeId, RouteParams &params) const {
+    // The routes may have been added after the last lookup
+    if (m_dirty.load(std::memory_order_acquire)) {
+        finalize();
+
+        const auto &staticPaths = m_staticPaths[static_cast<std::size_t>(method)];
+
+        if (auto it = staticPaths.find(path); it != staticPaths.end()) {
+            routeId = it->second;
+            return RESULT::FOUND;
+        }
+    }
+
+    const MethodRoutes_t *routes = lookup(path, params);
+    if (!routes) {
+        return RESULT::NOT_FOUND;
+    }
+
+    routeId = (*routes)[static_cast<std::size_t>(method)];
+    if (routeId == NONE) {
+        params.clear();
+        return RESULT::METHOD_NOT_ALLOWED;
+    }
+
+    return RESULT::FOUND;
+}
+
+std::uint16_t Router::allowedMethods(std::string_view path) const {
+    RouteParams params;
+
+    const MethodRoutes_t *routes = lookup(path, params);
+    if (!routes) {
+        return 0;
+    }
+
+    std::uint16_t mask = 0;
+    for (std::size_t method = 0; method < METHODS_NUM; ++method) {
+        if ((*routes)[method] != NONE) {
+            mask |= static_cast<std::uint16_t>(1u << method);
+        }
+    }
+
+    return mask;
+}
+
+const Router::MethodRoutes_t *Router::lookup(std::string_view path, RouteParams &params) const {
+    finalize();
+
+    std::uint32_t routesIdx = NONE;
+    return match(0, path, params, routesIdx) ? &m_routes[routesIdx] : nullptr;
+}
+
+bool Router::match(std::uint32_t nodeIdx, std::string_view path, RouteParams &params, std::uint32_t &routesIdx) const {
+    const std::size_t paramsNum = params.size();
+
+    auto fail = [&params, paramsNum]() {
+        params.truncate(paramsNum);
+        return false;
+    };
+
+    // Descends iteratively while there is a single candidate and recurses only where it may have to backtrack
+    while (true) {
+        const Node &node = m_nodes[nodeIdx];
+        const std::string_view label{ m_labels.data() + node.m_labelBegin, node.m_labelLength };
+
+        switch (node.m_type) {
+        case NODE_TYPE::STATIC:
+            if (path.size() < label.size() || std::memcmp(path.data(), label.data(), label.size()) != 0) {
+                return fail();
+            }
+
+            path.remove_prefix(label.size());
+            break;
+        case NODE_TYPE::PARAM: {
+            const std::string_view segment = path.substr(0, path.find('/'));
+            if (segment.empty() || !params.push(label, segment)) {
+                return fail();
+            }
+
+            path.remove_prefix(segment.size());
+            break;
+        }
+        case NODE_TYPE::WILDCARD:
+            if (!params.push(label, path)) {
+                return fail();
+            }
+
+            routesIdx = node.m_routes;
+            return true;
+        }
+
+        if (path.empty()) {
+            if (node.m_routes != NONE) {
+                routesIdx = node.m_routes;
+                return true;
+            }
+
+            // A wildcard matches an empty rest too
+            if (node.m_wildcardChild != NONE && match(node.m_wildcardChild, path, params, routesIdx)) {
+                return true;
+            }
+
+            return fail();
+        }
+
+        std::uint32_t staticChild = NONE;
+
+        const char *firstChars = m_firstChars.data() + node.m_firstChild;
+        for (std::uint32_t i = 0; i < node.m_childrenNum; ++i) {
+            if (firstChars[i] == path.front()) {
+                staticChild = node.m_firstChild + i;
+                break;
+            }
+        }
+
+        if (node.m_paramChild == NONE && node.m_wildcardChild == NONE) {
+            if (staticChild == NONE) {
+                return fail();
+            }
+
+            nodeIdx = staticChild;
+            continue;
+        }
+
+        if (staticChild != NONE && match(staticChild, path, params, routesIdx)) {
+            return true;
+        }
+
+        if (node.m_paramChild != NONE && match(node.m_paramChild, path, params, routesIdx)) {
+            return true;
+        }
+
+        if (node.m_wildcardChild != NONE && match(node.m_wildcardChild, path, params, routesIdx)) {
+            return true;
+        }
+
+        return fail();
+    }
+}
+
+void Router::build() const {
+    m_nodes.clear();
+    m_firstChars.clear();
+    m_routes.clear();
+    m_labels.clear();
+    for (auto &paths : m_staticPaths) {
+        paths.clear();
+    }
+
+    m_staticPathsStorage.clear();
+
+    std::vector<const BuildNode *> order;
+
+    // The full path of every node that is reachable through static nodes only
+    std::vector<std::optional<std::string>> staticPaths;
+    std::vector<std::pair<std::size_t, std::uint32_t>> staticRoutes;
+
+    auto appendNode = [this, &order, &staticPaths, &staticRoutes](const BuildNode *buildNode, const std::string *parentPath) {
+        Node node;
+        node.m_labelBegin = static_cast<std::uint32_t>(m_labels.size());
+        node.m_labelLength = static_cast<std::uint32_t>(buildNode->m_label.size());
+        node.m_firstChild = NONE;
+        node.m_paramChild = NONE;
+        node.m_wildcardChild = NONE;
+        node.m_routes = NONE;
+        node.m_childrenNum = 0;
+        node.m_type = buildNode->m_type;
+
+        if (buildNode->m_hasRoutes) {
+            node.m_routes = static_cast<std::uint32_t>(m_routes.size());
+            m_routes.push_back(buildNode->m_routes);
+        }
+
+        if (parentPath && buildNode->m_type == NODE_TYPE::STATIC) {
+            staticPaths.push_back(*parentPath + buildNode->m_label);
+
+            if (node.m_routes != NONE) {
+                staticRoutes.emplace_back(staticPaths.size() - 1, node.m_routes);
+            }
+        }
+        else {
+            staticPaths.push_back(std::nullopt);
+        }
+
+        m_labels += buildNode->m_label;
+        m_firstChars.push_back(buildNode->m_type == NODE_TYPE::STATIC && !buildNode->m_label.empty() ? buildNode->m_label.front() : '\0');
+        m_nodes.push_back(node);
+        order.push_back(buildNode);
+
+        return static_cast<std::uint32_t>(m_nodes.size() - 1);
+    };
+
+    const std::string rootPath;
+    appendNode(m_root.get(), &rootPath);
+
+    // Breadth-first, so the static children of every node are adjacent
+    for (std::size_t idx = 0; idx < order.size(); ++idx) {
+        const BuildNode *buildNode = order[idx];
+        const std::optional<std::string> path = staticPaths[idx]; // A copy, appending may reallocate
+
+        std::vector<const BuildNode *> children;
+        children.reserve(buildNode->m_children.size());
+        for (const auto &child : buildNode->m_children) {
+            children.push_back(child.get());
+        }
+
+        std::sort(children.begin(), children.end(), [](const BuildNode *lhs, const BuildNode *rhs) { return lhs->m_label.front() < rhs->m_label.front(); });
+
+        if (!children.empty()) {
+            m_nodes[idx].m_firstChild = static_cast<std::uint32_t>(m_nodes.size());
+            m_nodes[idx].m_childrenNum = static_cast<std::uint16_t>(children.size());
+
+            for (const BuildNode *child : children) {
+                appendNode(child, path ? &*path : nullptr);
+            }
+        }
+
+        if (buildNode->m_param) {
+            m_nodes[idx].m_paramChild = appendNode(buildNode->m_param.get(), nullptr);
+        }
+
+        if (buildNode->m_wildcard) {
+            m_nodes[idx].m_wildcardChild = appendNode(buildNode->m_wildcard.get(), nullptr);
+        }
+    }
+
+    // The routes without parameters are also indexed by their full path, so they are found with a
+    // single hash lookup. The keys are views into one string, which is not modified afterwards.
+    for (const auto &[pathIdx, routesIdx] : staticRoutes) {
+        m_staticPathsStorage += *staticPaths[pathIdx];
+    }
+
+    std::size_t offset = 0;
+    for (const auto &[pathIdx, routesIdx] : staticRoutes) {
+        const std::size_t length = staticPaths[pathIdx]->size();
+        const std::string_view key{ m_staticPathsStorage.data() + offset, length };
+
+        for (std::size_t method = 0; method < METHODS_NUM; ++method) {
+            if (const std::uint32_t routeId = m_routes[routesIdx][method]; routeId != NONE) {
+                m_staticPaths[method].emplace(key, routeId);
+            }
+        }
+
+        offset += length;
+    }
+}
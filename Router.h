@@ -0,0 +1,123 @@
+#ifndef _ROUTER_H_
+#define _ROUTER_H_
+
+#include "HttpMessage.h"
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+// Radix tree that maps (method, path) to a route id in a single walk.
+// Patterns may contain ":name" segments, which match one path segment, and a trailing "*name",
+// which matches the rest of the path. Static text wins over parameters and parameters win over wildcards.
+//
+// The routes are inserted into a pointer-based tree, which is then flattened into contiguous
+// arrays: the children of a node are adjacent and their first characters are stored separately,
+// so a lookup touches a few cache lines per level. The routes without parameters are additionally
+// indexed by their full path, which is a single hash lookup regardless of the tree depth.
+// Both are built once after the routes have been added, by finalize() or by the first lookup.
+// All routes must be added before the lookups start.
+class Router {
+public:
+    static constexpr std::uint32_t NO_ROUTE = UINT32_MAX;
+
+    enum class RESULT {
+        FOUND,
+        METHOD_NOT_ALLOWED,
+        NOT_FOUND
+    };
+
+    Router();
+    ~Router();
+
+    // Returns false if the pattern is invalid or conflicts with an existing one
+    bool add(HTTP_METHOD method, std::string_view pattern, std::uint32_t routeId);
+
+    // Flattens the routes added so far, otherwise the first lookup does it
+    void finalize() const;
+
+    // The captured parameters are views into the route table and the path
+    RESULT find(HTTP_METHOD method, std::string_view path, std::uint32_t &routeId, RouteParams &params) const;
+
+    // Bit mask of the methods (1 << HTTP_METHOD) registered for the path, used for the Allow header
+    std::uint16_t allowedMethods(std::string_view path) const;
+
+private:
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+    static constexpr std::size_t METHODS_NUM = static_cast<std::size_t>(HTTP_METHOD::INVALID_METHOD);
+
+    enum class NODE_TYPE : std::uint8_t {
+        STATIC,
+        PARAM,
+        WILDCARD
+    };
+
+    using MethodRoutes_t = std::array<std::uint32_t, METHODS_NUM>;
+
+    struct BuildNode;
+
+    struct Node {
+        std::uint32_t m_labelBegin;     // Static text or parameter name in m_labels
+        std::uint32_t m_labelLength;
+        std::uint32_t m_firstChild;     // The static children are [m_firstChild, m_firstChild + m_childrenNum)
+        std::uint32_t m_paramChild;
+        std::uint32_t m_wildcardChild;
+        std::uint32_t m_routes;         // Index in m_routes or NONE
+        std::uint16_t m_childrenNum;
+        NODE_TYPE m_type;
+    };
+
+    // The paths that aren't in the method's map of exact paths
+    RESULT findInTree(HTTP_METHOD method, std::string_view path, std::uint32_t &routeId, RouteParams &params) const;
+
+    // The route ids of the path by method, nullptr if no pattern matches it
+    const MethodRoutes_t *lookup(std::string_view path, RouteParams &params) const;
+    bool match(std::uint32_t nodeIdx, std::string_view path, RouteParams &params, std::uint32_t &routesIdx) const;
+
+    void build() const;
+
+private:
+    std::unique_ptr<BuildNode> m_root;
+
+    // The flattened tree, built from m_root when it's needed after the routes have changed
+    mutable std::atomic<bool> m_dirty{ true };
+    mutable std::mutex m_buildMutex;
+
+    mutable std::vector<Node> m_nodes;
+    mutable std::vector<char> m_firstChars; // The first character of every static node's label, indexed as m_nodes
+    mutable std::vector<MethodRoutes_t> m_routes;
+    mutable std::string m_labels;
+
+    // One map per method with the route id as the value, so an exact path is resolved by the hash lookup
+    // alone. A path registered only for other methods misses and the tree answers METHOD_NOT_ALLOWED.
+    mutable std::array<std::unordered_map<std::string_view, std::uint32_t>, METHODS_NUM> m_staticPaths;
+    mutable std::string m_staticPathsStorage;
+};
+
+// The exact paths are resolved inline, the call to the tree would cost as much as the hash lookup
+inline Router::RESULT Router::find(HTTP_METHOD method, std::string_view path, std::uint32_t &routeId, RouteParams &params) const {
+    params.clear();
+
+    if (method == HTTP_METHOD::INVALID_METHOD) {
+        return RESULT::NOT_FOUND;
+    }
+
+    if (!m_dirty.load(std::memory_order_acquire)) {
+        const auto &staticPaths = m_staticPaths[static_cast<std::size_t>(method)];
+
+        if (auto it = staticPaths.find(path); it != staticPaths.end()) {
+            routeId = it->second;
+            return RESULT::FOUND;
+        }
+    }
+
+    return findInTree(method, path, routeId, params);
+}
+
+#endif // !_ROUTER_H_
@@ -1,296 +1,473 @@
 #include "Server.h"
 #include "ServerResponses.h"
+#include "HttpParser.h"
+#include "Metrics.h"
 
-Server::Server()
-    : m_methodHandlers(static_cast<int>(HTTP_METHOD::INVALID_METHOD)) {
+#include <thread>
+#include <iostream>
+
+Server::Server(const ServerConfig &config)
+    : m_config{ config } {
     using namespace std::string_view_literals;
 
-    addHandler(
-        HTTP_METHOD::GET
-        , "/"
-        , [](std::string &response, const HttpRequest &request) {
-            getResponseLine(response, request.line().m_httpVersion, HTTP_RESPONSE_CODE::_200);
+    addFixedResponse(HTTP_METHOD::GET, "/", HTTP_RESPONSE_CODE::_200, "text/html"sv, ResponseBody::MAIN_HTML_PAGE);
+    addFixedResponse(HTTP_METHOD::GET, "/text", HTTP_RESPONSE_CODE::_200, "text/plain"sv, ResponseBody::MAIN_TEXT_PAGE);
 
-            response += "Content-Type: text/html"sv;
-            response += ResponseBody::CRLF;
+    for (const auto &[prefix, root] : m_config.m_staticRoutes) {
+        if (!addStaticRoute(prefix, root)) {
+            std::cerr << "Can't add a static route for " << prefix << '\n';
+        }
+    }
 
-            const static std::string CONTENT_LENGTH_HEADER = "Content-Length: " + std::to_string(ResponseBody::MAIN_HTML_PAGE.size());
-            response += CONTENT_LENGTH_HEADER;
-            response += ResponseBody::CRLF;
+    if (m_config.m_tls.enabled() && !m_tls.init(m_config.m_tls)) {
+        std::cerr << "Can't set up TLS with " << m_config.m_tls.m_certFile << '\n';
+    }
 
-            response += ResponseBody::CRLF;
+    if (!m_config.m_metricsPath.empty()) {
+        Route route;
+        route.m_metrics = true;
 
-            response += ResponseBody::MAIN_HTML_PAGE;
+        if (!addRoute(HTTP_METHOD::GET, m_config.m_metricsPath, route)) {
+            std::cerr << "Can't add the metrics route " << m_config.m_metricsPath << '\n';
         }
-    );
+    }
+}
 
-    addHandler(
-        HTTP_METHOD::GET
-        , "/text"
-        , [](std::string &response, const HttpRequest &request) {
-            getResponseLine(response, request.line().m_httpVersion, HTTP_RESPONSE_CODE::_200);
+const ServerConfig& Server::config() const {
+    return m_config;
+}
 
-            response += "Content-Type: text/plain"sv;
-            response += ResponseBody::CRLF;
+const TlsContext *Server::tls() const {
+    return m_tls.ready() ? &m_tls : nullptr;
+}
 
-            const static std::string CONTENT_LENGTH_HEADER = "Content-Length: " + std::to_string(ResponseBody::MAIN_TEXT_PAGE.size());
-            response += CONTENT_LENGTH_HEADER;
-            response += ResponseBody::CRLF;
+HttpRequest Server::parseRequest(char *rawInput, std::size_t len) {
+    HttpParser parser;
 
-            response += ResponseBody::CRLF;
+    if (parser.parse(rawInput, len, ParserLimits{}) == HttpParser::RESULT::BODY_FOLLOWS) {
+        parser.parse(rawInput, len, ParserLimits{});
+    }
 
-            response += ResponseBody::MAIN_TEXT_PAGE;
-        }
-    );
+    return parser.request(rawInput);
 }
 
-HttpRequest Server::parseRequest(char *rawInput, std::size_t len) {
-    auto builder = HttpRequest::create();
+int Server::createRawResponse(HttpRequest &request, OutputQueue &output, ThreadContext &context) {
+    const HTTP_METHOD method = request.line().m_method;
+
+    if (method == HTTP_METHOD::INVALID_METHOD || request.line().m_httpVersion == HTTP_VERSION::INVALID_VERSION) {
+        invalidRequest(output, context.m_date);
+        return 400;
+    }
 
-    std::size_t offset = parseRequestLine(builder, rawInput, len);
-    rawInput += offset;
-    len -= offset;
+    std::uint32_t routeId = 0;
 
-    offset = parseRequestHeaders(builder, rawInput, len);
-    rawInput += offset;
-    len -= offset;
+    switch (m_router.find(method, request.line().m_path, routeId, request.params())) {
+    case Router::RESULT::NOT_FOUND:
+        pageNotFound(output, context.m_date);
+        return 404;
+    case Router::RESULT::METHOD_NOT_ALLOWED:
+        methodNotAllowed(request, output, context.m_date);
+        return 405;
+    default:
+        break;
+    }
 
-    offset = parseRequestBody(builder, rawInput, len);
+    const Route &route = m_routes[routeId];
 
-    return builder;
-}
+    if (route.m_fixed) {
+        const auto &wire = route.m_fixed->m_wire[static_cast<int>(request.line().m_httpVersion)];
+        const PreformedResponse *response = &wire[static_cast<int>(CONTENT_ENCODING::IDENTITY)];
 
-void Server::createRawResponse(const HttpRequest &request, std::string &response) {
-    if (request.line().m_method == HTTP_METHOD::INVALID_METHOD || request.line().m_httpVersion == HTTP_VERSION::INVALID_VERSION) {
-        invalidRequest(response);
-        return;
+        if (route.m_fixed->m_compressed) {
+            if (const auto &encoded = wire[static_cast<int>(acceptedEncoding(request))]; !encoded.m_wire.empty()) {
+                response = &encoded;
+            }
+        }
+
+        sendPreformed(*response, output, context.m_date);
+        return route.m_fixed->m_status;
     }
 
-    auto &methodHandlers = m_methodHandlers[static_cast<int>(request.line().m_method)];
-    if (methodHandlers.empty()) {
-        invalidRequest(response);
-        return;
+    const std::size_t start = output.buffer().size();
+
+    if (route.m_static) {
+        if (!route.m_static->serve(request, output, context, acceptedEncoding(request))) {
+            pageNotFound(output, context.m_date);
+            return 404;
+        }
     }
+    else if (route.m_metrics) {
+        metrics(request, output, context.m_date);
+        return 200;
+    }
+    else if (route.m_streamHandler) {
+        return streamResponse(request, output, route.m_streamHandler(request), context.m_date);
+    }
+    else if (route.m_uploadHandler) {
+        // The body was complete before the route was looked up, e.g. an empty one
+        auto sink = route.m_uploadHandler(request);
 
-    auto handlerIt = methodHandlers.find(request.line().m_path);
-    if (handlerIt == methodHandlers.end()) {
-        pageNotFound(response);
-        return;
+        if (!sink || (!request.body().m_data.empty() && !sink->write(request.body().m_data))) {
+            internalError(output, context.m_date);
+            return 500;
+        }
+
+        beginHandlerResponse(output.buffer(), context.m_date);
+        sink->finish(output.buffer());
+        endHandlerResponse(output.buffer(), start);
     }
+    else if (route.m_asyncHandler) {
+        context.m_asyncHandler = route.m_asyncHandler;
+        return 0;
+    }
+    else {
+        beginHandlerResponse(output.buffer(), context.m_date);
 
-    handlerIt->second(response, request);
-}
+        if (route.m_arenaHandler) {
+            route.m_arenaHandler(output.buffer(), request, context.m_arena.resource());
+        }
+        else {
+            route.m_handler(output.buffer(), request);
+        }
 
-bool Server::checkCloseRequested(const HttpRequest &request) {
-    const static auto connectionKey = HttpHeader::calcKey("connection");
+        endHandlerResponse(output.buffer(), start);
 
-    switch (request.line().m_httpVersion) {
-    case HTTP_VERSION::HTTP_11:
-        return request.headers().hasFieldValue(connectionKey, "close");
-    case HTTP_VERSION::HTTP_10:
-        return !request.headers().hasFieldValue(connectionKey, "keep-alive");
-    default:
-        return true;
+        if (const CONTENT_ENCODING encoding = acceptedEncoding(request); encoding != CONTENT_ENCODING::IDENTITY) {
+            context.m_compressor.compressResponse(output.buffer(), start, encoding, m_config.m_compression);
+        }
     }
+
+    return statusOf(output.buffer(), start);
 }
 
-std::size_t Server::parseRequestLine(HttpRequest::Builder &builder, char *rawInput, const std::size_t len) {
-    std::size_t read = 0;
+int Server::statusOf(const std::string &response, std::size_t start) {
+    // "HTTP/1.1 200"
+    constexpr std::size_t STATUS_OFFSET = 9;
 
-    skipSpaces(read, rawInput, len);
+    if (response.size() < start + STATUS_OFFSET + 3) {
+        return 0;
+    }
 
-    const auto methodBegin = read;
+    int status = 0;
+    for (std::size_t i = start + STATUS_OFFSET; i < start + STATUS_OFFSET + 3; ++i) {
+        if (response[i] < '0' || response[i] > '9') {
+            return 0;
+        }
 
-    while (read < len && std::isalpha(rawInput[read])) {
-        ++read;
+        status = status * 10 + (response[i] - '0');
     }
 
-    std::transform(rawInput + methodBegin, rawInput + read, rawInput + methodBegin, [](char c) { return std::toupper(c); });
-    const HTTP_METHOD method = findHttpMethod({ rawInput + methodBegin, read - methodBegin });
-
-    skipSpaces(read, rawInput, len);
+    return status;
+}
 
-    const auto pathBegin = read;
+int Server::streamResponse(const HttpRequest &request, OutputQueue &output, std::unique_ptr<ResponseStream> stream, const HttpDate &date) {
+    using namespace std::string_view_literals;
 
-    while (read < len && rawInput[read] != ' ') {
-        ++read;
+    if (!stream) {
+        internalError(output, date);
+        return 500;
     }
 
-    const std::string_view path{ rawInput + pathBegin, read - pathBegin };
+    const HTTP_VERSION version = request.line().m_httpVersion;
+    const std::optional<std::size_t> length = stream->contentLength();
+    const bool chunked = !length && version == HTTP_VERSION::HTTP_11;
 
-    skipSpaces(read, rawInput, len);
+    auto &response = output.buffer();
 
-    const auto versionBegin = read;
+    getResponseLine(response, version, stream->status(), date);
 
-    while (read < len && rawInput[read] != ' ' && rawInput[read] != '\r') {
-        ++read;
+    response += "Content-Type: "sv;
+    response += stream->contentType();
+    response += ResponseBody::CRLF;
+
+    if (length) {
+        response += "Content-Length: "sv;
+        response += std::to_string(*length);
+    }
+    else if (chunked) {
+        response += "Transfer-Encoding: chunked"sv;
+    }
+    else {
+        // An HTTP/1.0 client reads the body until the connection is closed
+        response += "Connection: close"sv;
     }
+    response += ResponseBody::CRLF;
 
-    const HTTP_VERSION version = findHttpVersion({ rawInput + versionBegin, read - versionBegin });
+    response += ResponseBody::CRLF;
 
-    builder.line()
-        .setMethod(method)
-        .setPath(path)
-        .setHttpVersion(version);
+    const int status = codeToNumber(stream->status());
 
-    return read;
+    if (request.line().m_method != HTTP_METHOD::HEAD) {
+        output.setStream(std::move(stream), chunked, length.value_or(OutputQueue::UNKNOWN_LENGTH));
+    }
+
+    return status;
 }
 
-std::size_t Server::parseRequestHeaders(HttpRequest::Builder &builder, char *rawInput, const int len) {
-    std::size_t read = 0;
+void Server::finalizeRoutes() const {
+    m_router.finalize();
+}
 
-    skipCRLF(read, rawInput, len);
+void Server::setWorkers(const ServerThread *threads, int threadsNum) {
+    m_workers = threads;
+    m_workersNum = threadsNum;
+}
 
-    auto headers = builder.header();
+void Server::metrics(const HttpRequest &request, OutputQueue &output, const HttpDate &date) const {
+    using namespace std::string_view_literals;
 
-    while (true) {
-        skipSpaces(read, rawInput, len);
+    // Built separately for its length and queued without copying
+    auto body = std::make_shared<std::string>();
+    Metrics::writePrometheus(*body, m_workers, m_workersNum);
+    const std::string_view bodyView = *body;
 
-        const auto fieldStart = read;
+    auto &response = output.buffer();
 
-        while (read < len && rawInput[read] != ' ' && rawInput[read] != ':') {
-            ++read;
-        }
+    getResponseLine(response, request.line().m_httpVersion, HTTP_RESPONSE_CODE::_200, date);
 
-        std::transform(rawInput + fieldStart, rawInput + read, rawInput + fieldStart, [](char c) { return std::tolower(c); });
-        const std::string_view field{ rawInput + fieldStart, read - fieldStart };
+    response += "Content-Type: text/plain; version=0.0.4"sv;
+    response += ResponseBody::CRLF;
 
-        if (read >= len || rawInput[read] != ':') {
-            return {};
-        }
+    response += "Content-Length: "sv;
+    response += std::to_string(bodyView.size());
+    response += ResponseBody::CRLF;
 
-        ++read;
-        skipSpaces(read, rawInput, len);
+    response += ResponseBody::CRLF;
 
-        const auto valueStart = read;
+    output.addShared(bodyView, std::move(body));
+}
 
-        while (read < len && rawInput[read] != '\r' && rawInput[read] != '\n') {
-            ++read;
-        }
+Router::RESULT Server::findUploadHandler(HttpRequest &request, UploadHandler_t &handler) const {
+    const HTTP_METHOD method = request.line().m_method;
 
-        const std::string_view value{ rawInput + valueStart, read - valueStart };
+    handler = nullptr;
 
-        headers.add(field, value);
+    if (method == HTTP_METHOD::INVALID_METHOD || request.line().m_httpVersion == HTTP_VERSION::INVALID_VERSION) {
+        return Router::RESULT::NOT_FOUND;
+    }
 
-        skipCRLF(read, rawInput, len);
+    std::uint32_t routeId = 0;
 
-        if (read >= len || rawInput[read] == '\r') {
-            break;
-        }
+    const Router::RESULT result = m_router.find(method, request.line().m_path, routeId, request.params());
+
+    if (result == Router::RESULT::FOUND) {
+        handler = m_routes[routeId].m_uploadHandler;
     }
 
-    return read;
+    return result;
 }
 
-std::size_t Server::parseRequestBody(HttpRequest::Builder &builder, char *rawInput, const int len) {
-    std::size_t read = 0;
-
-    skipCRLF(read, rawInput, len);
+void Server::continueResponse(OutputQueue &output) {
+    static const std::string RESPONSE = []() {
+        // An interim response, neither Server nor Date is needed
+        std::string response{ versionToString(HTTP_VERSION::HTTP_11) };
+        response += codeToString(HTTP_RESPONSE_CODE::_100);
+        response += ResponseBody::CRLF;
+        response += ResponseBody::CRLF;
 
-    if (read < len) {
-        builder.body().set({ rawInput + read, len - read });
-    }
+        return response;
+    }();
 
-    return len;
+    output.addStatic(RESPONSE);
 }
 
-void Server::skipSpaces(std::size_t &idx, const char *str, const std::size_t len) {
-    while (idx < len && str[idx] == ' ') {
-        ++idx;
+bool Server::checkCloseRequested(const HttpRequest &request) {
+    switch (request.line().m_httpVersion) {
+    case HTTP_VERSION::HTTP_11:
+        return request.headers().hasFieldValue(HTTP_HEADER::CONNECTION, "close");
+    case HTTP_VERSION::HTTP_10:
+        return !request.headers().hasFieldValue(HTTP_HEADER::CONNECTION, "keep-alive");
+    default:
+        return true;
     }
 }
 
-void Server::skipCRLF(std::size_t &idx, const char *str, const std::size_t len) {
-    while (idx < len && str[idx] == '\r') {
-        ++idx;
-    }
+void Server::invalidRequest(OutputQueue &output, const HttpDate &date) {
+    const static PreformedResponse RESPONSE = serializeResponse(HTTP_VERSION::HTTP_11, HTTP_RESPONSE_CODE::_400, "text/plain", ResponseBody::INVALID_REQUEST);
 
-    if (idx < len && str[idx] == '\n') {
-        ++idx;
-    }
+    sendPreformed(RESPONSE, output, date);
 }
 
-HTTP_METHOD Server::findHttpMethod(std::string_view method) {
-    using namespace std::string_view_literals;
+void Server::internalError(OutputQueue &output, const HttpDate &date) {
+    const static PreformedResponse RESPONSE = serializeResponse(HTTP_VERSION::HTTP_11, HTTP_RESPONSE_CODE::_500, "text/plain", ResponseBody::INTERNAL_ERROR);
 
-    static constexpr std::array methodMap = {
-        std::make_pair("GET"sv, HTTP_METHOD::GET),
-        std::make_pair("HEAD"sv, HTTP_METHOD::HEAD),
-        std::make_pair("PUT"sv, HTTP_METHOD::PUT),
-        std::make_pair("DELETE"sv, HTTP_METHOD::DELETE),
-        std::make_pair("CONNECT"sv, HTTP_METHOD::CONNECT),
-        std::make_pair("OPTIONS"sv, HTTP_METHOD::OPTIONS),
-        std::make_pair("TRACE"sv, HTTP_METHOD::TRACE),
-        std::make_pair("PATCH"sv, HTTP_METHOD::PATCH)
-    };
+    sendPreformed(RESPONSE, output, date);
+}
 
-    auto it = std::find_if(methodMap.begin(), methodMap.end(), [method](const auto &pair) { return method == pair.first; });
-    if (it == methodMap.end()) {
-        return HTTP_METHOD::INVALID_METHOD;
-    }
+void Server::pageNotFound(OutputQueue &output, const HttpDate &date) {
+    const static PreformedResponse RESPONSE = serializeResponse(HTTP_VERSION::HTTP_11, HTTP_RESPONSE_CODE::_404, "text/plain", ResponseBody::NOT_FOUND);
 
-    return it->second;
+    sendPreformed(RESPONSE, output, date);
 }
 
-HTTP_VERSION Server::findHttpVersion(std::string_view version) {
+void Server::methodNotAllowed(const HttpRequest &request, OutputQueue &output, const HttpDate &date) const {
     using namespace std::string_view_literals;
 
-    static constexpr std::array versionMap = {
-        std::make_pair("HTTP/1.0"sv, HTTP_VERSION::HTTP_10),
-        std::make_pair("HTTP/1.1"sv, HTTP_VERSION::HTTP_11)
-    };
+    const std::uint16_t allowed = m_router.allowedMethods(request.line().m_path);
 
-    auto it = std::find_if(
-        versionMap.begin()
-        , versionMap.end()
-        , [version](const auto &pair) {
-            return version.size() == pair.first.size() && version.back() == pair.first.back();
-        }
-    );
+    auto &response = output.buffer();
+
+    getResponseLine(response, request.line().m_httpVersion, HTTP_RESPONSE_CODE::_405, date);
+
+    response += "Allow: "sv;
+
+    bool first = true;
+    for (int method = 0; method < static_cast<int>(HTTP_METHOD::INVALID_METHOD); ++method) {
+        if (allowed & (1u << method)) {
+            if (!first) {
+                response += ", "sv;
+            }
 
-    if (it == versionMap.end()) {
-        return HTTP_VERSION::INVALID_VERSION;
+            response += methodToString(static_cast<HTTP_METHOD>(method));
+            first = false;
+        }
     }
 
-    return it->second;
+    response += ResponseBody::CRLF;
+
+    response += "Content-Length: 0"sv;
+    response += ResponseBody::CRLF;
+
+    response += ResponseBody::CRLF;
 }
 
-void Server::invalidRequest(std::string &response) {
-    const static std::string CONTENT_LENGTH_HEADER = "Content-Length: " + std::to_string(ResponseBody::INVALID_REQUEST.size());
+Server::PreformedResponse Server::serializeResponse(HTTP_VERSION version, HTTP_RESPONSE_CODE code, std::string_view contentType, std::string_view body, std::string_view extraHeaders) {
+    using namespace std::string_view_literals;
+
+    PreformedResponse preformed;
+    std::string &response = preformed.m_wire;
 
-    getResponseLine(response, HTTP_VERSION::HTTP_11, HTTP_RESPONSE_CODE::_400);
+    response += responseHead(version, code);
+    preformed.m_dateOffset = response.size();
 
-    response += "Content-Type: text/plain";
+    response += "Content-Type: "sv;
+    response += contentType;
     response += ResponseBody::CRLF;
 
-    response += CONTENT_LENGTH_HEADER;
+    response += extraHeaders;
+
+    response += "Content-Length: "sv;
+    response += std::to_string(body.size());
     response += ResponseBody::CRLF;
 
     response += ResponseBody::CRLF;
 
-    response += ResponseBody::INVALID_REQUEST;
+    preformed.m_bodyOffset = response.size();
+    response += body;
+
+    return preformed;
+}
+
+void Server::sendPreformed(const PreformedResponse &response, OutputQueue &output, const HttpDate &date) {
+    const std::string_view wire = response.m_wire;
+    auto &buffer = output.buffer();
+
+    buffer += wire.substr(0, response.m_dateOffset);
+    buffer += date.headerLine();
+
+    if (wire.size() - response.m_bodyOffset < OutputQueue::MIN_SEGMENT_SIZE) {
+        buffer += wire.substr(response.m_dateOffset);
+        return;
+    }
+
+    buffer += wire.substr(response.m_dateOffset, response.m_bodyOffset - response.m_dateOffset);
+    output.addStatic(wire.substr(response.m_bodyOffset));
 }
 
-void Server::pageNotFound(std::string &response) {
-    const static std::string CONTENT_LENGTH_HEADER = "Content-Length: " + std::to_string(ResponseBody::NOT_FOUND.size());
+void Server::createErrorResponse(HTTP_RESPONSE_CODE code, std::string &response, const HttpDate &date) {
+    using namespace std::string_view_literals;
+
+    // The reason phrase without the status code
+    const std::string_view message = codeToString(code).substr(4);
+
+    getResponseLine(response, HTTP_VERSION::HTTP_11, code, date);
 
-    getResponseLine(response, HTTP_VERSION::HTTP_11, HTTP_RESPONSE_CODE::_404);
+    response += "Content-Type: text/plain"sv;
+    response += ResponseBody::CRLF;
 
-    response += "Content-Type: text/plain";
+    response += "Content-Length: "sv;
+    response += std::to_string(message.size());
     response += ResponseBody::CRLF;
 
-    response += CONTENT_LENGTH_HEADER;
+    response += "Connection: close"sv;
     response += ResponseBody::CRLF;
 
     response += ResponseBody::CRLF;
 
-    response += ResponseBody::NOT_FOUND;
+    response += message;
 }
 
-void Server::getResponseLine(std::string &response, HTTP_VERSION version, HTTP_RESPONSE_CODE code) {
-    response += versionToString(version);
-    response += codeToString(code);
-    response += ResponseBody::CRLF;
+void Server::getResponseLine(std::string &response, HTTP_VERSION version, HTTP_RESPONSE_CODE code, const HttpDate &date) {
+    response += responseHead(version, code);
+    response += date.headerLine();
+}
+
+void Server::beginHandlerResponse(std::string &response, const HttpDate &date) {
+    response += ResponseBody::SERVER_HEADER;
+    response += date.headerLine();
+}
+
+void Server::endHandlerResponse(std::string &response, std::size_t start) {
+    const std::size_t handlerStart = start + COMMON_HEADERS_SIZE;
+
+    const std::size_t lineEnd = response.find(ResponseBody::CRLF, handlerStart);
+    if (lineEnd == std::string::npos) {
+        // Not a response, leave the handler's output as it is
+        response.erase(start, COMMON_HEADERS_SIZE);
+        return;
+    }
+
+    // "Server: ...Date: ...HTTP/1.1 200 OK\r\n" -> "HTTP/1.1 200 OK\r\nServer: ...Date: ..."
+    std::rotate(response.begin() + start, response.begin() + handlerStart, response.begin() + lineEnd + ResponseBody::CRLF.size());
+}
+
+void Server::queueHandlerResponse(OutputQueue &output, std::string response, const HttpDate &date) {
+    auto &buffer = output.buffer();
+
+    const std::size_t lineEnd = response.find(ResponseBody::CRLF);
+    if (lineEnd == std::string::npos) {
+        buffer += response;
+        return;
+    }
+
+    const std::size_t headersStart = lineEnd + ResponseBody::CRLF.size();
+
+    buffer.append(response, 0, headersStart);
+    beginHandlerResponse(buffer, date);
+
+    if (response.size() - headersStart < OutputQueue::MIN_SEGMENT_SIZE) {
+        buffer.append(response, headersStart);
+        return;
+    }
+
+    auto owned = std::make_shared<const std::string>(std::move(response));
+    const std::string_view rest = std::string_view{ *owned }.substr(headersStart);
+
+    output.addShared(rest, std::move(owned));
+}
+
+std::string_view Server::responseHead(HTTP_VERSION version, HTTP_RESPONSE_CODE code) {
+    static constexpr int VERSIONS_NUM = static_cast<int>(HTTP_VERSION::INVALID_VERSION) + 1;
+    static constexpr int CODES_NUM = static_cast<int>(HTTP_RESPONSE_CODE::COUNT);
+
+    static const auto HEADS = []() {
+        std::array<std::array<std::string, CODES_NUM>, VERSIONS_NUM> heads;
+
+        for (int v = 0; v < VERSIONS_NUM; ++v) {
+            for (int c = 0; c < CODES_NUM; ++c) {
+                std::string &head = heads[v][c];
+
+                head += versionToString(static_cast<HTTP_VERSION>(v));
+                head += codeToString(static_cast<HTTP_RESPONSE_CODE>(c));
+                head += ResponseBody::CRLF;
+                head += ResponseBody::SERVER_HEADER;
+            }
+        }
+
+        return heads;
+    }();
+
+    return HEADS[static_cast<int>(version)][static_cast<int>(code)];
 }
 
 std::string_view Server::versionToString(HTTP_VERSION version) {
@@ -309,15 +486,224 @@ std::string_view Server::codeToString(HTTP_RESPONSE_CODE code) {
     using namespace std::string_view_literals;
 
     static constexpr std::array codeMap{
+        std::make_pair(HTTP_RESPONSE_CODE::_100, "100 Continue"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_101, "101 Switching Protocols"sv),
         std::make_pair(HTTP_RESPONSE_CODE::_200, "200 OK"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_201, "201 Created"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_202, "202 Accepted"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_203, "203 Non-Authoritative Information"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_204, "204 No Content"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_205, "205 Reset Content"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_206, "206 Partial Content"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_300, "300 Multiple Choices"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_301, "301 Moved Permanently"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_302, "302 Found"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_303, "303 See Other"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_304, "304 Not Modified"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_307, "307 Temporary Redirect"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_308, "308 Permanent Redirect"sv),
         std::make_pair(HTTP_RESPONSE_CODE::_400, "400 Bad Request"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_401, "401 Unauthorized"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_402, "402 Payment Required"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_403, "403 Forbidden"sv),
         std::make_pair(HTTP_RESPONSE_CODE::_404, "404 Not Found"sv),
-        std::make_pair(HTTP_RESPONSE_CODE::_500, "500 Internal Server Error"sv)
+        std::make_pair(HTTP_RESPONSE_CODE::_405, "405 Method Not Allowed"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_406, "406 Not Acceptable"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_407, "407 Proxy Authentication Required"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_408, "408 Request Timeout"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_409, "409 Conflict"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_410, "410 Gone"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_411, "411 Length Required"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_412, "412 Precondition Failed"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_413, "413 Content Too Large"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_414, "414 URI Too Long"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_415, "415 Unsupported Media Type"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_416, "416 Range Not Satisfiable"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_417, "417 Expectation Failed"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_421, "421 Misdirected Request"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_422, "422 Unprocessable Content"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_426, "426 Upgrade Required"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_428, "428 Precondition Required"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_429, "429 Too Many Requests"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_431, "431 Request Header Fields Too Large"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_500, "500 Internal Server Error"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_501, "501 Not Implemented"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_502, "502 Bad Gateway"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_503, "503 Service Unavailable"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_504, "504 Gateway Timeout"sv),
+        std::make_pair(HTTP_RESPONSE_CODE::_505, "505 HTTP Version Not Supported"sv)
     };
 
+    static_assert(codeMap.size() == static_cast<std::size_t>(HTTP_RESPONSE_CODE::COUNT), "Every code needs its status line");
+
     return codeMap[static_cast<int>(code)].second;
 }
 
-void Server::addHandler(HTTP_METHOD method, std::string_view path, Handler_t handler) {
-    m_methodHandlers[static_cast<int>(method)][path] = handler;
+int Server::codeToNumber(HTTP_RESPONSE_CODE code) {
+    const std::string_view text = codeToString(code);
+
+    return (text[0] - '0') * 100 + (text[1] - '0') * 10 + (text[2] - '0');
+}
+
+std::string_view Server::methodToString(HTTP_METHOD method) {
+    using namespace std::string_view_literals;
+
+    static constexpr std::array methodMap{
+        std::make_pair(HTTP_METHOD::GET, "GET"sv),
+        std::make_pair(HTTP_METHOD::HEAD, "HEAD"sv),
+        std::make_pair(HTTP_METHOD::POST, "POST"sv),
+        std::make_pair(HTTP_METHOD::PUT, "PUT"sv),
+        std::make_pair(HTTP_METHOD::DELETE, "DELETE"sv),
+        std::make_pair(HTTP_METHOD::CONNECT, "CONNECT"sv),
+        std::make_pair(HTTP_METHOD::OPTIONS, "OPTIONS"sv),
+        std::make_pair(HTTP_METHOD::TRACE, "TRACE"sv),
+        std::make_pair(HTTP_METHOD::PATCH, "PATCH"sv)
+    };
+
+    return methodMap[static_cast<int>(method)].second;
+}
+
+bool Server::addRoute(HTTP_METHOD method, std::string_view path, const Route &route) {
+    if (!m_router.add(method, path, static_cast<std::uint32_t>(m_routes.size()))) {
+        return false;
+    }
+
+    m_routes.push_back(route);
+    return true;
+}
+
+bool Server::addHandler(HTTP_METHOD method, std::string_view path, Handler_t handler) {
+    Route route;
+    route.m_handler = handler;
+
+    return addRoute(method, path, route);
+}
+
+bool Server::addHandler(HTTP_METHOD method, std::string_view path, ArenaHandler_t handler) {
+    Route route;
+    route.m_arenaHandler = handler;
+
+    return addRoute(method, path, route);
+}
+
+bool Server::addHandler(HTTP_METHOD method, std::string_view path, StreamHandler_t handler) {
+    Route route;
+    route.m_streamHandler = handler;
+
+    return addRoute(method, path, route);
+}
+
+bool Server::addHandler(HTTP_METHOD method, std::string_view path, UploadHandler_t handler) {
+    Route route;
+    route.m_uploadHandler = handler;
+
+    return addRoute(method, path, route);
+}
+
+bool Server::addAsyncHandler(HTTP_METHOD method, std::string_view path, Handler_t handler) {
+    Route route;
+    route.m_asyncHandler = handler;
+
+    if (!addRoute(method, path, route)) {
+        return false;
+    }
+
+    if (!m_asyncPool) {
+        const std::uint32_t threads = m_config.m_asyncThreads != 0 ? m_config.m_asyncThreads : std::thread::hardware_concurrency();
+        m_asyncPool = std::make_unique<AsyncPool>(threads);
+    }
+
+    return true;
+}
+
+CONTENT_ENCODING Server::acceptedEncoding(const HttpRequest &request) const {
+    if (!m_config.m_compression.m_enabled) {
+        return CONTENT_ENCODING::IDENTITY;
+    }
+
+    const auto acceptEncoding = request.headers().getFieldValue(HTTP_HEADER::ACCEPT_ENCODING);
+
+    return acceptEncoding ? negotiateEncoding(*acceptEncoding) : CONTENT_ENCODING::IDENTITY;
+}
+
+bool Server::hasAsyncHandlers() const {
+    return m_asyncPool != nullptr;
+}
+
+void Server::submitAsync(std::unique_ptr<AsyncJob> job) {
+    m_asyncPool->submit(std::move(job));
+}
+
+bool Server::addFixedResponse(HTTP_METHOD method, std::string_view path, HTTP_RESPONSE_CODE code, std::string_view contentType, std::string_view body) {
+    using namespace std::string_view_literals;
+
+    auto &fixed = m_fixedResponses.emplace_back();
+    fixed.m_path = path;
+    fixed.m_status = codeToNumber(code);
+
+    // Compressed once with the best level, there is no reason to save CPU here
+    std::array<std::string, static_cast<int>(CONTENT_ENCODING::COUNT)> encodedBodies;
+
+    if (m_config.m_compression.m_enabled && isCompressible(contentType)) {
+        Compressor compressor;
+
+        for (const CONTENT_ENCODING encoding : { CONTENT_ENCODING::GZIP, CONTENT_ENCODING::DEFLATE }) {
+            auto &encoded = encodedBodies[static_cast<int>(encoding)];
+
+            if (!compressor.compress(body, encoding, Z_BEST_COMPRESSION, encoded) || encoded.size() >= body.size()) {
+                encoded.clear();
+                continue;
+            }
+
+            fixed.m_compressed = true;
+        }
+    }
+
+    const std::string_view vary = fixed.m_compressed ? "Vary: Accept-Encoding\r\n"sv : std::string_view{};
+
+    for (std::size_t version = 0; version < fixed.m_wire.size(); ++version) {
+        auto &wire = fixed.m_wire[version];
+
+        wire[static_cast<int>(CONTENT_ENCODING::IDENTITY)] = serializeResponse(static_cast<HTTP_VERSION>(version), code, contentType, body, vary);
+
+        for (const CONTENT_ENCODING encoding : { CONTENT_ENCODING::GZIP, CONTENT_ENCODING::DEFLATE }) {
+            const auto &encoded = encodedBodies[static_cast<int>(encoding)];
+            if (encoded.empty()) {
+                continue;
+            }
+
+            std::string headers{ "Content-Encoding: "sv };
+            headers += encodingToString(encoding);
+            headers += ResponseBody::CRLF;
+            headers += vary;
+
+            wire[static_cast<int>(encoding)] = serializeResponse(static_cast<HTTP_VERSION>(version), code, contentType, encoded, headers);
+        }
+    }
+
+    Route route;
+    route.m_fixed = &fixed;
+
+    return addRoute(method, fixed.m_path, route);
+}
+
+bool Server::addStaticRoute(std::string_view prefix, std::string_view root) {
+    const auto &staticRoute = m_staticRoutes.emplace_back(prefix, root, m_config.m_compression.m_enabled);
+
+    Route route;
+    route.m_static = &staticRoute;
+
+    const std::string wildcard = staticRoute.prefix() + "/*path";
+
+    bool added = true;
+
+    for (const HTTP_METHOD method : { HTTP_METHOD::GET, HTTP_METHOD::HEAD }) {
+        if (!staticRoute.prefix().empty()) {
+            added &= addRoute(method, staticRoute.prefix(), route);
+        }
+
+        added &= addRoute(method, wildcard, route);
+    }
+
+    return added;
 }
@@ -2,48 +2,181 @@
 #define _SERVER_H_
 
 #include "HttpMessage.h"
+#include "ServerConfig.h"
+#include "OutputQueue.h"
+#include "ResponseStream.h"
+#include "BodySink.h"
+#include "StaticRoute.h"
+#include "ThreadContext.h"
+#include "Router.h"
+#include "ServerResponses.h"
+#include "Tls.h"
 
+#include <array>
+#include <string>
+#include <deque>
+#include <memory>
 #include <vector>
 #include <algorithm>
 #include <string_view>
-#include <unordered_map>
+#include <memory_resource>
+
+class ServerThread;
 
 class Server {
     using Handler_t = void(*)(std::string&, const HttpRequest&);
 
+    // The handler may allocate scratch memory from the worker's arena, which is reset after the request
+    using ArenaHandler_t = void(*)(std::string&, const HttpRequest&, std::pmr::memory_resource*);
+
+    // The handler returns the producer of the response, which the connection pulls as the socket drains.
+    // nullptr is answered with 500.
+    using StreamHandler_t = std::unique_ptr<ResponseStream>(*)(const HttpRequest&);
+
 public:
-    explicit Server();
+    // The handler is called when the headers are complete and returns the receiver of the body, see BodySink.
+    // nullptr is answered with 500.
+    using UploadHandler_t = std::unique_ptr<BodySink>(*)(const HttpRequest&);
+
+    explicit Server(const ServerConfig &config = {});
+
+    const ServerConfig& config() const;
+
+    // nullptr without TLS or if the certificate couldn't be loaded
+    const TlsContext *tls() const;
 
 public:
+    // Parses a complete request from a single buffer
     static HttpRequest parseRequest(char *rawInput, std::size_t len);
 
-    void createRawResponse(const HttpRequest &request, std::string &response);
+    // Routes the request. The captured route parameters are stored in request.params().
+    // Returns the status code of the response, for the metrics. A route with an async handler appends
+    // nothing, it sets context.m_asyncHandler for the caller, which submits the request to the pool.
+    int createRawResponse(HttpRequest &request, OutputQueue &output, ThreadContext &context);
+
+    // Used when the request can't be parsed. The connection is closed after the response.
+    static void createErrorResponse(HTTP_RESPONSE_CODE code, std::string &response, const HttpDate &date);
+
+    // Looks up the route of a request whose body follows, NOT_FOUND also for an invalid method or version.
+    // handler is the route's upload handler, or nullptr if the body is collected in the buffer.
+    // The captured route parameters are stored in request.params().
+    Router::RESULT findUploadHandler(HttpRequest &request, UploadHandler_t &handler) const;
+
+    // "100 Continue" before the body of a request with "Expect: 100-continue"
+    static void continueResponse(OutputQueue &output);
 
     static bool checkCloseRequested(const HttpRequest &request);
 
+    // The status line, the Server header and the Date header: a preformed fragment and the date's line
+    static void getResponseLine(std::string &response, HTTP_VERSION version, HTTP_RESPONSE_CODE code, const HttpDate &date);
+
+    // The Server and Date headers of the responses that the handlers write whole. begin reserves them in
+    // front of the handler's output and end moves the status line that starts at start in front of them,
+    // so only the status line is moved and not the body.
+    static void beginHandlerResponse(std::string &response, const HttpDate &date);
+    static void endHandlerResponse(std::string &response, std::size_t start);
+
+    // Queues a response that a handler wrote whole into its own string, e.g. on the async pool. The status
+    // line and the common headers are copied, the rest is referenced unless it's shorter than a segment.
+    static void queueHandlerResponse(OutputQueue &output, std::string response, const HttpDate &date);
+
+    static std::string_view methodToString(HTTP_METHOD method);
+    static int codeToNumber(HTTP_RESPONSE_CODE code);
+
+    // The encoding of the compressed responses for this request, identity if compression is off
+    CONTENT_ENCODING acceptedEncoding(const HttpRequest &request) const;
+
+    // The status code of the response that starts at start, the handlers write whole responses
+    static int statusOf(const std::string &response, std::size_t start);
+
+    // Builds the lookup tables once all routes have been added, otherwise the first request does it
+    void finalizeRoutes() const;
+
+    // The workers whose metrics are served on the metrics route, they must outlive the server
+    void setWorkers(const ServerThread *threads, int threadsNum);
+
+    // Serves the files under root for all GET/HEAD paths that start with prefix
+    bool addStaticRoute(std::string_view prefix, std::string_view root);
+
+    // Registers a response that never changes. The whole response except the Date header is serialized
+    // once per HTTP version and content encoding, see PreformedResponse.
+    bool addFixedResponse(HTTP_METHOD method, std::string_view path, HTTP_RESPONSE_CODE code, std::string_view contentType, std::string_view body);
+
+    // The path may contain ":name" segments and a trailing "*name" (see Router)
+    bool addHandler(HTTP_METHOD method, std::string_view path, Handler_t handler);
+    bool addHandler(HTTP_METHOD method, std::string_view path, ArenaHandler_t handler);
+    bool addHandler(HTTP_METHOD method, std::string_view path, StreamHandler_t handler);
+    bool addHandler(HTTP_METHOD method, std::string_view path, UploadHandler_t handler);
+
+    // The handler runs on the async pool instead of the worker, for the routes that block or take long.
+    // The requests after it on the same connection wait for its response, the other connections don't.
+    bool addAsyncHandler(HTTP_METHOD method, std::string_view path, Handler_t handler);
+
+    // Any thread
+    bool hasAsyncHandlers() const;
+    void submitAsync(std::unique_ptr<AsyncJob> job);
+
 private:
-    static std::size_t parseRequestLine(HttpRequest::Builder &builder, char *rawInput, const std::size_t len);
-    static std::size_t parseRequestHeaders(HttpRequest::Builder &builder, char *rawInput, const int len);
-    static std::size_t parseRequestBody(HttpRequest::Builder &builder, char *rawInput, const int len);
+    // A serialized response without its Date header. The headers are copied to the buffer around the
+    // worker's Date line and a body of at least OutputQueue::MIN_SEGMENT_SIZE is queued without copying.
+    struct PreformedResponse {
+        std::string m_wire;
+        std::size_t m_dateOffset{ 0 };  // After the status line and the Server header
+        std::size_t m_bodyOffset{ 0 };
+    };
+
+    static constexpr std::size_t COMMON_HEADERS_SIZE = ResponseBody::SERVER_HEADER.size() + HttpDate::LINE_SIZE;
 
-    static void skipSpaces(std::size_t &idx, const char *str, const std::size_t len);
-    static void skipCRLF(std::size_t &idx, const char *str, const std::size_t len);
+    static void invalidRequest(OutputQueue &output, const HttpDate &date);
+    static void pageNotFound(OutputQueue &output, const HttpDate &date);
+    void methodNotAllowed(const HttpRequest &request, OutputQueue &output, const HttpDate &date) const;
+    void metrics(const HttpRequest &request, OutputQueue &output, const HttpDate &date) const;
+    static int streamResponse(const HttpRequest &request, OutputQueue &output, std::unique_ptr<ResponseStream> stream, const HttpDate &date);
+    static void internalError(OutputQueue &output, const HttpDate &date);
 
-    static HTTP_METHOD findHttpMethod(std::string_view method);
-    static HTTP_VERSION findHttpVersion(std::string_view version);
+    // extraHeaders are complete header lines, each one ending with CRLF
+    static PreformedResponse serializeResponse(HTTP_VERSION version, HTTP_RESPONSE_CODE code, std::string_view contentType, std::string_view body, std::string_view extraHeaders = {});
+    static void sendPreformed(const PreformedResponse &response, OutputQueue &output, const HttpDate &date);
 
-    static void invalidRequest(std::string &response);
-    static void pageNotFound(std::string &response);
+    // "HTTP/1.1 200 OK\r\nServer: http-server\r\n", built once for every version and code
+    static std::string_view responseHead(HTTP_VERSION version, HTTP_RESPONSE_CODE code);
 
-    static void getResponseLine(std::string &response, HTTP_VERSION version, HTTP_RESPONSE_CODE code);
     static std::string_view versionToString(HTTP_VERSION version);
     static std::string_view codeToString(HTTP_RESPONSE_CODE code);
 
 private:
-    void addHandler(HTTP_METHOD method, std::string_view path, Handler_t handler);
+    struct FixedResponse {
+        std::string m_path;
+        int m_status;
+        // Indexed by HTTP_VERSION and CONTENT_ENCODING, an empty encoded response means that the body doesn't get smaller
+        std::array<std::array<PreformedResponse, static_cast<int>(CONTENT_ENCODING::COUNT)>, static_cast<int>(HTTP_VERSION::INVALID_VERSION)> m_wire;
+        bool m_compressed{ false };
+    };
+
+    struct Route {
+        Handler_t m_handler{ nullptr };
+        ArenaHandler_t m_arenaHandler{ nullptr };
+        StreamHandler_t m_streamHandler{ nullptr };
+        UploadHandler_t m_uploadHandler{ nullptr };
+        Handler_t m_asyncHandler{ nullptr };
+        const FixedResponse *m_fixed{ nullptr };
+        const StaticRoute *m_static{ nullptr };
+        bool m_metrics{ false };
+    };
+
+    bool addRoute(HTTP_METHOD method, std::string_view path, const Route &route);
 
 private:
-    std::vector<std::unordered_map<std::string_view, Handler_t>> m_methodHandlers;
+    ServerConfig m_config;
+    Router m_router;
+    std::vector<Route> m_routes; // Indexed by the router's route ids
+    std::deque<FixedResponse> m_fixedResponses; // Stable addresses for the routes and the output queues
+    std::deque<StaticRoute> m_staticRoutes;
+    std::unique_ptr<AsyncPool> m_asyncPool; // Started with the first async handler
+    TlsContext m_tls;
+
+    const ServerThread *m_workers{ nullptr };
+    int m_workersNum{ 0 };
 };
 
 #endif // !_SERVER_H_
@@ -0,0 +1,512 @@
+#include "ServerConfig.h"
+
+#include <array>
+#include <cstdio>
+#include <thread>
+#include <limits>
+#include <fstream>
+#include <cstdint>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include <sched.h>
+
+namespace {
+
+bool parseAcceptMode(std::string_view value, ACCEPT_MODE &mode) {
+	using namespace std::string_view_literals;
+
+	static constexpr std::array modeMap = {
+		std::make_pair("dispatcher"sv, ACCEPT_MODE::DISPATCHER),
+		std::make_pair("reuseport"sv, ACCEPT_MODE::REUSEPORT),
+		std::make_pair("cbpf"sv, ACCEPT_MODE::REUSEPORT_CBPF)
+	};
+
+	auto it = std::find_if(modeMap.begin(), modeMap.end(), [value](const auto &pair) { return value == pair.first; });
+	if (it == modeMap.end()) {
+		return false;
+	}
+
+	mode = it->second;
+	return true;
+}
+
+bool parsePlacement(std::string_view value, PLACEMENT &placement) {
+	using namespace std::string_view_literals;
+
+	static constexpr std::array placementMap = {
+		std::make_pair("round-robin"sv, PLACEMENT::ROUND_ROBIN),
+		std::make_pair("least-connections"sv, PLACEMENT::LEAST_CONNECTIONS),
+		std::make_pair("least-latency"sv, PLACEMENT::LEAST_LATENCY),
+		std::make_pair("p2c"sv, PLACEMENT::POWER_OF_TWO)
+	};
+
+	auto it = std::find_if(placementMap.begin(), placementMap.end(), [value](const auto &pair) { return value == pair.first; });
+	if (it == placementMap.end()) {
+		return false;
+	}
+
+	placement = it->second;
+	return true;
+}
+
+bool parseIoBackend(std::string_view value, IO_BACKEND &backend) {
+	if (value == "epoll") {
+		backend = IO_BACKEND::EPOLL;
+		return true;
+	}
+
+	if (value == "io_uring") {
+		backend = IO_BACKEND::IO_URING;
+		return true;
+	}
+
+	return false;
+}
+
+bool parseNumber(std::string_view value, std::uint32_t &number) {
+	if (value.empty()) {
+		return false;
+	}
+
+	std::uint64_t result = 0;
+	for (const char c : value) {
+		if (c < '0' || c > '9') {
+			return false;
+		}
+
+		result = result * 10 + (c - '0');
+
+		if (result > std::numeric_limits<std::uint32_t>::max()) {
+			return false;
+		}
+	}
+
+	number = static_cast<std::uint32_t>(result);
+	return true;
+}
+
+// "0-3,8,10-11"
+bool parseCpuList(std::string_view value, std::vector<int> &cpus) {
+	cpus.clear();
+
+	while (!value.empty()) {
+		const auto comma = value.find(',');
+		const std::string_view item = value.substr(0, comma);
+		value = comma == std::string_view::npos ? std::string_view{} : value.substr(comma + 1);
+
+		const auto dash = item.find('-');
+
+		std::uint32_t first = 0;
+		std::uint32_t last = 0;
+
+		if (!parseNumber(item.substr(0, dash), first)) {
+			return false;
+		}
+
+		last = first;
+		if (dash != std::string_view::npos && !parseNumber(item.substr(dash + 1), last)) {
+			return false;
+		}
+
+		if (last < first || last >= CPU_SETSIZE) {
+			return false;
+		}
+
+		for (std::uint32_t cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(static_cast<int>(cpu));
+		}
+	}
+
+	return !cpus.empty();
+}
+
+// Splits "--name=value" into its parts. Returns false if the argument is not an option.
+bool splitOption(std::string_view arg, std::string_view &name, std::string_view &value) {
+	if (arg.size() < 3 || arg.substr(0, 2) != "--") {
+		return false;
+	}
+
+	arg.remove_prefix(2);
+
+	const auto eq = arg.find('=');
+	name = arg.substr(0, eq);
+	value = eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1);
+
+	return true;
+}
+
+enum class OPTION {
+	APPLIED,
+	UNKNOWN,
+	INVALID
+};
+
+// arg is the whole option, for the error messages
+OPTION applyOption(std::string_view arg, std::string_view name, std::string_view value, ServerConfig &config) {
+	if (name == "accept") {
+		if (!parseAcceptMode(value, config.m_acceptMode)) {
+			std::cerr << "Invalid accept mode: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		return OPTION::APPLIED;
+	}
+
+	if (name == "placement") {
+		if (!parsePlacement(value, config.m_placement)) {
+			std::cerr << "Invalid placement policy: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		return OPTION::APPLIED;
+	}
+
+	if (name == "io") {
+		if (!parseIoBackend(value, config.m_ioBackend)) {
+			std::cerr << "Invalid I/O backend: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		return OPTION::APPLIED;
+	}
+
+	if (name == "epoll") {
+		if (value != "level" && value != "edge") {
+			std::cerr << "Invalid epoll mode: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		config.m_epollEdgeTriggered = value == "edge";
+		return OPTION::APPLIED;
+	}
+
+	if (name == "cpus" || name == "irq-cpus") {
+		if (!parseCpuList(value, name == "cpus" ? config.m_cpus : config.m_irqCpus)) {
+			std::cerr << "Invalid CPU list: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		return OPTION::APPLIED;
+	}
+
+	if (name == "compression") {
+		if (value != "on" && value != "off") {
+			std::cerr << "Invalid compression mode: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		config.m_compression.m_enabled = value == "on";
+		return OPTION::APPLIED;
+	}
+
+	if (name == "tls-cert" || name == "tls-key") {
+		if (value.empty()) {
+			std::cerr << "Invalid value: " << arg << '\n';
+			return OPTION::INVALID;
+		}
+
+		(name == "tls-cert" ? config.m_tls.m_certFile : config.m_tls.m_keyFile) = value;
+		return OPTION::APPLIED;
+	}
+
+	if (name == "tls-tickets" || name == "ktls") {
+		if (value != "on" && value != "off") {
+			std::cerr << "Invalid value: " << arg << '\n';
+			return OPTION::INVALID;
+		}
+
+		(name == "ktls" ? config.m_tls.m_kernel : config.m_tls.m_tickets) = value == "on";
+		return OPTION::APPLIED;
+	}
+
+	if (name == "metrics-path") {
+		if (!value.empty() && value.front() != '/') {
+			std::cerr << "Invalid metrics path: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		config.m_metricsPath = value;
+		return OPTION::APPLIED;
+	}
+
+	if (name == "static") {
+		const auto colon = value.find(':');
+		if (colon == std::string_view::npos || colon == 0 || colon + 1 == value.size() || value.front() != '/') {
+			std::cerr << "Invalid static route: " << value << '\n';
+			return OPTION::INVALID;
+		}
+
+		config.m_staticRoutes.emplace_back(value.substr(0, colon), value.substr(colon + 1));
+		return OPTION::APPLIED;
+	}
+
+	const std::pair<std::string_view, std::uint32_t *> numericOptions[] = {
+		{ "port", &config.m_port },
+		{ "backlog", &config.m_backlog },
+		{ "threads", &config.m_threads },
+		{ "max-connections", &config.m_maxConnections },
+		{ "async-threads", &config.m_asyncThreads },
+		{ "epoll-events", &config.m_epollEvents },
+		{ "zerocopy-threshold", &config.m_zerocopyThreshold },
+		{ "max-request-line", &config.m_parserLimits.m_maxRequestLine },
+		{ "max-header-line", &config.m_parserLimits.m_maxHeaderLine },
+		{ "max-headers", &config.m_parserLimits.m_maxHeaders },
+		{ "max-header-size", &config.m_parserLimits.m_maxHeaderBytes },
+		{ "max-body-size", &config.m_parserLimits.m_maxBodySize },
+		{ "max-upload-size", &config.m_parserLimits.m_maxUploadMb },
+		{ "compression-min-size", &config.m_compression.m_minSize },
+		{ "compression-level", &config.m_compression.m_level },
+		{ "tls-session-cache", &config.m_tls.m_sessionCacheSize },
+		{ "file-cache-size", &config.m_fileCacheSize },
+		{ "file-cache-revalidate", &config.m_fileCacheRevalidateMs },
+		{ "header-timeout", &config.m_headerTimeoutMs },
+		{ "keepalive-timeout", &config.m_keepAliveTimeoutMs },
+		{ "write-timeout", &config.m_writeTimeoutMs },
+		{ "uring-buffers", &config.m_uringBuffers },
+		{ "stats-interval", &config.m_statsInterval }
+	};
+
+	auto numericIt = std::find_if(std::begin(numericOptions), std::end(numericOptions), [name](const auto &pair) { return name == pair.first; });
+	if (numericIt != std::end(numericOptions)) {
+		if (!parseNumber(value, *numericIt->second)) {
+			std::cerr << "Invalid value: " << arg << '\n';
+			return OPTION::INVALID;
+		}
+
+		return OPTION::APPLIED;
+	}
+
+	return OPTION::UNKNOWN;
+}
+
+bool parseFile(const std::string &path, ServerConfig &config) {
+	std::ifstream file{ path };
+	if (!file) {
+		std::cerr << "Can't open the config file: " << path << '\n';
+		return false;
+	}
+
+	std::string line;
+	for (int lineNum = 1; std::getline(file, line); ++lineNum) {
+		std::string_view option = line;
+
+		option = option.substr(0, option.find('#'));
+
+		const auto first = option.find_first_not_of(" \t\r");
+		if (first == std::string_view::npos) {
+			continue;
+		}
+
+		option = option.substr(first, option.find_last_not_of(" \t\r") + 1 - first);
+
+		const auto eq = option.find('=');
+		const std::string_view name = option.substr(0, eq);
+		const std::string_view value = eq == std::string_view::npos ? std::string_view{} : option.substr(eq + 1);
+
+		switch (applyOption(option, name, value, config)) {
+		case OPTION::APPLIED:
+			break;
+		case OPTION::UNKNOWN:
+			std::cerr << path << ':' << lineNum << ": Unknown option: " << name << '\n';
+			return false;
+		default:
+			std::cerr << path << ':' << lineNum << ": Invalid option\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The CPUs this process may run on, 0 if they can't be read
+std::uint32_t allowedCpusNum() {
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		perror("sched_getaffinity");
+		return 0;
+	}
+
+	return static_cast<std::uint32_t>(CPU_COUNT(&allowed));
+}
+
+bool validate(ServerConfig &config) {
+	if (config.m_port == 0 || config.m_port > 65535) {
+		std::cerr << "Invalid port: " << config.m_port << '\n';
+		return false;
+	}
+
+	const bool cbpf = config.m_acceptMode == ACCEPT_MODE::REUSEPORT_CBPF;
+	const std::uint32_t cbpfCpus = cbpf ? allowedCpusNum() : 0;
+
+	if (config.m_threads == 0) {
+		config.m_threads = std::max(1u, cbpf ? cbpfCpus : std::thread::hardware_concurrency());
+	}
+
+	if (config.m_asyncThreads == 0) {
+		config.m_asyncThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	if (config.m_epollEvents == 0) {
+		std::cerr << "--epoll-events must be positive\n";
+		return false;
+	}
+
+	if (config.m_zerocopyThreshold != 0 && config.m_ioBackend != IO_BACKEND::EPOLL) {
+		std::cerr << "--zerocopy-threshold is supported only with --io=epoll\n";
+		return false;
+	}
+
+	if (!config.m_tls.enabled() && !config.m_tls.m_keyFile.empty()) {
+		std::cerr << "--tls-key requires --tls-cert\n";
+		return false;
+	}
+
+	if (config.m_tls.enabled() && config.m_ioBackend != IO_BACKEND::EPOLL) {
+		std::cerr << "TLS is supported only with --io=epoll\n";
+		return false;
+	}
+
+	// kTLS has no MSG_ZEROCOPY and OpenSSL encrypts from its own buffer
+	if (config.m_tls.enabled() && config.m_zerocopyThreshold != 0) {
+		std::cerr << "--zerocopy-threshold can't be combined with TLS\n";
+		return false;
+	}
+
+	// The parser keeps 32-bit offsets into the buffer of one request, with its body and chunk framing
+	constexpr std::uint32_t MAX_COLLECTED_SIZE = 1u << 30;
+
+	if (config.m_parserLimits.m_maxHeaderBytes > MAX_COLLECTED_SIZE || config.m_parserLimits.m_maxBodySize > MAX_COLLECTED_SIZE) {
+		std::cerr << "--max-header-size and --max-body-size can't be above " << MAX_COLLECTED_SIZE << '\n';
+		return false;
+	}
+
+	if (config.m_compression.m_level < 1 || config.m_compression.m_level > 9) {
+		std::cerr << "--compression-level must be between 1 and 9\n";
+		return false;
+	}
+
+	// The interval also bounds the reactor's wait, 0 would make the workers spin and re-stat the files
+	if (config.m_fileCacheRevalidateMs == 0) {
+		std::cerr << "--file-cache-revalidate must be positive\n";
+		return false;
+	}
+
+	// The CBPF program steers a connection to the worker pinned to the CPU that received it,
+	// every worker gets one of the allowed CPUs
+	if (cbpf && (!config.m_cpus.empty() || !config.m_irqCpus.empty())) {
+		std::cerr << "--accept=cbpf pins the workers to the allowed CPUs, it can't be combined with --cpus or --irq-cpus\n";
+		return false;
+	}
+
+	if (cbpf && config.m_threads > cbpfCpus) {
+		std::cerr << "--accept=cbpf needs an allowed CPU per worker: " << config.m_threads << " worker(s), " << cbpfCpus << " CPU(s)\n";
+		return false;
+	}
+
+	return true;
+}
+
+}
+
+bool ServerConfig::parse(int argc, char **argv, ServerConfig &config) {
+	for (int i = 1; i < argc; ++i) {
+		std::string_view name;
+		std::string_view value;
+
+		if (!splitOption(argv[i], name, value)) {
+			std::cerr << "Unknown argument: " << argv[i] << '\n';
+			printUsage(argv[0]);
+			return false;
+		}
+
+		if (name == "help") {
+			printUsage(argv[0]);
+			return false;
+		}
+
+		if (name == "config") {
+			if (!parseFile(std::string{ value }, config)) {
+				return false;
+			}
+
+			continue;
+		}
+
+		switch (applyOption(argv[i], name, value, config)) {
+		case OPTION::APPLIED:
+			break;
+		case OPTION::UNKNOWN:
+			std::cerr << "Unknown option: " << argv[i] << '\n';
+			printUsage(argv[0]);
+			return false;
+		default:
+			return false;
+		}
+	}
+
+	return validate(config);
+}
+
+void ServerConfig::printUsage(const char *program) {
+	std::cerr
+		<< "Usage: " << program << " [options]\n"
+		<< "  --config=<file>              reads the options from a file, one name=value per line\n"
+		<< "  --port=<port>                (default: 3490)\n"
+		<< "  --backlog=<count>            the listen() backlog (default: 10000)\n"
+		<< "  --threads=<count>            worker threads (default: the number of CPUs)\n"
+		<< "  --max-connections=<count>    split between the workers (default: 0, only the file descriptor limit)\n"
+		<< "  --async-threads=<count>      threads of the async handlers, started only if there are any\n"
+		<< "                               (default: the number of CPUs)\n"
+		<< "  --cpus=<list>                pins the workers to these CPUs in order, e.g. 0-3,8\n"
+		<< "  --irq-cpus=<list>            the CPUs that handle the NIC queues; without --cpus the workers\n"
+		<< "                               are pinned to the other allowed CPUs\n"
+		<< "  --accept=dispatcher|reuseport|cbpf\n"
+		<< "      dispatcher - a single thread accepts and distributes the connections (default)\n"
+		<< "      reuseport  - every worker accepts on its own SO_REUSEPORT listener\n"
+		<< "      cbpf       - reuseport + the workers are pinned to CPUs and a CBPF program\n"
+		<< "                   steers every connection to the worker on the receiving CPU\n"
+		<< "  --placement=round-robin|least-connections|least-latency|p2c\n"
+		<< "      how the dispatcher picks the worker for a new connection (default: round-robin)\n"
+		<< "      least-connections - the fewest open and queued connections\n"
+		<< "      least-latency     - the shortest recent event loop iterations\n"
+		<< "      p2c               - the one with fewer connections out of two random workers\n"
+		<< "  --io=epoll|io_uring          the event loop of the workers (default: epoll)\n"
+		<< "  --epoll=level|edge\n"
+		<< "      level - waits for either EPOLLIN or EPOLLOUT and switches with epoll_ctl() (default)\n"
+		<< "      edge  - registers both once as edge-triggered and writes the responses right away\n"
+		<< "  --epoll-events=<count>       events returned by one epoll_wait() (default: 1024)\n"
+		<< "  --uring-buffers=<count>      io_uring receive buffers per worker, a power of 2 (default: 512)\n"
+		<< "  --zerocopy-threshold=<bytes> sends the bodies of at least this size that aren't copied into\n"
+		<< "                               the buffer with MSG_ZEROCOPY, epoll only (default: 0, off)\n"
+		<< "  --max-request-line=<bytes>   (default: 8192)\n"
+		<< "  --max-header-line=<bytes>    (default: 8192)\n"
+		<< "  --max-headers=<count>        (default: 100)\n"
+		<< "  --max-header-size=<bytes>    request line + headers, at most 1 GiB (default: 65536)\n"
+		<< "  --max-body-size=<bytes>      a body collected in memory, at most 1 GiB (default: 1048576)\n"
+		<< "  --max-upload-size=<MB>       a body streamed to an upload handler (default: 1024)\n"
+		<< "  --compression=on|off         gzip/deflate by Accept-Encoding (default: on)\n"
+		<< "  --compression-min-size=<bytes>\n"
+		<< "                               smaller handler responses aren't compressed (default: 1024)\n"
+		<< "  --compression-level=<1-9>    of the handler responses, the constant ones use 9 (default: 6)\n"
+		<< "  --tls-cert=<file>            serves HTTPS with this PEM certificate chain, epoll only\n"
+		<< "  --tls-key=<file>             the PEM private key (default: the certificate file)\n"
+		<< "  --tls-session-cache=<count>  sessions kept for resumption by id (default: 20480, 0 = none)\n"
+		<< "  --tls-tickets=on|off         resumption with session tickets (default: on)\n"
+		<< "  --ktls=on|off                the kernel encrypts after the handshake when it can (default: on)\n"
+		<< "  --static=<prefix>:<directory>\n"
+		<< "      serves the files under <directory> for the paths that start with <prefix> (repeatable)\n"
+		<< "  --file-cache-size=<count>    open files cached per worker (default: 1024),\n"
+		<< "                               0 also serves the static files uncompressed\n"
+		<< "  --file-cache-revalidate=<ms> how often the cached files are checked for changes (default: 1000)\n"
+		<< "  --header-timeout=<ms>        time to receive a complete request (default: 10000, 0 = none)\n"
+		<< "  --keepalive-timeout=<ms>     idle time between requests (default: 60000, 0 = none)\n"
+		<< "  --write-timeout=<ms>         time without progress while sending or while\n"
+		<< "                               an async handler runs (default: 30000, 0 = none)\n"
+		<< "  --metrics-path=<path>        the Prometheus metrics route (default: /metrics, empty = none)\n"
+		<< "  --stats-interval=<seconds>   prints the request and syscall counters periodically (default: 0, off)\n";
+}
@@ -0,0 +1,72 @@
+#ifndef _SERVER_CONFIG_H_
+#define _SERVER_CONFIG_H_
+
+#include "ServerConstants.h"
+#include "HttpParser.h"
+#include "Compression.h"
+#include "Tls.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+enum class ACCEPT_MODE {
+	DISPATCHER,		// One acceptor thread hands the sockets to the workers
+	REUSEPORT,		// Every worker owns a SO_REUSEPORT listener
+	REUSEPORT_CBPF	// Same as REUSEPORT, but a CBPF program steers the connection to the worker pinned to the receiving CPU
+};
+
+// How the dispatcher picks the worker for a new connection
+enum class PLACEMENT {
+	ROUND_ROBIN,
+	LEAST_CONNECTIONS,	// The fewest open and queued connections
+	LEAST_LATENCY,		// The shortest recent event loop iterations
+	POWER_OF_TWO		// The one with fewer connections out of two random workers
+};
+
+enum class IO_BACKEND {
+	EPOLL,
+	IO_URING
+};
+
+struct ServerConfig {
+	std::uint32_t m_port{ SERVER_PORT };
+	std::uint32_t m_backlog{ BACKLOG_SIZE };
+	std::uint32_t m_threads{ 0 };			// Worker threads, hardware_concurrency() (the allowed CPUs with cbpf) when not set
+	std::uint32_t m_maxConnections{ 0 };	// Split evenly between the workers, 0 is limited only by the file descriptors
+	std::uint32_t m_asyncThreads{ 0 };		// The pool of the async handlers, hardware_concurrency() when not set
+
+	// The workers are pinned to these CPUs in order. Without the list, if m_irqCpus isn't empty,
+	// they are pinned to the allowed CPUs except the ones that handle the NIC queues.
+	std::vector<int> m_cpus;
+	std::vector<int> m_irqCpus;
+
+	ACCEPT_MODE m_acceptMode{ ACCEPT_MODE::DISPATCHER };
+	PLACEMENT m_placement{ PLACEMENT::ROUND_ROBIN };	// Dispatcher mode only
+	IO_BACKEND m_ioBackend{ IO_BACKEND::EPOLL };
+	bool m_epollEdgeTriggered{ false };
+	std::uint32_t m_epollEvents{ EPOLL_EVENTS_NUM }; // The epoll_wait() batch
+	std::uint32_t m_uringBuffers{ 512 }; // Provided receive buffers per worker
+	std::uint32_t m_zerocopyThreshold{ 0 }; // Bytes, MSG_ZEROCOPY for the larger referenced bodies (epoll only), 0 disables it
+	std::uint32_t m_statsInterval{ 0 }; // Seconds, 0 disables the statistics
+	std::string m_metricsPath{ "/metrics" }; // Empty disables the metrics route
+	ParserLimits m_parserLimits;
+	CompressionOptions m_compression;
+	TlsOptions m_tls; // Epoll only
+
+	std::vector<std::pair<std::string, std::string>> m_staticRoutes; // (prefix, document root)
+	std::uint32_t m_fileCacheSize{ 1024 };
+	std::uint32_t m_fileCacheRevalidateMs{ 1000 };
+
+	// Connection deadlines, 0 disables them
+	std::uint32_t m_headerTimeoutMs{ 10000 };		// From the first byte of a request until it's complete
+	std::uint32_t m_keepAliveTimeoutMs{ 60000 };	// Between the requests
+	std::uint32_t m_writeTimeoutMs{ 30000 };		// Without any progress while the socket buffer is full or an async handler runs
+
+	// The command line options may also come from --config=<file>: one "name=value" per line, without
+	// the dashes, and # starts a comment. The options that follow --config override the file.
+	static bool parse(int argc, char **argv, ServerConfig &config);
+	static void printUsage(const char *program);
+};
+
+#endif // !_SERVER_CONFIG_H_
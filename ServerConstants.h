@@ -1,11 +1,11 @@
 #ifndef _SERVER_CONSTANTS_H_
 #define _SERVER_CONSTANTS_H_
 
-inline constexpr auto NUM_THREADS = 7; // N - 1 threads where N is the number of cores
-inline constexpr auto MAX_CONNECTIONS_NUM = 10000;
-inline constexpr auto CONNECTIONS_PER_THREAD = MAX_CONNECTIONS_NUM / NUM_THREADS + 1;
+#include <cstdint>
 
-inline constexpr auto BACKLOG_SIZE = 10000;
-inline constexpr auto SERVER_PORT = "3490";
+// The defaults of --port, --backlog and --epoll-events
+inline constexpr std::uint16_t SERVER_PORT = 3490;
+inline constexpr std::uint32_t BACKLOG_SIZE = 10000;
+inline constexpr std::uint32_t EPOLL_EVENTS_NUM = 1024;
 
 #endif // !_SERVER_CONSTANTS_H_
@@ -7,10 +7,14 @@ namespace ResponseBody {
 
 inline constexpr std::string_view CRLF = "\r\n";
 
+inline constexpr std::string_view SERVER_HEADER = "Server: http-server\r\n";
+
 inline constexpr std::string_view INVALID_REQUEST = "Invalid request";
 
 inline constexpr std::string_view NOT_FOUND = "Not Found";
 
+inline constexpr std::string_view INTERNAL_ERROR = "Internal Server Error";
+
 inline constexpr std::string_view HELLO_MESSAGE = "Hello World";
 
 inline constexpr std::string_view MAIN_TEXT_PAGE = "Hello World!";
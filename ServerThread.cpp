@@ -1,13 +1,19 @@
 #include "ServerThread.h"
 
-#include <cassert>
+#include <cstdio>
+#include <cerrno>
+#include <utility>
+#include <functional>
 
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/socket.h>
+#include <pthread.h>
+#include <sched.h>
+
+ServerThread::ServerThread()
+	: m_wakeupTicks{ 0 }
+	, m_lastTicks{ 0 }
+	, m_wakeups{ 0 }
+	, m_timers{ 0 } {
 
-ServerThread::ServerThread() {
-	m_responseBuffer.reserve(ThreadData::MSG_BUFFER_AVG_SIZE);
 }
 
 ServerThread::~ServerThread() {
@@ -16,150 +22,552 @@ ServerThread::~ServerThread() {
 	}
 }
 
-void ServerThread::runThread(Server &server, int epollfd) {
-	m_data.setEpollFd(epollfd);
-
+bool ServerThread::runThread(Server &server, IO_BACKEND backend, int listenerfd, int cpu) {
 	m_server = &server;
-	m_thread = std::thread{ &ServerThread::threadLoop, this };
+
+	const auto &config = server.config();
+	m_context.m_fileCache = FileCache{ config.m_fileCacheSize, std::chrono::milliseconds(config.m_fileCacheRevalidateMs) };
+
+	if (config.m_maxConnections != 0) {
+		m_data.setLimit((config.m_maxConnections + config.m_threads - 1) / config.m_threads);
+	}
+
+	if (server.hasAsyncHandlers() && !m_completions.init()) {
+		return false;
+	}
+
+	m_reactor = Reactor::create(backend, *this, listenerfd);
+	if (!m_reactor) {
+		return false;
+	}
+
+	m_thread = std::thread{ [this, cpu]() {
+		if (cpu != -1) {
+			pinToCpu(cpu);
+		}
+
+		m_reactor->run();
+	} };
+
+	return true;
+}
+
+void ServerThread::join() {
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+bool ServerThread::pinToCpu(int cpu) {
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+
+	if (const int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet); err != 0) {
+		errno = err;
+		perror("pthread_setaffinity_np");
+		return false;
+	}
+
+	return true;
 }
 
 bool ServerThread::addClient(int fd) {
-	return m_data.add(fd);
+	return m_reactor->addClient(fd);
+}
+
+const IoStats &ServerThread::stats() const {
+	return m_stats;
 }
 
-void ServerThread::threadLoop() {
-	const int epollfd = m_data.getEpollFd();
+const Metrics &ServerThread::metrics() const {
+	return m_metrics;
+}
 
-	epoll_event events[CONNECTIONS_PER_THREAD];
+std::size_t ServerThread::connections() const {
+	return m_data.size() + m_reactor->pendingClients();
+}
 
-	auto closeConnection = [this](ThreadData::Event &eventData, epoll_event *event) {
-		const int fd = eventData.m_data.fd;
+Server &ServerThread::server() {
+	return *m_server;
+}
 
-		shutdown(fd, SHUT_RDWR);
+ThreadData &ServerThread::data() {
+	return m_data;
+}
 
-		m_data.release(eventData, event);
+ThreadContext &ServerThread::context() {
+	return m_context;
+}
 
-		close(fd);
-	};
+IoStats &ServerThread::stats() {
+	return m_stats;
+}
 
-	while (true) {
-		const int eventsNum = epoll_wait(epollfd, events, CONNECTIONS_PER_THREAD, -1);
-		if (eventsNum == -1) {
-			perror("epoll_wait");
-			continue;
+Metrics &ServerThread::metrics() {
+	return m_metrics;
+}
+
+AsyncCompletions &ServerThread::completions() {
+	return m_completions;
+}
+
+void ServerThread::onWakeup() {
+	if (++m_wakeups % Metrics::TIMED_WAKEUPS != 0) {
+		m_wakeupTicks = 0;
+		return;
+	}
+
+	m_wakeupTicks = CycleClock::now();
+	m_lastTicks = m_wakeupTicks;
+}
+
+void ServerThread::onSend(ThreadData::Event::Data &data) {
+	// The response is complete at the last handler's end, or this wakeup writes what an earlier one left.
+	// The clock is read again only if that wakeup isn't timed.
+	if (data.firstByteTicks != 0) {
+		const std::uint64_t now = m_wakeupTicks != 0 ? m_lastTicks : CycleClock::now();
+		m_metrics.firstByte().record(now - data.firstByteTicks);
+		data.firstByteTicks = 0;
+	}
+}
+
+void ServerThread::armTimeout(ThreadData::Event &event, TIMEOUT timeout) {
+	const auto &config = m_server->config();
+	const std::size_t idx = m_data.index(event);
+
+	// Every connection is armed first, so the timers follow the slabs of slots here
+	if (idx >= m_timeoutKinds.size()) {
+		m_timers.grow(m_data.capacity());
+		m_timeoutKinds.resize(m_data.capacity(), TIMEOUT::IDLE);
+	}
+
+	std::uint32_t timeoutMs = 0;
+	switch (timeout) {
+	case TIMEOUT::HEADER:
+		timeoutMs = config.m_headerTimeoutMs;
+		break;
+	case TIMEOUT::IDLE:
+		timeoutMs = config.m_keepAliveTimeoutMs;
+		break;
+	case TIMEOUT::WRITE:
+		timeoutMs = config.m_writeTimeoutMs;
+		break;
+	}
+
+	m_timeoutKinds[idx] = timeout;
+
+	if (timeoutMs == 0) {
+		m_timers.cancel(idx);
+		return;
+	}
+
+	m_timers.arm(idx, std::chrono::milliseconds(timeoutMs), TimerWheel::Clock::now());
+}
+
+void ServerThread::updateTimeout(ThreadData::Event &event) {
+	const auto &data = event.m_data;
+
+	if (!data.output.empty() || data.asyncPending) {
+		armTimeout(event, TIMEOUT::WRITE);
+		return;
+	}
+
+	if (data.upload) {
+		armTimeout(event, TIMEOUT::HEADER);
+		return;
+	}
+
+	if (!data.input.empty()) {
+		// Slowly sent requests don't get more time
+		if (m_timeoutKinds[m_data.index(event)] != TIMEOUT::HEADER) {
+			armTimeout(event, TIMEOUT::HEADER);
 		}
 
-		for (int i = 0; i < eventsNum; ++i) {
-			auto &event = events[i];
+		return;
+	}
+
+	armTimeout(event, TIMEOUT::IDLE);
+}
+
+void ServerThread::cancelTimeout(ThreadData::Event &event) {
+	m_timers.cancel(m_data.index(event));
+}
+
+std::chrono::milliseconds ServerThread::waitTimeout() const {
+	return m_timers.nextTimeout(TimerWheel::Clock::now(), m_context.m_fileCache.revalidateInterval());
+}
 
-			assert(event.data.ptr && "The pointer must point to pre-allocated and valid data");
+std::size_t ServerThread::processRequests(ThreadData::Event &event, char *begin, std::size_t size) {
+	auto &data = event.m_data;
+	const auto &limits = m_server->config().m_parserLimits;
 
-			ThreadData::Event &eventData = *static_cast<ThreadData::Event *>(event.data.ptr);
+	// The response of an async request goes before the responses of the requests that waited for it
+	if (data.asyncJob) {
+		finishAsync(data);
 
-			if (event.events & EPOLLRDHUP || event.events & EPOLLHUP) {
-				closeConnection(eventData, &event);
+		if (data.clientClosed) {
+			// Everything after the last request is ignored
+			return size;
+		}
+	}
+
+	// Walk all complete (pipelined) requests and append the responses in order.
+	// The caller consumes the input, so the request views stay valid while the responses are created.
+	std::size_t consumed = 0;
+
+	// The timestamps cost more than the histograms: the first request's parse starts at the wakeup (or the
+	// previous handler's end) and includes the read, the end of a request is the start of the next pipelined one
+	const bool timed = m_wakeupTicks != 0;
+	std::uint64_t parseStart = m_lastTicks;
+
+	while (consumed < size) {
+		// The requests after a streamed response wait until its last piece has been produced,
+		// and the ones after an async request until its handler returns
+		if (data.output.streaming() || data.asyncPending) {
+			break;
+		}
+
+		char *requestBegin = begin + consumed;
+
+		// The body of an upload goes to its sink as it arrives, only an incomplete chunk header is kept
+		if (data.upload) {
+			consumed += receiveUpload(data, requestBegin, size - consumed);
+
+			if (data.upload) {
+				break;
+			}
+
+			if (data.clientClosed) {
+				// Everything after the last request is ignored
+				consumed = size;
+				break;
+			}
+
+			// The upload's last handler call has just ended
+			parseStart = m_lastTicks;
+			continue;
+		}
+
+		// Parse the input message, resuming from where the previous read stopped
+		auto result = data.parser.parse(requestBegin, size - consumed, limits);
+
+		if (result == HttpParser::RESULT::BODY_FOLLOWS) {
+			const std::size_t headersSize = data.parser.requestSize();
+
+			if (startUpload(data, requestBegin)) {
+				consumed = data.clientClosed ? size : consumed + headersSize;
 				continue;
 			}
 
-			if (event.events & EPOLLIN) {
+			// The body is collected in the buffer
+			result = data.parser.parse(requestBegin, size - consumed, limits);
 
-				if (!readData(eventData, event)) {
-					closeConnection(eventData, &event);
-					continue;
-				}
+			// The client may wait for the interim response before it sends the body
+			if (result == HttpParser::RESULT::INCOMPLETE && data.parser.expectsContinue()) {
+				Server::continueResponse(data.output);
+			}
+		}
+
+		if (result == HttpParser::RESULT::INCOMPLETE) {
+			break;
+		}
+
+		if (data.firstByteTicks == 0) {
+			data.firstByteTicks = m_wakeupTicks;
+		}
+
+		if (result != HttpParser::RESULT::COMPLETE) {
+			m_metrics.addParseError();
+			failRequest(data, HTTP_METHOD::INVALID_METHOD, HttpParser::errorCode(result));
+
+			consumed = size;
+			break;
+		}
+
+		bool closeRequested = false;
+
+		{
+			std::uint64_t handlerStart = 0;
+			if (timed) {
+				handlerStart = CycleClock::now();
+				m_metrics.parse().record(handlerStart - parseStart);
 			}
-			else if (event.events & EPOLLOUT) {
 
-				if (!sendData(eventData, event)) {
-					closeConnection(eventData, &event);
-					continue;
+			HttpRequest inputMessage = data.parser.request(requestBegin, m_context.m_arena.resource());
+
+			const int status = m_server->createRawResponse(inputMessage, data.output, m_context);
+
+			closeRequested = m_server->checkCloseRequested(inputMessage) || data.output.closeDelimited();
+
+			if (m_context.m_asyncHandler) {
+				// The handler's time, the status and the close come with the completion
+				submitAsync(event, requestBegin, inputMessage, closeRequested);
+			}
+			else {
+				if (timed) {
+					parseStart = CycleClock::now();
+					m_lastTicks = parseStart;
+					m_metrics.handler().record(parseStart - handlerStart);
 				}
+
+				m_metrics.addRequest(inputMessage.line().m_method, status);
+			}
+		}
+
+		// The request and everything its handler allocated from the arena are gone
+		m_context.m_arena.reset();
+
+		consumed += data.parser.requestSize();
+		data.parser.reset();
+
+		if (data.asyncPending) {
+			if (closeRequested) {
+				// Everything after the last request is ignored
+				consumed = size;
 			}
+
+			break;
+		}
+
+		m_stats.addRequests(1);
+
+		// Don't shutdown(SHUT_RD) here: it raises EPOLLRDHUP and the connection would be closed before the response is sent
+		if (closeRequested) {
+			// Everything after the last request is ignored
+			data.clientClosed = 1;
+			consumed = size;
+			break;
 		}
 	}
-}
 
-bool ServerThread::readData(ThreadData::Event &event, epoll_event &epollEvent) {
-	const int fd = event.m_data.fd;
+	return consumed;
+}
 
-	constexpr auto BUFF_SIZE = 4096;
-	char buff[BUFF_SIZE + 1];
+bool ServerThread::startUpload(ThreadData::Event::Data &data, char *requestBegin) {
+	HttpRequest request = data.parser.request(requestBegin, m_context.m_arena.resource());
 
-	const int nr = recv(fd, buff, BUFF_SIZE, 0);
+	Server::UploadHandler_t handler = nullptr;
 
-	switch (nr) {
-	case -1:
-		// Do nothing, just loop and wait for the next epoll_wait()
-		if (errno == EAGAIN || errno == EWOULDBLOCK) {
-			return true;
+	if (m_server->findUploadHandler(request, handler) != Router::RESULT::FOUND) {
+		// Nothing would take the body: the final 400/404/405 goes out without "100 Continue" and the
+		// connection is closed instead of receiving the body only to drop it
+		if (data.firstByteTicks == 0) {
+			data.firstByteTicks = m_wakeupTicks;
 		}
 
-		return false; // error
-	case 0:
-		// The connection must be closed
+		const int status = m_server->createRawResponse(request, data.output, m_context);
+		m_metrics.addRequest(request.line().m_method, status);
+
+		m_context.m_arena.reset();
+
+		data.clientClosed = 1;
+		return true;
+	}
+
+	if (!handler) {
+		// The request is built again when the body is complete
+		m_context.m_arena.reset();
 		return false;
-	default:
-		buff[nr] = '\0';
+	}
+
+	const HTTP_METHOD method = request.line().m_method;
+
+	const bool timed = m_wakeupTicks != 0;
+	const std::uint64_t handlerStart = timed ? CycleClock::now() : 0;
+
+	data.upload = handler(request);
+
+	if (timed) {
+		m_lastTicks = CycleClock::now();
+		m_metrics.handler().record(m_lastTicks - handlerStart);
+	}
+
+	data.uploadMethod = static_cast<std::uint32_t>(method);
+	data.uploadCloses = Server::checkCloseRequested(request);
+
+	m_context.m_arena.reset();
+
+	if (!data.upload) {
+		failRequest(data, method, HTTP_RESPONSE_CODE::_500);
+		return true;
+	}
+
+	data.parser.streamBody();
+
+	// A Content-Length above the limit is rejected before the client sends the body
+	std::string_view piece;
+	std::size_t used = 0;
+
+	if (const auto result = data.parser.parseBody(requestBegin, 0, m_server->config().m_parserLimits, piece, used); result != HttpParser::RESULT::INCOMPLETE) {
+		m_metrics.addParseError();
+		failRequest(data, method, HttpParser::errorCode(result));
+		return true;
+	}
+
+	if (data.parser.expectsContinue()) {
+		Server::continueResponse(data.output);
+	}
 
-		// Parse the input message
-		HttpRequest inputMessage = m_server->parseRequest(buff, static_cast<std::size_t>(nr));
+	return true;
+}
+
+std::size_t ServerThread::receiveUpload(ThreadData::Event::Data &data, char *begin, std::size_t size) {
+	const auto &limits = m_server->config().m_parserLimits;
+	const HTTP_METHOD method = static_cast<HTTP_METHOD>(data.uploadMethod);
 
-		m_responseBuffer.clear();
+	std::size_t used = 0;
 
-		m_server->createRawResponse(inputMessage, m_responseBuffer);
+	while (true) {
+		std::string_view piece;
+		std::size_t pieceUsed = 0;
 
-		// Save the response to a buffer
-		event.m_data.buffer.swap(m_responseBuffer);
-		event.m_data.offset = 0;
-		event.m_data.clientClosed = m_server->checkCloseRequested(inputMessage);
+		const auto result = data.parser.parseBody(begin + used, size - used, limits, piece, pieceUsed);
+		used += pieceUsed;
 
-		if (event.m_data.clientClosed) {
-			shutdown(fd, SHUT_RD); // Won't read anymore
+		if (!piece.empty() && !data.upload->write(piece)) {
+			failRequest(data, method, HTTP_RESPONSE_CODE::_500);
+			return size;
 		}
 
-		epollEvent.events = EPOLLOUT | EPOLLHUP | EPOLLRDHUP;
+		if (result == HttpParser::RESULT::COMPLETE) {
+			break;
+		}
 
-		if (epoll_ctl(m_data.getEpollFd(), EPOLL_CTL_MOD, fd, &epollEvent) == -1) {
-			assert(false && "This should not happen.");
-			return false;
+		if (result != HttpParser::RESULT::INCOMPLETE) {
+			m_metrics.addParseError();
+			failRequest(data, method, HttpParser::errorCode(result));
+			return size;
 		}
 
-		return true;
+		if (piece.empty()) {
+			return used;
+		}
+	}
+
+	if (data.firstByteTicks == 0) {
+		data.firstByteTicks = m_wakeupTicks;
+	}
+
+	const std::size_t start = data.output.buffer().size();
+
+	Server::beginHandlerResponse(data.output.buffer(), m_context.m_date);
+
+	const bool timed = m_wakeupTicks != 0;
+	const std::uint64_t handlerStart = timed ? CycleClock::now() : 0;
+
+	data.upload->finish(data.output.buffer());
+
+	if (timed) {
+		m_lastTicks = CycleClock::now();
+		m_metrics.handler().record(m_lastTicks - handlerStart);
+	}
+
+	Server::endHandlerResponse(data.output.buffer(), start);
+
+	data.upload.reset();
+
+	m_metrics.addRequest(method, Server::statusOf(data.output.buffer(), start));
+	m_stats.addRequests(1);
+
+	data.parser.reset();
+
+	// Don't shutdown(SHUT_RD) here: it raises EPOLLRDHUP and the connection would be closed before the response is sent
+	if (data.uploadCloses) {
+		data.clientClosed = 1;
+	}
+
+	return used;
+}
+
+void ServerThread::failRequest(ThreadData::Event::Data &data, HTTP_METHOD method, HTTP_RESPONSE_CODE code) {
+	if (data.firstByteTicks == 0) {
+		data.firstByteTicks = m_wakeupTicks;
 	}
+
+	m_metrics.addRequest(method, Server::codeToNumber(code));
+
+	Server::createErrorResponse(code, data.output.buffer(), m_context.m_date);
+
+	data.upload.reset();
+	data.clientClosed = 1;
 }
 
-bool ServerThread::sendData(ThreadData::Event &event, epoll_event &epollEvent) {
+void ServerThread::submitAsync(ThreadData::Event &event, const char *requestBegin, const HttpRequest &request, bool close) {
 	auto &data = event.m_data;
-	const int fd = data.fd;
+	const std::size_t size = data.parser.requestSize();
 
-	const int nw = send(fd, data.buffer.c_str() + data.offset, data.buffer.size() - data.offset, 0);
+	auto job = std::make_unique<AsyncJob>();
+	job->m_handler = std::exchange(m_context.m_asyncHandler, nullptr);
+	job->m_request.assign(requestBegin, size);
+	job->m_parser = data.parser;
 
-	switch (nw) {
-	case -1:
-		if (errno == EAGAIN || errno == EWOULDBLOCK) {
-			return true;
+	// The captured values are views into the path, they have to point into the copy
+	const char *requestEnd = requestBegin + size;
+
+	for (std::size_t i = 0; i < request.params().size(); ++i) {
+		const auto &param = request.params()[i];
+		std::string_view value = param.m_value;
+
+		if (std::less_equal<const char *>{}(requestBegin, value.data()) && std::less_equal<const char *>{}(value.data(), requestEnd)) {
+			value = { job->m_request.data() + (value.data() - requestBegin), value.size() };
 		}
 
-		return false;
-	default:
-		data.offset += nw;
+		job->m_params.push(param.m_name, value);
+	}
 
-		// Everything has been sent
-		if (data.offset == data.buffer.size()) {
+	job->m_completions = &m_completions;
+	job->m_slot = event.m_index;
+	job->m_generation = event.m_generation;
+	job->m_method = request.line().m_method;
+	job->m_close = close;
+	job->m_encoding = m_server->acceptedEncoding(request);
+	job->m_compression = &m_server->config().m_compression;
 
-			if (data.clientClosed) {
-				shutdown(fd, SHUT_WR); // Won't write anymore
-				return false;
-			}
+	data.asyncPending = 1;
 
-			epollEvent.events = EPOLLIN | EPOLLHUP | EPOLLRDHUP;
+	// The time to first byte starts when the response is back
+	if (data.output.empty()) {
+		data.firstByteTicks = 0;
+	}
 
-			if (epoll_ctl(m_data.getEpollFd(), EPOLL_CTL_MOD, fd, &epollEvent) == -1) {
-				assert(false && "This should not happen.");
-				return false;
-			}
-		}
+	m_server->submitAsync(std::move(job));
+}
 
-		return true;
+ThreadData::Event *ServerThread::completeAsync(AsyncJob *job) {
+	std::unique_ptr<AsyncJob> owned{ job };
+
+	// The connection has been closed while the handler ran, the slot may belong to another one by now
+	ThreadData::Event &event = m_data.at(job->m_slot);
+	if (event.m_generation != job->m_generation || !event.m_data.asyncPending) {
+		return nullptr;
+	}
+
+	event.m_data.asyncPending = 0;
+	event.m_data.asyncJob = std::move(owned);
+
+	return &event;
+}
+
+void ServerThread::finishAsync(ThreadData::Event::Data &data) {
+	const std::unique_ptr<AsyncJob> job = std::move(data.asyncJob);
+
+	if (data.firstByteTicks == 0) {
+		data.firstByteTicks = m_wakeupTicks;
+	}
+
+	const std::size_t start = data.output.buffer().size();
+	Server::queueHandlerResponse(data.output, std::move(job->m_response), m_context.m_date);
+
+	// Sampled like the other handlers, though the pool has timed it anyway
+	if (m_wakeupTicks != 0) {
+		m_metrics.handler().record(job->m_handlerTicks);
+	}
+	m_metrics.addRequest(job->m_method, Server::statusOf(data.output.buffer(), start));
+	m_stats.addRequests(1);
+
+	// Don't shutdown(SHUT_RD) here: it raises EPOLLRDHUP and the connection would be closed before the response is sent
+	if (job->m_close) {
+		data.clientClosed = 1;
 	}
 }
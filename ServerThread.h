@@ -3,33 +3,133 @@
 
 #include "ThreadData.h"
 #include "Server.h"
+#include "ThreadContext.h"
+#include "IoStats.h"
+#include "Metrics.h"
+#include "Reactor.h"
+#include "TimerWheel.h"
 
+#include <chrono>
+#include <memory>
+#include <vector>
 #include <string>
 #include <thread>
 
 class ServerThread {
 public:
+	enum class TIMEOUT : std::uint8_t {
+		HEADER,	// The request has to be complete
+		IDLE,	// Keep-alive, waiting for the next request
+		WRITE	// The socket buffer is full and nothing has been sent
+	};
+
 	explicit ServerThread();
 	~ServerThread();
 
-	void runThread(Server &server, int epollfd);
+	// When listenerfd is valid the thread accepts its own connections from it (SO_REUSEPORT mode).
+	// With a valid cpu the thread pins itself before it touches any of its memory.
+	bool runThread(Server &server, IO_BACKEND backend, int listenerfd = -1, int cpu = -1);
+	void join();
 
 	bool addClient(int fd);
 
+	const IoStats &stats() const;
+	const Metrics &metrics() const;
+
+	// The open connections and the ones waiting in the handoff queue, read by the dispatcher thread
+	std::size_t connections() const;
+
+	// Used by the reactors
+	Server &server();
+	ThreadData &data();
+	ThreadContext &context();
+	IoStats &stats();
+	Metrics &metrics();
+
+	// Called by the reactors when they wake up with new events, the time to first byte starts here
+	void onWakeup();
+
+	// Called before the output of the connection is written, records the time to first byte of the
+	// oldest response that hasn't been written yet
+	void onSend(ThreadData::Event::Data &data);
+
+	// Appends the responses of all complete requests in [begin, begin + size) to the output queue,
+	// starting with the finished async request of the connection. Returns the number of bytes consumed,
+	// the rest is the beginning of an incomplete request or the requests that wait until a streamed
+	// response ends or an async handler returns.
+	std::size_t processRequests(ThreadData::Event &event, char *begin, std::size_t size);
+
+	// The finished async requests of this worker, the eventfd is -1 if the server has no async handlers
+	AsyncCompletions &completions();
+
+	// Called by the reactors for every drained job. Returns the connection that has to process it
+	// again or nullptr if the connection has been closed since.
+	ThreadData::Event *completeAsync(AsyncJob *job);
+
+	// Connection deadlines, every slot has one timer
+	void armTimeout(ThreadData::Event &event, TIMEOUT timeout);
+	// Picks the deadline from the state of the connection: WRITE while there is output or an async
+	// handler runs, HEADER while a request is incomplete and IDLE otherwise. A HEADER deadline isn't
+	// moved, the others restart, and so does the HEADER deadline of an upload, which only has to keep
+	// making progress.
+	void updateTimeout(ThreadData::Event &event);
+	void cancelTimeout(ThreadData::Event &event);
+
+	// Calls onExpired(ThreadData::Event &) for every connection whose deadline has passed
+	template <typename OnExpired>
+	void expireTimeouts(OnExpired &&onExpired);
+
+	// How long the reactor may wait for I/O
+	std::chrono::milliseconds waitTimeout() const;
+
 private:
-	void threadLoop();
+	// Pins the calling thread
+	bool pinToCpu(int cpu);
+
+	// Called when the headers of a request with a body are complete. Returns true if the route takes
+	// the body as it arrives: the sink has been created (or a 500 appended) and the caller drops the
+	// request line and the headers. Also true when no route takes the request, its error response has
+	// been appended and the connection is closing.
+	bool startUpload(ThreadData::Event::Data &data, char *requestBegin);
+
+	// Hands the body in [begin, begin + size) to the sink of the upload and appends the response after
+	// the last piece. Returns the number of bytes consumed.
+	std::size_t receiveUpload(ThreadData::Event::Data &data, char *begin, std::size_t size);
 
-	bool readData(ThreadData::Event &event, epoll_event &epollEvent);
-	bool sendData(ThreadData::Event &event, epoll_event &epollEvent);
+	// Answers with the error and closes the connection, the rest of the input can't be framed
+	void failRequest(ThreadData::Event::Data &data, HTTP_METHOD method, HTTP_RESPONSE_CODE code);
+
+	// Copies the parsed request into a job for the handler in m_context.m_asyncHandler
+	void submitAsync(ThreadData::Event &event, const char *requestBegin, const HttpRequest &request, bool close);
+
+	// Appends the response of data.asyncJob
+	void finishAsync(ThreadData::Event::Data &data);
 
 private:
 	Server *m_server;
 
-    ThreadData m_data;
-    std::thread m_thread;
+	ThreadData m_data;
+	ThreadContext m_context;
+	IoStats m_stats;
+	Metrics m_metrics;
+	std::uint64_t m_wakeupTicks;	// 0 if the latencies aren't timed on this wakeup
+	std::uint64_t m_lastTicks;	// The latest clock read: the wakeup or the end of the last handler
+	std::uint32_t m_wakeups;
+
+	AsyncCompletions m_completions;
+
+	TimerWheel m_timers;
+	std::vector<TIMEOUT> m_timeoutKinds;
 
-    std::string m_responseBuffer;
+	std::unique_ptr<Reactor> m_reactor;
+	std::thread m_thread;
 };
 
+template <typename OnExpired>
+void ServerThread::expireTimeouts(OnExpired &&onExpired) {
+	m_timers.advance(TimerWheel::Clock::now(), [this, &onExpired](std::size_t idx) {
+		onExpired(m_data.at(idx));
+	});
+}
 
 #endif // !_SERVER_THREAD_H_
@@ -0,0 +1,450 @@
+#include "StaticRoute.h"
+#include "Server.h"
+#include "ServerResponses.h"
+
+#include <array>
+#include <ctime>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+std::string_view trimTrailingSlashes(std::string_view str) {
+    while (!str.empty() && str.back() == '/') {
+        str.remove_suffix(1);
+    }
+
+    return str;
+}
+
+std::string_view trimSpaces(std::string_view str) {
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+        str.remove_prefix(1);
+    }
+
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+        str.remove_suffix(1);
+    }
+
+    return str;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+bool parseSize(std::string_view str, std::size_t &value) {
+    if (str.empty() || str.size() > 18) {
+        return false;
+    }
+
+    value = 0;
+    for (const char c : str) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+
+        value = value * 10 + (c - '0');
+    }
+
+    return true;
+}
+
+// Weak comparison of an entity tag against an If-None-Match list (RFC 9110, 13.1.2)
+bool etagListMatches(std::string_view list, std::string_view etag) {
+    if (trimSpaces(list) == "*") {
+        return true;
+    }
+
+    while (!list.empty()) {
+        const auto comma = list.find(',');
+        std::string_view tag = trimSpaces(list.substr(0, comma));
+
+        if (tag.substr(0, 2) == "W/") {
+            tag.remove_prefix(2);
+        }
+
+        if (tag == etag) {
+            return true;
+        }
+
+        if (comma == std::string_view::npos) {
+            break;
+        }
+
+        list.remove_prefix(comma + 1);
+    }
+
+    return false;
+}
+
+}
+
+StaticRoute::StaticRoute(std::string_view prefix, std::string_view root, bool compression)
+    : m_prefix{ trimTrailingSlashes(prefix) }
+    , m_root{ trimTrailingSlashes(root) }
+    , m_compression{ compression } {
+
+}
+
+const std::string &StaticRoute::prefix() const {
+    return m_prefix;
+}
+
+bool StaticRoute::serve(const HttpRequest &request, OutputQueue &output, ThreadContext &context, CONTENT_ENCODING encoding) const {
+    using namespace std::string_view_literals;
+
+    std::pmr::string relativePath{ context.m_arena.resource() };
+    if (!resolvePath(request.line().m_path, relativePath)) {
+        return false;
+    }
+
+    auto file = context.m_fileCache.open(m_root, relativePath);
+    if (!file) {
+        return false;
+    }
+
+    const auto version = request.line().m_httpVersion;
+    const std::size_t fileSize = static_cast<std::size_t>(file->m_stat.st_size);
+
+    const std::string_view type = contentType(relativePath);
+
+    // The representation of these files depends on Accept-Encoding. The compressed copy lives as long
+    // as the cached file, so without the cache every request would compress the file again.
+    const bool negotiated = m_compression && context.m_fileCache.enabled() && isCompressible(type) && fileSize <= CachedFile::MAX_COMPRESSED_SIZE;
+
+    std::shared_ptr<const CachedFile::Compressed> compressed;
+
+    if (negotiated && encoding != CONTENT_ENCODING::IDENTITY && !request.headers().getFieldValue(HTTP_HEADER::RANGE)) {
+        compressed = file->compressed(encoding, context.m_compressor);
+
+        if (compressed && compressed->m_body.empty()) {
+            compressed.reset();
+        }
+    }
+
+    const std::string_view etag = compressed ? std::string_view{ compressed->m_etag } : std::string_view{ file->m_etag };
+
+    auto &response = output.buffer();
+
+    if (notModified(request, *file, etag)) {
+        Server::getResponseLine(response, version, HTTP_RESPONSE_CODE::_304, context.m_date);
+
+        response += "ETag: "sv;
+        response += etag;
+        response += ResponseBody::CRLF;
+
+        if (negotiated) {
+            response += "Vary: Accept-Encoding"sv;
+            response += ResponseBody::CRLF;
+        }
+
+        response += "Last-Modified: "sv;
+        response += file->m_lastModified;
+        response += ResponseBody::CRLF;
+
+        response += ResponseBody::CRLF;
+        return true;
+    }
+
+    ByteRange range{ 0, fileSize ? fileSize - 1 : 0 };
+    const RANGE_RESULT rangeResult = parseRange(request, *file, range);
+
+    if (rangeResult == RANGE_RESULT::NOT_SATISFIABLE) {
+        Server::getResponseLine(response, version, HTTP_RESPONSE_CODE::_416, context.m_date);
+
+        response += "Content-Range: bytes */"sv;
+        response += std::to_string(fileSize);
+        response += ResponseBody::CRLF;
+
+        response += "Content-Length: 0"sv;
+        response += ResponseBody::CRLF;
+
+        response += ResponseBody::CRLF;
+        return true;
+    }
+
+    std::size_t contentLength = fileSize ? range.m_last - range.m_first + 1 : 0;
+    if (compressed) {
+        contentLength = compressed->m_body.size();
+    }
+
+    Server::getResponseLine(response, version, rangeResult == RANGE_RESULT::SATISFIABLE ? HTTP_RESPONSE_CODE::_206 : HTTP_RESPONSE_CODE::_200, context.m_date);
+
+    response += "Content-Type: "sv;
+    response += type;
+    response += ResponseBody::CRLF;
+
+    if (compressed) {
+        response += "Content-Encoding: "sv;
+        response += encodingToString(encoding);
+        response += ResponseBody::CRLF;
+    }
+
+    if (negotiated) {
+        response += "Vary: Accept-Encoding"sv;
+        response += ResponseBody::CRLF;
+    }
+
+    response += "Content-Length: "sv;
+    response += std::to_string(contentLength);
+    response += ResponseBody::CRLF;
+
+    if (rangeResult == RANGE_RESULT::SATISFIABLE) {
+        response += "Content-Range: bytes "sv;
+        response += std::to_string(range.m_first);
+        response += '-';
+        response += std::to_string(range.m_last);
+        response += '/';
+        response += std::to_string(fileSize);
+        response += ResponseBody::CRLF;
+    }
+
+    response += "Accept-Ranges: bytes"sv;
+    response += ResponseBody::CRLF;
+
+    response += "ETag: "sv;
+    response += etag;
+    response += ResponseBody::CRLF;
+
+    response += "Last-Modified: "sv;
+    response += file->m_lastModified;
+    response += ResponseBody::CRLF;
+
+    response += ResponseBody::CRLF;
+
+    if (request.line().m_method == HTTP_METHOD::HEAD) {
+        return true;
+    }
+
+    if (compressed) {
+        const std::string_view body = compressed->m_body;
+        output.addShared(body, std::move(compressed));
+    }
+    else {
+        output.addFile(std::move(file), static_cast<off_t>(range.m_first), contentLength);
+    }
+
+    return true;
+}
+
+bool StaticRoute::resolvePath(std::string_view path, std::pmr::string &relativePath) const {
+    path.remove_prefix(m_prefix.size());
+
+    relativePath.reserve(path.size() + 16);
+
+    if (path.empty() || path.front() != '/') {
+        relativePath += '/';
+    }
+
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        char c = path[i];
+
+        if (c == '%') {
+            const int high = i + 2 < path.size() ? hexValue(path[i + 1]) : -1;
+            const int low = high != -1 ? hexValue(path[i + 2]) : -1;
+
+            if (low == -1) {
+                return false;
+            }
+
+            c = static_cast<char>(high * 16 + low);
+            i += 2;
+        }
+
+        if (c == '\0') {
+            return false;
+        }
+
+        relativePath += c;
+    }
+
+    // Don't let the path escape the document root
+    for (std::size_t pos = relativePath.find("/.."); pos != std::pmr::string::npos; pos = relativePath.find("/..", pos + 1)) {
+        if (pos + 3 == relativePath.size() || relativePath[pos + 3] == '/') {
+            return false;
+        }
+    }
+
+    if (relativePath.back() == '/') {
+        relativePath += "index.html";
+    }
+
+    return true;
+}
+
+bool StaticRoute::notModified(const HttpRequest &request, const CachedFile &file, std::string_view etag) {
+    const auto &headers = request.headers();
+
+    // If-None-Match takes precedence over If-Modified-Since (RFC 9110, 13.2.2)
+    if (const auto ifNoneMatch = headers.getFieldValue(HTTP_HEADER::IF_NONE_MATCH)) {
+        return etagListMatches(*ifNoneMatch, etag);
+    }
+
+    if (const auto ifModifiedSince = headers.getFieldValue(HTTP_HEADER::IF_MODIFIED_SINCE)) {
+        time_t since;
+        return parseHttpDate(*ifModifiedSince, since) && file.m_stat.st_mtim.tv_sec <= since;
+    }
+
+    return false;
+}
+
+StaticRoute::RANGE_RESULT StaticRoute::parseRange(const HttpRequest &request, const CachedFile &file, ByteRange &range) {
+    using namespace std::string_view_literals;
+
+    if (request.line().m_method != HTTP_METHOD::GET) {
+        return RANGE_RESULT::NONE;
+    }
+
+    const auto &headers = request.headers();
+
+    auto rangeValue = headers.getFieldValue(HTTP_HEADER::RANGE);
+    if (!rangeValue) {
+        return RANGE_RESULT::NONE;
+    }
+
+    // A stale If-Range means the whole representation has to be sent
+    if (const auto ifRange = headers.getFieldValue(HTTP_HEADER::IF_RANGE); ifRange && *ifRange != file.m_etag && *ifRange != file.m_lastModified) {
+        return RANGE_RESULT::NONE;
+    }
+
+    std::string_view spec = trimSpaces(*rangeValue);
+
+    // Unknown units and multiple ranges are ignored, the whole file is sent instead
+    if (spec.substr(0, 6) != "bytes="sv || spec.find(',') != std::string_view::npos) {
+        return RANGE_RESULT::NONE;
+    }
+
+    spec.remove_prefix(6);
+
+    const auto dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+        return RANGE_RESULT::NONE;
+    }
+
+    const std::size_t fileSize = static_cast<std::size_t>(file.m_stat.st_size);
+    const std::string_view firstStr = trimSpaces(spec.substr(0, dash));
+    const std::string_view lastStr = trimSpaces(spec.substr(dash + 1));
+
+    std::size_t first = 0;
+    std::size_t last = 0;
+
+    if (firstStr.empty()) {
+        // Suffix range: the last N bytes
+        std::size_t suffix = 0;
+        if (!parseSize(lastStr, suffix)) {
+            return RANGE_RESULT::NONE;
+        }
+
+        if (suffix == 0 || fileSize == 0) {
+            return RANGE_RESULT::NOT_SATISFIABLE;
+        }
+
+        range.m_first = fileSize - std::min(suffix, fileSize);
+        range.m_last = fileSize - 1;
+
+        return RANGE_RESULT::SATISFIABLE;
+    }
+
+    if (!parseSize(firstStr, first)) {
+        return RANGE_RESULT::NONE;
+    }
+
+    if (lastStr.empty()) {
+        last = fileSize ? fileSize - 1 : 0;
+    }
+    else if (!parseSize(lastStr, last) || last < first) {
+        return RANGE_RESULT::NONE;
+    }
+
+    if (first >= fileSize) {
+        return RANGE_RESULT::NOT_SATISFIABLE;
+    }
+
+    range.m_first = first;
+    range.m_last = std::min(last, fileSize - 1);
+
+    return RANGE_RESULT::SATISFIABLE;
+}
+
+bool StaticRoute::parseHttpDate(std::string_view value, time_t &time) {
+    char buff[64];
+    if (value.size() >= sizeof(buff)) {
+        return false;
+    }
+
+    std::memcpy(buff, value.data(), value.size());
+    buff[value.size()] = '\0';
+
+    struct tm date;
+    std::memset(&date, 0, sizeof(date));
+
+    if (!strptime(buff, "%a, %d %b %Y %H:%M:%S GMT", &date)) {
+        return false;
+    }
+
+    time = timegm(&date);
+    return time != -1;
+}
+
+std::string_view StaticRoute::contentType(std::string_view path) {
+    using namespace std::string_view_literals;
+
+    static constexpr std::array typeMap = {
+        std::make_pair(".html"sv, "text/html"sv),
+        std::make_pair(".htm"sv, "text/html"sv),
+        std::make_pair(".css"sv, "text/css"sv),
+        std::make_pair(".js"sv, "text/javascript"sv),
+        std::make_pair(".mjs"sv, "text/javascript"sv),
+        std::make_pair(".json"sv, "application/json"sv),
+        std::make_pair(".txt"sv, "text/plain"sv),
+        std::make_pair(".xml"sv, "application/xml"sv),
+        std::make_pair(".svg"sv, "image/svg+xml"sv),
+        std::make_pair(".png"sv, "image/png"sv),
+        std::make_pair(".jpg"sv, "image/jpeg"sv),
+        std::make_pair(".jpeg"sv, "image/jpeg"sv),
+        std::make_pair(".gif"sv, "image/gif"sv),
+        std::make_pair(".webp"sv, "image/webp"sv),
+        std::make_pair(".ico"sv, "image/x-icon"sv),
+        std::make_pair(".woff"sv, "font/woff"sv),
+        std::make_pair(".woff2"sv, "font/woff2"sv),
+        std::make_pair(".wasm"sv, "application/wasm"sv),
+        std::make_pair(".pdf"sv, "application/pdf"sv),
+        std::make_pair(".mp4"sv, "video/mp4"sv)
+    };
+
+    const auto dot = path.rfind('.');
+    if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos) {
+        return "application/octet-stream"sv;
+    }
+
+    const std::string_view extension = path.substr(dot);
+
+    auto it = std::find_if(
+        typeMap.begin()
+        , typeMap.end()
+        , [extension](const auto &pair) {
+            return extension.size() == pair.first.size()
+                && std::equal(extension.begin(), extension.end(), pair.first.begin(), [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+        }
+    );
+
+    if (it == typeMap.end()) {
+        return "application/octet-stream"sv;
+    }
+
+    return it->second;
+}
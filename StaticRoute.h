@@ -0,0 +1,53 @@
+#ifndef _STATIC_ROUTE_H_
+#define _STATIC_ROUTE_H_
+
+#include "HttpMessage.h"
+#include "OutputQueue.h"
+#include "FileCache.h"
+#include "ThreadContext.h"
+
+#include <string>
+#include <string_view>
+#include <memory_resource>
+
+// Serves the files under a document root for every path that starts with the prefix.
+// The bodies are queued as file segments, so they are sent with sendfile(). With compression, a
+// compressible file is compressed once per encoding and its cached copy is sent instead, except
+// for the range requests.
+class StaticRoute {
+public:
+    StaticRoute(std::string_view prefix, std::string_view root, bool compression = false);
+
+    // Without the trailing '/'
+    const std::string &prefix() const;
+
+    // Returns false if there is no such file. The encoding is the one the client accepts.
+    bool serve(const HttpRequest &request, OutputQueue &output, ThreadContext &context, CONTENT_ENCODING encoding) const;
+
+private:
+    struct ByteRange {
+        std::size_t m_first;
+        std::size_t m_last;
+    };
+
+    enum class RANGE_RESULT {
+        NONE,
+        SATISFIABLE,
+        NOT_SATISFIABLE
+    };
+
+    bool resolvePath(std::string_view path, std::pmr::string &relativePath) const;
+
+    static bool notModified(const HttpRequest &request, const CachedFile &file, std::string_view etag);
+    static RANGE_RESULT parseRange(const HttpRequest &request, const CachedFile &file, ByteRange &range);
+
+    static bool parseHttpDate(std::string_view value, time_t &time);
+    static std::string_view contentType(std::string_view path);
+
+private:
+    std::string m_prefix; // Without the trailing '/'
+    std::string m_root;
+    bool m_compression;
+};
+
+#endif // !_STATIC_ROUTE_H_
@@ -0,0 +1,24 @@
+#ifndef _THREAD_CONTEXT_H_
+#define _THREAD_CONTEXT_H_
+
+#include "FileCache.h"
+#include "RequestArena.h"
+#include "AsyncPool.h"
+#include "Compression.h"
+#include "HttpDate.h"
+#include "OutputQueue.h"
+
+#include <memory>
+
+// Per-worker state that the request handlers may use without synchronization
+struct ThreadContext {
+    FileCache m_fileCache;
+    RequestArena m_arena; // Reset after every request
+    Compressor m_compressor;
+    HttpDate m_date; // Refreshed by the event loop
+    ZerocopyRetired m_zerocopyRetired;
+    std::unique_ptr<char[]> m_tlsRecord; // TlsSession::MAX_RECORD_SIZE bytes for the encryption without kTLS, only with TLS on
+    AsyncJob::Handler_t m_asyncHandler{ nullptr }; // Set by the router when the request's route runs on the async pool
+};
+
+#endif // !_THREAD_CONTEXT_H_
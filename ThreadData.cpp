@@ -1,71 +1,106 @@
 #include "ThreadData.h"
 
+#include <new>
 #include <cassert>
 
 void ThreadData::Event::clear() {
-	m_data.buffer.clear();
-	m_data.offset = 0;
+	m_data.input.clear();
+	m_data.parser.reset();
+	m_data.output.clear();
+	m_data.upload.reset();
 	m_data.clientClosed = 0;
+	m_data.readPaused = 0;
+	m_data.uploadCloses = 0;
+	m_data.uploadMethod = 0;
+	m_data.asyncJob.reset();
+	m_data.asyncPending = 0;
+	m_data.tls.reset();
 	m_data.fd = -1;
-	m_next = nullptr;
+	m_data.firstByteTicks = 0;
+	m_next = NIL;
+	++m_generation;
 }
 
 ThreadData::ThreadData()
-	: m_head{ &m_data.front() }
-	, m_tail{ &m_data.back() } {
+	: m_free{ NIL }
+	, m_used{ 0 }
+	, m_limit{ 0 } {
 
-	for (std::size_t i = 0; i + 1 < m_data.size(); ++i) {
-		auto &e = m_data[i];
-		e.m_next = &m_data[i + 1];
-	}
+}
 
+void ThreadData::setLimit(std::size_t limit) {
+	m_limit = limit;
 }
 
-bool ThreadData::add(int fd) {
-	{
-		std::lock_guard lock(m_mtxTail);
-		if (m_head == m_tail) {
-			return false;
-		}
+bool ThreadData::grow() {
+	const std::size_t first = capacity();
+	if (first + SLAB_SIZE > NIL) {
+		return false;
 	}
 
-	Event *oldHead = m_head;
-	m_head = m_head->m_next;
-
-	oldHead->m_data.fd = fd;
-
-	epoll_event newEvent;
-	newEvent.events = EPOLLIN | EPOLLHUP | EPOLLRDHUP;
-	newEvent.data.ptr = oldHead;
-
-	if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &newEvent) == -1) {
-		release(*oldHead, &newEvent);
+	std::unique_ptr<Slab> slab{ new (std::nothrow) Slab };
+	if (!slab) {
 		return false;
 	}
 
+	// Link the new slots in order, so the lowest indices are handed out first
+	for (std::size_t i = 0; i < SLAB_SIZE; ++i) {
+		auto &e = slab->m_events[i];
+		e.m_index = static_cast<std::uint32_t>(first + i);
+		e.m_next = i + 1 < SLAB_SIZE ? static_cast<std::uint32_t>(first + i + 1) : m_free;
+	}
+
+	m_free = static_cast<std::uint32_t>(first);
+	m_slabs.push_back(std::move(slab));
+
 	return true;
 }
 
-void ThreadData::release(Event &myEvnt, epoll_event *evnt) {
-	const int fd = myEvnt.m_data.fd;
+ThreadData::Event *ThreadData::acquire(int fd) {
+	const std::size_t used = m_used.load(std::memory_order_relaxed);
 
-	myEvnt.clear();
-
-	{
-		std::lock_guard lock(m_mtxTail);
-		m_tail->m_next = &myEvnt;
-		m_tail = m_tail->m_next;
+	if (m_limit != 0 && used == m_limit) {
+		return nullptr;
 	}
 
-	if (epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, evnt) == -1) {
-		assert(false && "Error. Can't release the epoll event.");
+	if (m_free == NIL && !grow()) {
+		return nullptr;
 	}
+
+	m_used.store(used + 1, std::memory_order_relaxed);
+
+	Event &e = at(m_free);
+	m_free = e.m_next;
+
+	e.m_next = NIL;
+	e.m_data.fd = fd;
+
+	return &e;
+}
+
+void ThreadData::release(Event &myEvnt) {
+	myEvnt.clear();
+	m_used.store(m_used.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+	// LIFO, the slot that was used last is the most likely to be in the cache
+	myEvnt.m_next = m_free;
+	m_free = myEvnt.m_index;
+}
+
+std::size_t ThreadData::index(const Event &myEvnt) const {
+	assert(myEvnt.m_index < capacity());
+	return myEvnt.m_index;
+}
+
+ThreadData::Event &ThreadData::at(std::size_t idx) {
+	assert(idx < capacity());
+	return m_slabs[idx / SLAB_SIZE]->m_events[idx % SLAB_SIZE];
 }
 
-int ThreadData::getEpollFd() const {
-	return m_epollfd;
+std::size_t ThreadData::capacity() const {
+	return m_slabs.size() * SLAB_SIZE;
 }
 
-void ThreadData::setEpollFd(int id) {
-	m_epollfd = id;
+std::size_t ThreadData::size() const {
+	return m_used.load(std::memory_order_relaxed);
 }
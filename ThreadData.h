@@ -2,22 +2,41 @@
 #define _THREAD_DATA_H_
 
 #include "ServerConstants.h"
+#include "InputBuffer.h"
+#include "HttpParser.h"
+#include "OutputQueue.h"
+#include "BodySink.h"
+#include "AsyncPool.h"
+#include "Tls.h"
 
-#include <mutex>
 #include <array>
-#include <sys/epoll.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
 
+// Connection slots of a worker, owned and used only by the worker thread. The slots are allocated
+// in slabs when the free list runs out and are never freed, so a slot and its index stay valid
+// for the lifetime of the worker. The slabs are created and constructed by the worker, so the
+// kernel's first-touch policy places them on its NUMA node.
 class ThreadData {
 public:
 	static constexpr int MSG_BUFFER_AVG_SIZE = 1024;
+	static constexpr std::size_t SLAB_SIZE = 256;
 
 	struct Event {
 		struct Data {
 			Data()
-				: offset(0)
+				: output(MSG_BUFFER_AVG_SIZE)
 				, clientClosed(0)
-				, fd(-1) {
-				buffer.reserve(MSG_BUFFER_AVG_SIZE);
+				, readPaused(0)
+				, uploadCloses(0)
+				, uploadMethod(0)
+				, asyncPending(0)
+				, fd(-1)
+				, firstByteTicks(0) {
+
 			}
 			Data(const Data &) = delete;
 			Data& operator=(const Data &) = delete;
@@ -25,33 +44,64 @@ public:
 			Data& operator=(Data &&) = default;
 			~Data() = default;
 
-			std::string buffer;
-			std::uint32_t offset : 31;
+			InputBuffer input;
+			HttpParser parser;
+
+			OutputQueue output;
+			std::unique_ptr<BodySink> upload; // Receives the body of the current request as it arrives
+			std::unique_ptr<AsyncJob> asyncJob; // The finished async request, its response goes out next
+			std::unique_ptr<TlsSession> tls; // nullptr on a plaintext connection
 			std::uint32_t clientClosed : 1;
+			std::uint32_t readPaused : 1; // Edge-triggered epoll: the socket wasn't drained because the output is blocked
+			std::uint32_t uploadCloses : 1; // The upload's request asked to close the connection
+			std::uint32_t uploadMethod : 4; // HTTP_METHOD of the upload, for the metrics
+			std::uint32_t asyncPending : 1; // A request is on the async pool, the ones after it wait in the input
 			int fd;
+			std::uint64_t firstByteTicks; // CycleClock ticks of the wakeup that completed the oldest unsent response, 0 if none
 		} m_data;
 
-		Event *m_next{ nullptr };
+		std::uint32_t m_next{ NIL };	// The next free slot
+		std::uint32_t m_index{ 0 };
+		std::uint32_t m_generation{ 0 };	// Changes when the slot is released, the async results of a closed connection are dropped
 
 		void clear();
 	};
 
-	static_assert(sizeof(Event) == 48, "Broken Event size");
+	static_assert(sizeof(Event) == 320, "Broken Event size");
 
 	explicit ThreadData();
 
-	bool add(int fd);
-	void release(Event &myEvnt, epoll_event *evnt);
+	// 0 means no limit
+	void setLimit(std::size_t limit);
+
+	// Returns nullptr if the limit has been reached or a new slab can't be allocated
+	Event *acquire(int fd);
+	void release(Event &myEvnt);
+
+	// Stable slot numbers, used by the reactors and the timers to keep their own per-connection state.
+	// The slots that have ever been acquired are below capacity().
+	std::size_t index(const Event &myEvnt) const;
+	Event &at(std::size_t idx);
+	std::size_t capacity() const;
+
+	// The slots in use, any thread may read it
+	std::size_t size() const;
 
-	int getEpollFd() const;
-	void setEpollFd(int id);
+private:
+	static constexpr std::uint32_t NIL = UINT32_MAX;
+
+	struct alignas(64) Slab {
+		std::array<Event, SLAB_SIZE> m_events;
+	};
+
+	bool grow();
 
 private:
-	int m_epollfd;
-	std::array<Event, CONNECTIONS_PER_THREAD + 1> m_data;
-	Event *m_head;
-	Event *m_tail;
-	std::mutex m_mtxTail;
+	std::vector<std::unique_ptr<Slab>> m_slabs;
+	std::uint32_t m_free;
+
+	std::atomic<std::size_t> m_used;	// Written only by the worker
+	std::size_t m_limit;
 };
 
 #endif // !_THREAD_DATA_H_
@@ -0,0 +1,149 @@
+#include "TimerWheel.h"
+
+#include <cassert>
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::size_t timers, Clock::time_point now)
+    : m_start{ now }
+    , m_nodes(HEADS) {
+
+    // The list heads point to themselves when their slot is empty
+    for (std::size_t idx = 0; idx < HEADS; ++idx) {
+        m_nodes[idx] = Node{ static_cast<std::uint32_t>(idx), static_cast<std::uint32_t>(idx), 0, NIL };
+    }
+
+    grow(timers);
+}
+
+void TimerWheel::grow(std::size_t timers) {
+    assert(HEADS + timers < NIL);
+
+    if (HEADS + timers > m_nodes.size()) {
+        m_nodes.resize(HEADS + timers, Node{ NIL, NIL, 0, NIL });
+    }
+}
+
+void TimerWheel::arm(std::size_t id, std::chrono::milliseconds timeout, Clock::time_point now) {
+    assert(HEADS + id < m_nodes.size());
+
+    const std::uint32_t node = static_cast<std::uint32_t>(HEADS + id);
+
+    if (armed(id)) {
+        unlink(node);
+    }
+
+    // Round up, a timer never fires early
+    const std::uint64_t ticks = static_cast<std::uint64_t>((std::max(timeout, TICK) + TICK - std::chrono::milliseconds{ 1 }) / TICK);
+
+    m_nodes[node].m_expiry = std::max(toTick(now), m_current) + ticks;
+    insert(node);
+}
+
+void TimerWheel::cancel(std::size_t id) {
+    assert(HEADS + id < m_nodes.size());
+
+    if (armed(id)) {
+        unlink(static_cast<std::uint32_t>(HEADS + id));
+    }
+}
+
+bool TimerWheel::armed(std::size_t id) const {
+    return m_nodes[HEADS + id].m_slot != NIL;
+}
+
+std::size_t TimerWheel::size() const {
+    return m_armed;
+}
+
+std::chrono::milliseconds TimerWheel::nextTimeout(Clock::time_point now, std::chrono::milliseconds limit) const {
+    if (m_armed == 0) {
+        return limit;
+    }
+
+    // The first non-empty slot of the lowest level after the current one. If it's empty,
+    // the lowest level has to wrap around before anything can expire.
+    const std::size_t current = static_cast<std::size_t>(m_current & (SLOTS - 1));
+    const std::uint64_t ahead = current + 1 < SLOTS ? m_occupied[0] >> (current + 1) : 0;
+
+    const std::uint64_t ticks = ahead ? static_cast<std::uint64_t>(__builtin_ctzll(ahead)) + 1 : SLOTS - current;
+
+    const auto deadline = m_start + (m_current + ticks) * TICK;
+    if (deadline <= now) {
+        return std::chrono::milliseconds{ 0 };
+    }
+
+    return std::min(limit, std::chrono::ceil<std::chrono::milliseconds>(deadline - now));
+}
+
+std::uint64_t TimerWheel::toTick(Clock::time_point time) const {
+    return time > m_start ? static_cast<std::uint64_t>((time - m_start) / TICK) : 0;
+}
+
+void TimerWheel::insert(std::uint32_t id) {
+    Node &node = m_nodes[id];
+
+    const std::uint64_t delta = node.m_expiry > m_current ? node.m_expiry - m_current : 0;
+
+    // The lowest level whose range covers the delta. The timers beyond the range wait at the top level.
+    std::size_t level = 0;
+    while (level + 1 < LEVELS && delta >= (std::uint64_t{ 1 } << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+
+    std::uint64_t expiry = node.m_expiry;
+    if (level + 1 == LEVELS && delta >= (std::uint64_t{ 1 } << (SLOT_BITS * LEVELS))) {
+        expiry = m_current + (std::uint64_t{ 1 } << (SLOT_BITS * LEVELS)) - 1;
+    }
+
+    const std::size_t slot = static_cast<std::size_t>((expiry >> (SLOT_BITS * level)) & (SLOTS - 1));
+    const std::uint32_t head = static_cast<std::uint32_t>(level * SLOTS + slot);
+
+    // Append, so the timers of a slot fire in the order they were armed
+    Node &headNode = m_nodes[head];
+    node.m_prev = headNode.m_prev;
+    node.m_next = head;
+    m_nodes[headNode.m_prev].m_next = id;
+    headNode.m_prev = id;
+
+    node.m_slot = head;
+    m_occupied[level] |= std::uint64_t{ 1 } << slot;
+    ++m_armed;
+}
+
+void TimerWheel::unlink(std::uint32_t id) {
+    Node &node = m_nodes[id];
+    const std::uint32_t head = node.m_slot;
+
+    m_nodes[node.m_prev].m_next = node.m_next;
+    m_nodes[node.m_next].m_prev = node.m_prev;
+
+    if (m_nodes[head].m_next == head) {
+        m_occupied[head / SLOTS] &= ~(std::uint64_t{ 1 } << (head % SLOTS));
+    }
+
+    node.m_prev = node.m_next = NIL;
+    node.m_slot = NIL;
+    --m_armed;
+}
+
+void TimerWheel::cascade(std::size_t level) {
+    if (level >= LEVELS) {
+        return;
+    }
+
+    const std::size_t slot = static_cast<std::size_t>((m_current >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+    // The upper level wraps around first, so its timers that are due in this slot are moved here
+    if (slot == 0) {
+        cascade(level + 1);
+    }
+
+    const std::uint32_t head = static_cast<std::uint32_t>(level * SLOTS + slot);
+
+    while (m_nodes[head].m_next != head) {
+        const std::uint32_t id = m_nodes[head].m_next;
+
+        unlink(id);
+        insert(id);
+    }
+}
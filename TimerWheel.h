@@ -0,0 +1,103 @@
+#ifndef _TIMER_WHEEL_H_
+#define _TIMER_WHEEL_H_
+
+#include <array>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Hierarchical timing wheel over a fixed set of timer ids (the connection slots of a worker).
+// Every level has 64 slots and every slot of a level covers 64 slots of the level below, so
+// 4 levels of 10 ms ticks reach about 46 hours. Arming, re-arming and cancelling are O(1):
+// the timers are intrusive doubly-linked lists of indices and nothing is allocated after the
+// construction. Timers of the upper levels are moved down when the lower level wraps around.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds TICK{ 10 };
+    static constexpr std::size_t SLOT_BITS = 6;
+    static constexpr std::size_t SLOTS = std::size_t{ 1 } << SLOT_BITS;
+    static constexpr std::size_t LEVELS = 4;
+
+    explicit TimerWheel(std::size_t timers, Clock::time_point now = Clock::now());
+
+    // Adds timers, the armed ones aren't affected
+    void grow(std::size_t timers);
+
+    // Re-arms the timer if it's already armed
+    void arm(std::size_t id, std::chrono::milliseconds timeout, Clock::time_point now);
+    void cancel(std::size_t id);
+    bool armed(std::size_t id) const;
+
+    std::size_t size() const;
+
+    // Calls onExpired(id) for every timer that has expired by now. The timer is disarmed before
+    // the call, so the handler may arm it again and may arm or cancel any other timer.
+    template <typename OnExpired>
+    void advance(Clock::time_point now, OnExpired &&onExpired);
+
+    // The time until the next timer can expire, at most limit
+    std::chrono::milliseconds nextTimeout(Clock::time_point now, std::chrono::milliseconds limit) const;
+
+private:
+    static constexpr std::uint32_t NIL = UINT32_MAX;
+    static constexpr std::size_t HEADS = LEVELS * SLOTS;
+
+    struct Node {
+        std::uint32_t m_prev;
+        std::uint32_t m_next;
+        std::uint64_t m_expiry; // Tick
+        std::uint32_t m_slot;   // Index of the list head, NIL when not armed
+    };
+
+    std::uint64_t toTick(Clock::time_point time) const;
+
+    void insert(std::uint32_t id);
+    void unlink(std::uint32_t id);
+
+    // Moves the timers of the current slot of the level to the lower levels
+    void cascade(std::size_t level);
+
+private:
+    Clock::time_point m_start;
+    std::uint64_t m_current{ 0 }; // The last processed tick
+
+    // One list head per slot followed by the timers
+    std::vector<Node> m_nodes;
+    std::size_t m_armed{ 0 };
+
+    // The non-empty slots of every level
+    std::array<std::uint64_t, LEVELS> m_occupied{};
+};
+
+template <typename OnExpired>
+void TimerWheel::advance(Clock::time_point now, OnExpired &&onExpired) {
+    const std::uint64_t target = toTick(now);
+
+    while (m_current < target) {
+        if (m_armed == 0) {
+            // Nothing to move or fire, just catch up
+            m_current = target;
+            break;
+        }
+
+        ++m_current;
+
+        if ((m_current & (SLOTS - 1)) == 0) {
+            cascade(1);
+        }
+
+        const std::uint32_t head = static_cast<std::uint32_t>(m_current & (SLOTS - 1));
+
+        while (m_nodes[head].m_next != head) {
+            const std::uint32_t node = m_nodes[head].m_next;
+
+            unlink(node);
+            onExpired(static_cast<std::size_t>(node - HEADS));
+        }
+    }
+}
+
+#endif // !_TIMER_WHEEL_H_
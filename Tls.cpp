@@ -0,0 +1,202 @@
+#include "Tls.h"
+
+#include <cerrno>
+#include <iostream>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/bio.h>
+
+namespace {
+
+void printErrors(const char *what) {
+    std::cerr << what << '\n';
+
+    while (const unsigned long error = ERR_get_error()) {
+        char text[256];
+        ERR_error_string_n(error, text, sizeof(text));
+        std::cerr << "  " << text << '\n';
+    }
+}
+
+}
+
+TlsContext::~TlsContext() {
+    SSL_CTX_free(m_ctx);
+}
+
+bool TlsContext::init(const TlsOptions &options) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        printErrors("Can't create the TLS context");
+        return false;
+    }
+
+    const std::string &keyFile = options.m_keyFile.empty() ? options.m_certFile : options.m_keyFile;
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, options.m_certFile.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(ctx) != 1) {
+        printErrors("Can't load the TLS certificate and key");
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    // A client that closes without close_notify ends the session like one that sends it
+    std::uint64_t sslOptions = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+
+    if (!options.m_tickets) {
+        sslOptions |= SSL_OP_NO_TICKET; // TLS 1.3 then issues tickets that refer to the session cache
+    }
+
+    if (options.m_kernel) {
+        sslOptions |= SSL_OP_ENABLE_KTLS;
+    }
+
+    SSL_CTX_set_options(ctx, sslOptions);
+
+    // A write encrypts one record and may be retried from a different buffer with the same bytes.
+    // The idle keep-alive connections don't hold the read and write buffers.
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    static constexpr unsigned char SESSION_ID_CONTEXT[] = "http-server";
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+
+    if (options.m_sessionCacheSize != 0) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, options.m_sessionCacheSize);
+    }
+    else {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    // Every ticket costs an encryption in the handshake, an HTTP client resumes with one
+    SSL_CTX_set_num_tickets(ctx, options.m_tickets || options.m_sessionCacheSize != 0 ? 1 : 0);
+
+    SSL_CTX_free(m_ctx);
+    m_ctx = ctx;
+    return true;
+}
+
+bool TlsContext::ready() const {
+    return m_ctx != nullptr;
+}
+
+std::unique_ptr<TlsSession> TlsContext::accept(int fd, char *record) const {
+    SSL *ssl = SSL_new(m_ctx);
+    if (!ssl) {
+        return nullptr;
+    }
+
+    if (SSL_set_fd(ssl, fd) != 1) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+
+    SSL_set_accept_state(ssl);
+
+    return std::make_unique<TlsSession>(ssl, record);
+}
+
+TlsSession::TlsSession(SSL *ssl, char *record)
+    : m_ssl{ ssl }
+    , m_record{ record } {
+
+}
+
+TlsSession::~TlsSession() {
+    SSL_free(m_ssl);
+}
+
+TlsSession::RESULT TlsSession::handshake() {
+    const int result = SSL_do_handshake(m_ssl);
+
+    if (result == 1) {
+        m_established = true;
+        return RESULT::DONE;
+    }
+
+    switch (SSL_get_error(m_ssl, result)) {
+    case SSL_ERROR_WANT_READ:
+        return RESULT::WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return RESULT::WANT_WRITE;
+    default:
+        ERR_clear_error();
+        return RESULT::ERROR;
+    }
+}
+
+bool TlsSession::established() const {
+    return m_established;
+}
+
+bool TlsSession::resumed() const {
+    return SSL_session_reused(m_ssl) == 1;
+}
+
+bool TlsSession::kernelSend() const {
+    return BIO_get_ktls_send(SSL_get_wbio(m_ssl));
+}
+
+bool TlsSession::kernelReceive() const {
+    return BIO_get_ktls_recv(SSL_get_rbio(m_ssl));
+}
+
+ssize_t TlsSession::read(char *buffer, std::size_t len) {
+    std::size_t received = 0;
+
+    if (SSL_read_ex(m_ssl, buffer, len, &received) == 1) {
+        return static_cast<ssize_t>(received);
+    }
+
+    switch (SSL_get_error(m_ssl, 0)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        // errno of the failed recv() is kept
+        ERR_clear_error();
+        if (errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+            errno = ECONNRESET;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+TlsSession::RESULT TlsSession::write(const char *data, std::size_t len, std::size_t &written) {
+    written = 0;
+
+    if (SSL_write_ex(m_ssl, data, len, &written) == 1) {
+        return RESULT::DONE;
+    }
+
+    switch (SSL_get_error(m_ssl, 0)) {
+    case SSL_ERROR_WANT_WRITE:
+        return RESULT::WANT_WRITE;
+    case SSL_ERROR_WANT_READ:
+        return RESULT::WANT_READ;
+    default:
+        ERR_clear_error();
+        return RESULT::ERROR;
+    }
+}
+
+char *TlsSession::record() const {
+    return m_record;
+}
+
+void TlsSession::close() {
+    if (m_established && SSL_shutdown(m_ssl) < 0) {
+        ERR_clear_error();
+    }
+}
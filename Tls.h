@@ -0,0 +1,100 @@
+#ifndef _TLS_H_
+#define _TLS_H_
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/types.h>
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+struct TlsOptions {
+    std::string m_certFile;                 // PEM chain, TLS is off without it
+    std::string m_keyFile;                  // PEM private key, the certificate file when empty
+    std::uint32_t m_sessionCacheSize{ 20480 }; // Sessions kept for resumption by id, 0 disables the cache
+    bool m_tickets{ true };                 // Stateless resumption with session tickets
+    bool m_kernel{ true };                  // kTLS after the handshake when the kernel and the cipher allow it
+
+    bool enabled() const { return !m_certFile.empty(); }
+};
+
+class TlsSession;
+
+// The OpenSSL context shared by all workers: the certificate, the session cache and the ticket keys,
+// so a session can be resumed on any worker. OpenSSL locks it internally.
+class TlsContext {
+public:
+    TlsContext() = default;
+    ~TlsContext();
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    // Loads the certificate and the key. Prints the OpenSSL errors and returns false if they can't be used.
+    bool init(const TlsOptions &options);
+
+    bool ready() const;
+
+    // A server session on the accepted socket, nullptr if OpenSSL can't allocate it.
+    // record is the worker's buffer for the records encrypted without kTLS.
+    std::unique_ptr<TlsSession> accept(int fd, char *record) const;
+
+private:
+    ssl_ctx_st *m_ctx{ nullptr };
+};
+
+// The TLS state of one connection, used only by its worker. The handshake runs on the non-blocking
+// socket. Afterwards OpenSSL may have moved the encryption into the kernel: with kernelSend() the
+// output goes to the plain socket with sendmsg() and sendfile(), otherwise write() encrypts it.
+// The input is always read with read(), which uses the kernel's decryption when it's on.
+class TlsSession {
+public:
+    enum class RESULT {
+        DONE,
+        WANT_READ,
+        WANT_WRITE,
+        ERROR
+    };
+
+    // The largest plaintext of a record, a read into a smaller buffer could leave bytes in OpenSSL
+    // that no readiness event reports
+    static constexpr std::size_t MAX_RECORD_SIZE = 16384;
+
+    TlsSession(ssl_st *ssl, char *record);
+    ~TlsSession();
+
+    TlsSession(const TlsSession &) = delete;
+    TlsSession &operator=(const TlsSession &) = delete;
+
+    RESULT handshake();
+    bool established() const;
+
+    // Of the completed handshake
+    bool resumed() const;
+    bool kernelSend() const;
+    bool kernelReceive() const;
+
+    // With the semantics of recv(): 0 when the peer has closed the session, -1 and EAGAIN when
+    // more input is needed
+    ssize_t read(char *buffer, std::size_t len);
+
+    // Encrypts at most MAX_RECORD_SIZE bytes as one record. After WANT_WRITE the next call must
+    // start with the same bytes, they have been encrypted already.
+    RESULT write(const char *data, std::size_t len, std::size_t &written);
+
+    // The worker's buffer of MAX_RECORD_SIZE bytes where write()'s data may be gathered
+    char *record() const;
+
+    // Sends close_notify, without waiting for the peer's
+    void close();
+
+private:
+    ssl_st *m_ssl;
+    char *m_record;
+    bool m_established{ false };
+};
+
+#endif // !_TLS_H_
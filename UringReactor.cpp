@@ -0,0 +1,489 @@
+#include "UringReactor.h"
+#include "ServerThread.h"
+
+#include <cassert>
+
+#include <cstdio>
+#include <cerrno>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+UringReactor::UringReactor(ServerThread &thread, int listenerfd)
+	: m_thread{ thread }
+	, m_data{ thread.data() }
+	, m_context{ thread.context() }
+	, m_stats{ thread.stats() }
+	, m_metrics{ thread.metrics() }
+	, m_listenerfd{ listenerfd }
+	, m_wakeupValue{ 0 }
+	, m_asyncValue{ 0 } {
+
+}
+
+bool UringReactor::init() {
+	if (!m_ring.init(RING_ENTRIES)) {
+		return false;
+	}
+
+	if (!m_ring.setupBuffers(m_thread.server().config().m_uringBuffers, InputBuffer::INITIAL_CAPACITY)) {
+		return false;
+	}
+
+	if (m_listenerfd == -1 && !m_handoff.init()) {
+		return false;
+	}
+
+	return true;
+}
+
+bool UringReactor::addClient(int fd) {
+	return m_handoff.push(fd);
+}
+
+std::size_t UringReactor::pendingClients() const {
+	return m_handoff.size();
+}
+
+void UringReactor::run() {
+	if (!m_ring.enable()) {
+		return;
+	}
+
+	if (m_listenerfd != -1) {
+		armAccept();
+	}
+	else {
+		armWakeup();
+	}
+
+	if (m_thread.completions().fd() != -1) {
+		armAsyncWakeup();
+	}
+
+	std::uint64_t enterCalls = 0;
+
+	while (true) {
+		// Wake up for the next deadline and periodically for the housekeeping, even if there are no completions
+		m_ring.submitAndWait(m_thread.waitTimeout());
+
+		const auto wakeup = std::chrono::steady_clock::now();
+		m_context.m_fileCache.onTimer(wakeup);
+		m_context.m_date.onTimer(wakeup);
+		m_thread.onWakeup();
+
+		m_ring.forEachCompletion([this](const io_uring_cqe &cqe) {
+			onCompletion(cqe);
+		});
+
+		m_thread.expireTimeouts([this](ThreadData::Event &event) {
+			abort(m_data.index(event));
+		});
+
+		m_stats.addSyscalls(m_ring.enterCalls() - enterCalls);
+		enterCalls = m_ring.enterCalls();
+
+		// For the dispatcher's placement policy
+		m_stats.addLoopTime(std::chrono::steady_clock::now() - wakeup);
+	}
+}
+
+std::uint64_t UringReactor::userData(OP op, std::size_t idx) {
+	return (static_cast<std::uint64_t>(idx) << 8) | static_cast<std::uint64_t>(op);
+}
+
+io_uring_sqe *UringReactor::prepare(OP op, std::size_t idx, std::uint8_t opcode, int fd) {
+	io_uring_sqe *sqe = m_ring.getSqe();
+	if (!sqe) {
+		return nullptr;
+	}
+
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = userData(op, idx);
+
+	return sqe;
+}
+
+void UringReactor::armAccept() {
+	io_uring_sqe *sqe = prepare(OP::ACCEPT, 0, IORING_OP_ACCEPT, m_listenerfd);
+	if (!sqe) {
+		assert(false && "The submission queue can't be full after a submit");
+		return;
+	}
+
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK;
+}
+
+void UringReactor::armWakeup() {
+	io_uring_sqe *sqe = prepare(OP::WAKEUP, 0, IORING_OP_READ, m_handoff.fd());
+	if (!sqe) {
+		assert(false && "The submission queue can't be full after a submit");
+		return;
+	}
+
+	sqe->addr = reinterpret_cast<std::uint64_t>(&m_wakeupValue);
+	sqe->len = sizeof(m_wakeupValue);
+}
+
+void UringReactor::armAsyncWakeup() {
+	io_uring_sqe *sqe = prepare(OP::ASYNC, 0, IORING_OP_READ, m_thread.completions().fd());
+	if (!sqe) {
+		assert(false && "The submission queue can't be full after a submit");
+		return;
+	}
+
+	sqe->addr = reinterpret_cast<std::uint64_t>(&m_asyncValue);
+	sqe->len = sizeof(m_asyncValue);
+}
+
+void UringReactor::armRecv(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+
+	io_uring_sqe *sqe = prepare(OP::RECV, idx, IORING_OP_RECV, m_data.at(idx).m_data.fd);
+	if (!sqe) {
+		abort(idx);
+		return;
+	}
+
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = IoUring::BUFFER_GROUP;
+
+	connection.m_receiving = true;
+	++connection.m_pending;
+}
+
+void UringReactor::onCompletion(const io_uring_cqe &cqe) {
+	const OP op = static_cast<OP>(cqe.user_data & 0xff);
+	const std::size_t idx = static_cast<std::size_t>(cqe.user_data >> 8);
+
+	switch (op) {
+	case OP::ACCEPT:
+		if (cqe.res >= 0) {
+			addAccepted(cqe.res);
+		}
+
+		if (!(cqe.flags & IORING_CQE_F_MORE)) {
+			armAccept();
+		}
+		break;
+	case OP::WAKEUP:
+		m_handoff.drain([this](int clientfd) {
+			addAccepted(clientfd);
+		});
+
+		armWakeup();
+		break;
+	case OP::ASYNC:
+		onAsync();
+		armAsyncWakeup();
+		break;
+	case OP::RECV:
+		onRecv(idx, cqe);
+		break;
+	case OP::SEND:
+		onSend(idx, cqe);
+		break;
+	case OP::SHUTDOWN: {
+		Connection &connection = m_connections[idx];
+		--connection.m_pending;
+		connection.m_shutdownLinked = false;
+		connection.m_shutdown = connection.m_shutdown || cqe.res == 0;
+
+		tryRelease(idx);
+		break;
+	}
+	case OP::POLL_OUT: {
+		Connection &connection = m_connections[idx];
+		--connection.m_pending;
+		connection.m_sending = false;
+
+		if (connection.m_closing) {
+			tryRelease(idx);
+		}
+		else {
+			send(idx);
+		}
+		break;
+	}
+	}
+}
+
+void UringReactor::addAccepted(int clientfd) {
+	if (ThreadData::Event *event = m_data.acquire(clientfd)) {
+		m_metrics.addAccepted();
+		startConnection(*event);
+		return;
+	}
+
+	close(clientfd);
+	m_stats.addSyscalls(1);
+	m_metrics.addRejected();
+}
+
+void UringReactor::startConnection(ThreadData::Event &event) {
+	const std::size_t idx = m_data.index(event);
+
+	// A new slab of slots
+	if (idx >= m_connections.size()) {
+		m_connections.resize(m_data.capacity());
+	}
+
+	m_connections[idx] = Connection{};
+	m_thread.armTimeout(event, ServerThread::TIMEOUT::HEADER);
+	armRecv(idx);
+}
+
+void UringReactor::onRecv(std::size_t idx, const io_uring_cqe &cqe) {
+	Connection &connection = m_connections[idx];
+
+	const bool more = cqe.flags & IORING_CQE_F_MORE;
+	if (!more) {
+		connection.m_receiving = false;
+		--connection.m_pending;
+	}
+
+	if (cqe.res > 0) {
+		const unsigned bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		m_stats.addBytesIn(static_cast<std::size_t>(cqe.res));
+
+		if (!connection.m_closing) {
+			receive(idx, m_ring.buffer(bufferId), static_cast<std::size_t>(cqe.res));
+		}
+
+		// Everything that must outlive the request has been copied
+		m_ring.recycleBuffer(bufferId);
+	}
+	else if (cqe.res != -ENOBUFS) {
+		// The client closed the connection or an error
+		abort(idx);
+		return;
+	}
+
+	// The multishot recv stops when it runs out of buffers, they have been recycled by now
+	if (connection.m_closing) {
+		tryRelease(idx);
+	}
+	else if (!connection.m_receiving) {
+		armRecv(idx);
+	}
+}
+
+void UringReactor::receive(std::size_t idx, char *bytes, std::size_t len) {
+	auto &data = m_data.at(idx).m_data;
+
+	if (data.clientClosed) {
+		// Everything after the last request is ignored
+		return;
+	}
+
+	if (m_connections[idx].m_sending) {
+		// The responses are sent from the output queue, so it can't change until the send completes
+		data.input.append(bytes, len);
+		return;
+	}
+
+	if (data.input.empty()) {
+		// Parse in place and keep only the incomplete request
+		const std::size_t consumed = m_thread.processRequests(m_data.at(idx), bytes, len);
+		if (consumed < len) {
+			data.input.append(bytes + consumed, len - consumed);
+		}
+	}
+	else {
+		data.input.append(bytes, len);
+		data.input.consume(m_thread.processRequests(m_data.at(idx), data.input.data(), data.input.size()));
+	}
+
+	send(idx);
+}
+
+void UringReactor::send(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+	auto &data = m_data.at(idx).m_data;
+
+	assert(!connection.m_sending);
+
+	m_thread.onSend(data);
+
+	while (true) {
+		// The next pieces of a streamed response, nothing is in flight at this point
+		if (!data.output.refill()) {
+			abort(idx);
+			return;
+		}
+
+		if (data.output.empty()) {
+			break;
+		}
+
+		if (data.output.fileNext()) {
+			const auto result = data.output.sendNextFile(data.fd, m_stats);
+
+			if (result == OutputQueue::RESULT::ERROR) {
+				abort(idx);
+				return;
+			}
+
+			if (result == OutputQueue::RESULT::WOULD_BLOCK) {
+				io_uring_sqe *sqe = prepare(OP::POLL_OUT, idx, IORING_OP_POLL_ADD, data.fd);
+				if (!sqe) {
+					abort(idx);
+					return;
+				}
+
+				sqe->poll32_events = POLLOUT;
+
+				connection.m_sending = true;
+				++connection.m_pending;
+
+				m_thread.updateTimeout(m_data.at(idx));
+				return;
+			}
+
+			continue;
+		}
+
+		std::size_t bytes = 0;
+		bool moreFollows = false;
+		const int iovCount = data.output.gatherMemory(connection.m_iov, MAX_SEND_IOVEC, bytes, moreFollows);
+
+		// The last bytes of a closing connection: MSG_WAITALL makes a short send fail the link
+		const bool last = data.clientClosed && !moreFollows && iovCount < MAX_SEND_IOVEC && !data.output.streaming();
+
+		connection.m_message = msghdr{};
+		connection.m_message.msg_iov = connection.m_iov;
+		connection.m_message.msg_iovlen = static_cast<std::size_t>(iovCount);
+
+		io_uring_sqe *sqe = prepare(OP::SEND, idx, IORING_OP_SENDMSG, data.fd);
+		if (!sqe) {
+			abort(idx);
+			return;
+		}
+
+		sqe->addr = reinterpret_cast<std::uint64_t>(&connection.m_message);
+		sqe->msg_flags = MSG_NOSIGNAL | (moreFollows ? MSG_MORE : 0) | (last ? MSG_WAITALL : 0);
+
+		connection.m_sending = true;
+		++connection.m_pending;
+
+		if (last && !connection.m_shutdown) {
+			if (io_uring_sqe *shutdownSqe = prepare(OP::SHUTDOWN, idx, IORING_OP_SHUTDOWN, data.fd)) {
+				sqe->flags |= IOSQE_IO_LINK;
+				shutdownSqe->len = SHUT_RDWR;
+
+				connection.m_shutdownLinked = true;
+				++connection.m_pending;
+			}
+		}
+
+		m_thread.updateTimeout(m_data.at(idx));
+		return;
+	}
+
+	if (data.clientClosed) {
+		finish(idx);
+		return;
+	}
+
+	m_thread.updateTimeout(m_data.at(idx));
+}
+
+void UringReactor::onSend(std::size_t idx, const io_uring_cqe &cqe) {
+	Connection &connection = m_connections[idx];
+	auto &data = m_data.at(idx).m_data;
+
+	--connection.m_pending;
+	connection.m_sending = false;
+
+	if (connection.m_closing) {
+		tryRelease(idx);
+		return;
+	}
+
+	if (cqe.res < 0) {
+		abort(idx);
+		return;
+	}
+
+	m_stats.addBytesOut(static_cast<std::size_t>(cqe.res));
+	data.output.commitSent(static_cast<std::size_t>(cqe.res));
+
+	if (data.output.empty() && !data.clientClosed && (!data.input.empty() || data.asyncJob)) {
+		// The finished async request and the requests that arrived while the responses were being sent
+		data.input.consume(m_thread.processRequests(m_data.at(idx), data.input.data(), data.input.size()));
+	}
+
+	send(idx);
+}
+
+void UringReactor::onAsync() {
+	m_thread.completions().drain([this](AsyncJob *job) {
+		ThreadData::Event *event = m_thread.completeAsync(job);
+		if (!event) {
+			return;
+		}
+
+		const std::size_t idx = m_data.index(*event);
+		const Connection &connection = m_connections[idx];
+
+		// The output can't change during a send, onSend() picks the response up
+		if (connection.m_closing || connection.m_sending) {
+			return;
+		}
+
+		auto &data = event->m_data;
+		data.input.consume(m_thread.processRequests(*event, data.input.data(), data.input.size()));
+
+		send(idx);
+	});
+}
+
+void UringReactor::finish(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+	connection.m_closing = true;
+
+	if (!connection.m_shutdown && !connection.m_shutdownLinked) {
+		shutdown(m_data.at(idx).m_data.fd, SHUT_RDWR);
+		m_stats.addSyscalls(1);
+		connection.m_shutdown = true;
+	}
+
+	tryRelease(idx);
+}
+
+void UringReactor::abort(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+	connection.m_closing = true;
+
+	// Also completes the recv and the send in flight
+	if (!connection.m_shutdown) {
+		shutdown(m_data.at(idx).m_data.fd, SHUT_RDWR);
+		m_stats.addSyscalls(1);
+		connection.m_shutdown = true;
+	}
+
+	tryRelease(idx);
+}
+
+void UringReactor::tryRelease(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+
+	if (!connection.m_closing || connection.m_pending != 0 || connection.m_released) {
+		return;
+	}
+
+	auto &event = m_data.at(idx);
+	close(event.m_data.fd);
+	m_stats.addSyscalls(1);
+	m_metrics.addClosed();
+
+	m_thread.cancelTimeout(event);
+
+	// The callers up the stack may still look at the slot
+	connection.m_released = true;
+	m_data.release(event);
+}
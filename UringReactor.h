@@ -0,0 +1,104 @@
+#ifndef _URING_REACTOR_H_
+#define _URING_REACTOR_H_
+
+#include "Reactor.h"
+#include "ThreadData.h"
+#include "IoUring.h"
+
+#include <deque>
+#include <cstdint>
+
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+struct ThreadContext;
+class IoStats;
+class Metrics;
+
+// io_uring loop. Every connection has a multishot recv that fills buffers from the provided buffer
+// ring, so the worker doesn't keep a receive buffer per idle connection. The responses are sent
+// with one SENDMSG in flight per connection, the final one of a closing connection is linked to
+// its SHUTDOWN. Everything queued during a loop iteration is submitted with the next wait.
+// The file segments are sent with sendfile() from the worker, which is fine for cached files.
+class UringReactor : public Reactor {
+public:
+	static constexpr unsigned RING_ENTRIES = 1024;
+	static constexpr int MAX_SEND_IOVEC = 16;
+
+	UringReactor(ServerThread &thread, int listenerfd);
+
+	bool init();
+
+	void run() override;
+	bool addClient(int fd) override;
+	std::size_t pendingClients() const override;
+
+private:
+	enum class OP : std::uint8_t {
+		ACCEPT,
+		WAKEUP,
+		RECV,
+		SEND,
+		SHUTDOWN,
+		POLL_OUT,
+		ASYNC
+	};
+
+	struct Connection {
+		msghdr m_message;
+		iovec m_iov[MAX_SEND_IOVEC];
+		std::uint32_t m_pending;		// Requests in flight, the slot is released when it drops to 0
+		bool m_receiving;				// The multishot recv is armed
+		bool m_sending;					// A SENDMSG or a POLL_ADD for writability is in flight
+		bool m_shutdownLinked;			// A SHUTDOWN is linked to the SENDMSG in flight
+		bool m_shutdown;
+		bool m_closing;
+		bool m_released;
+	};
+
+	static std::uint64_t userData(OP op, std::size_t idx);
+
+	io_uring_sqe *prepare(OP op, std::size_t idx, std::uint8_t opcode, int fd);
+
+	void armAccept();
+	void armWakeup();
+	void armAsyncWakeup();
+	void armRecv(std::size_t idx);
+
+	void onCompletion(const io_uring_cqe &cqe);
+	void onRecv(std::size_t idx, const io_uring_cqe &cqe);
+	void onSend(std::size_t idx, const io_uring_cqe &cqe);
+	void onAsync();
+
+	void addAccepted(int clientfd);
+	void startConnection(ThreadData::Event &event);
+	void receive(std::size_t idx, char *bytes, std::size_t len);
+	void send(std::size_t idx);
+
+	// After the final response has been sent
+	void finish(std::size_t idx);
+	// On errors and when the client closes the connection
+	void abort(std::size_t idx);
+	void tryRelease(std::size_t idx);
+
+private:
+	ServerThread &m_thread;
+	ThreadData &m_data;
+	ThreadContext &m_context;
+	IoStats &m_stats;
+	Metrics &m_metrics;
+
+	IoUring m_ring;
+	std::deque<Connection> m_connections; // Indexed by slot, growing doesn't move the connections in flight
+
+	int m_listenerfd;
+
+	// Dispatcher mode
+	ClientHandoff m_handoff;
+	std::uint64_t m_wakeupValue;
+
+	// The eventfd of the async completions
+	std::uint64_t m_asyncValue;
+};
+
+#endif // !_URING_REACTOR_H_
@@ -0,0 +1,100 @@
+#include "WorkerPlacement.h"
+#include "ServerThread.h"
+
+#include <chrono>
+
+WorkerPlacement::WorkerPlacement(PLACEMENT policy, const ServerThread *threads, int threadsNum)
+	: m_policy{ policy }
+	, m_threads{ threads }
+	, m_threadsNum{ threadsNum }
+	, m_next{ 0 }
+	, m_random{ static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) | 1 } {
+
+}
+
+int WorkerPlacement::pick() {
+	if (m_threadsNum == 1) {
+		return 0;
+	}
+
+	switch (m_policy) {
+	case PLACEMENT::LEAST_CONNECTIONS:
+		return leastConnections();
+	case PLACEMENT::LEAST_LATENCY:
+		return leastLatency();
+	case PLACEMENT::POWER_OF_TWO:
+		return powerOfTwo();
+	default: {
+		const int idx = m_next;
+		m_next = (m_next + 1) % m_threadsNum;
+		return idx;
+	}
+	}
+}
+
+int WorkerPlacement::leastConnections() {
+	int best = m_next;
+	std::size_t bestConnections = m_threads[best].connections();
+
+	for (int i = 1; i < m_threadsNum && bestConnections != 0; ++i) {
+		const int idx = (m_next + i) % m_threadsNum;
+		const std::size_t connections = m_threads[idx].connections();
+
+		if (connections < bestConnections) {
+			best = idx;
+			bestConnections = connections;
+		}
+	}
+
+	m_next = (m_next + 1) % m_threadsNum;
+	return best;
+}
+
+int WorkerPlacement::leastLatency() {
+	int best = m_next;
+	auto bestLatency = m_threads[best].stats().loopLatency();
+	std::size_t bestConnections = m_threads[best].connections();
+
+	for (int i = 1; i < m_threadsNum; ++i) {
+		const int idx = (m_next + i) % m_threadsNum;
+		const auto latency = m_threads[idx].stats().loopLatency();
+
+		// Equal latencies, e.g. of the workers that haven't run yet, go to the one with fewer connections
+		if (latency < bestLatency || (latency == bestLatency && m_threads[idx].connections() < bestConnections)) {
+			best = idx;
+			bestLatency = latency;
+			bestConnections = m_threads[idx].connections();
+		}
+	}
+
+	m_next = (m_next + 1) % m_threadsNum;
+	return best;
+}
+
+int WorkerPlacement::powerOfTwo() {
+	const int first = static_cast<int>(random() % static_cast<std::uint32_t>(m_threadsNum));
+
+	// A different second worker
+	int second = static_cast<int>(random() % static_cast<std::uint32_t>(m_threadsNum - 1));
+	if (second >= first) {
+		++second;
+	}
+
+	const std::size_t firstConnections = m_threads[first].connections();
+	const std::size_t secondConnections = m_threads[second].connections();
+
+	if (firstConnections != secondConnections) {
+		return firstConnections < secondConnections ? first : second;
+	}
+
+	return m_threads[first].stats().loopLatency() <= m_threads[second].stats().loopLatency() ? first : second;
+}
+
+std::uint32_t WorkerPlacement::random() {
+	// xorshift64*
+	m_random ^= m_random >> 12;
+	m_random ^= m_random << 25;
+	m_random ^= m_random >> 27;
+
+	return static_cast<std::uint32_t>((m_random * 0x2545F4914F6CDD1DULL) >> 32);
+}
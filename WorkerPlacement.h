@@ -0,0 +1,38 @@
+#ifndef _WORKER_PLACEMENT_H_
+#define _WORKER_PLACEMENT_H_
+
+#include "ServerConfig.h"
+
+#include <cstdint>
+
+class ServerThread;
+
+// Picks the worker for the next connection in dispatcher mode. The policies read the counters of
+// the workers (ServerThread::connections() and IoStats::loopLatency()) without locks, the values
+// may be slightly stale. The queued connections are counted, so a burst of accepts is spread
+// before the workers take them.
+class WorkerPlacement {
+public:
+	WorkerPlacement(PLACEMENT policy, const ServerThread *threads, int threadsNum);
+
+	// Called only by the dispatcher thread
+	int pick();
+
+private:
+	int leastConnections();
+	int leastLatency();
+	int powerOfTwo();
+
+	std::uint32_t random();
+
+private:
+	const PLACEMENT m_policy;
+	const ServerThread *m_threads;
+	const int m_threadsNum;
+
+	// Round-robin position, also the start of the scans, so the ties don't always go to worker 0
+	int m_next;
+	std::uint64_t m_random;
+};
+
+#endif // !_WORKER_PLACEMENT_H_
@@ -0,0 +1,339 @@
+// Measures the latency of a fast route while other connections keep a slow route busy. The slow
+// handler blocks for --work milliseconds, like a call to a database or a disk read, and is
+// registered once as an ordinary handler and once as an async one. The server runs in-process
+// on one worker thread: an inline slow handler stalls every connection of the worker, an async
+// one only its own.
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "Server.h"
+#include "ServerThread.h"
+#include "BenchJson.h"
+
+namespace {
+
+int workMs = 20;
+
+void respond(std::string &response, std::string_view body) {
+	response += "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: ";
+	response += std::to_string(body.size());
+	response += "\r\n\r\n";
+	response += body;
+}
+
+void fastHandler(std::string &response, const HttpRequest &) {
+	respond(response, "fast");
+}
+
+void slowHandler(std::string &response, const HttpRequest &) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(workMs));
+	respond(response, "slow");
+}
+
+int setupListener(sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = 0; // Any free port
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+	socklen_t addressSize = sizeof(address);
+
+	if (bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1
+		|| getsockname(fd, reinterpret_cast<sockaddr *>(&address), &addressSize) == -1
+		|| listen(fd, 256) == -1) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int connectTo(const sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Sends one request and reads its response, the bodies are short and end the response
+bool roundTrip(int fd, const std::string &request, std::string_view body) {
+	if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+		return false;
+	}
+
+	char buffer[512];
+	std::size_t received = 0;
+
+	while (received < sizeof(buffer)) {
+		const ssize_t nr = recv(fd, buffer + received, sizeof(buffer) - received, 0);
+		if (nr <= 0) {
+			return false;
+		}
+
+		received += static_cast<std::size_t>(nr);
+
+		const std::string_view response{ buffer, received };
+		if (response.size() >= body.size() && response.substr(response.size() - body.size()) == body) {
+			return response.substr(0, 12) == "HTTP/1.1 200";
+		}
+	}
+
+	return false;
+}
+
+struct Result {
+	std::string_view m_name;
+	std::uint64_t m_fastRequests{ 0 };
+	std::uint64_t m_slowRequests{ 0 };
+	double m_p50Us{ 0.0 };
+	double m_p99Us{ 0.0 };
+	double m_maxUs{ 0.0 };
+	bool m_ok{ true };
+};
+
+Result runPhase(const sockaddr_in &address, std::string_view name, std::string_view slowPath, int slowClients, double seconds) {
+	Result result;
+	result.m_name = name;
+
+	std::atomic<bool> stop{ false };
+	std::atomic<std::uint64_t> slowRequests{ 0 };
+	std::atomic<bool> failed{ false };
+
+	const std::string slowRequest = "GET " + std::string{ slowPath } + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	const std::string fastRequest = "GET /fast HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+	std::vector<std::thread> clients;
+	for (int i = 0; i < slowClients; ++i) {
+		clients.emplace_back([&]() {
+			const int fd = connectTo(address);
+			if (fd == -1) {
+				failed = true;
+				return;
+			}
+
+			while (!stop.load(std::memory_order_relaxed)) {
+				if (!roundTrip(fd, slowRequest, "slow")) {
+					failed = true;
+					break;
+				}
+
+				slowRequests.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			close(fd);
+		});
+	}
+
+	// Let the slow clients fill the worker first
+	std::this_thread::sleep_for(std::chrono::milliseconds(workMs * 2));
+
+	std::vector<double> latencies;
+
+	const int fd = connectTo(address);
+	const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+
+	while (fd != -1 && std::chrono::steady_clock::now() < end) {
+		const auto start = std::chrono::steady_clock::now();
+
+		if (!roundTrip(fd, fastRequest, "fast")) {
+			failed = true;
+			break;
+		}
+
+		latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	if (fd != -1) {
+		close(fd);
+	}
+
+	stop = true;
+	for (auto &client : clients) {
+		client.join();
+	}
+
+	result.m_ok = fd != -1 && !failed && !latencies.empty();
+	result.m_fastRequests = latencies.size();
+	result.m_slowRequests = slowRequests.load();
+
+	if (!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		result.m_p50Us = latencies[latencies.size() / 2];
+		result.m_p99Us = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+		result.m_maxUs = latencies.back();
+	}
+
+	return result;
+}
+
+}
+
+int main(int argc, char **argv) {
+	IO_BACKEND backend = IO_BACKEND::EPOLL;
+	int slowClients = 16;
+	double seconds = 3.0;
+	std::uint32_t asyncThreads = 16;
+	std::string jsonPath;
+	std::string label;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+
+		if (arg.substr(0, 7) == "--work=") {
+			workMs = std::atoi(argv[i] + 7);
+		}
+		else if (arg.substr(0, 15) == "--slow-clients=") {
+			slowClients = std::atoi(argv[i] + 15);
+		}
+		else if (arg.substr(0, 11) == "--duration=") {
+			seconds = std::atof(argv[i] + 11);
+		}
+		else if (arg.substr(0, 16) == "--async-threads=") {
+			asyncThreads = static_cast<std::uint32_t>(std::strtoul(argv[i] + 16, nullptr, 10));
+		}
+		else if (arg == "--io=epoll") {
+			backend = IO_BACKEND::EPOLL;
+		}
+		else if (arg == "--io=io_uring") {
+			backend = IO_BACKEND::IO_URING;
+		}
+		else if (arg.substr(0, 7) == "--json=") {
+			jsonPath = arg.substr(7);
+		}
+		else if (arg.substr(0, 8) == "--label=") {
+			label = arg.substr(8);
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--work=<ms>] [--slow-clients=<count>] [--duration=<seconds>]"
+				" [--async-threads=<count>] [--io=epoll|io_uring] [--json=<file>|-] [--label=<text>]\n";
+			return 1;
+		}
+	}
+
+	if (workMs <= 0 || slowClients <= 0 || seconds <= 0.0) {
+		std::cerr << "--work, --slow-clients and --duration must be positive\n";
+		return 1;
+	}
+
+	ServerConfig config;
+	config.m_metricsPath.clear();
+	config.m_asyncThreads = asyncThreads;
+
+	Server server{ config };
+	server.addHandler(HTTP_METHOD::GET, "/fast", fastHandler);
+	server.addHandler(HTTP_METHOD::GET, "/slow/inline", slowHandler);
+	server.addAsyncHandler(HTTP_METHOD::GET, "/slow/async", slowHandler);
+
+	sockaddr_in address;
+	const int listener = setupListener(address);
+	if (listener == -1) {
+		return 1;
+	}
+
+	ServerThread worker;
+	if (!worker.runThread(server, backend, listener)) {
+		std::cerr << "Can't start the worker\n";
+		return 1;
+	}
+
+	std::cout << "work " << workMs << " ms, " << slowClients << " slow clients, " << asyncThreads << " async threads\n"
+		<< std::left << std::setw(10) << "slow route"
+		<< std::right << std::setw(12) << "fast req/s"
+		<< std::setw(12) << "slow req/s"
+		<< std::setw(12) << "p50 us"
+		<< std::setw(12) << "p99 us"
+		<< std::setw(12) << "max us" << '\n';
+
+	const std::pair<std::string_view, std::string_view> PHASES[] = {
+		{ "inline", "/slow/inline" },
+		{ "async", "/slow/async" }
+	};
+
+	std::vector<Result> results;
+	bool ok = true;
+
+	for (const auto &[name, path] : PHASES) {
+		const Result result = runPhase(address, name, path, slowClients, seconds);
+		ok = ok && result.m_ok;
+
+		std::cout << std::left << std::setw(10) << result.m_name << std::right << std::fixed << std::setprecision(0)
+			<< std::setw(12) << result.m_fastRequests / seconds
+			<< std::setw(12) << result.m_slowRequests / seconds
+			<< std::setprecision(1)
+			<< std::setw(12) << result.m_p50Us
+			<< std::setw(12) << result.m_p99Us
+			<< std::setw(12) << result.m_maxUs
+			<< (result.m_ok ? "" : "  FAILED") << '\n';
+
+		results.push_back(result);
+	}
+
+	if (!jsonPath.empty()) {
+		BenchJson json;
+		json.value("benchmark", "async-bench");
+		json.value("label", label);
+		json.value("work_ms", static_cast<std::uint64_t>(workMs));
+		json.value("slow_clients", static_cast<std::uint64_t>(slowClients));
+		json.value("async_threads", static_cast<std::uint64_t>(asyncThreads));
+		json.value("duration_seconds", seconds);
+
+		json.beginArray("phases");
+		for (const Result &result : results) {
+			json.beginObject();
+			json.value("slow_route", result.m_name);
+			json.value("ok", result.m_ok);
+			json.value("fast_requests", result.m_fastRequests);
+			json.value("slow_requests", result.m_slowRequests);
+			json.value("fast_p50_us", result.m_p50Us);
+			json.value("fast_p99_us", result.m_p99Us);
+			json.value("fast_max_us", result.m_maxUs);
+			json.endObject();
+		}
+		json.endArray();
+
+		if (!json.write(jsonPath)) {
+			ok = false;
+		}
+	}
+
+	// The worker and the pool run until the process exits
+	std::cout.flush();
+	std::_Exit(ok ? 0 : 1);
+}
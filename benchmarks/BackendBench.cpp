@@ -0,0 +1,365 @@
+// Compares the throughput and the syscalls per request of the level- and edge-triggered epoll loops
+// and the io_uring backend. The server is started once per backend in reuseport mode with --stats-interval=1 and every client
+// thread sends keep-alive requests over its own connection (--pipeline of them at a time).
+// The syscalls per request are computed from the counters that the server prints.
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <string_view>
+
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "ServerConstants.h"
+
+namespace {
+
+struct BenchConfig {
+	std::string m_server;
+	std::string m_path{ "/text" };
+	int m_threads{ 8 };
+	int m_pipeline{ 1 };
+	int m_duration{ 10 };
+};
+
+struct ServerStats {
+	std::atomic<std::uint64_t> m_requests{ 0 };
+	std::atomic<std::uint64_t> m_syscalls{ 0 };
+	std::atomic<std::uint64_t> m_lines{ 0 };
+};
+
+struct BenchResult {
+	std::uint64_t m_requests{ 0 };
+	std::uint64_t m_errors{ 0 };
+	double m_seconds{ 0.0 };
+	double m_syscallsPerRequest{ 0.0 };
+};
+
+sockaddr_in makeAddress() {
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(SERVER_PORT);
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+	return address;
+}
+
+int connectTo(const sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	return fd;
+}
+
+bool waitForServer(const sockaddr_in &address) {
+	for (int attempt = 0; attempt < 100; ++attempt) {
+		const int fd = connectTo(address);
+		if (fd != -1) {
+			close(fd);
+			return true;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	return false;
+}
+
+// Reads until count complete responses have been received. The bytes of the next responses stay in buffer.
+bool readResponses(int fd, std::string &buffer, int count) {
+	char chunk[16384];
+
+	while (count > 0) {
+		const auto headerEnd = buffer.find("\r\n\r\n");
+
+		if (headerEnd != std::string::npos) {
+			const auto lengthPos = buffer.find("Content-Length: ");
+			const std::size_t bodySize = lengthPos < headerEnd ? std::strtoul(buffer.c_str() + lengthPos + 16, nullptr, 10) : 0;
+			const std::size_t responseSize = headerEnd + 4 + bodySize;
+
+			if (buffer.size() >= responseSize) {
+				buffer.erase(0, responseSize);
+				--count;
+				continue;
+			}
+		}
+
+		const ssize_t nr = recv(fd, chunk, sizeof(chunk), 0);
+		if (nr <= 0) {
+			return false;
+		}
+
+		buffer.append(chunk, static_cast<std::size_t>(nr));
+	}
+
+	return true;
+}
+
+// Parses the "stats: requests=<n> syscalls=<n> ..." lines of the server
+void readServerStats(int pipefd, ServerStats &stats) {
+	FILE *input = fdopen(pipefd, "r");
+	char line[256];
+
+	while (input && std::fgets(line, sizeof(line), input)) {
+		unsigned long long requests = 0;
+		unsigned long long syscalls = 0;
+
+		if (std::sscanf(line, "stats: requests=%llu syscalls=%llu", &requests, &syscalls) == 2) {
+			stats.m_requests = requests;
+			stats.m_syscalls = syscalls;
+			++stats.m_lines;
+		}
+	}
+
+	if (input) {
+		std::fclose(input);
+	}
+}
+
+void waitForStatsLine(const ServerStats &stats) {
+	const std::uint64_t lines = stats.m_lines;
+
+	for (int attempt = 0; attempt < 40 && stats.m_lines == lines; ++attempt) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+BenchResult measure(const BenchConfig &config, const ServerStats &stats) {
+	const sockaddr_in address = makeAddress();
+	const std::string request = "GET " + config.m_path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+	std::string batch;
+	for (int i = 0; i < config.m_pipeline; ++i) {
+		batch += request;
+	}
+
+	std::atomic<bool> stop{ false };
+	std::atomic<std::uint64_t> requests{ 0 };
+	std::atomic<std::uint64_t> errors{ 0 };
+
+	std::vector<std::thread> clients;
+	clients.reserve(config.m_threads);
+
+	for (int i = 0; i < config.m_threads; ++i) {
+		clients.emplace_back([&]() {
+			std::uint64_t localRequests = 0;
+			std::uint64_t localErrors = 0;
+			std::string buffer;
+
+			int fd = connectTo(address);
+
+			while (!stop.load(std::memory_order_relaxed)) {
+				if (fd != -1 && send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(batch.size())
+					&& readResponses(fd, buffer, config.m_pipeline)) {
+					localRequests += config.m_pipeline;
+					continue;
+				}
+
+				++localErrors;
+
+				if (fd != -1) {
+					close(fd);
+				}
+
+				buffer.clear();
+				fd = connectTo(address);
+			}
+
+			if (fd != -1) {
+				close(fd);
+			}
+
+			requests += localRequests;
+			errors += localErrors;
+		});
+	}
+
+	// Warm up, then take the counters from the next two stats lines that the server prints
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+	waitForStatsLine(stats);
+
+	const std::uint64_t startRequests = stats.m_requests;
+	const std::uint64_t startSyscalls = stats.m_syscalls;
+	const std::uint64_t clientStartRequests = requests;
+	const auto start = std::chrono::steady_clock::now();
+
+	std::this_thread::sleep_for(std::chrono::seconds(config.m_duration));
+	waitForStatsLine(stats);
+
+	const std::uint64_t endRequests = stats.m_requests;
+	const std::uint64_t endSyscalls = stats.m_syscalls;
+
+	stop = true;
+
+	for (auto &client : clients) {
+		client.join();
+	}
+
+	BenchResult result;
+	result.m_requests = requests - clientStartRequests;
+	result.m_errors = errors;
+	result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (endRequests > startRequests) {
+		result.m_syscallsPerRequest = static_cast<double>(endSyscalls - startSyscalls) / (endRequests - startRequests);
+	}
+
+	return result;
+}
+
+struct Backend {
+	std::string_view m_name;
+	const char *m_ioArg;
+	const char *m_epollArg;
+};
+
+constexpr Backend BACKENDS[] = {
+	{ "epoll", "--io=epoll", "--epoll=level" },
+	{ "epoll-edge", "--io=epoll", "--epoll=edge" },
+	{ "io_uring", "--io=io_uring", "--epoll=level" }
+};
+
+pid_t startServer(const std::string &path, const Backend &backend, int &pipefd) {
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+
+	const pid_t pid = fork();
+	if (pid != 0) {
+		close(fds[1]);
+		pipefd = fds[0];
+		return pid;
+	}
+
+	close(fds[0]);
+	dup2(fds[1], STDOUT_FILENO);
+
+	execl(path.c_str(), path.c_str(), backend.m_ioArg, backend.m_epollArg, "--accept=reuseport", "--stats-interval=1",
+		static_cast<char *>(nullptr));
+
+	perror("execl");
+	_exit(1);
+}
+
+void stopServer(pid_t pid) {
+	kill(pid, SIGTERM);
+	waitpid(pid, nullptr, 0);
+}
+
+void printResult(std::string_view name, const BenchResult &result) {
+	std::cout
+		<< std::left << std::setw(12) << name
+		<< std::right << std::setw(14) << result.m_requests
+		<< std::setw(14) << std::fixed << std::setprecision(0) << result.m_requests / result.m_seconds
+		<< std::setw(18) << std::setprecision(2) << result.m_syscallsPerRequest
+		<< std::setw(10) << result.m_errors << '\n';
+}
+
+bool parseArguments(int argc, char **argv, BenchConfig &config) {
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		const auto eq = arg.find('=');
+		const std::string_view name = arg.substr(0, eq);
+		const std::string value{ eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1) };
+
+		if (name == "--server") {
+			config.m_server = value;
+		}
+		else if (name == "--path") {
+			config.m_path = value;
+		}
+		else if (name == "--threads") {
+			config.m_threads = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--pipeline") {
+			config.m_pipeline = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--duration") {
+			config.m_duration = std::max(1, std::atoi(value.c_str()));
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " --server=<path> [--path=/text] [--threads=N] [--pipeline=N] [--duration=seconds]\n";
+			return false;
+		}
+	}
+
+	if (config.m_server.empty()) {
+		std::cerr << "--server=<path> is required\n";
+		return false;
+	}
+
+	return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+	BenchConfig config;
+	if (!parseArguments(argc, argv, config)) {
+		return 1;
+	}
+
+	std::cout << config.m_threads << " connections, " << config.m_pipeline << " request(s) in flight each, "
+		<< config.m_duration << "s per run\n";
+	std::cout
+		<< std::left << std::setw(12) << "backend"
+		<< std::right << std::setw(14) << "requests"
+		<< std::setw(14) << "requests/s"
+		<< std::setw(18) << "syscalls/request"
+		<< std::setw(10) << "errors" << '\n';
+
+	const sockaddr_in address = makeAddress();
+
+	for (const Backend &backend : BACKENDS) {
+		int pipefd = -1;
+		const pid_t pid = startServer(config.m_server, backend, pipefd);
+		if (pid == -1) {
+			return 1;
+		}
+
+		ServerStats stats;
+		std::thread statsReader{ readServerStats, pipefd, std::ref(stats) };
+
+		if (!waitForServer(address)) {
+			std::cerr << "The server didn't start with the " << backend.m_name << " backend\n";
+			stopServer(pid);
+			statsReader.join();
+			continue;
+		}
+
+		printResult(backend.m_name, measure(config, stats));
+
+		stopServer(pid);
+		statsReader.join();
+	}
+
+	return 0;
+}
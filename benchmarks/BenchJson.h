@@ -0,0 +1,136 @@
+#ifndef _BENCH_JSON_H_
+#define _BENCH_JSON_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+// A minimal JSON writer for the benchmark results, so runs of different builds can be compared
+// with a script. The keys are ignored inside arrays.
+class BenchJson {
+public:
+    BenchJson() {
+        m_first.push_back(true);
+        m_text += '{';
+    }
+
+    BenchJson &beginObject(std::string_view key = {}) {
+        this->key(key);
+        m_text += '{';
+        m_first.push_back(true);
+        return *this;
+    }
+
+    BenchJson &endObject() {
+        m_text += '}';
+        m_first.pop_back();
+        return *this;
+    }
+
+    BenchJson &beginArray(std::string_view key) {
+        this->key(key);
+        m_text += '[';
+        m_first.push_back(true);
+        m_inArray.push_back(m_first.size());
+        return *this;
+    }
+
+    BenchJson &endArray() {
+        m_text += ']';
+        m_first.pop_back();
+        m_inArray.pop_back();
+        return *this;
+    }
+
+    BenchJson &value(std::string_view key, std::string_view text) {
+        this->key(key);
+        quote(text);
+        return *this;
+    }
+
+    BenchJson &value(std::string_view key, const char *text) {
+        return value(key, std::string_view{ text });
+    }
+
+    BenchJson &value(std::string_view key, bool flag) {
+        this->key(key);
+        m_text += flag ? "true" : "false";
+        return *this;
+    }
+
+    BenchJson &value(std::string_view key, double number) {
+        char text[32];
+        const int len = std::snprintf(text, sizeof(text), "%.6g", number);
+
+        this->key(key);
+        m_text.append(text, static_cast<std::size_t>(len));
+        return *this;
+    }
+
+    BenchJson &value(std::string_view key, std::uint64_t number) {
+        this->key(key);
+        m_text += std::to_string(number);
+        return *this;
+    }
+
+    BenchJson &value(std::string_view key, int number) {
+        this->key(key);
+        m_text += std::to_string(number);
+        return *this;
+    }
+
+    // Closes the top-level object. "-" writes to stdout.
+    bool write(const std::string &path) {
+        m_text += "}\n";
+
+        if (path == "-") {
+            std::cout << m_text;
+            return true;
+        }
+
+        std::ofstream file{ path };
+        file << m_text;
+
+        if (!file) {
+            std::cerr << "Can't write " << path << '\n';
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    void key(std::string_view name) {
+        if (!m_first.back()) {
+            m_text += ',';
+        }
+        m_first.back() = false;
+
+        if (m_inArray.empty() || m_inArray.back() != m_first.size()) {
+            quote(name);
+            m_text += ':';
+        }
+    }
+
+    void quote(std::string_view text) {
+        m_text += '"';
+        for (const char c : text) {
+            if (c == '"' || c == '\\') {
+                m_text += '\\';
+            }
+            m_text += c;
+        }
+        m_text += '"';
+    }
+
+private:
+    std::string m_text;
+    std::vector<bool> m_first;
+    std::vector<std::size_t> m_inArray; // The depths that are arrays
+};
+
+#endif // !_BENCH_JSON_H_
@@ -0,0 +1,241 @@
+// Measures how many short-lived HTTP/1.0 connections per second the server can accept and serve.
+// Every client thread runs connect -> send request -> read until EOF -> close in a loop.
+//
+// With --server=<path> the benchmark starts the server once per accept mode and compares them,
+// otherwise it measures the server that is already listening on SERVER_PORT.
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string_view>
+
+#include <netdb.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "ServerConstants.h"
+
+namespace {
+
+struct BenchConfig {
+	std::string m_server;
+	std::string m_host{ "127.0.0.1" };
+	int m_threads{ static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) };
+	int m_duration{ 10 };
+};
+
+struct BenchResult {
+	std::uint64_t m_connections{ 0 };
+	std::uint64_t m_errors{ 0 };
+	double m_seconds{ 0.0 };
+};
+
+constexpr std::string_view REQUEST = "GET / HTTP/1.0\r\n\r\n";
+
+sockaddr_in makeAddress(const std::string &host) {
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(SERVER_PORT);
+	inet_pton(AF_INET, host.c_str(), &address.sin_addr);
+
+	return address;
+}
+
+bool runConnection(const sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return false;
+	}
+
+	bool ok = connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0
+		&& send(fd, REQUEST.data(), REQUEST.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(REQUEST.size());
+
+	std::size_t received = 0;
+	char buff[4096];
+
+	while (ok) {
+		const ssize_t nr = recv(fd, buff, sizeof(buff), 0);
+		if (nr <= 0) {
+			ok = nr == 0 && received > 0;
+			break;
+		}
+
+		received += static_cast<std::size_t>(nr);
+	}
+
+	close(fd);
+
+	return ok;
+}
+
+bool waitForServer(const sockaddr_in &address) {
+	for (int attempt = 0; attempt < 100; ++attempt) {
+		const int fd = socket(AF_INET, SOCK_STREAM, 0);
+		const bool connected = connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+		close(fd);
+
+		if (connected) {
+			return true;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	return false;
+}
+
+BenchResult measure(const BenchConfig &config) {
+	const sockaddr_in address = makeAddress(config.m_host);
+
+	std::atomic<bool> stop{ false };
+	std::atomic<std::uint64_t> connections{ 0 };
+	std::atomic<std::uint64_t> errors{ 0 };
+
+	std::vector<std::thread> clients;
+	clients.reserve(config.m_threads);
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < config.m_threads; ++i) {
+		clients.emplace_back([&]() {
+			std::uint64_t localConnections = 0;
+			std::uint64_t localErrors = 0;
+
+			while (!stop.load(std::memory_order_relaxed)) {
+				if (runConnection(address)) {
+					++localConnections;
+				}
+				else {
+					++localErrors;
+				}
+			}
+
+			connections += localConnections;
+			errors += localErrors;
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(config.m_duration));
+	stop = true;
+
+	for (auto &client : clients) {
+		client.join();
+	}
+
+	BenchResult result;
+	result.m_connections = connections;
+	result.m_errors = errors;
+	result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	return result;
+}
+
+pid_t startServer(const std::string &path, const std::string &mode) {
+	const pid_t pid = fork();
+	if (pid != 0) {
+		return pid;
+	}
+
+	const int devNull = open("/dev/null", O_WRONLY);
+	dup2(devNull, STDOUT_FILENO);
+
+	const std::string acceptArg = "--accept=" + mode;
+	execl(path.c_str(), path.c_str(), acceptArg.c_str(), static_cast<char *>(nullptr));
+
+	perror("execl");
+	_exit(1);
+}
+
+void stopServer(pid_t pid) {
+	kill(pid, SIGTERM);
+	waitpid(pid, nullptr, 0);
+}
+
+void printResult(std::string_view name, const BenchResult &result) {
+	std::cout
+		<< std::left << std::setw(12) << name
+		<< std::right << std::setw(14) << result.m_connections
+		<< std::setw(14) << std::fixed << std::setprecision(0) << result.m_connections / result.m_seconds
+		<< std::setw(10) << result.m_errors << '\n';
+}
+
+bool parseArguments(int argc, char **argv, BenchConfig &config) {
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		const auto eq = arg.find('=');
+		const std::string_view name = arg.substr(0, eq);
+		const std::string value{ eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1) };
+
+		if (name == "--server") {
+			config.m_server = value;
+		}
+		else if (name == "--host") {
+			config.m_host = value;
+		}
+		else if (name == "--threads") {
+			config.m_threads = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--duration") {
+			config.m_duration = std::max(1, std::atoi(value.c_str()));
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--server=<path>] [--host=<ip>] [--threads=N] [--duration=seconds]\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+	BenchConfig config;
+	if (!parseArguments(argc, argv, config)) {
+		return 1;
+	}
+
+	std::cout << config.m_threads << " client threads, " << config.m_duration << "s per run\n";
+	std::cout
+		<< std::left << std::setw(12) << "mode"
+		<< std::right << std::setw(14) << "connections"
+		<< std::setw(14) << "conn/s"
+		<< std::setw(10) << "errors" << '\n';
+
+	if (config.m_server.empty()) {
+		printResult("running", measure(config));
+		return 0;
+	}
+
+	const sockaddr_in address = makeAddress(config.m_host);
+
+	for (const std::string mode : { "dispatcher", "reuseport", "cbpf" }) {
+		const pid_t pid = startServer(config.m_server, mode);
+
+		if (!waitForServer(address)) {
+			std::cerr << "The server didn't start in " << mode << " mode\n";
+			stopServer(pid);
+			continue;
+		}
+
+		printResult(mode, measure(config));
+
+		stopServer(pid);
+	}
+
+	return 0;
+}
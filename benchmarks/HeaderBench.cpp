@@ -0,0 +1,183 @@
+// Counts the heap allocations and measures the time needed to parse a typical browser request and build
+// its HttpRequest. The previous header storage (an unordered_map of name hash -> value) is measured
+// by copying the fields into such a map, so its numbers include the HttpHeader ones.
+// The last cases use a request with more fields than HttpHeader keeps inline and a query string,
+// with and without the per-worker arena.
+
+#include <new>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <unordered_map>
+
+#include "HttpParser.h"
+#include "RequestArena.h"
+
+namespace {
+
+std::size_t g_allocations = 0;
+
+constexpr int ROUNDS = 200000;
+
+const std::string_view REQUEST =
+    "GET /assets/js/app.4f2c1e.js?v=20240101 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/dashboard/overview\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,bg;q=0.8\r\n"
+    "Cookie: session=3f7a9c2e8b1d4f6a\r\n"
+    "Cookie: theme=dark\r\n"
+    "If-None-Match: \"5e1f-18c7a2b3d40\"\r\n"
+    "\r\n";
+
+std::string largeRequest() {
+    std::string request = "GET /search?q=http+server&page=2&lang=en%2Dus HTTP/1.1\r\n";
+
+    for (std::size_t idx = 0; idx < HttpHeader::INLINE_FIELDS + 16; ++idx) {
+        request += "X-Custom-Header-" + std::to_string(idx) + ": value\r\n";
+    }
+
+    return request + "\r\n";
+}
+
+struct Result {
+    double m_nsPerRequest;
+    double m_allocationsPerRequest;
+    std::size_t m_fields;
+};
+
+template <typename Build>
+Result measure(std::string_view rawRequest, Build &&build) {
+    std::string buffer{ rawRequest };
+    HttpParser parser;
+    const ParserLimits limits;
+
+    std::size_t fields = 0;
+
+    // Warm up, so the parser's reusable storage is already allocated
+    parser.parse(buffer.data(), buffer.size(), limits);
+    fields += build(parser, buffer.data());
+
+    const std::size_t allocations = g_allocations;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        parser.reset();
+        parser.parse(buffer.data(), buffer.size(), limits);
+        fields += build(parser, buffer.data());
+    }
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    return { elapsed / ROUNDS, static_cast<double>(g_allocations - allocations) / ROUNDS, fields };
+}
+
+void printResult(std::string_view name, const Result &result) {
+    std::cout << std::left << std::setw(24) << name
+        << std::right << std::setw(10) << std::fixed << std::setprecision(1) << result.m_nsPerRequest << " ns/request"
+        << std::setw(8) << std::setprecision(2) << result.m_allocationsPerRequest << " allocations/request"
+        << std::setw(8) << result.m_fields << " fields\n";
+}
+
+}
+
+void *operator new(std::size_t size) {
+    ++g_allocations;
+
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+// std::pmr::new_delete_resource() uses the aligned versions
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    ++g_allocations;
+
+    const std::size_t align = static_cast<std::size_t>(alignment);
+    if (void *ptr = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+int main() {
+    // The old storage: one node per field and the repeated fields overwrite each other
+    printResult("HttpHeader + map", measure(REQUEST, [](const HttpParser &parser, const char *data) {
+        const HttpRequest request = parser.request(data);
+
+        std::unordered_map<std::size_t, std::string_view> fields;
+        for (std::size_t idx = 0; idx < request.headers().size(); ++idx) {
+            const auto &field = request.headers()[idx];
+            fields[std::hash<std::string_view>{}(field.name())] = field.value();
+        }
+
+        return fields.count(std::hash<std::string_view>{}("cookie"));
+    }));
+
+    printResult("HttpHeader", measure(REQUEST, [](const HttpParser &parser, const char *data) {
+        const HttpRequest request = parser.request(data);
+        const auto &headers = request.headers();
+
+        std::size_t cookies = 0;
+        for (auto idx = headers.find("cookie"); idx != HttpHeader::NPOS; idx = headers.find("cookie", idx + 1)) {
+            ++cookies;
+        }
+
+        return cookies + (headers.hasFieldValue(HTTP_HEADER::CONNECTION, "close") ? 1 : 0);
+    }));
+
+    const std::string large = largeRequest();
+
+    printResult("large, heap", measure(large, [](const HttpParser &parser, const char *data) {
+        const HttpRequest request = parser.request(data);
+        return request.headers().size() + request.queryParams().size();
+    }));
+
+    RequestArena arena;
+
+    printResult("large, arena", measure(large, [&arena](const HttpParser &parser, const char *data) {
+        std::size_t fields = 0;
+
+        {
+            const HttpRequest request = parser.request(data, arena.resource());
+            fields = request.headers().size() + request.queryParams().size();
+        }
+
+        arena.reset();
+        return fields;
+    }));
+
+    return 0;
+}
@@ -0,0 +1,826 @@
+// An HTTP/1.1 load generator for the server. Every thread runs an epoll loop over its share of the
+// connections and keeps --pipeline requests in flight on each of them.
+//
+// Closed loop (default): a connection sends the next request when a response arrives, so the
+// offered load follows the server. The latencies are also corrected for coordinated omission: a
+// response that took longer than the expected interval (the mean latency of the warm-up) hides the
+// requests that would have been sent meanwhile, and those are added to the corrected histogram.
+//
+// Open loop (--rate): the requests are scheduled at a constant rate, independent of the responses.
+// A request that can't be sent on time waits for a connection, and its corrected latency is
+// measured from the time it was scheduled, not from the time it was sent.
+//
+// --churn=N closes every connection after N requests (the last one has "Connection: close") and
+// opens a new one. --json writes the configuration and the results for comparing builds.
+
+#include <deque>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "ServerConstants.h"
+#include "BenchJson.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::uint64_t nowNs() {
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+struct Options {
+	std::string m_host{ "127.0.0.1" };
+	int m_port{ SERVER_PORT };
+	std::vector<std::string> m_paths{ "/text" };
+	int m_threads{ 1 };
+	int m_connections{ 16 };
+	int m_pipeline{ 1 };
+	double m_rate{ 0.0 };	// Requests per second of all threads, 0 is a closed loop
+	int m_churn{ 0 };		// Requests per connection, 0 keeps the connections open
+	int m_warmup{ 1 };		// Seconds
+	int m_duration{ 10 };	// Seconds
+	std::string m_json;		// "-" is stdout
+	std::string m_label;	// Identifies the build in the JSON output
+};
+
+// Log-linear latency histogram in nanoseconds: every power of two is split into 128 buckets, so a
+// value is within 1% of its bucket. From 1 ns to 2^40 ns (18 minutes), the larger values are clamped.
+class Histogram {
+public:
+	static constexpr int SUB_BITS = 7;
+	static constexpr std::uint64_t SUB_BUCKETS = 1u << SUB_BITS;
+	static constexpr int MAX_BITS = 40;
+	static constexpr std::size_t BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BITS) * SUB_BUCKETS;
+
+	Histogram()
+		: m_counts(BUCKETS, 0) {
+
+	}
+
+	void record(std::uint64_t ns, std::uint64_t count = 1) {
+		m_counts[index(ns)] += count;
+		m_total += count;
+		m_sum += ns * count;
+		m_max = std::max(m_max, ns);
+	}
+
+	// Adds the samples that a closed loop didn't send while it waited for this one
+	void recordCorrected(std::uint64_t ns, std::uint64_t expectedInterval) {
+		record(ns);
+
+		if (expectedInterval == 0) {
+			return;
+		}
+
+		for (std::uint64_t missing = ns - std::min(ns, expectedInterval); missing >= expectedInterval; missing -= expectedInterval) {
+			record(missing);
+		}
+	}
+
+	void merge(const Histogram &other) {
+		for (std::size_t i = 0; i < BUCKETS; ++i) {
+			m_counts[i] += other.m_counts[i];
+		}
+
+		m_total += other.m_total;
+		m_sum += other.m_sum;
+		m_max = std::max(m_max, other.m_max);
+	}
+
+	// The upper end of the bucket of the q-th quantile
+	std::uint64_t percentile(double q) const {
+		if (m_total == 0) {
+			return 0;
+		}
+
+		const std::uint64_t target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(q * static_cast<double>(m_total) + 0.5));
+
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < BUCKETS; ++i) {
+			seen += m_counts[i];
+			if (seen >= target) {
+				return std::min(upperBound(i), m_max);
+			}
+		}
+
+		return m_max;
+	}
+
+	std::uint64_t total() const { return m_total; }
+	std::uint64_t max() const { return m_max; }
+	double mean() const { return m_total == 0 ? 0.0 : static_cast<double>(m_sum) / m_total; }
+
+private:
+	static std::size_t index(std::uint64_t ns) {
+		if (ns < SUB_BUCKETS) {
+			return static_cast<std::size_t>(ns);
+		}
+
+		const int msb = 63 - __builtin_clzll(ns);
+		if (msb >= MAX_BITS) {
+			return BUCKETS - 1;
+		}
+
+		const int shift = msb - SUB_BITS;
+		return static_cast<std::size_t>(SUB_BUCKETS + static_cast<std::uint64_t>(shift) * SUB_BUCKETS + ((ns >> shift) - SUB_BUCKETS));
+	}
+
+	static std::uint64_t upperBound(std::size_t idx) {
+		if (idx < SUB_BUCKETS) {
+			return idx;
+		}
+
+		const std::size_t shift = (idx - SUB_BUCKETS) / SUB_BUCKETS;
+		const std::uint64_t top = SUB_BUCKETS + (idx - SUB_BUCKETS) % SUB_BUCKETS;
+
+		return ((top + 1) << shift) - 1;
+	}
+
+private:
+	std::vector<std::uint64_t> m_counts;
+	std::uint64_t m_total{ 0 };
+	std::uint64_t m_sum{ 0 };
+	std::uint64_t m_max{ 0 };
+};
+
+struct ThreadResult {
+	Histogram m_corrected;
+	Histogram m_uncorrected;
+	std::uint64_t m_responses{ 0 };	// Measured, after the warm-up
+	std::uint64_t m_bytes{ 0 };		// Measured response bytes
+	std::uint64_t m_connects{ 0 };
+	std::uint64_t m_errors{ 0 };
+	std::uint64_t m_backlog{ 0 };	// Open loop: scheduled requests that were never sent
+};
+
+struct InFlight {
+	std::uint64_t m_intended;
+	std::uint64_t m_sent;
+};
+
+struct Connection {
+	int m_fd{ -1 };
+	bool m_connected{ false };
+	int m_sentOnConnection{ 0 };
+	std::size_t m_nextPath{ 0 };
+
+	std::string m_output;
+	std::size_t m_outputSent{ 0 };
+
+	std::string m_input;
+	std::deque<InFlight> m_inFlight;
+};
+
+enum class PARSE {
+	COMPLETE,
+	INCOMPLETE,
+	ERROR
+};
+
+// Finds the end of the response at the start of input: Content-Length or a chunked body
+PARSE responseSize(std::string_view input, std::size_t &size) {
+	const auto headerEnd = input.find("\r\n\r\n");
+	if (headerEnd == std::string_view::npos) {
+		return PARSE::INCOMPLETE;
+	}
+
+	const std::string_view headers = input.substr(0, headerEnd);
+	const std::size_t bodyStart = headerEnd + 4;
+
+	if (headers.find("Transfer-Encoding: chunked") != std::string_view::npos) {
+		std::size_t pos = bodyStart;
+
+		while (true) {
+			const auto lineEnd = input.find("\r\n", pos);
+			if (lineEnd == std::string_view::npos) {
+				return PARSE::INCOMPLETE;
+			}
+
+			std::size_t chunkSize = 0;
+			if (std::from_chars(input.data() + pos, input.data() + lineEnd, chunkSize, 16).ec != std::errc{}) {
+				return PARSE::ERROR;
+			}
+
+			if (chunkSize == 0) {
+				// No trailers
+				const auto last = input.find("\r\n", lineEnd + 2);
+				if (last == std::string_view::npos) {
+					return PARSE::INCOMPLETE;
+				}
+
+				size = last + 2;
+				return PARSE::COMPLETE;
+			}
+
+			pos = lineEnd + 2 + chunkSize + 2;
+			if (pos > input.size()) {
+				return PARSE::INCOMPLETE;
+			}
+		}
+	}
+
+	std::size_t bodySize = 0;
+	if (const auto lengthPos = headers.find("Content-Length: "); lengthPos != std::string_view::npos) {
+		const std::string_view value = headers.substr(lengthPos + 16);
+		std::from_chars(value.data(), value.data() + value.size(), bodySize);
+	}
+
+	if (input.size() < bodyStart + bodySize) {
+		return PARSE::INCOMPLETE;
+	}
+
+	size = bodyStart + bodySize;
+	return PARSE::COMPLETE;
+}
+
+class Worker {
+public:
+	Worker(const Options &options, int connections, double rate, std::uint64_t warmupEnd, std::uint64_t end)
+		: m_options{ options }
+		, m_connections(static_cast<std::size_t>(connections))
+		, m_interval{ rate > 0.0 ? 1e9 / rate : 0.0 }
+		, m_warmupEnd{ warmupEnd }
+		, m_end{ end } {
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(static_cast<std::uint16_t>(options.m_port));
+		inet_pton(AF_INET, options.m_host.c_str(), &address.sin_addr);
+		m_address = address;
+
+		for (const auto &path : options.m_paths) {
+			m_requests.push_back("GET " + path + " HTTP/1.1\r\nHost: " + options.m_host + "\r\nUser-Agent: load-gen\r\nAccept: */*\r\n\r\n");
+			m_closeRequests.push_back("GET " + path + " HTTP/1.1\r\nHost: " + options.m_host + "\r\nUser-Agent: load-gen\r\nAccept: */*\r\nConnection: close\r\n\r\n");
+		}
+	}
+
+	void run();
+
+	const ThreadResult &result() const { return m_result; }
+
+private:
+	bool open(std::size_t idx);
+	void reopen(std::size_t idx, bool failed);
+
+	void fill(std::size_t idx, std::uint64_t now);
+	bool flush(Connection &connection);
+	bool receive(std::size_t idx);
+
+	bool canSend(const Connection &connection) const;
+	void schedule(std::uint64_t now);
+
+	bool measured(std::uint64_t start, std::uint64_t now) const { return start >= m_warmupEnd && now <= m_end; }
+
+private:
+	const Options &m_options;
+	sockaddr_in m_address;
+	int m_epollfd{ -1 };
+
+	std::vector<Connection> m_connections;
+	std::vector<std::string> m_requests;
+	std::vector<std::string> m_closeRequests;
+
+	// Open loop
+	const double m_interval;		// ns between the scheduled requests of this thread
+	double m_nextIntended{ 0.0 };
+	std::deque<std::uint64_t> m_pending;
+
+	// Closed loop, the expected interval for the coordinated omission correction
+	Histogram m_warmupLatency;
+	std::uint64_t m_expectedInterval{ 0 };
+
+	const std::uint64_t m_warmupEnd;
+	const std::uint64_t m_end;
+
+	ThreadResult m_result;
+};
+
+bool Worker::open(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+	connection = Connection{};
+
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		return false;
+	}
+
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&m_address), sizeof(m_address)) == -1 && errno != EINPROGRESS) {
+		close(fd);
+		return false;
+	}
+
+	epoll_event event{};
+	event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	event.data.u64 = idx;
+
+	if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+		close(fd);
+		return false;
+	}
+
+	connection.m_fd = fd;
+	connection.m_nextPath = idx % m_requests.size();
+	++m_result.m_connects;
+
+	return true;
+}
+
+void Worker::reopen(std::size_t idx, bool failed) {
+	Connection &connection = m_connections[idx];
+
+	if (failed) {
+		++m_result.m_errors;
+
+		// The scheduled requests are sent again on the next connection
+		for (auto it = connection.m_inFlight.rbegin(); it != connection.m_inFlight.rend(); ++it) {
+			if (m_interval > 0.0) {
+				m_pending.push_front(it->m_intended);
+			}
+		}
+	}
+
+	if (connection.m_fd != -1) {
+		close(connection.m_fd);
+	}
+
+	if (!open(idx)) {
+		++m_result.m_errors;
+		connection.m_fd = -1;
+	}
+}
+
+bool Worker::canSend(const Connection &connection) const {
+	if (!connection.m_connected || static_cast<int>(connection.m_inFlight.size()) >= m_options.m_pipeline) {
+		return false;
+	}
+
+	return m_options.m_churn == 0 || connection.m_sentOnConnection < m_options.m_churn;
+}
+
+void Worker::schedule(std::uint64_t now) {
+	if (m_interval <= 0.0) {
+		return;
+	}
+
+	while (m_nextIntended <= static_cast<double>(now) && m_nextIntended < static_cast<double>(m_end)) {
+		m_pending.push_back(static_cast<std::uint64_t>(m_nextIntended));
+		m_nextIntended += m_interval;
+	}
+}
+
+void Worker::fill(std::size_t idx, std::uint64_t now) {
+	Connection &connection = m_connections[idx];
+	const bool openLoop = m_interval > 0.0;
+
+	while (canSend(connection) && now < m_end) {
+		std::uint64_t intended = now;
+
+		if (openLoop) {
+			if (m_pending.empty()) {
+				break;
+			}
+
+			intended = m_pending.front();
+			m_pending.pop_front();
+		}
+
+		++connection.m_sentOnConnection;
+
+		const bool last = m_options.m_churn != 0 && connection.m_sentOnConnection == m_options.m_churn;
+		connection.m_output += last ? m_closeRequests[connection.m_nextPath] : m_requests[connection.m_nextPath];
+		connection.m_nextPath = (connection.m_nextPath + 1) % m_requests.size();
+
+		connection.m_inFlight.push_back(InFlight{ intended, now });
+	}
+
+	if (!flush(connection)) {
+		reopen(idx, true);
+	}
+}
+
+bool Worker::flush(Connection &connection) {
+	while (connection.m_outputSent < connection.m_output.size()) {
+		const ssize_t ns = send(connection.m_fd, connection.m_output.data() + connection.m_outputSent,
+			connection.m_output.size() - connection.m_outputSent, MSG_NOSIGNAL);
+
+		if (ns == -1) {
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+
+		connection.m_outputSent += static_cast<std::size_t>(ns);
+	}
+
+	connection.m_output.clear();
+	connection.m_outputSent = 0;
+
+	return true;
+}
+
+bool Worker::receive(std::size_t idx) {
+	Connection &connection = m_connections[idx];
+	char chunk[65536];
+
+	while (true) {
+		const ssize_t nr = recv(connection.m_fd, chunk, sizeof(chunk), 0);
+
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+
+			return false;
+		}
+
+		if (nr == 0) {
+			// A churned connection is closed by the server after its last response
+			return connection.m_inFlight.empty() && m_options.m_churn != 0 && connection.m_sentOnConnection == m_options.m_churn;
+		}
+
+		connection.m_input.append(chunk, static_cast<std::size_t>(nr));
+
+		const std::uint64_t now = nowNs();
+		std::size_t consumed = 0;
+
+		while (!connection.m_inFlight.empty()) {
+			std::size_t size = 0;
+
+			const PARSE result = responseSize(std::string_view{ connection.m_input }.substr(consumed), size);
+			if (result == PARSE::ERROR) {
+				return false;
+			}
+
+			if (result == PARSE::INCOMPLETE) {
+				break;
+			}
+
+			const InFlight request = connection.m_inFlight.front();
+			connection.m_inFlight.pop_front();
+			consumed += size;
+
+			if (m_interval <= 0.0 && request.m_sent < m_warmupEnd) {
+				m_warmupLatency.record(now - request.m_sent);
+			}
+
+			if (!measured(request.m_intended, now)) {
+				continue;
+			}
+
+			++m_result.m_responses;
+			m_result.m_bytes += size;
+			m_result.m_uncorrected.record(now - request.m_sent);
+
+			if (m_interval > 0.0) {
+				m_result.m_corrected.record(now - request.m_intended);
+			}
+			else {
+				m_result.m_corrected.recordCorrected(now - request.m_sent, m_expectedInterval);
+			}
+		}
+
+		connection.m_input.erase(0, consumed);
+	}
+}
+
+void Worker::run() {
+	m_epollfd = epoll_create1(0);
+	if (m_epollfd == -1) {
+		perror("epoll_create1");
+		return;
+	}
+
+	m_nextIntended = static_cast<double>(nowNs());
+
+	for (std::size_t idx = 0; idx < m_connections.size(); ++idx) {
+		if (!open(idx)) {
+			++m_result.m_errors;
+		}
+	}
+
+	std::vector<epoll_event> events(m_connections.size() + 1);
+
+	while (true) {
+		std::uint64_t now = nowNs();
+		if (now >= m_end) {
+			break;
+		}
+
+		if (m_expectedInterval == 0 && now >= m_warmupEnd) {
+			m_expectedInterval = static_cast<std::uint64_t>(m_warmupLatency.mean());
+		}
+
+		// Wake up for the next scheduled request, the open loop can't wait in milliseconds
+		std::uint64_t wait = m_end - now;
+		if (m_interval > 0.0 && m_pending.empty()) {
+			wait = std::min<std::uint64_t>(wait, static_cast<std::uint64_t>(std::max(0.0, m_nextIntended - static_cast<double>(now))));
+		}
+
+		const timespec timeout{ static_cast<time_t>(wait / 1000000000), static_cast<long>(wait % 1000000000) };
+		const int eventsNum = epoll_pwait2(m_epollfd, events.data(), static_cast<int>(events.size()), &timeout, nullptr);
+
+		now = nowNs();
+		schedule(now);
+
+		for (int i = 0; i < eventsNum; ++i) {
+			const std::size_t idx = events[i].data.u64;
+			Connection &connection = m_connections[idx];
+
+			if (connection.m_fd == -1) {
+				continue;
+			}
+
+			if (!connection.m_connected && (events[i].events & EPOLLOUT)) {
+				int error = 0;
+				socklen_t len = sizeof(error);
+				getsockopt(connection.m_fd, SOL_SOCKET, SO_ERROR, &error, &len);
+
+				if (error != 0) {
+					reopen(idx, true);
+					continue;
+				}
+
+				connection.m_connected = true;
+			}
+
+			if ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !receive(idx)) {
+				reopen(idx, true);
+				continue;
+			}
+
+			// The last response of a churned connection, open the next one without waiting for the FIN
+			if (m_options.m_churn != 0 && connection.m_sentOnConnection == m_options.m_churn && connection.m_inFlight.empty()) {
+				reopen(idx, false);
+				continue;
+			}
+
+			if ((events[i].events & EPOLLOUT) && !flush(connection)) {
+				reopen(idx, true);
+			}
+		}
+
+		// The failed connections are retried, the open loop sends the scheduled requests on any free connection
+		for (std::size_t idx = 0; idx < m_connections.size(); ++idx) {
+			if (m_connections[idx].m_fd == -1) {
+				if (!open(idx)) {
+					continue;
+				}
+			}
+
+			if (canSend(m_connections[idx])) {
+				fill(idx, now);
+			}
+		}
+	}
+
+	for (const auto &pending : m_pending) {
+		m_result.m_backlog += pending >= m_warmupEnd ? 1 : 0;
+	}
+
+	for (auto &connection : m_connections) {
+		if (connection.m_fd != -1) {
+			close(connection.m_fd);
+		}
+	}
+
+	close(m_epollfd);
+}
+
+void printUsage(const char *program) {
+	std::cerr
+		<< "Usage: " << program << " [options]\n"
+		<< "  --host=<ipv4>              (default: 127.0.0.1)\n"
+		<< "  --port=<port>              (default: " << SERVER_PORT << ")\n"
+		<< "  --path=<path>              repeatable, the connections cycle through the paths (default: /text)\n"
+		<< "  --threads=<count>          client threads (default: 1)\n"
+		<< "  --connections=<count>      split between the threads (default: 16)\n"
+		<< "  --pipeline=<count>         requests in flight per connection (default: 1)\n"
+		<< "  --rate=<requests/s>        open loop at this total rate (default: 0, closed loop)\n"
+		<< "  --churn=<requests>         reconnects after this many requests (default: 0, keep-alive)\n"
+		<< "  --warmup=<seconds>         not measured (default: 1)\n"
+		<< "  --duration=<seconds>       measured (default: 10)\n"
+		<< "  --json=<file>              writes the results as JSON, - for stdout\n"
+		<< "  --label=<text>             names the run in the JSON output, e.g. the build\n";
+}
+
+bool parseArguments(int argc, char **argv, Options &options) {
+	bool defaultPaths = true;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		const auto eq = arg.find('=');
+		const std::string_view name = arg.substr(0, eq);
+		const std::string value{ eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1) };
+
+		if (name == "--host") {
+			options.m_host = value;
+		}
+		else if (name == "--port") {
+			options.m_port = std::atoi(value.c_str());
+		}
+		else if (name == "--path") {
+			if (defaultPaths) {
+				options.m_paths.clear();
+				defaultPaths = false;
+			}
+
+			options.m_paths.push_back(value);
+		}
+		else if (name == "--threads") {
+			options.m_threads = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--connections") {
+			options.m_connections = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--pipeline") {
+			options.m_pipeline = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--rate") {
+			options.m_rate = std::max(0.0, std::atof(value.c_str()));
+		}
+		else if (name == "--churn") {
+			options.m_churn = std::max(0, std::atoi(value.c_str()));
+		}
+		else if (name == "--warmup") {
+			options.m_warmup = std::max(0, std::atoi(value.c_str()));
+		}
+		else if (name == "--duration") {
+			options.m_duration = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (name == "--json") {
+			options.m_json = value;
+		}
+		else if (name == "--label") {
+			options.m_label = value;
+		}
+		else {
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+
+	options.m_threads = std::min(options.m_threads, options.m_connections);
+
+	sockaddr_in address{};
+	if (inet_pton(AF_INET, options.m_host.c_str(), &address.sin_addr) != 1) {
+		std::cerr << "Invalid IPv4 address: " << options.m_host << '\n';
+		return false;
+	}
+
+	return true;
+}
+
+constexpr std::pair<std::string_view, double> PERCENTILES[] = {
+	{ "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p99.9", 0.999 }, { "p99.99", 0.9999 }
+};
+
+void printLatency(std::string_view name, const Histogram &histogram) {
+	std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(1);
+
+	for (const auto &[label, q] : PERCENTILES) {
+		std::cout << std::setw(8) << label << ' ' << std::setw(9) << histogram.percentile(q) / 1000.0;
+	}
+
+	std::cout << std::setw(6) << "max" << ' ' << std::setw(9) << histogram.max() / 1000.0 << " us\n";
+}
+
+void writeLatency(BenchJson &json, std::string_view name, const Histogram &histogram) {
+	json.beginObject(name);
+	json.value("samples", histogram.total());
+	json.value("mean_us", histogram.mean() / 1000.0);
+
+	for (const auto &[label, q] : PERCENTILES) {
+		json.value(std::string{ label } + "_us", histogram.percentile(q) / 1000.0);
+	}
+
+	json.value("max_us", histogram.max() / 1000.0);
+	json.endObject();
+}
+
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	if (!parseArguments(argc, argv, options)) {
+		return 1;
+	}
+
+	const std::uint64_t start = nowNs();
+	const std::uint64_t warmupEnd = start + static_cast<std::uint64_t>(options.m_warmup) * 1000000000ull;
+	const std::uint64_t end = warmupEnd + static_cast<std::uint64_t>(options.m_duration) * 1000000000ull;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	for (int i = 0; i < options.m_threads; ++i) {
+		const int connections = options.m_connections / options.m_threads + (i < options.m_connections % options.m_threads ? 1 : 0);
+		workers.push_back(std::make_unique<Worker>(options, connections, options.m_rate / options.m_threads, warmupEnd, end));
+	}
+
+	std::vector<std::thread> threads;
+	for (auto &worker : workers) {
+		threads.emplace_back([&worker]() {
+			worker->run();
+		});
+	}
+
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	ThreadResult total;
+	for (const auto &worker : workers) {
+		const ThreadResult &result = worker->result();
+
+		total.m_corrected.merge(result.m_corrected);
+		total.m_uncorrected.merge(result.m_uncorrected);
+		total.m_responses += result.m_responses;
+		total.m_bytes += result.m_bytes;
+		total.m_connects += result.m_connects;
+		total.m_errors += result.m_errors;
+		total.m_backlog += result.m_backlog;
+	}
+
+	const double seconds = static_cast<double>(options.m_duration);
+	const bool openLoop = options.m_rate > 0.0;
+
+	std::cout << options.m_connections << " connections, " << options.m_threads << " thread(s), " << options.m_pipeline
+		<< " request(s) in flight each, " << (openLoop ? "open loop at " + std::to_string(static_cast<long long>(options.m_rate)) + " requests/s" : std::string{ "closed loop" })
+		<< (options.m_churn ? ", " + std::to_string(options.m_churn) + " requests per connection" : std::string{}) << '\n';
+
+	std::cout << std::fixed << std::setprecision(0)
+		<< "requests/s " << total.m_responses / seconds
+		<< "  MB/s " << std::setprecision(2) << total.m_bytes / seconds / 1e6
+		<< "  responses " << total.m_responses
+		<< "  connects " << total.m_connects
+		<< "  errors " << total.m_errors;
+
+	if (openLoop) {
+		std::cout << "  unsent " << total.m_backlog;
+	}
+
+	std::cout << '\n';
+
+	printLatency("corrected", total.m_corrected);
+	printLatency("uncorrected", total.m_uncorrected);
+
+	if (!options.m_json.empty()) {
+		BenchJson json;
+		json.value("benchmark", "load-gen");
+		json.value("label", options.m_label);
+
+		json.beginObject("config");
+		json.value("host", options.m_host);
+		json.value("port", options.m_port);
+		json.beginArray("paths");
+		for (const auto &path : options.m_paths) {
+			json.value({}, path);
+		}
+		json.endArray();
+		json.value("threads", options.m_threads);
+		json.value("connections", options.m_connections);
+		json.value("pipeline", options.m_pipeline);
+		json.value("mode", openLoop ? "open" : "closed");
+		json.value("rate", options.m_rate);
+		json.value("churn", options.m_churn);
+		json.value("warmup_s", options.m_warmup);
+		json.value("duration_s", options.m_duration);
+		json.endObject();
+
+		json.value("requests_per_second", total.m_responses / seconds);
+		json.value("bytes_per_second", total.m_bytes / seconds);
+		json.value("responses", total.m_responses);
+		json.value("connects", total.m_connects);
+		json.value("errors", total.m_errors);
+		json.value("unsent", total.m_backlog);
+
+		writeLatency(json, "latency_corrected", total.m_corrected);
+		writeLatency(json, "latency_uncorrected", total.m_uncorrected);
+
+		if (!json.write(options.m_json)) {
+			return 1;
+		}
+	}
+
+	return total.m_responses == 0 ? 1 : 0;
+}
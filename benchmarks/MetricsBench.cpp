@@ -0,0 +1,208 @@
+// Measures what the metrics add to a request: the same parse + route + response loop that a worker
+// runs, with and without the timestamps, the histograms and the counters of processRequests(), and
+// checks the overhead against the budget of a few nanoseconds per request.
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include "Server.h"
+#include "HttpParser.h"
+#include "OutputQueue.h"
+#include "ThreadContext.h"
+#include "Metrics.h"
+
+namespace {
+
+constexpr int ROUNDS = 2000000;
+
+// The loops are interleaved in short passes and the best pass counts, a difference of a few
+// nanoseconds is below the noise of one long run
+constexpr int REQUEST_ROUNDS = 100000;
+
+constexpr double BUDGET_NS = 5.0;
+
+const std::string_view REQUEST =
+    "GET /text HTTP/1.1\r\n"
+    "Host: localhost:3490\r\n"
+    "User-Agent: wrk\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+template <typename Body>
+double measure(int rounds, Body &&body) {
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < rounds; ++round) {
+        body();
+    }
+
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+}
+
+enum class TIMING {
+    NONE,       // Without the metrics
+    EVERY,      // Every wakeup is timed
+    SAMPLED     // One of Metrics::TIMED_WAKEUPS, like the workers
+};
+
+// A keep-alive request the way ServerThread handles it: its own wakeup, which reads the clock if it's
+// timed, and processRequests(), which reads it twice more, at the start and the end of the handler.
+// The requests of a pipelined batch share the wakeup's read.
+template <TIMING MODE>
+double measureRequests(Server &server, Metrics &metrics, std::string &input, std::uint64_t &checksum) {
+    HttpParser parser;
+    OutputQueue output;
+    ThreadContext context;
+    const ParserLimits limits;
+
+    std::uint32_t wakeups = 0;
+
+    return measure(REQUEST_ROUNDS, [&]() {
+        // ServerThread::onWakeup()
+        std::uint64_t wakeupTicks = 0;
+        if constexpr (MODE == TIMING::EVERY) {
+            wakeupTicks = CycleClock::now();
+        }
+        else if constexpr (MODE == TIMING::SAMPLED) {
+            if (++wakeups % Metrics::TIMED_WAKEUPS == 0) {
+                wakeupTicks = CycleClock::now();
+            }
+        }
+
+        parser.parse(input.data(), input.size(), limits);
+
+        std::uint64_t handlerStart = 0;
+        if (wakeupTicks != 0) {
+            handlerStart = CycleClock::now();
+            metrics.parse().record(handlerStart - wakeupTicks);
+        }
+
+        HttpRequest request = parser.request(input.data(), context.m_arena.resource());
+        const int status = server.createRawResponse(request, output, context);
+
+        if (wakeupTicks != 0) {
+            const std::uint64_t handlerEnd = CycleClock::now();
+            metrics.handler().record(handlerEnd - handlerStart);
+
+            // ServerThread::onSend() takes the end from the last handler
+            metrics.firstByte().record(handlerEnd - wakeupTicks);
+        }
+
+        if constexpr (MODE != TIMING::NONE) {
+            metrics.addRequest(request.line().m_method, status);
+        }
+
+        checksum += static_cast<std::uint64_t>(status);
+
+        context.m_arena.reset();
+        parser.reset();
+        output.clear();
+    });
+}
+
+// Only what the metrics do for such a request, the budget is checked against this. A few nanoseconds
+// of difference between the request loops are lost in their noise.
+template <TIMING MODE>
+double measureRecording(Metrics &metrics, std::uint64_t &checksum) {
+    std::uint32_t wakeups = 0;
+
+    return measure(ROUNDS, [&]() {
+        std::uint64_t wakeupTicks = 0;
+        if constexpr (MODE == TIMING::EVERY) {
+            wakeupTicks = CycleClock::now();
+        }
+        else {
+            if (++wakeups % Metrics::TIMED_WAKEUPS == 0) {
+                wakeupTicks = CycleClock::now();
+            }
+        }
+
+        if (wakeupTicks != 0) {
+            const std::uint64_t handlerStart = CycleClock::now();
+            metrics.parse().record(handlerStart - wakeupTicks);
+
+            const std::uint64_t handlerEnd = CycleClock::now();
+            metrics.handler().record(handlerEnd - handlerStart);
+            metrics.firstByte().record(handlerEnd - wakeupTicks);
+
+            checksum += handlerEnd;
+        }
+
+        metrics.addRequest(HTTP_METHOD::GET, 200);
+    });
+}
+
+void printResult(std::string_view name, double ns) {
+    std::cout << std::left << std::setw(36) << name << std::right << std::setw(10) << std::fixed << std::setprecision(1) << ns << " ns\n";
+}
+
+}
+
+int main(int argc, char **argv) {
+    const int repeats = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+
+    ServerConfig config;
+    config.m_metricsPath.clear();
+
+    Server server{ config };
+    Metrics metrics;
+
+    std::string input{ REQUEST };
+    std::uint64_t checksum = 0;
+
+    std::cout << "CycleClock: " << std::fixed << std::setprecision(3) << CycleClock::ticksPerSecond() / 1e9 << " ticks/ns\n";
+
+    const double clockNs = measure(ROUNDS, [&checksum]() {
+        checksum += CycleClock::now();
+    });
+    printResult("CycleClock::now()", clockNs);
+
+    // Walks through the buckets
+    std::uint64_t ticks = 0;
+    printResult("LatencyHistogram::record()", measure(ROUNDS, [&metrics, &ticks]() {
+        ticks += 977;
+        metrics.handler().record(ticks);
+    }));
+
+    const double recordingEvery = measureRecording<TIMING::EVERY>(metrics, checksum);
+    const double recordingSampled = measureRecording<TIMING::SAMPLED>(metrics, checksum);
+
+    printResult("metrics, every wakeup timed", recordingEvery);
+    printResult("metrics, sampled timing", recordingSampled);
+
+    // The best of the repeats, the rest is mostly noise from the other processes
+    double without = 0.0;
+    double every = 0.0;
+    double sampled = 0.0;
+
+    for (int repeat = 0; repeat < repeats; ++repeat) {
+        const double withoutNs = measureRequests<TIMING::NONE>(server, metrics, input, checksum);
+        const double everyNs = measureRequests<TIMING::EVERY>(server, metrics, input, checksum);
+        const double sampledNs = measureRequests<TIMING::SAMPLED>(server, metrics, input, checksum);
+
+        without = repeat == 0 ? withoutNs : std::min(without, withoutNs);
+        every = repeat == 0 ? everyNs : std::min(every, everyNs);
+        sampled = repeat == 0 ? sampledNs : std::min(sampled, sampledNs);
+    }
+
+    printResult("request without metrics", without);
+    printResult("request, every wakeup timed", every);
+    printResult("request, sampled timing", sampled);
+    printResult("overhead, every wakeup timed", every - without);
+    printResult("overhead, sampled timing", sampled - without);
+
+    // The workers time one of Metrics::TIMED_WAKEUPS wakeups
+    std::cout << "budget of " << std::setprecision(1) << BUDGET_NS << " ns per request: "
+        << (recordingSampled <= BUDGET_NS ? "met" : "NOT met") << " (" << recordingSampled << " ns sampled, "
+        << recordingEvery << " ns if every wakeup were timed)\n";
+
+    std::cout << "checksum " << checksum << '\n';
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Measures the request parser with every scanner implementation supported by the CPU on a typical
+// browser request. parser-check verifies that they match the scalar one.
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include "CharScanner.h"
+#include "HttpParser.h"
+
+namespace {
+
+constexpr int PARSE_ROUNDS = 500000;
+
+// The parser lower-cases the header names in place, so every request is parsed from a fresh copy.
+// The copies are restored between the timed batches and the best batch counts, the rest is mostly
+// noise from the other processes.
+constexpr int COPIES = 256;
+
+constexpr CharScanner::ISA ISAS[] = { CharScanner::ISA::SCALAR, CharScanner::ISA::SSE42, CharScanner::ISA::AVX2 };
+
+const std::string_view REQUEST =
+    "GET /assets/js/app.4f2c1e.js?v=20240101 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/dashboard/overview\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,bg;q=0.8\r\n"
+    "Cookie: session=3f7a9c2e8b1d4f6a; theme=dark; _ga=GA1.2.1234567890.1700000000\r\n"
+    "If-None-Match: \"5e1f-18c7a2b3d40\"\r\n"
+    "\r\n";
+
+double measureParse(std::size_t &checksum) {
+    std::vector<std::string> buffers(COPIES, std::string{ REQUEST });
+    HttpParser parser;
+    const ParserLimits limits;
+
+    double best = 0.0;
+
+    constexpr int BATCHES = PARSE_ROUNDS / COPIES;
+
+    for (int batch = 0; batch < BATCHES; ++batch) {
+        for (auto &buffer : buffers) {
+            buffer.assign(REQUEST);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (auto &buffer : buffers) {
+            parser.reset();
+            parser.parse(buffer.data(), buffer.size(), limits);
+            checksum += parser.requestSize();
+        }
+
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / COPIES;
+        best = batch == 0 ? ns : std::min(best, ns);
+    }
+
+    return best;
+}
+
+}
+
+int main() {
+    std::size_t checksum = 0;
+
+    std::cout << "detected: " << CharScanner::isaName(CharScanner::isa()) << '\n';
+
+    for (const auto isa : ISAS) {
+        if (!CharScanner::supported(isa)) {
+            std::cout << std::left << std::setw(10) << CharScanner::isaName(isa) << "not supported\n";
+            continue;
+        }
+
+        CharScanner::setIsa(isa);
+        const double nsPerRequest = measureParse(checksum);
+
+        std::cout << std::left << std::setw(10) << CharScanner::isaName(isa)
+            << std::right << std::setw(10) << std::fixed << std::setprecision(1) << nsPerRequest << " ns/request\n";
+    }
+
+    std::cout << "checksum: " << checksum << '\n';
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,457 @@
+// Regression checks of the request parser: requests split at every byte, pipelined requests,
+// the limits, the framing rules (leading empty lines, obs-fold, Content-Length and Transfer-Encoding)
+// and the body decoding, collected and streamed. They run with every scanner implementation the CPU
+// supports, after the check that it matches the scalar one on random input. Prints the failed checks
+// and exits with 1 if any.
+
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include "CharScanner.h"
+#include "HttpParser.h"
+
+namespace {
+
+using RESULT = HttpParser::RESULT;
+
+constexpr int SCANNER_ROUNDS = 20000;
+
+constexpr CharScanner::ISA ISAS[] = { CharScanner::ISA::SCALAR, CharScanner::ISA::SSE42, CharScanner::ISA::AVX2 };
+
+int g_failures = 0;
+std::string_view g_isa;
+
+const char *resultName(RESULT result) {
+    switch (result) {
+    case RESULT::INCOMPLETE:
+        return "INCOMPLETE";
+    case RESULT::COMPLETE:
+        return "COMPLETE";
+    case RESULT::BODY_FOLLOWS:
+        return "BODY_FOLLOWS";
+    case RESULT::INVALID:
+        return "INVALID";
+    case RESULT::REQUEST_LINE_TOO_LONG:
+        return "REQUEST_LINE_TOO_LONG";
+    case RESULT::HEADERS_TOO_LARGE:
+        return "HEADERS_TOO_LARGE";
+    case RESULT::BODY_TOO_LARGE:
+        return "BODY_TOO_LARGE";
+    }
+
+    return "?";
+}
+
+void expect(bool ok, std::string_view name, std::string_view what) {
+    if (!ok) {
+        std::cerr << "FAILED " << g_isa << ' ' << name << ": " << what << '\n';
+        ++g_failures;
+    }
+}
+
+void expectResult(RESULT result, RESULT expected, std::string_view name, std::string_view what) {
+    if (result != expected) {
+        std::cerr << "FAILED " << g_isa << ' ' << name << ": " << what << " is " << resultName(result) << " instead of " << resultName(expected) << '\n';
+        ++g_failures;
+    }
+}
+
+struct Outcome {
+    RESULT m_result{ RESULT::INCOMPLETE };
+    std::size_t m_fed{ 0 };             // The bytes passed to the call that returned the result
+    std::size_t m_headersSize{ 0 };     // requestSize() after BODY_FOLLOWS
+    bool m_bodyFollows{ false };
+};
+
+// Passes the input in prefixes growing by step bytes, as they would arrive on the socket, and collects
+// the body after BODY_FOLLOWS like ServerThread::processRequests.
+Outcome feed(HttpParser &parser, std::string &input, std::size_t step, const ParserLimits &limits) {
+    Outcome outcome;
+
+    for (std::size_t len = std::min(step, input.size()); ; len = std::min(len + step, input.size())) {
+        RESULT result = parser.parse(input.data(), len, limits);
+
+        if (result == RESULT::BODY_FOLLOWS) {
+            outcome.m_bodyFollows = true;
+            outcome.m_headersSize = parser.requestSize();
+
+            result = parser.parse(input.data(), len, limits);
+        }
+
+        if (result != RESULT::INCOMPLETE || len == input.size()) {
+            outcome.m_result = result;
+            outcome.m_fed = len;
+            return outcome;
+        }
+    }
+}
+
+constexpr std::size_t STEPS[] = { 1, 2, 3, 7, 64, SIZE_MAX };
+
+// The request must complete exactly with its last byte however it's split
+void checkComplete(std::string_view name, std::string_view request, std::string_view body = {}) {
+    // BODY_FOLLOWS after the empty line that ends the headers
+    const std::size_t headersSize = body.empty() ? 0 : request.find("\r\n\r\n") + 4;
+
+    for (const std::size_t step : STEPS) {
+        std::string input{ request };
+        HttpParser parser;
+
+        const Outcome outcome = feed(parser, input, step, ParserLimits{});
+        const std::string what = "step " + std::to_string(step);
+
+        expectResult(outcome.m_result, RESULT::COMPLETE, name, what);
+        expect(outcome.m_fed == request.size(), name, what + ": completed before the last byte");
+        expect(parser.requestSize() == request.size(), name, what + ": requestSize()");
+        expect(outcome.m_bodyFollows == (headersSize != 0), name, what + ": BODY_FOLLOWS");
+        expect(outcome.m_headersSize == headersSize, name, what + ": the size of the headers");
+
+        const HttpRequest parsed = parser.request(input.data());
+        expect(parsed.body().m_data == body, name, what + ": the body");
+    }
+}
+
+RESULT parseAll(std::string_view request, const ParserLimits &limits = {}) {
+    std::string input{ request };
+    HttpParser parser;
+
+    return feed(parser, input, SIZE_MAX, limits).m_result;
+}
+
+void checkRequests() {
+    const std::string_view get =
+        "GET /path/file.txt?x=1 HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "ACCEPT-Encoding:   gzip  \r\n"
+        "\r\n";
+
+    checkComplete("get", get);
+
+    std::string input{ get };
+    HttpParser parser;
+    feed(parser, input, SIZE_MAX, ParserLimits{});
+
+    const HttpRequest request = parser.request(input.data());
+    expect(request.line().m_method == HTTP_METHOD::GET, "get", "method");
+    expect(request.line().m_httpVersion == HTTP_VERSION::HTTP_11, "get", "version");
+    expect(request.line().m_path == "/path/file.txt", "get", "path");
+    expect(request.line().m_query == "x=1", "get", "query");
+    expect(request.headers().size() == 2, "get", "fields");
+    expect(request.headers().getFieldValue(HTTP_HEADER::ACCEPT_ENCODING) == "gzip", "get", "trimmed value");
+
+    checkComplete("bare LF", "GET / HTTP/1.0\nHost: a\n\n");
+
+    checkComplete("content-length",
+        "POST /upload HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world",
+        "hello world");
+
+    checkComplete("chunked",
+        "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "4\r\nWiki\r\n5;ext=1\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\nTrailer: x\r\n\r\n",
+        "Wikipedia in\r\n\r\nchunks.");
+
+    // The same length repeated is allowed
+    checkComplete("repeated content-length",
+        "POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc",
+        "abc");
+}
+
+void checkPipelined() {
+    const std::string_view requests[] = {
+        "GET /a HTTP/1.1\r\nHost: a\r\n\r\n",
+        "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello",
+        "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n",
+        "HEAD /d HTTP/1.0\r\n\r\n"
+    };
+
+    std::string input;
+    for (const auto request : requests) {
+        input += request;
+    }
+
+    HttpParser parser;
+    std::size_t offset = 0;
+
+    for (const auto request : requests) {
+        RESULT result = parser.parse(input.data() + offset, input.size() - offset, ParserLimits{});
+
+        if (result == RESULT::BODY_FOLLOWS) {
+            result = parser.parse(input.data() + offset, input.size() - offset, ParserLimits{});
+        }
+
+        expectResult(result, RESULT::COMPLETE, "pipelined", request);
+        expect(parser.requestSize() == request.size(), "pipelined", std::string{ request } + ": requestSize()");
+
+        offset += parser.requestSize();
+        parser.reset();
+    }
+
+    expect(offset == input.size(), "pipelined", "the requests don't end with the input");
+}
+
+void checkLeadingLines() {
+    // Empty lines before the request line are skipped (RFC 9112, 2.2) and counted in the request
+    checkComplete("leading CRLFs", "\r\n\r\n\nGET / HTTP/1.1\r\n\r\n");
+
+    ParserLimits limits;
+    limits.m_maxHeaderBytes = 1024;
+
+    std::string flood;
+    while (flood.size() <= limits.m_maxHeaderBytes) {
+        flood += "\r\n";
+    }
+
+    expectResult(parseAll(flood, limits), RESULT::HEADERS_TOO_LARGE, "CRLF flood", "parse()");
+
+    // Split at every byte, the limit holds while the empty lines arrive
+    HttpParser parser;
+    RESULT result = RESULT::INCOMPLETE;
+    std::size_t len = 0;
+
+    while (result == RESULT::INCOMPLETE && len < flood.size()) {
+        result = parser.parse(flood.data(), ++len, limits);
+    }
+
+    expectResult(result, RESULT::HEADERS_TOO_LARGE, "CRLF flood", "byte split");
+    expect(len <= limits.m_maxHeaderBytes + 1, "CRLF flood", "the limit was passed");
+}
+
+void checkFraming() {
+    expectResult(parseAll("GET / HTTP/1.1\r\nHost: a\r\n Transfer-Encoding: chunked\r\n\r\n"), RESULT::INVALID, "obs-fold", "SP");
+    expectResult(parseAll("GET / HTTP/1.1\r\nHost: a\r\n\tX: b\r\n\r\n"), RESULT::INVALID, "obs-fold", "HTAB");
+    expectResult(parseAll("GET / HTTP/1.1\r\nHost : a\r\n\r\n"), RESULT::INVALID, "field", "space before the colon");
+    expectResult(parseAll("GET / HTTP/1.1\r\nHost\r\n\r\n"), RESULT::INVALID, "field", "no colon");
+
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n"), RESULT::INVALID, "CL + TE", "parse()");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n\r\n0\r\n\r\n"), RESULT::INVALID, "TE + CL", "parse()");
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd"), RESULT::INVALID, "different content-lengths", "parse()");
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n"), RESULT::INVALID, "negative content-length", "parse()");
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: 1 2\r\n\r\n"), RESULT::INVALID, "content-length list", "parse()");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"), RESULT::INVALID, "transfer codings", "parse()");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n"), RESULT::INVALID, "repeated transfer-encoding", "parse()");
+    expectResult(parseAll("POST / HTTP/1.0\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n"), RESULT::INVALID, "HTTP/1.0 chunked", "parse()");
+
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nx\r\n"), RESULT::INVALID, "chunk size", "not hex");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3 x\r\nabc\r\n0\r\n\r\n"), RESULT::INVALID, "chunk size", "garbage after");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcd\r\n0\r\n\r\n"), RESULT::INVALID, "chunk data", "longer than its size");
+
+    const std::pair<std::string_view, HTTP_VERSION> versions[] = {
+        { "HTTP/1.0", HTTP_VERSION::HTTP_10 },
+        { "HTTP/1.1", HTTP_VERSION::HTTP_11 },
+        { "HTTP/9.1", HTTP_VERSION::INVALID_VERSION },
+        { "XXXX/1.0", HTTP_VERSION::INVALID_VERSION },
+        { "HTTP/1.11", HTTP_VERSION::INVALID_VERSION },
+        { "http/1.1", HTTP_VERSION::INVALID_VERSION }
+    };
+
+    for (const auto &[token, version] : versions) {
+        std::string input = "GET / " + std::string{ token } + "\r\n\r\n";
+        HttpParser parser;
+
+        expectResult(parser.parse(input.data(), input.size(), ParserLimits{}), RESULT::COMPLETE, "version", token);
+        expect(parser.request(input.data()).line().m_httpVersion == version, "version", token);
+    }
+
+    const std::pair<std::string_view, bool> expectations[] = {
+        { "POST / HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 1\r\n\r\n", true },
+        { "POST / HTTP/1.1\r\nExpect: 100-Continue\r\nContent-Length: 1\r\n\r\n", true },
+        { "POST / HTTP/1.0\r\nExpect: 100-continue\r\nContent-Length: 1\r\n\r\n", false },
+        { "POST / HTTP/9.1\r\nExpect: 100-continue\r\nContent-Length: 1\r\n\r\n", false },
+        { "POST / HTTP/1.1\r\nExpect: 200-ok\r\nContent-Length: 1\r\n\r\n", false }
+    };
+
+    for (const auto &[request, continues] : expectations) {
+        std::string input{ request };
+        HttpParser parser;
+
+        expectResult(parser.parse(input.data(), input.size(), ParserLimits{}), RESULT::BODY_FOLLOWS, "expect", request);
+        expect(parser.expectsContinue() == continues, "expect", request);
+    }
+}
+
+void checkLimits() {
+    ParserLimits limits;
+    limits.m_maxRequestLine = 64;
+    limits.m_maxHeaderLine = 64;
+    limits.m_maxHeaders = 4;
+    limits.m_maxHeaderBytes = 256;
+    limits.m_maxBodySize = 16;
+    limits.m_maxUploadMb = 1;
+
+    const std::string longPath(64, 'a');
+    const std::string longValue(64, 'b');
+
+    expectResult(parseAll("GET /" + longPath + " HTTP/1.1\r\n\r\n", limits), RESULT::REQUEST_LINE_TOO_LONG, "request line", "complete");
+    expectResult(parseAll("GET /" + longPath, limits), RESULT::REQUEST_LINE_TOO_LONG, "request line", "without its end");
+    expectResult(parseAll("GET / HTTP/1.1\r\nX: " + longValue + "\r\n\r\n", limits), RESULT::HEADERS_TOO_LARGE, "header line", "complete");
+    expectResult(parseAll("GET / HTTP/1.1\r\nX: " + longValue, limits), RESULT::HEADERS_TOO_LARGE, "header line", "without its end");
+    expectResult(parseAll("GET / HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\nD: 4\r\n\r\n", limits), RESULT::COMPLETE, "headers", "at the limit");
+    expectResult(parseAll("GET / HTTP/1.1\r\nA: 1\r\nB: 2\r\nC: 3\r\nD: 4\r\nE: 5\r\n\r\n", limits), RESULT::HEADERS_TOO_LARGE, "headers", "above the limit");
+
+    limits.m_maxHeaders = 100;
+
+    std::string manyLines = "GET / HTTP/1.1\r\n";
+    while (manyLines.size() <= limits.m_maxHeaderBytes) {
+        manyLines += "X: 0123456789\r\n";
+    }
+
+    expectResult(parseAll(manyLines + "\r\n", limits), RESULT::HEADERS_TOO_LARGE, "header bytes", "complete");
+    expectResult(parseAll(manyLines, limits), RESULT::HEADERS_TOO_LARGE, "header bytes", "without the end");
+
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdef", limits), RESULT::COMPLETE, "body", "at the limit");
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: 17\r\n\r\n", limits), RESULT::BODY_TOO_LARGE, "body", "content-length above the limit");
+    expectResult(parseAll("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n", limits), RESULT::BODY_TOO_LARGE, "body", "content-length overflow");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n10\r\n0123456789abcdef\r\n1\r\nx\r\n0\r\n\r\n", limits), RESULT::BODY_TOO_LARGE, "body", "chunks above the limit");
+    expectResult(parseAll("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nffffffffffffffffff\r\n", limits), RESULT::BODY_TOO_LARGE, "body", "chunk size overflow");
+
+    // The chunk extensions don't grow a collected body, but its framing is limited
+    std::string framing = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    while (framing.size() <= 2 * limits.m_maxHeaderBytes) {
+        framing += "1;a=0123456789\r\nx\r\n";
+    }
+
+    limits.m_maxBodySize = 1024;
+
+    expectResult(parseAll(framing, limits), RESULT::BODY_TOO_LARGE, "body", "chunk framing");
+}
+
+// After BODY_FOLLOWS the headers are dropped and the body is decoded piece by piece from byte-split input
+void checkStreamed(std::string_view name, std::string_view headers, std::string_view body, std::string_view expected) {
+    for (const std::size_t step : STEPS) {
+        const std::string what = "step " + std::to_string(step);
+
+        std::string input{ headers };
+        HttpParser parser;
+
+        expectResult(parser.parse(input.data(), input.size(), ParserLimits{}), RESULT::BODY_FOLLOWS, name, what + ": the headers");
+        expect(parser.requestSize() == headers.size(), name, what + ": the size of the headers");
+
+        parser.streamBody();
+
+        std::string pending;
+        std::string decoded;
+        std::size_t offset = 0;
+        RESULT result = RESULT::INCOMPLETE;
+
+        while (result == RESULT::INCOMPLETE) {
+            if (offset == body.size()) {
+                break;
+            }
+
+            const std::size_t take = std::min(step, body.size() - offset);
+            pending.append(body.data() + offset, take);
+            offset += take;
+
+            // The caller drops the used bytes and keeps the rest for the next call
+            while (true) {
+                std::string_view piece;
+                std::size_t used = 0;
+
+                result = parser.parseBody(pending.data(), pending.size(), ParserLimits{}, piece, used);
+                decoded += piece;
+                pending.erase(0, used);
+
+                if (result != RESULT::INCOMPLETE || piece.empty()) {
+                    break;
+                }
+            }
+        }
+
+        expectResult(result, RESULT::COMPLETE, name, what);
+        expect(offset == body.size(), name, what + ": completed before the last byte");
+        expect(pending.empty(), name, what + ": bytes left after the body");
+        expect(decoded == expected, name, what + ": the body");
+    }
+}
+
+std::string randomBytes(std::mt19937 &rng, std::size_t len) {
+    // Mostly the bytes the parser looks for, so the matches land at every position
+    static constexpr std::string_view ALPHABET = " :\r\n\tAZaz@[`{\x7f\x80\xff-09";
+
+    std::string bytes(len, '\0');
+    for (auto &c : bytes) {
+        c = rng() % 4 == 0 ? ALPHABET[rng() % ALPHABET.size()] : static_cast<char>(rng() % 256);
+    }
+
+    return bytes;
+}
+
+// The results of every scanner function must be those of the scalar implementation
+void checkScanner(CharScanner::ISA isa, std::mt19937 &rng) {
+    static constexpr std::string_view DELIMITERS[] = { " ", ": ", "\r\n", " :\r\n", std::string_view{ "\0", 1 } };
+
+    for (int round = 0; round < SCANNER_ROUNDS; ++round) {
+        const std::string input = randomBytes(rng, rng() % 200);
+        const std::string_view delimiters = DELIMITERS[round % std::size(DELIMITERS)];
+
+        CharScanner::setIsa(CharScanner::ISA::SCALAR);
+        const std::size_t expectedIdx = CharScanner::findFirstOf(input.data(), input.size(), delimiters);
+        std::string expectedLower = input;
+        CharScanner::toLower(expectedLower.data(), expectedLower.size());
+        std::string expectedUpper = input;
+        CharScanner::toUpper(expectedUpper.data(), expectedUpper.size());
+        std::string expectedLowerUntil = input;
+        const std::size_t expectedLowerIdx = CharScanner::toLowerUntil(expectedLowerUntil.data(), expectedLowerUntil.size(), delimiters);
+
+        CharScanner::setIsa(isa);
+        const std::size_t idx = CharScanner::findFirstOf(input.data(), input.size(), delimiters);
+        std::string lower = input;
+        CharScanner::toLower(lower.data(), lower.size());
+        std::string upper = input;
+        CharScanner::toUpper(upper.data(), upper.size());
+        std::string lowerUntil = input;
+        const std::size_t lowerIdx = CharScanner::toLowerUntil(lowerUntil.data(), lowerUntil.size(), delimiters);
+
+        if (idx != expectedIdx || lower != expectedLower || upper != expectedUpper
+            || lowerIdx != expectedLowerIdx || lowerUntil != expectedLowerUntil) {
+            expect(false, "scanner", "differs from scalar on a " + std::to_string(input.size()) + " byte input");
+            return;
+        }
+    }
+}
+
+}
+
+int main() {
+    std::mt19937 rng{ 42 };
+
+    const CharScanner::ISA detected = CharScanner::isa();
+
+    for (const auto isa : ISAS) {
+        if (!CharScanner::supported(isa)) {
+            std::cout << CharScanner::isaName(isa) << " not supported, skipped\n";
+            continue;
+        }
+
+        g_isa = CharScanner::isaName(isa);
+
+        checkScanner(isa, rng);
+
+        CharScanner::setIsa(isa);
+
+        checkRequests();
+        checkPipelined();
+        checkLeadingLines();
+        checkFraming();
+        checkLimits();
+
+        checkStreamed("streamed content-length", "PUT /f HTTP/1.1\r\nContent-Length: 10\r\n\r\n", "0123456789", "0123456789");
+        checkStreamed("streamed chunked", "PUT /f HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+            "3\r\nabc\r\n1;x=y\r\nd\r\n0\r\nTrailer: 1\r\n\r\n", "abcd");
+    }
+
+    CharScanner::setIsa(detected);
+
+    if (g_failures != 0) {
+        std::cerr << g_failures << " checks failed\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "all parser checks passed\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+// Compares the router with the previous per-method std::unordered_map of exact paths.
+// The map can't match parameters, so the parameterized routes are measured only with the router.
+// The cases take turns and the best pass of each is reported, so frequency changes and the order
+// of the cases don't decide the comparison. Also times adding the routes.
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+#include "Router.h"
+
+namespace {
+
+constexpr int PASSES = 10;
+constexpr int PASS_ROUNDS = 20;
+
+template <typename Lookup>
+double measure(const std::vector<std::string> &paths, Lookup &&lookup, std::uint64_t &checksum) {
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int round = 0; round < PASS_ROUNDS; ++round) {
+        for (const auto &path : paths) {
+            checksum += lookup(path);
+        }
+    }
+
+    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    return elapsed / (static_cast<double>(paths.size()) * PASS_ROUNDS);
+}
+
+void printResult(std::string_view name, double nsPerLookup) {
+    std::cout << std::left << std::setw(36) << name << std::right << std::setw(10) << std::fixed << std::setprecision(1) << nsPerLookup << " ns/lookup\n";
+}
+
+}
+
+int main(int argc, char **argv) {
+    const int routesNum = argc > 1 ? std::max(1, std::atoi(argv[1])) : 2000;
+
+    static const char *RESOURCES[] = { "users", "orders", "products", "invoices", "carts", "reviews", "shipments", "accounts" };
+
+    std::vector<std::string> staticPatterns;
+    std::vector<std::string> paramPatterns;
+    std::vector<std::string> paramPaths;
+
+    for (int i = 0; i < routesNum; ++i) {
+        const std::string resource = RESOURCES[i % std::size(RESOURCES)];
+        const std::string version = "/api/v" + std::to_string(i % 4 + 1);
+
+        staticPatterns.push_back(version + "/" + resource + "/group" + std::to_string(i) + "/list");
+        paramPatterns.push_back(version + "/" + resource + std::to_string(i) + "/:id/items/:item");
+        paramPaths.push_back(version + "/" + resource + std::to_string(i) + "/" + std::to_string(i * 7919) + "/items/42");
+    }
+
+    std::vector<std::unordered_map<std::string_view, std::uint32_t>> methodMaps(static_cast<int>(HTTP_METHOD::INVALID_METHOD));
+
+    std::uint32_t routeId = 0;
+    for (const auto &pattern : staticPatterns) {
+        methodMaps[static_cast<int>(HTTP_METHOD::GET)][pattern] = routeId++;
+    }
+
+    const auto addStart = std::chrono::steady_clock::now();
+
+    Router router;
+
+    routeId = 0;
+    for (const auto &pattern : staticPatterns) {
+        router.add(HTTP_METHOD::GET, pattern, routeId++);
+    }
+
+    for (const auto &pattern : paramPatterns) {
+        router.add(HTTP_METHOD::GET, pattern, routeId++);
+    }
+
+    router.finalize();
+
+    const auto addMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - addStart).count();
+
+    std::mt19937 rng{ 42 };
+    std::vector<std::string> staticPaths = staticPatterns;
+    std::shuffle(staticPaths.begin(), staticPaths.end(), rng);
+    std::shuffle(paramPaths.begin(), paramPaths.end(), rng);
+
+    std::cout << routesNum * 2 << " routes (" << routesNum << " static, " << routesNum << " with parameters)\n";
+
+    std::uint64_t checksum = 0;
+    RouteParams params;
+
+    double mapStatic = 1e18;
+    double routerStatic = 1e18;
+    double routerParams = 1e18;
+
+    for (int pass = 0; pass < PASSES; ++pass) {
+        mapStatic = std::min(mapStatic, measure(staticPaths, [&](const std::string &path) {
+            const auto &handlers = methodMaps[static_cast<int>(HTTP_METHOD::GET)];
+            auto it = handlers.find(path);
+            return it == handlers.end() ? 0u : it->second;
+        }, checksum));
+
+        routerStatic = std::min(routerStatic, measure(staticPaths, [&](const std::string &path) {
+            std::uint32_t id = 0;
+            router.find(HTTP_METHOD::GET, path, id, params);
+            return id;
+        }, checksum));
+
+        routerParams = std::min(routerParams, measure(paramPaths, [&](const std::string &path) {
+            std::uint32_t id = 0;
+            router.find(HTTP_METHOD::GET, path, id, params);
+            return id + static_cast<std::uint32_t>(params.size());
+        }, checksum));
+    }
+
+    std::cout << "adding the routes: " << std::fixed << std::setprecision(1) << addMs << " ms\n";
+
+    printResult("unordered_map, static paths", mapStatic);
+    printResult("router, static paths", routerStatic);
+    printResult("router, paths with parameters", routerParams);
+
+    std::cout << "checksum: " << checksum << '\n';
+
+    return 0;
+}
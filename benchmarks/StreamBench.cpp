@@ -0,0 +1,312 @@
+// Compares a response that the handler builds in memory with the same body produced by a
+// ResponseStream, with and without a Content-Length. The server runs in-process on one worker
+// thread, so the peak RSS of every phase is the memory that the server needed for the response.
+// The client reads the whole response and reports the throughput.
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "Server.h"
+#include "ServerThread.h"
+#include "ResponseStream.h"
+#include "BenchJson.h"
+
+namespace {
+
+std::size_t bodySize = 128 * 1024 * 1024;
+
+void fillBody(std::string &out, std::size_t offset, std::size_t length) {
+	const std::size_t start = out.size();
+	out.resize(start + length);
+
+	for (std::size_t i = 0; i < length; ++i) {
+		out[start + i] = static_cast<char>('a' + (offset + i) % 26);
+	}
+}
+
+class GeneratedStream : public ResponseStream {
+public:
+	explicit GeneratedStream(bool knownLength) : m_knownLength(knownLength) {}
+
+	std::string_view contentType() const override {
+		return "application/octet-stream";
+	}
+
+	std::optional<std::size_t> contentLength() const override {
+		return m_knownLength ? std::optional<std::size_t>{ bodySize } : std::nullopt;
+	}
+
+	bool produce(std::string &out) override {
+		const std::size_t length = std::min(PIECE_SIZE, bodySize - m_produced);
+		fillBody(out, m_produced, length);
+		m_produced += length;
+
+		return m_produced < bodySize;
+	}
+
+private:
+	bool m_knownLength;
+	std::size_t m_produced{ 0 };
+};
+
+std::unique_ptr<ResponseStream> chunkedHandler(const HttpRequest &) {
+	return std::make_unique<GeneratedStream>(false);
+}
+
+std::unique_ptr<ResponseStream> lengthHandler(const HttpRequest &) {
+	return std::make_unique<GeneratedStream>(true);
+}
+
+void materializedHandler(std::string &response, const HttpRequest &) {
+	response += "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: ";
+	response += std::to_string(bodySize);
+	response += "\r\n\r\n";
+
+	fillBody(response, 0, bodySize);
+}
+
+int setupListener(sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = 0; // Any free port
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+
+	socklen_t addressSize = sizeof(address);
+
+	if (bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1
+		|| getsockname(fd, reinterpret_cast<sockaddr *>(&address), &addressSize) == -1
+		|| listen(fd, 16) == -1) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// "VmHWM" or "VmRSS" in KB
+std::uint64_t readMemory(std::string_view field) {
+	std::ifstream status{ "/proc/self/status" };
+	std::string line;
+
+	while (std::getline(status, line)) {
+		if (std::string_view{ line }.substr(0, field.size()) == field) {
+			return std::strtoull(line.c_str() + field.size() + 1, nullptr, 10);
+		}
+	}
+
+	return 0;
+}
+
+// Writing 5 to clear_refs resets VmHWM to the current RSS
+void resetPeakMemory() {
+	std::ofstream clearRefs{ "/proc/self/clear_refs" };
+	clearRefs << "5";
+}
+
+struct Result {
+	std::string_view m_name;
+	std::uint64_t m_bytes{ 0 };
+	double m_seconds{ 0.0 };
+	std::uint64_t m_peakGrowthKb{ 0 };
+	bool m_ok{ false };
+};
+
+Result download(const sockaddr_in &address, std::string_view name, std::string_view path) {
+	Result result;
+	result.m_name = name;
+
+	const std::uint64_t baseline = readMemory("VmRSS:");
+	resetPeakMemory();
+
+	const auto start = std::chrono::steady_clock::now();
+
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1 || connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+		perror("connect");
+		return result;
+	}
+
+	const std::string request = "GET " + std::string{ path } + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+	if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+		close(fd);
+		return result;
+	}
+
+	// The server closes the connection after the response, the body is read into a fixed buffer
+	static char buffer[256 * 1024];
+	char head[16] = {};
+	char tail[5] = {};
+
+	while (true) {
+		const ssize_t nr = recv(fd, buffer, sizeof(buffer), 0);
+		if (nr <= 0) {
+			break;
+		}
+
+		const std::size_t len = static_cast<std::size_t>(nr);
+
+		if (result.m_bytes < sizeof(head)) {
+			std::memcpy(head + result.m_bytes, buffer, std::min(len, sizeof(head) - result.m_bytes));
+		}
+
+		if (len >= sizeof(tail)) {
+			std::memcpy(tail, buffer + len - sizeof(tail), sizeof(tail));
+		}
+		else {
+			std::memmove(tail, tail + len, sizeof(tail) - len);
+			std::memcpy(tail + sizeof(tail) - len, buffer, len);
+		}
+
+		result.m_bytes += len;
+	}
+
+	close(fd);
+
+	result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const std::uint64_t peak = readMemory("VmHWM:");
+	result.m_peakGrowthKb = peak > baseline ? peak - baseline : 0;
+
+	const bool chunked = path == "/chunked";
+	result.m_ok = std::string_view{ head, 12 } == "HTTP/1.1 200"
+		&& result.m_bytes > bodySize
+		&& (!chunked || std::string_view{ tail, sizeof(tail) } == "0\r\n\r\n");
+
+	return result;
+}
+
+}
+
+int main(int argc, char **argv) {
+	IO_BACKEND backend = IO_BACKEND::EPOLL;
+	std::string jsonPath;
+	std::string label;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+
+		if (arg.substr(0, 7) == "--size=") {
+			bodySize = std::strtoull(argv[i] + 7, nullptr, 10) * 1024 * 1024;
+		}
+		else if (arg == "--io=epoll") {
+			backend = IO_BACKEND::EPOLL;
+		}
+		else if (arg == "--io=io_uring") {
+			backend = IO_BACKEND::IO_URING;
+		}
+		else if (arg.substr(0, 7) == "--json=") {
+			jsonPath = arg.substr(7);
+		}
+		else if (arg.substr(0, 8) == "--label=") {
+			label = arg.substr(8);
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--size=<MB>] [--io=epoll|io_uring] [--json=<file>|-] [--label=<text>]\n";
+			return 1;
+		}
+	}
+
+	if (bodySize == 0) {
+		std::cerr << "The size must be at least 1 MB\n";
+		return 1;
+	}
+
+	ServerConfig config;
+	config.m_metricsPath.clear();
+
+	Server server{ config };
+	server.addHandler(HTTP_METHOD::GET, "/materialized", materializedHandler);
+	server.addHandler(HTTP_METHOD::GET, "/chunked", chunkedHandler);
+	server.addHandler(HTTP_METHOD::GET, "/length", lengthHandler);
+
+	sockaddr_in address;
+	const int listener = setupListener(address);
+	if (listener == -1) {
+		return 1;
+	}
+
+	ServerThread worker;
+	if (!worker.runThread(server, backend, listener)) {
+		std::cerr << "Can't start the worker\n";
+		return 1;
+	}
+
+	std::cout << "body " << bodySize / (1024 * 1024) << " MB\n"
+		<< std::left << std::setw(16) << "response"
+		<< std::right << std::setw(12) << "MB/s"
+		<< std::setw(18) << "peak RSS +MB" << '\n';
+
+	// The streams first, the materialized response leaves its pages to the allocator
+	const std::pair<std::string_view, std::string_view> PHASES[] = {
+		{ "chunked", "/chunked" },
+		{ "content-length", "/length" },
+		{ "materialized", "/materialized" }
+	};
+
+	std::vector<Result> results;
+	bool ok = true;
+
+	for (const auto &[name, path] : PHASES) {
+		const Result result = download(address, name, path);
+		ok = ok && result.m_ok;
+
+		std::cout << std::left << std::setw(16) << result.m_name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(12) << (result.m_seconds > 0.0 ? result.m_bytes / result.m_seconds / (1024 * 1024) : 0.0)
+			<< std::setw(18) << result.m_peakGrowthKb / 1024.0
+			<< (result.m_ok ? "" : "  FAILED") << '\n';
+
+		results.push_back(result);
+	}
+
+	if (!jsonPath.empty()) {
+		BenchJson json;
+		json.value("benchmark", "stream-bench");
+		json.value("label", label);
+		json.value("body_bytes", static_cast<std::uint64_t>(bodySize));
+
+		json.beginArray("responses");
+		for (const Result &result : results) {
+			json.beginObject();
+			json.value("name", result.m_name);
+			json.value("ok", result.m_ok);
+			json.value("bytes", result.m_bytes);
+			json.value("seconds", result.m_seconds);
+			json.value("peak_rss_growth_kb", result.m_peakGrowthKb);
+			json.endObject();
+		}
+		json.endArray();
+
+		if (!json.write(jsonPath)) {
+			ok = false;
+		}
+	}
+
+	// The worker thread runs until the process exits
+	std::cout.flush();
+	std::_Exit(ok ? 0 : 1);
+}
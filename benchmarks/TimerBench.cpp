@@ -0,0 +1,159 @@
+// Measures the connection timers of a worker: arming a deadline for every connection, re-arming them
+// (what every request of a keep-alive connection does), cancelling them and expiring them all.
+// A std::multimap ordered by the deadline is measured the same way for comparison.
+
+#include <map>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+#include "TimerWheel.h"
+
+namespace {
+
+using Clock = TimerWheel::Clock;
+
+struct Result {
+    double m_arm;
+    double m_rearm;
+    double m_cancel;
+    double m_expire;
+    std::size_t m_expired;
+};
+
+double nsPerTimer(Clock::time_point start, std::size_t timers) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / timers;
+}
+
+// Keep-alive, header and write timeouts between 1 and 60 s
+std::vector<std::chrono::milliseconds> makeTimeouts(std::size_t timers) {
+    std::mt19937 generator{ 42 };
+    std::uniform_int_distribution<int> distribution{ 1000, 60000 };
+
+    std::vector<std::chrono::milliseconds> timeouts(timers);
+    for (auto &timeout : timeouts) {
+        timeout = std::chrono::milliseconds{ distribution(generator) };
+    }
+
+    return timeouts;
+}
+
+Result measureWheel(const std::vector<std::chrono::milliseconds> &timeouts) {
+    const std::size_t timers = timeouts.size();
+    const auto now = Clock::now();
+
+    TimerWheel wheel{ timers, now };
+    Result result{};
+
+    auto start = Clock::now();
+    for (std::size_t id = 0; id < timers; ++id) {
+        wheel.arm(id, timeouts[id], now);
+    }
+    result.m_arm = nsPerTimer(start, timers);
+
+    start = Clock::now();
+    for (std::size_t id = 0; id < timers; ++id) {
+        wheel.arm(id, timeouts[timers - id - 1], now);
+    }
+    result.m_rearm = nsPerTimer(start, timers);
+
+    start = Clock::now();
+    for (std::size_t id = 0; id < timers; id += 2) {
+        wheel.cancel(id);
+    }
+    result.m_cancel = nsPerTimer(start, timers / 2);
+
+    // Every armed timer expires by then
+    start = Clock::now();
+    wheel.advance(now + std::chrono::seconds{ 61 }, [&result](std::size_t) {
+        ++result.m_expired;
+    });
+    result.m_expire = nsPerTimer(start, timers - timers / 2);
+
+    return result;
+}
+
+Result measureMultimap(const std::vector<std::chrono::milliseconds> &timeouts) {
+    using Timers = std::multimap<Clock::time_point, std::size_t>;
+
+    const std::size_t timers = timeouts.size();
+    const auto now = Clock::now();
+
+    Timers deadlines;
+    std::vector<Timers::iterator> handles(timers);
+    Result result{};
+
+    auto start = Clock::now();
+    for (std::size_t id = 0; id < timers; ++id) {
+        handles[id] = deadlines.emplace(now + timeouts[id], id);
+    }
+    result.m_arm = nsPerTimer(start, timers);
+
+    start = Clock::now();
+    for (std::size_t id = 0; id < timers; ++id) {
+        deadlines.erase(handles[id]);
+        handles[id] = deadlines.emplace(now + timeouts[timers - id - 1], id);
+    }
+    result.m_rearm = nsPerTimer(start, timers);
+
+    start = Clock::now();
+    for (std::size_t id = 0; id < timers; id += 2) {
+        deadlines.erase(handles[id]);
+    }
+    result.m_cancel = nsPerTimer(start, timers / 2);
+
+    start = Clock::now();
+    const auto end = deadlines.upper_bound(now + std::chrono::seconds{ 61 });
+    for (auto it = deadlines.begin(); it != end;) {
+        ++result.m_expired;
+        it = deadlines.erase(it);
+    }
+    result.m_expire = nsPerTimer(start, timers - timers / 2);
+
+    return result;
+}
+
+void printResult(std::string_view name, std::size_t timers, const Result &result) {
+    std::cout
+        << std::left << std::setw(12) << name
+        << std::right << std::setw(10) << timers
+        << std::fixed << std::setprecision(1)
+        << std::setw(12) << result.m_arm
+        << std::setw(12) << result.m_rearm
+        << std::setw(12) << result.m_cancel
+        << std::setw(12) << result.m_expire
+        << std::setw(12) << result.m_expired << '\n';
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::size_t> counts{ 100000, 1000000 };
+    if (argc > 1) {
+        counts.assign(1, static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)));
+    }
+
+    std::cout << "ns per timer\n";
+    std::cout
+        << std::left << std::setw(12) << "timers"
+        << std::right << std::setw(10) << "count"
+        << std::setw(12) << "arm"
+        << std::setw(12) << "re-arm"
+        << std::setw(12) << "cancel"
+        << std::setw(12) << "expire"
+        << std::setw(12) << "expired" << '\n';
+
+    for (const std::size_t timers : counts) {
+        const auto timeouts = makeTimeouts(timers);
+
+        printResult("wheel", timers, measureWheel(timeouts));
+        printResult("multimap", timers, measureMultimap(timeouts));
+    }
+
+    return 0;
+}
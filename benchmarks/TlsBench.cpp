@@ -0,0 +1,495 @@
+// Measures the cost of TLS on one in-process worker: full handshakes, resumed handshakes (with a
+// ticket, or the session cache with --tickets=off) and the download throughput of a large body,
+// which is encrypted by the kernel when kTLS is available and by OpenSSL otherwise. The
+// certificate is a self-signed P-256 one generated at startup, the clients run on loopback.
+
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+
+#include "Server.h"
+#include "ServerThread.h"
+#include "BenchJson.h"
+
+namespace {
+
+int clientsNum = 4;
+int handshakesNum = 500;	// Per client and mode
+int sizeMb = 16;
+int durationMs = 1000;
+
+int setupListener(sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	socklen_t addressSize = sizeof(address);
+
+	if (bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1
+		|| getsockname(fd, reinterpret_cast<sockaddr *>(&address), &addressSize) == -1
+		|| listen(fd, 1024) == -1) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Writes a self-signed certificate and its key for CN=localhost to one PEM file
+bool writeCertificate(const std::string &path) {
+	EVP_PKEY *key = EVP_EC_gen("P-256");
+	X509 *cert = X509_new();
+
+	bool ok = key && cert;
+
+	if (ok) {
+		ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+		X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+		X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+		X509_set_pubkey(cert, key);
+
+		X509_NAME *name = X509_get_subject_name(cert);
+		X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+		X509_set_issuer_name(cert, name);
+
+		ok = X509_sign(cert, key, EVP_sha256()) > 0;
+	}
+
+	if (ok) {
+		FILE *file = std::fopen(path.c_str(), "w");
+		ok = file && PEM_write_X509(file, cert) == 1 && PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+
+		if (file) {
+			ok = std::fclose(file) == 0 && ok;
+		}
+	}
+
+	X509_free(cert);
+	EVP_PKEY_free(key);
+	return ok;
+}
+
+double threadCpuSeconds() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double processCpuSeconds() {
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int connectTo(const sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Sends the request and reads a response with a Content-Length. Returns the body size, -1 on an error.
+long long exchange(SSL *ssl, std::string_view request, std::vector<char> &buffer) {
+	if (SSL_write(ssl, request.data(), static_cast<int>(request.size())) != static_cast<int>(request.size())) {
+		return -1;
+	}
+
+	std::size_t received = 0;
+	std::size_t expected = 0;
+	std::size_t bodyStart = 0;
+
+	while (expected == 0 || received < expected) {
+		// Only the head is kept, the body is counted
+		char *target = expected == 0 ? buffer.data() + received : buffer.data();
+		const int capacity = static_cast<int>(expected == 0 ? buffer.size() - received : buffer.size());
+
+		const int nr = SSL_read(ssl, target, capacity);
+		if (nr <= 0) {
+			return -1;
+		}
+
+		received += static_cast<std::size_t>(nr);
+
+		if (expected == 0) {
+			const std::string_view head{ buffer.data(), received };
+			const auto headEnd = head.find("\r\n\r\n");
+			const auto length = head.find("Content-Length: ");
+
+			if (headEnd == std::string_view::npos || length == std::string_view::npos) {
+				if (received == buffer.size()) {
+					return -1;
+				}
+
+				continue;
+			}
+
+			bodyStart = headEnd + 4;
+			expected = bodyStart + std::strtoull(head.data() + length + 16, nullptr, 10);
+		}
+	}
+
+	return static_cast<long long>(expected - bodyStart);
+}
+
+struct ClientResult {
+	std::uint64_t m_handshakes{ 0 };
+	std::uint64_t m_resumed{ 0 };
+	double m_cpuSeconds{ 0.0 };
+	bool m_ok{ true };
+};
+
+// handshakesNum connections, each with one request. With resume, every connection offers the session of the previous one.
+void runHandshakes(SSL_CTX *ctx, const sockaddr_in &address, bool resume, ClientResult &result) {
+	const double cpuStart = threadCpuSeconds();
+
+	std::vector<char> buffer(16 * 1024);
+	SSL_SESSION *session = nullptr;
+
+	for (int i = 0; i < handshakesNum && result.m_ok; ++i) {
+		const int fd = connectTo(address);
+		SSL *ssl = fd == -1 ? nullptr : SSL_new(ctx);
+
+		if (!ssl) {
+			result.m_ok = false;
+			break;
+		}
+
+		SSL_set_fd(ssl, fd);
+
+		if (resume && session) {
+			SSL_set_session(ssl, session);
+		}
+
+		if (SSL_connect(ssl) != 1 || exchange(ssl, "GET /text HTTP/1.1\r\nHost: bench\r\n\r\n", buffer) < 0) {
+			result.m_ok = false;
+		}
+		else {
+			++result.m_handshakes;
+			result.m_resumed += SSL_session_reused(ssl) ? 1 : 0;
+
+			// A TLS 1.3 ticket arrives after the handshake, it has been read with the response
+			if (resume) {
+				SSL_SESSION_free(session);
+				session = SSL_get1_session(ssl);
+			}
+		}
+
+		SSL_shutdown(ssl);
+		SSL_free(ssl);
+		close(fd);
+	}
+
+	SSL_SESSION_free(session);
+	result.m_cpuSeconds = threadCpuSeconds() - cpuStart;
+}
+
+struct HandshakeSample {
+	double m_perSecond{ 0.0 };
+	double m_serverUs{ 0.0 };	// Server CPU per handshake
+	double m_resumedShare{ 0.0 };
+	bool m_ok{ false };
+};
+
+HandshakeSample measureHandshakes(SSL_CTX *ctx, const sockaddr_in &address, bool resume) {
+	std::vector<ClientResult> results(static_cast<std::size_t>(clientsNum));
+	std::vector<std::thread> clients;
+
+	const double processStart = processCpuSeconds();
+	const auto start = std::chrono::steady_clock::now();
+
+	for (auto &result : results) {
+		clients.emplace_back(runHandshakes, ctx, std::cref(address), resume, std::ref(result));
+	}
+
+	for (auto &client : clients) {
+		client.join();
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	HandshakeSample sample;
+	sample.m_ok = true;
+
+	std::uint64_t handshakes = 0;
+	std::uint64_t resumed = 0;
+	double clientCpu = 0.0;
+
+	for (const auto &result : results) {
+		sample.m_ok = sample.m_ok && result.m_ok;
+		handshakes += result.m_handshakes;
+		resumed += result.m_resumed;
+		clientCpu += result.m_cpuSeconds;
+	}
+
+	if (handshakes) {
+		sample.m_perSecond = handshakes / seconds;
+		sample.m_serverUs = std::max(0.0, processCpuSeconds() - processStart - clientCpu) * 1e6 / handshakes;
+		sample.m_resumedShare = static_cast<double>(resumed) / handshakes;
+	}
+
+	return sample;
+}
+
+// Downloads the large body on one connection until the duration has passed. Returns MB/s, -1 on an error.
+double measureDownload(SSL_CTX *ctx, const sockaddr_in &address) {
+	const int fd = connectTo(address);
+	SSL *ssl = fd == -1 ? nullptr : SSL_new(ctx);
+
+	if (!ssl) {
+		return -1.0;
+	}
+
+	SSL_set_fd(ssl, fd);
+
+	double result = -1.0;
+
+	if (SSL_connect(ssl) == 1) {
+		std::vector<char> buffer(256 * 1024);
+		std::uint64_t bytes = 0;
+		bool ok = true;
+
+		const auto start = std::chrono::steady_clock::now();
+		const auto deadline = start + std::chrono::milliseconds(durationMs);
+
+		while (ok && std::chrono::steady_clock::now() < deadline) {
+			const long long body = exchange(ssl, "GET /large HTTP/1.1\r\nHost: bench\r\n\r\n", buffer);
+			ok = body == static_cast<long long>(sizeMb) * 1024 * 1024;
+			bytes += ok ? static_cast<std::uint64_t>(body) : 0;
+		}
+
+		if (ok) {
+			result = bytes / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / (1024 * 1024);
+		}
+	}
+
+	SSL_free(ssl);
+	close(fd);
+	return result;
+}
+
+// A counter of the server's /metrics, -1 if it can't be read
+long long readMetric(SSL_CTX *ctx, const sockaddr_in &address, std::string_view name) {
+	const int fd = connectTo(address);
+	SSL *ssl = fd == -1 ? nullptr : SSL_new(ctx);
+
+	if (!ssl) {
+		return -1;
+	}
+
+	SSL_set_fd(ssl, fd);
+
+	long long value = -1;
+	std::vector<char> buffer(1024 * 1024);
+
+	if (SSL_connect(ssl) == 1 && exchange(ssl, "GET /metrics HTTP/1.1\r\nHost: bench\r\n\r\n", buffer) > 0) {
+		const std::string_view text{ buffer.data(), buffer.size() };
+		const std::string line = "\n" + std::string{ name } + ' ';
+
+		if (const auto at = text.find(line); at != std::string_view::npos) {
+			value = std::strtoll(text.data() + at + line.size(), nullptr, 10);
+		}
+	}
+
+	SSL_free(ssl);
+	close(fd);
+	return value;
+}
+
+}
+
+int main(int argc, char **argv) {
+	bool kernel = true;
+	bool tickets = true;
+	bool tls12 = false;
+	std::string jsonPath;
+	std::string label;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+
+		if (arg.substr(0, 10) == "--clients=") {
+			clientsNum = std::atoi(argv[i] + 10);
+		}
+		else if (arg.substr(0, 13) == "--handshakes=") {
+			handshakesNum = std::atoi(argv[i] + 13);
+		}
+		else if (arg.substr(0, 7) == "--size=") {
+			sizeMb = std::atoi(argv[i] + 7);
+		}
+		else if (arg.substr(0, 11) == "--duration=") {
+			durationMs = std::atoi(argv[i] + 11);
+		}
+		else if (arg == "--ktls=on" || arg == "--ktls=off") {
+			kernel = arg == "--ktls=on";
+		}
+		else if (arg == "--tickets=on" || arg == "--tickets=off") {
+			tickets = arg == "--tickets=on";
+		}
+		else if (arg == "--tls12") {
+			tls12 = true;
+		}
+		else if (arg.substr(0, 7) == "--json=") {
+			jsonPath = arg.substr(7);
+		}
+		else if (arg.substr(0, 8) == "--label=") {
+			label = arg.substr(8);
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--clients=<threads>] [--handshakes=<per client>] [--size=<MB>] [--duration=<ms>]\n"
+				<< "       [--ktls=on|off] [--tickets=on|off] [--tls12] [--json=<file>|-] [--label=<text>]\n";
+			return 1;
+		}
+	}
+
+	if (clientsNum <= 0 || handshakesNum <= 0 || sizeMb <= 0 || durationMs <= 0) {
+		std::cerr << "Invalid clients, handshakes, size or duration\n";
+		return 1;
+	}
+
+	// Like the server, a write to a closed connection must fail instead of killing the process
+	signal(SIGPIPE, SIG_IGN);
+
+	char directory[] = "/tmp/tls-bench-XXXXXX";
+	if (!mkdtemp(directory)) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	const std::string pemPath = std::string{ directory } + "/server.pem";
+
+	if (!writeCertificate(pemPath)) {
+		std::cerr << "Can't generate the certificate\n";
+		return 1;
+	}
+
+	ServerConfig config;
+	config.m_tls.m_certFile = pemPath;
+	config.m_tls.m_kernel = kernel;
+	config.m_tls.m_tickets = tickets;
+
+	Server server{ config };
+
+	std::remove(pemPath.c_str());
+	rmdir(directory);
+
+	if (!server.tls()) {
+		return 1;
+	}
+
+	const std::string large(static_cast<std::size_t>(sizeMb) * 1024 * 1024, 'x');
+	server.addFixedResponse(HTTP_METHOD::GET, "/large", HTTP_RESPONSE_CODE::_200, "application/octet-stream", large);
+
+	sockaddr_in address;
+	const int listener = setupListener(address);
+
+	ServerThread worker;
+	if (listener == -1 || !worker.runThread(server, IO_BACKEND::EPOLL, listener)) {
+		std::cerr << "Can't start the server\n";
+		return 1;
+	}
+
+	// The client doesn't verify the self-signed certificate
+	SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+
+	if (tls12) {
+		SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+	}
+
+	const HandshakeSample full = measureHandshakes(ctx, address, false);
+	const HandshakeSample resumed = measureHandshakes(ctx, address, true);
+	const double downloadMbps = measureDownload(ctx, address);
+	const long long kernelConnections = readMetric(ctx, address, "http_tls_ktls_total");
+
+	const bool ok = full.m_ok && resumed.m_ok && downloadMbps >= 0.0 && resumed.m_resumedShare > 0.0;
+
+	std::cout << (tls12 ? "TLS 1.2" : "TLS 1.3") << ", " << clientsNum << " clients, tickets " << (tickets ? "on" : "off")
+		<< ", kTLS " << (kernel ? "on" : "off") << '\n'
+		<< std::left << std::setw(10) << "mode"
+		<< std::right << std::setw(14) << "handshakes/s"
+		<< std::setw(16) << "server us/hs"
+		<< std::setw(10) << "resumed" << '\n';
+
+	for (const auto &[name, sample] : { std::make_pair("full", full), std::make_pair("resumed", resumed) }) {
+		std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(0)
+			<< std::setw(14) << sample.m_perSecond
+			<< std::setprecision(1) << std::setw(16) << sample.m_serverUs
+			<< std::setprecision(0) << std::setw(9) << sample.m_resumedShare * 100 << '%'
+			<< (sample.m_ok ? "" : "  FAILED") << '\n';
+	}
+
+	std::cout << "download of " << sizeMb << " MB: " << std::setprecision(1) << downloadMbps << " MB/s, "
+		<< (kernelConnections > 0 ? "encrypted by the kernel" : "encrypted by OpenSSL") << '\n';
+
+	if (!jsonPath.empty()) {
+		BenchJson json;
+		json.value("benchmark", "tls-bench");
+		json.value("label", label);
+		json.value("protocol", tls12 ? "TLSv1.2" : "TLSv1.3");
+		json.value("clients", clientsNum);
+		json.value("tickets", tickets);
+		json.value("ktls_requested", kernel);
+		json.value("ktls_connections", static_cast<std::uint64_t>(std::max(0LL, kernelConnections)));
+		json.value("full_handshakes_per_s", full.m_perSecond);
+		json.value("full_server_us", full.m_serverUs);
+		json.value("resumed_handshakes_per_s", resumed.m_perSecond);
+		json.value("resumed_server_us", resumed.m_serverUs);
+		json.value("resumed_share", resumed.m_resumedShare);
+		json.value("download_mb_per_s", downloadMbps);
+		json.value("ok", ok);
+
+		if (!json.write(jsonPath)) {
+			SSL_CTX_free(ctx);
+			std::_Exit(1);
+		}
+	}
+
+	SSL_CTX_free(ctx);
+
+	// The worker thread runs until the process exits
+	std::cout.flush();
+	std::_Exit(ok ? 0 : 1);
+}
@@ -0,0 +1,451 @@
+// Sweeps the body size of a response sent by copying and with MSG_ZEROCOPY, to find the size from
+// which zero-copy pays off. Two servers serve the same fixed bodies, one with --zerocopy-threshold=1
+// and one without, and the clients download each size from both for a fixed time.
+//
+// Over loopback the kernel copies the zero-copy pages anyway (the "copied" column), so the crossover
+// has to be measured over a NIC: run "--serve=<port>" on the server host and "--target=<ip>:<port>"
+// on another one. In-process, the server CPU time per response is reported as well.
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "Server.h"
+#include "ServerThread.h"
+#include "BenchJson.h"
+
+namespace {
+
+int connectionsNum = 4;
+int durationMs = 1000;
+
+const std::vector<std::size_t> DEFAULT_SIZES = { 1024, 4096, 16384, 65536, 262144, 1048576, 4194304 };
+
+int setupListener(sockaddr_in &address) {
+	const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		perror("socket");
+		return -1;
+	}
+
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	socklen_t addressSize = sizeof(address);
+
+	if (bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1
+		|| getsockname(fd, reinterpret_cast<sockaddr *>(&address), &addressSize) == -1
+		|| listen(fd, 128) == -1) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+std::string bodyPath(std::size_t size) {
+	return "/body/" + std::to_string(size);
+}
+
+// A server with a fixed response for every size, the bodies are queued without copying
+struct BenchServer {
+	explicit BenchServer(std::uint32_t zerocopyThreshold, const std::vector<std::size_t> &sizes)
+		: m_server{ makeConfig(zerocopyThreshold) } {
+		for (const std::size_t size : sizes) {
+			const std::string body(size, 'z');
+			m_server.addFixedResponse(HTTP_METHOD::GET, bodyPath(size), HTTP_RESPONSE_CODE::_200, "application/octet-stream", body);
+		}
+	}
+
+	static ServerConfig makeConfig(std::uint32_t zerocopyThreshold) {
+		ServerConfig config;
+		config.m_metricsPath.clear();
+		config.m_compression.m_enabled = false;
+		config.m_zerocopyThreshold = zerocopyThreshold;
+		return config;
+	}
+
+	bool start(sockaddr_in &address) {
+		const int listener = setupListener(address);
+		return listener != -1 && m_worker.runThread(m_server, IO_BACKEND::EPOLL, listener);
+	}
+
+	Server m_server;
+	ServerThread m_worker;
+};
+
+double threadCpuSeconds() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double processCpuSeconds() {
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct ClientResult {
+	std::uint64_t m_responses{ 0 };
+	std::uint64_t m_bytes{ 0 };
+	double m_cpuSeconds{ 0.0 };
+	bool m_ok{ true };
+};
+
+// Requests the body again and again on one connection until the deadline
+void runClient(const sockaddr_in &address, const std::string &request, std::chrono::steady_clock::time_point deadline, ClientResult &result) {
+	const double cpuStart = threadCpuSeconds();
+
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1 || connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+		result.m_ok = false;
+		return;
+	}
+
+	std::vector<char> buffer(256 * 1024);
+
+	while (std::chrono::steady_clock::now() < deadline) {
+		if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+			result.m_ok = false;
+			break;
+		}
+
+		// The headers, then Content-Length bytes of the body
+		std::size_t received = 0;
+		std::size_t expected = 0;
+		bool ok = true;
+
+		while (expected == 0 || received < expected) {
+			const ssize_t nr = recv(fd, buffer.data() + (expected == 0 ? received : 0), expected == 0 ? buffer.size() - received : buffer.size(), 0);
+			if (nr <= 0) {
+				ok = false;
+				break;
+			}
+
+			received += static_cast<std::size_t>(nr);
+
+			if (expected == 0) {
+				const std::string_view head{ buffer.data(), received };
+				const auto headEnd = head.find("\r\n\r\n");
+				const auto length = head.find("Content-Length: ");
+
+				if (headEnd == std::string_view::npos || length == std::string_view::npos) {
+					if (received == buffer.size()) {
+						ok = false;
+						break;
+					}
+
+					continue;
+				}
+
+				expected = headEnd + 4 + std::strtoull(head.data() + length + 16, nullptr, 10);
+			}
+		}
+
+		if (!ok) {
+			result.m_ok = false;
+			break;
+		}
+
+		++result.m_responses;
+		result.m_bytes += received;
+	}
+
+	close(fd);
+	result.m_cpuSeconds = threadCpuSeconds() - cpuStart;
+}
+
+struct Sample {
+	double m_mbPerSecond{ 0.0 };
+	double m_serverUsPerResponse{ -1.0 }; // Only in-process
+	std::uint64_t m_responses{ 0 };
+	bool m_ok{ false };
+};
+
+Sample measure(const sockaddr_in &address, std::size_t size, bool inProcess) {
+	const std::string request = "GET " + bodyPath(size) + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+
+	std::vector<ClientResult> results(static_cast<std::size_t>(connectionsNum));
+	std::vector<std::thread> clients;
+
+	const double processStart = processCpuSeconds();
+	const auto start = std::chrono::steady_clock::now();
+	const auto deadline = start + std::chrono::milliseconds(durationMs);
+
+	for (auto &result : results) {
+		clients.emplace_back(runClient, std::cref(address), std::cref(request), deadline, std::ref(result));
+	}
+
+	for (auto &client : clients) {
+		client.join();
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Sample sample;
+	sample.m_ok = true;
+
+	std::uint64_t bytes = 0;
+	double clientCpu = 0.0;
+
+	for (const auto &result : results) {
+		sample.m_ok = sample.m_ok && result.m_ok;
+		sample.m_responses += result.m_responses;
+		bytes += result.m_bytes;
+		clientCpu += result.m_cpuSeconds;
+	}
+
+	sample.m_mbPerSecond = bytes / seconds / (1024 * 1024);
+
+	// Everything else this process did in the meantime is the worker's
+	if (inProcess && sample.m_responses) {
+		sample.m_serverUsPerResponse = std::max(0.0, processCpuSeconds() - processStart - clientCpu) * 1e6 / sample.m_responses;
+	}
+
+	return sample;
+}
+
+std::vector<std::size_t> parseSizes(const char *list) {
+	std::vector<std::size_t> sizes;
+
+	while (*list) {
+		char *end = nullptr;
+		const std::size_t size = std::strtoull(list, &end, 10);
+
+		if (end == list || size == 0) {
+			return {};
+		}
+
+		sizes.push_back(size);
+		list = *end == ',' ? end + 1 : end;
+	}
+
+	return sizes;
+}
+
+}
+
+int main(int argc, char **argv) {
+	std::vector<std::size_t> sizes = DEFAULT_SIZES;
+	int servePort = 0;
+	std::string target;
+	std::string jsonPath;
+	std::string label;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+
+		if (arg.substr(0, 8) == "--sizes=") {
+			sizes = parseSizes(argv[i] + 8);
+		}
+		else if (arg.substr(0, 14) == "--connections=") {
+			connectionsNum = std::atoi(argv[i] + 14);
+		}
+		else if (arg.substr(0, 11) == "--duration=") {
+			durationMs = std::atoi(argv[i] + 11);
+		}
+		else if (arg.substr(0, 8) == "--serve=") {
+			servePort = std::atoi(argv[i] + 8);
+		}
+		else if (arg.substr(0, 9) == "--target=") {
+			target = arg.substr(9);
+		}
+		else if (arg.substr(0, 7) == "--json=") {
+			jsonPath = arg.substr(7);
+		}
+		else if (arg.substr(0, 8) == "--label=") {
+			label = arg.substr(8);
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--sizes=<bytes,...>] [--connections=<count>] [--duration=<ms>]\n"
+				<< "       [--serve=<port> | --target=<ip>:<port>] [--json=<file>|-] [--label=<text>]\n"
+				<< "  --serve  runs only the servers: copying on <port>, zero-copy on <port + 1>\n"
+				<< "  --target runs only the clients against the servers of --serve\n";
+			return 1;
+		}
+	}
+
+	if (sizes.empty() || connectionsNum <= 0 || durationMs <= 0 || servePort < 0 || servePort > 65534) {
+		std::cerr << "Invalid sizes, connections, duration or port\n";
+		return 1;
+	}
+
+	// [0] copies, [1] uses MSG_ZEROCOPY
+	sockaddr_in addresses[2];
+
+	for (int mode = 0; mode < 2; ++mode) {
+		std::memset(&addresses[mode], 0, sizeof(addresses[mode]));
+		addresses[mode].sin_family = AF_INET;
+		addresses[mode].sin_addr.s_addr = htonl(servePort ? INADDR_ANY : INADDR_LOOPBACK);
+		addresses[mode].sin_port = htons(static_cast<std::uint16_t>(servePort ? servePort + mode : 0));
+	}
+
+	const bool inProcess = target.empty();
+
+	if (!inProcess) {
+		const auto colon = target.rfind(':');
+		const int port = colon == std::string::npos ? 0 : std::atoi(target.c_str() + colon + 1);
+
+		if (port <= 0 || port > 65534 || inet_pton(AF_INET, target.substr(0, colon).c_str(), &addresses[0].sin_addr) != 1) {
+			std::cerr << "Invalid target: " << target << '\n';
+			return 1;
+		}
+
+		addresses[1].sin_addr = addresses[0].sin_addr;
+		addresses[0].sin_port = htons(static_cast<std::uint16_t>(port));
+		addresses[1].sin_port = htons(static_cast<std::uint16_t>(port + 1));
+	}
+
+	// Both servers run until the process exits
+	BenchServer *servers[2] = { nullptr, nullptr };
+
+	if (inProcess) {
+		servers[0] = new BenchServer{ 0, sizes };
+		servers[1] = new BenchServer{ 1, sizes };
+
+		if (!servers[0]->start(addresses[0]) || !servers[1]->start(addresses[1])) {
+			std::cerr << "Can't start the servers\n";
+			return 1;
+		}
+
+		if (servePort) {
+			std::cout << "copying on " << servePort << ", zero-copy on " << servePort + 1 << std::endl;
+			while (true) {
+				std::this_thread::sleep_for(std::chrono::hours(1));
+			}
+		}
+	}
+
+	std::cout << "connections " << connectionsNum << ", " << durationMs << " ms per size\n"
+		<< std::left << std::setw(10) << "body"
+		<< std::right << std::setw(12) << "copy MB/s"
+		<< std::setw(12) << "zc MB/s"
+		<< std::setw(14) << "copy us/resp"
+		<< std::setw(12) << "zc us/resp"
+		<< std::setw(10) << "copied" << '\n';
+
+	struct Row {
+		std::size_t m_size;
+		Sample m_copy;
+		Sample m_zerocopy;
+		double m_copiedShare;
+	};
+
+	std::vector<Row> rows;
+	bool ok = true;
+	std::size_t crossover = 0;
+
+	for (const std::size_t size : sizes) {
+		Row row{ size, {}, {}, -1.0 };
+
+		row.m_copy = measure(addresses[0], size, inProcess);
+
+		const std::uint64_t sendsBefore = inProcess ? servers[1]->m_worker.stats().zerocopySends() : 0;
+		const std::uint64_t copiedBefore = inProcess ? servers[1]->m_worker.stats().zerocopyCopied() : 0;
+
+		row.m_zerocopy = measure(addresses[1], size, inProcess);
+
+		if (inProcess) {
+			// The completions of the last sends may still be on the way
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+			const std::uint64_t sends = servers[1]->m_worker.stats().zerocopySends() - sendsBefore;
+			const std::uint64_t copied = servers[1]->m_worker.stats().zerocopyCopied() - copiedBefore;
+			row.m_copiedShare = sends ? static_cast<double>(copied) / sends : 0.0;
+		}
+
+		ok = ok && row.m_copy.m_ok && row.m_zerocopy.m_ok;
+
+		// The first size from which zero-copy costs the server less (in-process) or moves more data
+		const bool better = inProcess
+			? row.m_zerocopy.m_serverUsPerResponse < row.m_copy.m_serverUsPerResponse
+			: row.m_zerocopy.m_mbPerSecond > row.m_copy.m_mbPerSecond;
+
+		if (!better) {
+			crossover = 0;
+		}
+		else if (crossover == 0) {
+			crossover = size;
+		}
+
+		std::cout << std::left << std::setw(10) << size << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(12) << row.m_copy.m_mbPerSecond
+			<< std::setw(12) << row.m_zerocopy.m_mbPerSecond;
+
+		if (inProcess) {
+			std::cout << std::setprecision(2)
+				<< std::setw(14) << row.m_copy.m_serverUsPerResponse
+				<< std::setw(12) << row.m_zerocopy.m_serverUsPerResponse
+				<< std::setprecision(0) << std::setw(9) << row.m_copiedShare * 100 << '%';
+		}
+		else {
+			std::cout << std::setw(14) << '-' << std::setw(12) << '-' << std::setw(10) << '-';
+		}
+
+		std::cout << (row.m_copy.m_ok && row.m_zerocopy.m_ok ? "" : "  FAILED") << '\n';
+
+		rows.push_back(row);
+	}
+
+	if (crossover) {
+		std::cout << "zero-copy is better from " << crossover << " bytes, try --zerocopy-threshold=" << crossover << '\n';
+	}
+	else {
+		std::cout << "zero-copy isn't better at any of the sizes\n";
+	}
+
+	if (!jsonPath.empty()) {
+		BenchJson json;
+		json.value("benchmark", "zerocopy-bench");
+		json.value("label", label);
+		json.value("connections", connectionsNum);
+		json.value("duration_ms", durationMs);
+		json.value("in_process", inProcess);
+		json.value("crossover_bytes", static_cast<std::uint64_t>(crossover));
+
+		json.beginArray("sizes");
+		for (const Row &row : rows) {
+			json.beginObject();
+			json.value("body_bytes", static_cast<std::uint64_t>(row.m_size));
+			json.value("copy_mb_per_s", row.m_copy.m_mbPerSecond);
+			json.value("zerocopy_mb_per_s", row.m_zerocopy.m_mbPerSecond);
+			json.value("copy_responses", row.m_copy.m_responses);
+			json.value("zerocopy_responses", row.m_zerocopy.m_responses);
+
+			if (inProcess) {
+				json.value("copy_server_us_per_response", row.m_copy.m_serverUsPerResponse);
+				json.value("zerocopy_server_us_per_response", row.m_zerocopy.m_serverUsPerResponse);
+				json.value("zerocopy_copied_share", row.m_copiedShare);
+			}
+
+			json.value("ok", row.m_copy.m_ok && row.m_zerocopy.m_ok);
+			json.endObject();
+		}
+		json.endArray();
+
+		if (!json.write(jsonPath)) {
+			ok = false;
+		}
+	}
+
+	// The worker threads run until the process exits
+	std::cout.flush();
+	std::_Exit(ok ? 0 : 1);
+}
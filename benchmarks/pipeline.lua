@@ -0,0 +1,15 @@
+-- wrk script that pipelines N requests per write:
+-- $ ./wrk -c1000 -d30s -t2 -s benchmarks/pipeline.lua http://localhost:3490 -- 16
+
+init = function(args)
+   local depth = tonumber(args[1]) or 16
+   local r = {}
+   for i = 1, depth do
+      r[i] = wrk.format(nil, "/")
+   end
+   req = table.concat(r)
+end
+
+request = function()
+   return req
+end
@@ -1,6 +1,13 @@
 #include <iostream>
+#include <iomanip>
 #include <cstring>
 #include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -8,15 +15,19 @@
 #include <netdb.h>
 
 #include <unistd.h>
+#include <signal.h>
+#include <sched.h>
 
-#include <sys/epoll.h>
+#include <linux/filter.h>
 
 #include "ServerConstants.h"
+#include "ServerConfig.h"
 #include "Server.h"
 #include "ThreadData.h"
 #include "ServerThread.h"
+#include "WorkerPlacement.h"
 
-int setupListenerSocket() {
+int setupListenerSocket(const ServerConfig &config, bool nonBlocking, bool printAddress) {
 	struct addrinfo hints;
 	std::memset(&hints, 0, sizeof(hints));
 	hints.ai_family = AF_INET;
@@ -25,7 +36,9 @@ int setupListenerSocket() {
 
 	struct addrinfo *results = nullptr;
 
-	if (getaddrinfo(nullptr, SERVER_PORT, &hints, &results) != 0) {
+	const std::string port = std::to_string(config.m_port);
+
+	if (getaddrinfo(nullptr, port.c_str(), &hints, &results) != 0) {
 		perror("getaddrinfo");
 		return -1;
 	}
@@ -33,13 +46,19 @@ int setupListenerSocket() {
 	int listener = -1;
 	auto *tmp = results;
 	for (; tmp; tmp = tmp->ai_next) {
-		const int sid = socket(tmp->ai_family, tmp->ai_socktype, tmp->ai_protocol);
+		const int sid = socket(tmp->ai_family, tmp->ai_socktype | (nonBlocking ? SOCK_NONBLOCK : 0), tmp->ai_protocol);
 		if (sid == -1) {
 			perror("socket");
 			continue;
 		}
 
-		if (int yes = 1; setsockopt(sid, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &yes, sizeof(yes)) == -1) {
+		if (int yes = 1; setsockopt(sid, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1) {
+			perror("setsockopt");
+			close(sid);
+			continue;
+		}
+
+		if (int yes = 1; setsockopt(sid, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1) {
 			perror("setsockopt");
 			close(sid);
 			continue;
@@ -51,7 +70,7 @@ int setupListenerSocket() {
 			continue;
 		}
 
-		{
+		if (printAddress) {
 			struct sockaddr_in address;
 			std::memcpy(&address, tmp->ai_addr, sizeof(address));
 
@@ -59,7 +78,7 @@ int setupListenerSocket() {
 
 			inet_ntop(tmp->ai_family, &address.sin_addr, addressString, INET_ADDRSTRLEN);
 
-			std::cout << "Server address: " << addressString << ':' << SERVER_PORT << '\n';
+			std::cout << "Server address: " << (config.m_tls.enabled() ? "https://" : "http://") << addressString << ':' << port << '\n';
 		}
 
 		listener = sid;
@@ -68,7 +87,10 @@ int setupListenerSocket() {
 
 	freeaddrinfo(results);
 
-	if (listener != -1 && listen(listener, BACKLOG_SIZE) == -1) {
+	// The kernel caps the backlog at net.core.somaxconn
+	const int backlog = static_cast<int>(std::min<std::uint32_t>(config.m_backlog, std::numeric_limits<int>::max()));
+
+	if (listener != -1 && listen(listener, backlog) == -1) {
 		perror("listen");
 		close(listener);
 		return -1;
@@ -77,40 +99,77 @@ int setupListenerSocket() {
 	return listener;
 }
 
-// ###################################################
+// Steers every new connection to the listener of the worker pinned to the CPU that received the packet:
+// cpus[i] to listener i % groupSize, any other CPU to (CPU % groupSize). The listeners are indexed in
+// the order they joined the SO_REUSEPORT group.
+bool attachReusePortCBPF(int listener, const std::vector<int> &cpus, int groupSize) {
+	std::vector<sock_filter> code;
+	code.reserve(cpus.size() * 2 + 3);
 
-int main() {
-	const int listener = setupListenerSocket();
-	if (listener == -1) {
-		std::cout << "Setup failed! Exiting...\n";
-		return 1;
+	code.push_back({ BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<std::uint32_t>(SKF_AD_OFF + SKF_AD_CPU) });
+
+	for (std::size_t i = 0; i < cpus.size(); ++i) {
+		code.push_back({ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, static_cast<std::uint32_t>(cpus[i]) });
+		code.push_back({ BPF_RET | BPF_K, 0, 0, static_cast<std::uint32_t>(i % groupSize) });
 	}
 
-	std::cout << "Server: Allocating resources...\n";
+	code.push_back({ BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<std::uint32_t>(groupSize) });
+	code.push_back({ BPF_RET | BPF_A, 0, 0, 0 });
 
-	Server httpServer;
+	sock_fprog program;
+	program.len = static_cast<unsigned short>(code.size());
+	program.filter = code.data();
 
-	int epollfds[NUM_THREADS];
-	ServerThread threads[NUM_THREADS];
+	if (setsockopt(listener, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == -1) {
+		perror("setsockopt(SO_ATTACH_REUSEPORT_CBPF)");
+		return false;
+	}
 
-	for (int i = 0; i < NUM_THREADS; ++i) {
-		epollfds[i] = epoll_create1(0);
-		if (epollfds[i] == -1) {
-			perror("epoll_create1");
-			return 1;
+	return true;
+}
+
+// The CPUs of the workers in order, empty when they aren't pinned
+std::vector<int> workerCpus(const ServerConfig &config) {
+	if (!config.m_cpus.empty()) {
+		return config.m_cpus;
+	}
+
+	std::vector<int> cpus;
+
+	// cbpf pins the workers to the allowed CPUs in order, validate() has checked there are enough
+	if (config.m_irqCpus.empty() && config.m_acceptMode != ACCEPT_MODE::REUSEPORT_CBPF) {
+		return cpus;
+	}
+
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		perror("sched_getaffinity");
+		return cpus;
+	}
+
+	// Leave the cores that serve the NIC queues to the interrupts and the softirq processing
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, &allowed) && std::find(config.m_irqCpus.begin(), config.m_irqCpus.end(), cpu) == config.m_irqCpus.end()) {
+			cpus.push_back(cpu);
 		}
+	}
 
-		threads[i].runThread(httpServer, epollfds[i]);
+	if (cpus.empty() && !config.m_irqCpus.empty()) {
+		std::cout << "Warning: --irq-cpus leaves no CPU for the workers, they won't be pinned\n";
 	}
 
+	return cpus;
+}
+
+void runDispatcher(int listener, ServerThread *threads, int threadsNum, PLACEMENT policy) {
 	socklen_t clientAddrSize = sizeof(struct sockaddr_in);
 
 	struct sockaddr clientAddress;
 	std::memset(&clientAddress, 0, sizeof(struct sockaddr_in));
 
-	int threadIdx = 0;
-
-	std::cout << "Server: Waiting for connections...\n";
+	WorkerPlacement placement{ policy, threads, threadsNum };
 
 	while (true) {
 		const int clientSocket = accept4(listener, &clientAddress, &clientAddrSize, SOCK_NONBLOCK);
@@ -118,12 +177,15 @@ int main() {
 			continue;
 		}
 
+		// The next workers are tried only if the chosen one can't take the connection
+		const int threadIdx = placement.pick();
+
 		bool connectionReceived = false;
 		int probeIdx = threadIdx;
 
 		do {
 			connectionReceived = threads[probeIdx].addClient(clientSocket);
-			probeIdx = (probeIdx + 1) % NUM_THREADS;
+			probeIdx = (probeIdx + 1) % threadsNum;
 		} while (!connectionReceived && probeIdx != threadIdx);
 
 		if (!connectionReceived) {
@@ -131,15 +193,130 @@ int main() {
 
 			close(clientSocket);
 		}
+	}
+}
+
+// Prints the totals of all workers, the syscalls per request since the previous line and the open connections of every worker
+void runStats(const ServerThread *threads, int threadsNum, std::uint32_t intervalSeconds) {
+	std::uint64_t lastRequests = 0;
+	std::uint64_t lastSyscalls = 0;
+
+	while (true) {
+		std::this_thread::sleep_for(std::chrono::seconds(intervalSeconds));
+
+		std::uint64_t requests = 0;
+		std::uint64_t syscalls = 0;
+
+		for (int i = 0; i < threadsNum; ++i) {
+			requests += threads[i].stats().requests();
+			syscalls += threads[i].stats().syscalls();
+		}
+
+		const std::uint64_t intervalRequests = requests - lastRequests;
+		const double perRequest = intervalRequests ? static_cast<double>(syscalls - lastSyscalls) / intervalRequests : 0.0;
 
-		threadIdx = probeIdx;
+		std::cout << "stats: requests=" << requests << " syscalls=" << syscalls
+			<< " syscalls/request=" << std::fixed << std::setprecision(2) << perRequest << " connections=";
+
+		for (int i = 0; i < threadsNum; ++i) {
+			std::cout << (i ? "/" : "") << threads[i].connections();
+		}
+
+		std::cout << std::endl;
+
+		lastRequests = requests;
+		lastSyscalls = syscalls;
 	}
+}
 
-	for (int fd : epollfds) {
-		close(fd);
+// ###################################################
+
+int main(int argc, char **argv) {
+	ServerConfig config;
+	if (!ServerConfig::parse(argc, argv, config)) {
+		return 1;
+	}
+
+	// sendfile() has no MSG_NOSIGNAL, a write to a reset connection must fail with EPIPE instead
+	signal(SIGPIPE, SIG_IGN);
+
+	const bool perThreadListeners = config.m_acceptMode != ACCEPT_MODE::DISPATCHER;
+
+	const int threadsNum = static_cast<int>(config.m_threads);
+	const std::vector<int> cpus = workerCpus(config);
+
+	// In dispatcher mode there is a single listener, otherwise every worker thread gets its own
+	std::vector<int> listeners(perThreadListeners ? threadsNum : 1);
+	const int listenersNum = static_cast<int>(listeners.size());
+
+	for (int i = 0; i < listenersNum; ++i) {
+		listeners[i] = setupListenerSocket(config, perThreadListeners, i == 0);
+		if (listeners[i] == -1) {
+			std::cout << "Setup failed! Exiting...\n";
+			return 1;
+		}
+	}
+
+	if (config.m_acceptMode == ACCEPT_MODE::REUSEPORT_CBPF && !attachReusePortCBPF(listeners[0], cpus, threadsNum)) {
+		std::cout << "Setup failed! Exiting...\n";
+		return 1;
+	}
+
+	std::cout << "Server: Allocating resources...\n";
+
+	Server httpServer{ config };
+
+	if (config.m_tls.enabled() && !httpServer.tls()) {
+		std::cout << "Setup failed! Exiting...\n";
+		return 1;
 	}
 
-	close(listener);
+	httpServer.finalizeRoutes();
+
+	auto threads = std::make_unique<ServerThread[]>(threadsNum);
+	httpServer.setWorkers(threads.get(), threadsNum);
+
+	// Calibrated here, so the first metrics request doesn't stall a worker
+	CycleClock::ticksPerSecond();
+
+	std::cout << "Server: " << threadsNum << " worker thread(s)";
+	if (!cpus.empty()) {
+		std::cout << " pinned to " << cpus.size() << " CPU(s)";
+	}
+	std::cout << '\n';
+
+	for (int i = 0; i < threadsNum; ++i) {
+		// With cbpf there are at least as many CPUs as workers, so worker i runs on the CPU steered to listener i
+		const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+
+		if (!threads[i].runThread(httpServer, config.m_ioBackend, perThreadListeners ? listeners[i] : -1, cpu)) {
+			std::cout << "Setup failed! Exiting...\n";
+			return 1;
+		}
+	}
+
+	if (config.m_acceptMode == ACCEPT_MODE::REUSEPORT_CBPF && static_cast<int>(cpus.size()) > threadsNum) {
+		std::cout << "Warning: the connections received on " << static_cast<int>(cpus.size()) - threadsNum << " CPU(s) without a worker are steered to the others\n";
+	}
+
+	std::cout << "Server: Waiting for connections...\n";
+
+	if (config.m_statsInterval > 0) {
+		std::thread{ runStats, threads.get(), threadsNum, config.m_statsInterval }.detach();
+	}
+
+	if (perThreadListeners) {
+		for (int i = 0; i < threadsNum; ++i) {
+			threads[i].join();
+		}
+	}
+	else {
+		runDispatcher(listeners[0], threads.get(), threadsNum, config.m_placement);
+	}
+
+	for (int i = 0; i < listenersNum; ++i) {
+		close(listeners[i]);
+	}
 
-    return 0;
+	return 0;
 }